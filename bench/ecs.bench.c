@@ -0,0 +1,97 @@
+// Update pass over the game objects versus the entities
+//
+// The same 50k objects are moved by their velocities, once through the
+// list of game_obj_t and its update pointer, once by a system over the
+// dense columns of the ECS.
+
+#include <stdio.h>
+#include <time.h>
+
+#include "../src/ecs.h"
+#include "../src/game.h"
+#include "../src/data_structures/doublyLinkedList.h"
+
+#define NUM_ENTITIES 50000
+#define NUM_PASSES 100
+
+static game_obj_t* _current = NULL;
+
+static double _now_ms() {
+    struct timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+static int _update( int dt ) {
+    _current->x += _current->v * dt;
+    return 0;
+}
+
+static void _move( ecs_archetype_t* a, void* user ) {
+    int dt = *( int* ) user;
+    game_position_t* p = ecs_column( a, GAME_POSITION, game_position_t );
+    game_velocity_t* v = ecs_column( a, GAME_VELOCITY, game_velocity_t );
+    for ( unsigned int i = 0; i < a->count; i++ ) {
+        p[i].x += v[i].v * dt;
+    }
+}
+
+int ecs_bench() {
+    static game_obj_t objs[ NUM_ENTITIES ];
+    dbllist_t* list = dbllist_new();
+    ecs_t* ecs = ecs_new( NUM_ENTITIES );
+    for ( int c = 0; c <= GAME_SCRIPT; c++ ) {
+        static const unsigned int sizes[] = { sizeof( game_position_t ), sizeof( game_size_t ),
+            sizeof( game_velocity_t ), sizeof( game_type_t ), sizeof( game_script_t ) };
+        ecs_component( ecs, sizes[c] );
+    }
+
+    for ( int i = 0; i < NUM_ENTITIES; i++ ) {
+        game_obj_t* obj = &objs[i];
+        obj->x = i;
+        obj->y = i;
+        obj->v = 1 + i % 3;
+        obj->update = _update;
+        dbllist_push_to_end( list, obj );
+
+        int e = ecs_create( ecs );
+        ( ( game_position_t* ) ecs_add( ecs, e, GAME_POSITION ) )->x = i;
+        ( ( game_velocity_t* ) ecs_add( ecs, e, GAME_VELOCITY ) )->v = obj->v;
+        // Two archetypes, as the objects of two kinds would be
+        if ( i % 2 ) {
+            ecs_add( ecs, e, GAME_TYPE );
+        }
+    }
+
+    int dt = 1;
+    double start = _now_ms();
+    for ( int pass = 0; pass < NUM_PASSES; pass++ ) {
+        dblnode_t* node = dbllist_head( list );
+        while ( node ) {
+            _current = ( game_obj_t* ) node->data;
+            _current->update( dt );
+            node = node->next;
+        }
+    }
+    double list_ms = ( _now_ms() - start ) / NUM_PASSES;
+
+    start = _now_ms();
+    for ( int pass = 0; pass < NUM_PASSES; pass++ ) {
+        ecs_run( ecs, ecs_bit( GAME_POSITION ) | ecs_bit( GAME_VELOCITY ), _move, &dt );
+    }
+    double ecs_ms = ( _now_ms() - start ) / NUM_PASSES;
+
+    // Both must have moved the objects the same way.
+    int mismatches = 0;
+    for ( int e = 0; e < NUM_ENTITIES; e++ ) {
+        mismatches += ( ( game_position_t* ) ecs_get( ecs, e, GAME_POSITION ) )->x != objs[e].x;
+    }
+
+    printf( "ecs_update entities=%d list_ms=%.4f ecs_ms=%.4f speedup=%.2f mismatches=%d\n",
+        NUM_ENTITIES, list_ms, ecs_ms, ecs_ms > 0 ? list_ms / ecs_ms : 0.0, mismatches );
+
+    dbllist_remove( list, NULL );
+    dbllist_free( list );
+    ecs_free( ecs );
+    return mismatches;
+}
@@ -0,0 +1,20 @@
+// Frame time of the headless scenario
+//
+// The default scenario of headless.h, so the line is comparable to the
+// output of `make headless` with the defaults.
+
+#include <stdio.h>
+
+#include "../src/headless.h"
+
+int frame_bench() {
+    headless_config_t config = {
+        HEADLESS_DEFAULT_OBJECTS, HEADLESS_DEFAULT_STEPS, HEADLESS_DEFAULT_SEED, NULL, NULL, NULL
+    };
+    headless_report_t report;
+    if ( headless_run( &config, &report ) != HEADLESS_SUCCESS ) {
+        return 1;
+    }
+    headless_print( stdout, &report );
+    return 0;
+}
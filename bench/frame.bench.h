@@ -0,0 +1 @@
+int frame_bench();
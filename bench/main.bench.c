@@ -0,0 +1,17 @@
+// Benchmarks
+//
+// Each benchmark prints one line of key=value pairs.
+
+#include "./ecs.bench.h"
+#include "./frame.bench.h"
+#include "./profiler.bench.h"
+#include "./sjson.bench.h"
+
+int main() {
+    int failures = 0;
+    failures += ecs_bench() != 0;
+    failures += frame_bench() != 0;
+    failures += profiler_bench() != 0;
+    failures += sjson_bench() != 0;
+    return failures;
+}
@@ -0,0 +1,159 @@
+// Headless simulation
+//
+// Runs a scenario without rendering and prints its report (see headless.h)
+//
+// Usage: yaag_headless [-n objects] [-m steps] [-s seed] [-l level] [-p trace]
+//                      [-r recording | -R recording]
+//
+// With -r, the input and the checksum of each frame are written to the
+// recording; with -R, the recording is replayed and checked instead (see
+// replay.h). A replay takes the seed and the number of the objects from the
+// recording, and -l must give the level of the recording.
+//
+// With -p, the zones of the profiler are written to the trace file, which
+// opens in chrome://tracing or ui.perfetto.dev. The zones are recorded only
+// if the build defines PROFILE (see profiler.h).
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "../src/headless.h"
+#include "../src/mem.h"
+#include "../src/profiler.h"
+
+// Reads the whole file into a null-terminated buffer
+static char* _read_file( const char* path, size_t* size ) {
+    FILE* file = fopen( path, "rb" );
+    if ( !file ) {
+        return NULL;
+    }
+    fseek( file, 0, SEEK_END );
+    long length = ftell( file );
+    fseek( file, 0, SEEK_SET );
+    char* buf = ( char* ) mem_malloc( length + 1 );
+    size_t read = fread( buf, 1, length, file );
+    buf[ read ] = '\0';
+    fclose( file );
+    if ( size ) {
+        *size = read;
+    }
+    return buf;
+}
+
+int main( int argc, char* argv[] ) {
+    headless_config_t config = {
+        HEADLESS_DEFAULT_OBJECTS, HEADLESS_DEFAULT_STEPS, HEADLESS_DEFAULT_SEED, NULL, NULL, NULL
+    };
+    char* level = NULL;
+    const char* trace = NULL;
+    const char* recording = NULL;
+    int c;
+    while ( ( c = getopt( argc, argv, "n:m:s:l:p:r:R:" ) ) != -1 ) {
+        switch ( c ) {
+            case 'n':
+                config.num_objects = ( unsigned int ) strtoul( optarg, NULL, 10 );
+                break;
+            case 'm':
+                config.num_steps = ( unsigned int ) strtoul( optarg, NULL, 10 );
+                break;
+            case 's':
+                config.seed = ( unsigned int ) strtoul( optarg, NULL, 10 );
+                break;
+            case 'l':
+                level = _read_file( optarg, NULL );
+                if ( !level ) {
+                    fprintf( stderr, "Cannot read the level %s.\n", optarg );
+                    return 1;
+                }
+                config.level = level;
+                break;
+            case 'p':
+                trace = optarg;
+                break;
+            case 'r':
+                recording = optarg;
+                break;
+            case 'R': {
+                size_t size;
+                char* data = _read_file( optarg, &size );
+                if ( !data ) {
+                    fprintf( stderr, "Cannot read the recording %s.\n", optarg );
+                    return 1;
+                }
+                config.replay = replay_open( ( const unsigned char* ) data, size );
+                mem_free( data );
+                if ( !config.replay ) {
+                    fprintf( stderr, "%s is not a recording.\n", optarg );
+                    return 1;
+                }
+                break;
+            }
+            default:
+                fprintf( stderr, "Usage: %s [-n objects] [-m steps] [-s seed] [-l level] [-p trace]"
+                    " [-r recording | -R recording]\n", argv[0] );
+                return 1;
+        }
+    }
+    if ( recording ) {
+        config.record = config.replay
+            ? replay_new( config.replay->seed, config.replay->dt, config.replay->num_objects, config.replay->level )
+            : replay_new( config.seed, TIMESTEP_UNITS_PER_SECOND / TIMESTEP_DEFAULT_RATE,
+                config.num_objects, replay_hash( level ) );
+    }
+
+    headless_report_t report;
+    prof_capture( trace != NULL );
+    int result = headless_run( &config, &report );
+    if ( level ) {
+        mem_free( level );
+    }
+    if ( config.replay ) {
+        replay_free( config.replay );
+    }
+    if ( config.record ) {
+        FILE* out = fopen( recording, "wb" );
+        size_t written = out ? fwrite( config.record->data, 1, config.record->size, out ) : 0;
+        if ( out ) {
+            fclose( out );
+        }
+        if ( written != config.record->size ) {
+            fprintf( stderr, "Cannot write the recording %s.\n", recording );
+        }
+        replay_free( config.record );
+    }
+    if ( result == HEADLESS_TOOMANY ) {
+        fprintf( stderr, "The scene holds at most %d objects.\n", HEADLESS_MAX_OBJECTS );
+        return 1;
+    }
+    if ( result == HEADLESS_BADLEVEL ) {
+        fprintf( stderr, "The level has no valid tile map.\n" );
+        return 1;
+    }
+    if ( result == HEADLESS_BADREPLAY ) {
+        fprintf( stderr, "The recording is corrupt.\n" );
+        return 1;
+    }
+    if ( result == HEADLESS_OTHERLEVEL ) {
+        fprintf( stderr, "The recording is of another level.\n" );
+        return 1;
+    }
+    if ( result == HEADLESS_DIVERGED ) {
+        fprintf( stderr, "The replay diverged at the frame %d.\n", report.diverged );
+        headless_print( stdout, &report );
+        return 1;
+    }
+    headless_print( stdout, &report );
+    if ( trace ) {
+        FILE* out = fopen( trace, "w" );
+        if ( !out ) {
+            fprintf( stderr, "Cannot write the trace %s.\n", trace );
+            return 1;
+        }
+        unsigned int written = prof_export( out );
+        fclose( out );
+        fprintf( stderr, "Wrote %u events to %s, %u zones dropped.\n", written, trace, prof_dropped() );
+    }
+    prof_free();
+    return 0;
+}
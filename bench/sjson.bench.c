@@ -0,0 +1,123 @@
+// Throughput of the sjson tokenizer
+//
+// A level of many objects, like those of test/assets/json_test.txt, is
+// tokenized as a whole buffer and as a stream of chunks whose incomplete
+// tails are carried over. The first pass alone, the structural index, is
+// timed with the instruction set of sjson_index() and with the scalar
+// fallback. The best of the passes is reported in MB/s.
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/mem.h"
+#include "../src/parsers/sjson.h"
+
+#define NUM_OBJECTS 100000
+#define NUM_PASSES 5
+#define CHUNK_SIZE 65536
+
+static double _now_ms() {
+    struct timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return t.tv_sec * 1000.0 + t.tv_nsec / 1000000.0;
+}
+
+static int _count( void* user, const sjson_token_t* token, const char* text ) {
+    ( void ) token;
+    ( void ) text;
+    ( *( unsigned int* ) user )++;
+    return 0;
+}
+
+// Writes the level into a new buffer
+static char* _level( size_t* size ) {
+    size_t capacity = NUM_OBJECTS * 160 + 256;
+    char* buf = ( char* ) mem_malloc( capacity );
+    size_t n = ( size_t ) snprintf( buf, capacity, "\"version\":\"1.0.1\"\n\"objects\":[\n" );
+    for ( int i = 0; i < NUM_OBJECTS; i++ ) {
+        n += ( size_t ) snprintf( buf + n, capacity - n,
+            "\t{\"type\":\"attacker\", \"path\":\"a.b.c\" \"x\":%d.5 \"y\":-%d.25 \"v\":%d"
+            " \"tags\":[ \"fast\" \"a \\\"b\\\"\" true ] }\n", i, i % 977, i % 7 );
+    }
+    n += ( size_t ) snprintf( buf + n, capacity - n, "]\n\"settings\":[ \"world_x\":12.0 ]\n" );
+    *size = n;
+    return buf;
+}
+
+static unsigned int _parse_chunks( const char* data, size_t size, char* chunk ) {
+    unsigned int count = 0;
+    sjson_parser_t parser;
+    sjson_init( &parser, _count, &count );
+    size_t pending = 0;
+    size_t read = 0;
+    for ( ;; ) {
+        size_t n = size - read < CHUNK_SIZE - pending ? size - read : CHUNK_SIZE - pending;
+        memcpy( chunk + pending, data + read, n );
+        read += n;
+        pending += n;
+        int last = read == size;
+        size_t consumed = sjson_feed( &parser, chunk, pending, last );
+        memmove( chunk, chunk + consumed, pending - consumed );
+        pending -= consumed;
+        if ( last || parser.error ) {
+            break;
+        }
+    }
+    return parser.error ? 0 : count;
+}
+
+// Indexes the data a slice at a time, as sjson_feed() does
+static double _index_ms( const char* data, size_t size, int scalar ) {
+    static unsigned long long index[ SJSON_SLICE / 64 ];
+    double start = _now_ms();
+    for ( size_t base = 0; base < size; base += SJSON_SLICE ) {
+        size_t n = size - base < SJSON_SLICE ? size - base : SJSON_SLICE;
+        if ( scalar ) {
+            sjson_index_scalar( data + base, n, index );
+        } else {
+            sjson_index( data + base, n, index );
+        }
+    }
+    return _now_ms() - start;
+}
+
+int sjson_bench() {
+    size_t size;
+    char* data = _level( &size );
+    char* chunk = ( char* ) mem_malloc( CHUNK_SIZE );
+
+    unsigned int tokens = 0;
+    unsigned int chunked_tokens = 0;
+    double best_ms = 0;
+    double best_chunked_ms = 0;
+    double best_index_ms = 0;
+    double best_scalar_ms = 0;
+    int failed = 0;
+    for ( int pass = 0; pass < NUM_PASSES; pass++ ) {
+        tokens = 0;
+        double start = _now_ms();
+        failed |= sjson_parse( data, size, _count, &tokens ) != SJSON_SUCCESS;
+        double ms = _now_ms() - start;
+        best_ms = pass && best_ms < ms ? best_ms : ms;
+
+        start = _now_ms();
+        chunked_tokens = _parse_chunks( data, size, chunk );
+        ms = _now_ms() - start;
+        best_chunked_ms = pass && best_chunked_ms < ms ? best_chunked_ms : ms;
+
+        ms = _index_ms( data, size, 0 );
+        best_index_ms = pass && best_index_ms < ms ? best_index_ms : ms;
+        ms = _index_ms( data, size, 1 );
+        best_scalar_ms = pass && best_scalar_ms < ms ? best_scalar_ms : ms;
+    }
+    mem_free( chunk );
+    mem_free( data );
+
+    double mb = size / 1000000.0;
+    printf( "sjson bytes=%zu tokens=%u mbps=%.1f chunked_mbps=%.1f isa=%s index_mbps=%.1f"
+        " scalar_index_mbps=%.1f mismatches=%u\n",
+        size, tokens, mb / ( best_ms / 1000.0 ), mb / ( best_chunked_ms / 1000.0 ), sjson_index_isa(),
+        mb / ( best_index_ms / 1000.0 ), mb / ( best_scalar_ms / 1000.0 ), tokens != chunked_tokens );
+    return failed || tokens != chunked_tokens;
+}
@@ -0,0 +1,144 @@
+// Parallel broadphase
+//
+// [Implementation details]
+//
+// The tasks are planned on the calling thread. The subtree tasks are run by
+// jobs_parallel_for() one by one, as their sizes vary a lot; an idle thread
+// steals the ones that are left. The buffer of a task grows on demand as the
+// pairs are pushed. The buffers are kept from one pass to the next, and the
+// plan visits the same subtrees in the same order, so a buffer soon fits the
+// pairs of its subtree and is rarely reallocated.
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./broadphase.h"
+#include "./jobs.h"
+#include "./mem.h"
+#include "./physics.h"
+#include "./profiler.h"
+#include "./data_structures/doublyLinkedList.h"
+#include "./data_structures/quad_tree.h"
+
+#define _MIN_TASKS 8
+
+broadphase_t* broadphase_new( unsigned int level, jobs_t* jobs ) {
+    broadphase_t* bp = ( broadphase_t* ) mem_malloc( sizeof( broadphase_t ) );
+    bp->level = level;
+    bp->jobs = jobs;
+    bp->tasks = ( broadphase_task_t* ) mem_malloc( _MIN_TASKS * sizeof( broadphase_task_t ) );
+    bp->num_tasks = 0;
+    bp->max_tasks = _MIN_TASKS;
+    for ( unsigned int i = 0; i < bp->max_tasks; i++ ) {
+        bp->tasks[i].pairs = physics_pairs_new( 1 );
+    }
+    return bp;
+}
+
+void broadphase_free( broadphase_t* bp ) {
+    for ( unsigned int i = 0; i < bp->max_tasks; i++ ) {
+        physics_pairs_free( bp->tasks[i].pairs );
+    }
+    mem_free( bp->tasks );
+    mem_free( bp );
+}
+
+static broadphase_task_t* _add_task( broadphase_t* bp, tnode_t* node,
+        physics_bucket_t** ancestors, unsigned int num_ancestors, int subtree ) {
+    if ( bp->num_tasks == bp->max_tasks ) {
+        broadphase_task_t* grown = ( broadphase_task_t* ) mem_malloc( 2 * bp->max_tasks * sizeof( broadphase_task_t ) );
+        memcpy( grown, bp->tasks, bp->max_tasks * sizeof( broadphase_task_t ) );
+        for ( unsigned int i = bp->max_tasks; i < 2 * bp->max_tasks; i++ ) {
+            grown[i].pairs = physics_pairs_new( 1 );
+        }
+        mem_free( bp->tasks );
+        bp->tasks = grown;
+        bp->max_tasks *= 2;
+    }
+    broadphase_task_t* task = &bp->tasks[ bp->num_tasks++ ];
+    task->root = node;
+    memcpy( task->ancestors, ancestors, num_ancestors * sizeof( physics_bucket_t* ) );
+    task->num_ancestors = num_ancestors;
+    task->subtree = subtree;
+    physics_pairs_clear( task->pairs );
+    return task;
+}
+
+// Splits the tree into the tasks in the depth-first order
+static void _plan( broadphase_t* bp, tnode_t* node, unsigned int depth,
+        physics_bucket_t** ancestors, unsigned int num_ancestors ) {
+    if ( depth >= bp->level || !node->children ) {
+        _add_task( bp, node, ancestors, num_ancestors, 1 );
+        return;
+    }
+
+    _add_task( bp, node, ancestors, num_ancestors, 0 );
+    physics_bucket_t* bucket = ( physics_bucket_t* ) node->data;
+    if ( bucket && bucket->categories ) {
+        assert( num_ancestors < PHYSICS_MAX_DEPTH && PHYSICS_TOODEEP );
+        ancestors[ num_ancestors++ ] = bucket;
+    }
+    dblnode_t* child = dbllist_head( node->children );
+    while ( child ) {
+        _plan( bp, ( tnode_t* ) child->data, depth + 1, ancestors, num_ancestors );
+        child = child->next;
+    }
+}
+
+// Runs the subtree tasks [begin, end)
+static void _work( void* data, unsigned int begin, unsigned int end ) {
+    broadphase_t* bp = ( broadphase_t* ) data;
+    PROF_ZONE( "broadphase_work" );
+
+    for ( unsigned int i = begin; i < end; i++ ) {
+        broadphase_task_t* task = &bp->tasks[i];
+        if ( task->subtree ) {
+            physics_check_subtree( task->root, task->ancestors, task->num_ancestors, task->pairs );
+        }
+    }
+}
+
+void broadphase_collect( broadphase_t* bp, qtree_t* q, physics_pairs_t* pairs ) {
+    assert( bp && BROADPHASE_NOBROADPHASE );
+    assert( q && QUAD_NOQTREE );
+    assert( pairs && BROADPHASE_NOPAIRS );
+    PROF_ZONE( "broadphase_collect" );
+
+    bp->num_tasks = 0;
+    if ( !q->tree->root ) {
+        return;
+    }
+    physics_bucket_t* ancestors[ PHYSICS_MAX_DEPTH ];
+    _plan( bp, q->tree->root, 0, ancestors, 0 );
+
+    // The subtrees
+    if ( bp->jobs ) {
+        jobs_parallel_for( bp->jobs, bp->num_tasks, 1, _work, bp );
+    } else {
+        _work( bp, 0, bp->num_tasks );
+    }
+
+    // The upper levels
+    for ( unsigned int i = 0; i < bp->num_tasks; i++ ) {
+        broadphase_task_t* task = &bp->tasks[i];
+        if ( !task->subtree ) {
+            physics_check_node( task->root, task->ancestors, task->num_ancestors, task->pairs );
+        }
+    }
+
+    // The merge in the task order
+    unsigned int total = pairs->count;
+    for ( unsigned int i = 0; i < bp->num_tasks; i++ ) {
+        total += bp->tasks[i].pairs->count;
+    }
+    physics_pairs_reserve( pairs, total );
+    for ( unsigned int i = 0; i < bp->num_tasks; i++ ) {
+        physics_pairs_t* task_pairs = bp->tasks[i].pairs;
+        memcpy( &pairs->pairs[ pairs->count ], task_pairs->pairs,
+            task_pairs->count * sizeof( physics_pair_t ) );
+        pairs->count += task_pairs->count;
+        pairs->rejected += task_pairs->rejected;
+        pairs->sleeping += task_pairs->sleeping;
+    }
+}
@@ -0,0 +1,78 @@
+// Parallel broadphase
+//
+// The subtrees of the quad tree below a given level do not share objects,
+// so their candidate pairs can be collected independently. The broadphase
+// splits the tree into tasks in the depth-first order:
+//
+// - a subtree task for each node at the split level (or a shallower leaf)
+// - a node task for each node above the split level
+//
+// The subtree tasks run on the job system (see jobs.h). The node tasks,
+// i.e., the objects stored at the upper levels, are handled serially after
+// them.
+// Every task has a pair buffer of its own, so no locks are needed. The
+// buffers are concatenated in the task order, so the output equals that of
+// physics_check_collisions() regardless of the number of threads.
+//
+// The buffers of the tasks are kept from one pass to the next and grow as
+// the pairs are pushed, so they soon hold the pairs of a typical pass.
+//
+// Without a job system, the tasks run on the calling thread.
+
+#ifndef _broadphase_
+#define _broadphase_
+
+#include "./jobs.h"
+#include "./physics.h"
+#include "./data_structures/quad_tree.h"
+
+// Messages for the diagnostics
+#define BROADPHASE_NOBROADPHASE "Broadphase does not exist"
+#define BROADPHASE_NOPAIRS "Pair buffer does not exist"
+
+// The default for the quadrants of the root
+#define BROADPHASE_DEFAULT_LEVEL    1
+
+typedef struct {
+    tnode_t* root;
+    physics_bucket_t* ancestors[ PHYSICS_MAX_DEPTH ];
+    unsigned int num_ancestors;
+    // Non-zero if the descendants of the root are visited too
+    int subtree;
+    physics_pairs_t* pairs;
+} broadphase_task_t;
+
+typedef struct {
+    unsigned int level;
+    jobs_t* jobs;
+    broadphase_task_t* tasks;
+    unsigned int num_tasks;
+    unsigned int max_tasks;
+} broadphase_t;
+
+// Creates a new broadphase
+//
+// @param level The level of the tree where the subtrees are split off
+// @param jobs The job system that runs the subtree tasks, or NULL to run
+//             them on the calling thread
+// @return The pointer to the broadphase
+broadphase_t* broadphase_new( unsigned int level, jobs_t* jobs );
+
+// Releases the broadphase and the buffers of its tasks
+//
+// @param bp The pointer to the broadphase
+void broadphase_free( broadphase_t* bp );
+
+// Collects the candidate pairs of the tree
+//
+// @precondition bp != NULL
+// @precondition q != NULL
+// @precondition pairs != NULL
+// @postcondition The appended pairs and the counters equal to those of
+//                physics_check_collisions( q->tree->root, NULL, pairs )
+// @param bp The pointer to the broadphase
+// @param q The pointer to the tree
+// @param pairs The buffer where the pairs are appended to
+void broadphase_collect( broadphase_t* bp, qtree_t* q, physics_pairs_t* pairs );
+
+#endif // _broadphase_
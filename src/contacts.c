@@ -0,0 +1,479 @@
+// Contact cache
+//
+// [Implementation details]
+//
+// The table has at least twice as many slots as there are contacts. The
+// removal shifts the following entries of the probe sequence backwards, so
+// no tombstones are needed and the probe sequences stay short.
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./defs.h"
+#include "./mem.h"
+#include "./contacts.h"
+#include "./narrowphase.h"
+#include "./physics.h"
+
+#define _EMPTY -1
+#define _MIN_SLOTS 16
+
+static unsigned int _hash( int guid_0, int guid_1 ) {
+    unsigned int h = ( unsigned int ) guid_0 * 0x9e3779b1u;
+    h ^= ( unsigned int ) guid_1 + 0x7f4a7c15u + ( h << 6 ) + ( h >> 2 );
+    return h ^ ( h >> 16 );
+}
+
+static void _state( physics_body_t* body, int* state ) {
+    state[0] = body->x;
+    state[1] = body->y;
+    state[2] = body->w;
+    state[3] = body->h;
+    state[4] = body->vx;
+    state[5] = body->vy;
+}
+
+static int _state_equals( physics_body_t* body, int* state ) {
+    return state[0] == body->x
+        && state[1] == body->y
+        && state[2] == ( int ) body->w
+        && state[3] == ( int ) body->h
+        && state[4] == body->vx
+        && state[5] == body->vy;
+}
+
+static void _alloc( contacts_t* c, unsigned int num_slots ) {
+    c->num_slots = num_slots;
+    c->slots = ( int* ) mem_malloc( num_slots * sizeof( int ) );
+    c->contacts = ( contact_t* ) mem_malloc( ( num_slots / 2 ) * sizeof( contact_t ) );
+    for ( unsigned int i = 0; i < num_slots; i++ ) {
+        c->slots[i] = _EMPTY;
+    }
+}
+
+static void _place( contacts_t* c, unsigned int index ) {
+    unsigned int mask = c->num_slots - 1;
+    unsigned int slot = c->contacts[ index ].hash & mask;
+    while ( c->slots[ slot ] != _EMPTY ) {
+        slot = ( slot + 1 ) & mask;
+    }
+    c->slots[ slot ] = index;
+    c->contacts[ index ].slot = slot;
+}
+
+static void _grow( contacts_t* c ) {
+    int* slots = c->slots;
+    contact_t* contacts = c->contacts;
+
+    _alloc( c, 2 * c->num_slots );
+    memcpy( c->contacts, contacts, c->count * sizeof( contact_t ) );
+    for ( unsigned int i = 0; i < c->count; i++ ) {
+        _place( c, i );
+    }
+    mem_free( slots );
+    mem_free( contacts );
+}
+
+static void _remove( contacts_t* c, unsigned int index ) {
+    unsigned int mask = c->num_slots - 1;
+    unsigned int hole = c->contacts[ index ].slot;
+    unsigned int next = hole;
+
+    // Shift the rest of the probe sequence backwards.
+    c->slots[ hole ] = _EMPTY;
+    while ( 1 ) {
+        next = ( next + 1 ) & mask;
+        if ( c->slots[ next ] == _EMPTY ) {
+            break;
+        }
+        unsigned int home = c->contacts[ c->slots[ next ] ].hash & mask;
+        // The entry stays if its home is cyclically in ( hole, next ].
+        int stays = hole <= next
+            ? ( hole < home && home <= next )
+            : ( hole < home || home <= next );
+        if ( stays ) {
+            continue;
+        }
+        c->slots[ hole ] = c->slots[ next ];
+        c->contacts[ c->slots[ hole ] ].slot = hole;
+        c->slots[ next ] = _EMPTY;
+        hole = next;
+    }
+
+    // Keep the contacts dense.
+    unsigned int last = --c->count;
+    if ( index != last ) {
+        c->contacts[ index ] = c->contacts[ last ];
+        c->slots[ c->contacts[ index ].slot ] = index;
+    }
+}
+
+static void _emit( contacts_t* c, int type, contact_t* contact ) {
+    if ( c->num_events == c->max_events ) {
+        contact_event_t* grown = ( contact_event_t* ) mem_malloc( 2 * c->max_events * sizeof( contact_event_t ) );
+        memcpy( grown, c->events, c->num_events * sizeof( contact_event_t ) );
+        mem_free( c->events );
+        c->events = grown;
+        c->max_events *= 2;
+    }
+    contact_event_t* event = &c->events[ c->num_events++ ];
+    event->type = type;
+    event->guid_0 = contact->guid_0;
+    event->guid_1 = contact->guid_1;
+    event->toi = contact->toi;
+}
+
+// The extent of the box of the body during the step, from its position at
+// the beginning of the step (see physics_sweep_two_bodies) to the current one
+static void _extent( physics_body_t* body, int* box ) {
+    box[0] = body->x - ( body->vx > 0 ? body->vx : 0 );
+    box[1] = body->y - ( body->vy > 0 ? body->vy : 0 );
+    box[2] = body->x + ( int ) body->w - ( body->vx < 0 ? body->vx : 0 );
+    box[3] = body->y + ( int ) body->h - ( body->vy < 0 ? body->vy : 0 );
+}
+
+// Tells if the extents of the bodies during the step meet, which the swept
+// test needs to find a contact
+static int _swept_overlap( physics_body_t* b_0, physics_body_t* b_1 ) {
+    int e_0[4];
+    int e_1[4];
+    _extent( b_0, e_0 );
+    _extent( b_1, e_1 );
+    return e_0[0] <= e_1[2] && e_1[0] <= e_0[2] && e_0[1] <= e_1[3] && e_1[1] <= e_0[3];
+}
+
+// Makes room for the boxes of the world and the hits of the pairs
+static void _reserve( contacts_t* c, physics_world_t* world, unsigned int num_pairs ) {
+    if ( !c->boxes || c->boxes->capacity < world->count ) {
+        if ( c->boxes ) {
+            narrowphase_boxes_free( c->boxes );
+        }
+        c->boxes = narrowphase_boxes_new( world->capacity );
+    }
+    if ( !c->hits || c->max_hits < num_pairs ) {
+        if ( c->hits ) {
+            mem_free( c->hits );
+        }
+        c->max_hits = c->max_hits ? c->max_hits : _MIN_SLOTS;
+        while ( c->max_hits < num_pairs ) {
+            c->max_hits *= 2;
+        }
+        c->hits = ( unsigned int* ) mem_malloc( c->max_hits * sizeof( unsigned int ) );
+    }
+}
+
+// Orders the events by the time of impact. The guids break the ties, so
+// the order does not depend on the order of the pairs.
+static int _compare_events( const void* a, const void* b ) {
+    const contact_event_t* e_0 = ( const contact_event_t* ) a;
+    const contact_event_t* e_1 = ( const contact_event_t* ) b;
+
+    if ( e_0->toi != e_1->toi ) {
+        return e_0->toi < e_1->toi ? -1 : 1;
+    }
+    if ( e_0->guid_0 != e_1->guid_0 ) {
+        return e_0->guid_0 < e_1->guid_0 ? -1 : 1;
+    }
+    if ( e_0->guid_1 != e_1->guid_1 ) {
+        return e_0->guid_1 < e_1->guid_1 ? -1 : 1;
+    }
+    return e_0->type - e_1->type;
+}
+
+contacts_t* contacts_new( unsigned int capacity ) {
+    contacts_t* c = ( contacts_t* ) mem_malloc( sizeof( contacts_t ) );
+    unsigned int num_slots = _MIN_SLOTS;
+    while ( num_slots < 2 * capacity ) {
+        num_slots *= 2;
+    }
+    _alloc( c, num_slots );
+    c->count = 0;
+    c->frame = 0;
+    c->max_events = num_slots / 2;
+    c->events = ( contact_event_t* ) mem_malloc( c->max_events * sizeof( contact_event_t ) );
+    c->num_events = 0;
+    c->boxes = NULL;
+    c->hits = NULL;
+    c->max_hits = 0;
+    c->supported = NULL;
+    c->max_supported = 0;
+    c->tests = 0;
+    c->skipped = 0;
+    c->ccd_tests = 0;
+    return c;
+}
+
+void contacts_free( contacts_t* cache ) {
+    mem_free( cache->slots );
+    mem_free( cache->contacts );
+    mem_free( cache->events );
+    if ( cache->boxes ) {
+        narrowphase_boxes_free( cache->boxes );
+    }
+    if ( cache->hits ) {
+        mem_free( cache->hits );
+    }
+    if ( cache->supported ) {
+        mem_free( cache->supported );
+    }
+    mem_free( cache );
+}
+
+void contacts_clear( contacts_t* cache ) {
+    assert( cache && CONTACTS_NOCACHE );
+
+    for ( unsigned int i = 0; i < cache->count; i++ ) {
+        cache->slots[ cache->contacts[i].slot ] = _EMPTY;
+    }
+    cache->count = 0;
+    cache->num_events = 0;
+}
+
+contact_t* contacts_find( contacts_t* cache, int guid_0, int guid_1 ) {
+    assert( cache && CONTACTS_NOCACHE );
+
+    if ( guid_0 > guid_1 ) {
+        int tmp = guid_0;
+        guid_0 = guid_1;
+        guid_1 = tmp;
+    }
+    unsigned int mask = cache->num_slots - 1;
+    unsigned int slot = _hash( guid_0, guid_1 ) & mask;
+    while ( cache->slots[ slot ] != _EMPTY ) {
+        contact_t* contact = &cache->contacts[ cache->slots[ slot ] ];
+        if ( contact->guid_0 == guid_0 && contact->guid_1 == guid_1 ) {
+            return contact;
+        }
+        slot = ( slot + 1 ) & mask;
+    }
+    return NULL;
+}
+
+void contacts_update( contacts_t* cache, physics_world_t* world, physics_pairs_t* pairs ) {
+    assert( cache && CONTACTS_NOCACHE );
+    assert( world && PHYSICS_NOWORLD );
+    assert( pairs && CONTACTS_NOPAIRS );
+
+    cache->frame++;
+    cache->num_events = 0;
+    cache->tests = 0;
+    cache->skipped = 0;
+    cache->ccd_tests = 0;
+
+    // The boxes of the pairs are tested in batches; the hits are in the
+    // order of the pairs.
+    _reserve( cache, world, pairs->count );
+    narrowphase_gather( cache->boxes, world );
+    unsigned int num_hits = narrowphase_pairs( cache->boxes, pairs, cache->hits );
+    unsigned int next_hit = 0;
+
+    for ( unsigned int i = 0; i < pairs->count; i++ ) {
+        int overlap = next_hit < num_hits && cache->hits[ next_hit ] == i;
+        next_hit += overlap;
+        physics_obj_t* obj_0 = pairs->pairs[i].obj_0;
+        physics_obj_t* obj_1 = pairs->pairs[i].obj_1;
+        if ( obj_0->guid > obj_1->guid ) {
+            physics_obj_t* tmp = obj_0;
+            obj_0 = obj_1;
+            obj_1 = tmp;
+        }
+
+        // The pairs that cannot touch are rejected before the lookup, so the
+        // cache holds only the touching pairs and the fast pairs that may.
+        int fast = ( obj_0->flags | obj_1->flags ) & PHYSICS_FLAG_FAST;
+        if ( !fast ) {
+            cache->tests++;
+            if ( !overlap ) {
+                continue;
+            }
+        } else if ( !_swept_overlap( obj_0->body, obj_1->body ) ) {
+            continue;
+        }
+
+        int is_new = 0;
+        contact_t* contact = contacts_find( cache, obj_0->guid, obj_1->guid );
+        if ( !contact ) {
+            if ( 2 * ( cache->count + 1 ) > cache->num_slots ) {
+                _grow( cache );
+            }
+            contact = &cache->contacts[ cache->count ];
+            contact->guid_0 = obj_0->guid;
+            contact->guid_1 = obj_1->guid;
+            contact->hash = _hash( obj_0->guid, obj_1->guid );
+            contact->touching = 0;
+            contact->toi = 0;
+            contact->nx = 0;
+            contact->ny = 0;
+            contact->impulse_n = 0;
+            contact->impulse_t = 0;
+            _place( cache, cache->count++ );
+            is_new = 1;
+        } else if ( contact->frame == cache->frame ) {
+            // A duplicate pair.
+            continue;
+        }
+        contact->frame = cache->frame;
+
+        int touching = 1;
+        if ( fast ) {
+            if ( !is_new
+                    && _state_equals( obj_0->body, contact->state_0 )
+                    && _state_equals( obj_1->body, contact->state_1 ) ) {
+                cache->skipped++;
+                touching = contact->touching;
+            } else {
+                cache->ccd_tests++;
+                contact->toi = 0;
+                touching = physics_sweep_two_bodies( obj_0, obj_1, &contact->toi ) != 0;
+                _state( obj_0->body, contact->state_0 );
+                _state( obj_1->body, contact->state_1 );
+            }
+        } else {
+            contact->toi = 0;
+        }
+
+        if ( touching ) {
+            _emit( cache, contact->touching ? CONTACT_STAY : CONTACT_BEGIN, contact );
+        } else if ( contact->touching ) {
+            _emit( cache, CONTACT_END, contact );
+        }
+        contact->touching = touching;
+    }
+
+    // Remove the pairs that were not seen. The removal moves the last
+    // contact to the index, so the index is not advanced then.
+    unsigned int i = 0;
+    while ( i < cache->count ) {
+        contact_t* contact = &cache->contacts[i];
+        if ( contact->frame == cache->frame ) {
+            i++;
+            continue;
+        }
+        // The broadphase skips the sleeping pairs; keep them as they are.
+        // The objects are found by their guids, since the removal of a body
+        // moves another one to its index.
+        physics_obj_t* obj_0 = physics_world_find( world, contact->guid_0 );
+        physics_obj_t* obj_1 = physics_world_find( world, contact->guid_1 );
+        if ( obj_0 && obj_1
+                && physics_is_sleeping( obj_0->body )
+                && physics_is_sleeping( obj_1->body ) ) {
+            contact->frame = cache->frame;
+            i++;
+            continue;
+        }
+        if ( contact->touching ) {
+            _emit( cache, CONTACT_END, contact );
+        }
+        _remove( cache, i );
+    }
+
+    // The events of the contacts whose swept tests were skipped keep their
+    // time of impact, so any event with one is sorted.
+    for ( unsigned int e = 0; e < cache->num_events; e++ ) {
+        if ( cache->events[e].toi ) {
+            qsort( cache->events, cache->num_events, sizeof( contact_event_t ), _compare_events );
+            break;
+        }
+    }
+}
+
+contact_event_t* contacts_events( contacts_t* cache, unsigned int* num_events ) {
+    assert( cache && CONTACTS_NOCACHE );
+
+    *num_events = cache->num_events;
+    return cache->events;
+}
+
+// A body that does not accelerate holds its island where it is
+static int _is_held( physics_body_t* body ) {
+    return abs( body->ax ) <= PHYSICS_SLEEP_ACCELERATION
+        && abs( body->ay ) <= PHYSICS_SLEEP_ACCELERATION;
+}
+
+static unsigned int _find( unsigned int* islands, unsigned int i ) {
+    while ( islands[i] != i ) {
+        // Path halving.
+        islands[i] = islands[ islands[i] ];
+        i = islands[i];
+    }
+    return i;
+}
+
+unsigned int contacts_islands( contacts_t* cache, physics_world_t* world ) {
+    assert( cache && CONTACTS_NOCACHE );
+    assert( world && PHYSICS_NOWORLD );
+
+    if ( cache->max_supported < world->count ) {
+        if ( cache->supported ) {
+            mem_free( cache->supported );
+        }
+        cache->max_supported = world->capacity;
+        cache->supported = ( unsigned char* ) mem_malloc( cache->max_supported );
+    }
+    unsigned int* islands = world->islands;
+    unsigned char* supported = cache->supported;
+    physics_body_t* bodies = world->bodies;
+    for ( unsigned int i = 0; i < world->count; i++ ) {
+        islands[i] = i;
+        supported[i] = ( unsigned char ) _is_held( &bodies[i] );
+    }
+
+    // Union. The smaller index becomes the root, so the islands do not
+    // depend on the order of the contacts. A body that touches a static
+    // body rests on it.
+    for ( unsigned int i = 0; i < cache->count; i++ ) {
+        contact_t* contact = &cache->contacts[i];
+        physics_obj_t* obj_0 = physics_world_find( world, contact->guid_0 );
+        physics_obj_t* obj_1 = physics_world_find( world, contact->guid_1 );
+        if ( !obj_0 || !obj_1 || !contact->touching ) {
+            continue;
+        }
+        unsigned int i_0 = obj_0->index;
+        unsigned int i_1 = obj_1->index;
+        int static_0 = physics_is_static( &bodies[ i_0 ] );
+        int static_1 = physics_is_static( &bodies[ i_1 ] );
+        if ( static_0 || static_1 ) {
+            supported[ i_0 ] |= ( unsigned char ) static_1;
+            supported[ i_1 ] |= ( unsigned char ) static_0;
+            continue;
+        }
+        unsigned int root_0 = _find( islands, i_0 );
+        unsigned int root_1 = _find( islands, i_1 );
+        if ( root_0 < root_1 ) {
+            islands[ root_1 ] = root_0;
+        } else if ( root_1 < root_0 ) {
+            islands[ root_0 ] = root_1;
+        }
+    }
+
+    // Flatten and gather the smallest idle count and the support to the
+    // root.
+    unsigned int num_islands = 0;
+    for ( unsigned int i = 0; i < world->count; i++ ) {
+        unsigned int root = _find( islands, i );
+        islands[i] = root;
+        if ( root == i ) {
+            num_islands++;
+            continue;
+        }
+        if ( bodies[i].idle < bodies[ root ].idle ) {
+            bodies[ root ].idle = bodies[i].idle;
+        }
+        supported[ root ] |= supported[i];
+    }
+
+    // Spread the idle count of the root to the island, wake up the falling
+    // islands and recount.
+    world->num_active = 0;
+    world->num_sleeping = 0;
+    for ( unsigned int i = 0; i < world->count; i++ ) {
+        bodies[i].idle = supported[ islands[i] ] ? bodies[ islands[i] ].idle : 0;
+        if ( physics_is_sleeping( &bodies[i] ) ) {
+            world->num_sleeping++;
+        } else {
+            world->num_active++;
+        }
+    }
+    return num_islands;
+}
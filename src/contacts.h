@@ -0,0 +1,170 @@
+// Contact cache
+//
+// The contact cache keeps the touching pairs of the broadphase from one
+// frame to the next. A pair is identified by the guids of its objects and
+// stored in an open-addressing hash table with linear probing.
+//
+// The cache reports the changes of the contacts as events:
+//
+// CONTACT_BEGIN  The objects started to touch in this frame
+// CONTACT_STAY   The objects touched in the previous frame and still touch
+// CONTACT_END    The objects stopped touching, or the pair is no longer a
+//                candidate pair
+//
+// The candidate pairs are tested in batches (narrowphase_pairs, which
+// gives the results of physics_check_two_bodies) before they are looked
+// up, and the pairs that do not touch are not stored. Thus, the cost
+// of the cache follows the contacts rather than the candidate pairs.
+//
+// The pairs with a fast object (PHYSICS_FLAG_FAST) are tested with the
+// swept test (physics_sweep_two_bodies) if the extents of their boxes
+// during the step meet. The swept test is skipped for the pairs whose
+// bounding boxes and velocities have not changed since the previous test.
+// If any event has a time of impact, the events are sorted by it, so the
+// contacts can be resolved in the order they happened during the step. The
+// discrete contacts have the time of impact zero.
+//
+// The contact between two sleeping bodies is kept as it is, although the
+// broadphase does not emit its pair. Thus, the islands survive the sleep.
+// The contacts keep only the guids, as the removal of a body moves another
+// body to its index; the contact of a removed body ends at the next update.
+
+#ifndef _contacts_
+#define _contacts_
+
+#include "./narrowphase.h"
+#include "./physics.h"
+
+// Messages for the diagnostics
+#define CONTACTS_NOCACHE "Contact cache does not exist"
+#define CONTACTS_NOPAIRS "Pair buffer does not exist"
+
+// Event types
+#define CONTACT_BEGIN   1
+#define CONTACT_STAY    2
+#define CONTACT_END     3
+
+// The number of the body fields that are compared (x, y, w, h, vx, vy)
+#define CONTACT_STATE_SIZE  6
+
+typedef struct {
+    int type;
+    int guid_0;
+    int guid_1;
+    unsigned int toi;
+} contact_event_t;
+
+typedef struct {
+    // The key; guid_0 < guid_1
+    int guid_0;
+    int guid_1;
+    unsigned int hash;
+    unsigned int slot;
+    // The frame when the pair was last seen
+    unsigned int frame;
+    int touching;
+    unsigned int toi;
+    // The normal of the latest solve and the accumulated impulses, which
+    // warm start the next solve (see solver.h)
+    int nx;
+    int ny;
+    long long impulse_n;
+    long long impulse_t;
+    // The state of the bodies at the last narrowphase test
+    int state_0[ CONTACT_STATE_SIZE ];
+    int state_1[ CONTACT_STATE_SIZE ];
+} contact_t;
+
+typedef struct {
+    // The hash table maps the slots to the indexes of the contacts
+    int* slots;
+    unsigned int num_slots;
+    // The live contacts are kept dense
+    contact_t* contacts;
+    unsigned int count;
+    unsigned int frame;
+    // The events of the latest update
+    contact_event_t* events;
+    unsigned int num_events;
+    unsigned int max_events;
+    // The boxes of the world and the indices of the overlapping pairs of
+    // the batched narrowphase, which grow with the world and the pairs
+    narrowphase_boxes_t* boxes;
+    unsigned int* hits;
+    unsigned int max_hits;
+    // Per body, whether the island of contacts_islands() rests on something
+    unsigned char* supported;
+    unsigned int max_supported;
+    // Statistics of the latest update: the discrete tests, the skipped and
+    // the done swept tests
+    unsigned int tests;
+    unsigned int skipped;
+    unsigned int ccd_tests;
+} contacts_t;
+
+// Creates a new contact cache
+//
+// @param capacity The expected number of the live pairs
+// @return The pointer to the cache
+contacts_t* contacts_new( unsigned int capacity );
+
+// Releases the cache
+//
+// @param cache The pointer to the cache
+void contacts_free( contacts_t* cache );
+
+// Removes all pairs without reporting them. The cost is linear to the number
+// of the live pairs
+//
+// @param cache The pointer to the cache
+void contacts_clear( contacts_t* cache );
+
+// Updates the cache with the candidate pairs of the frame
+//
+// The pairs that are not candidates anymore are removed, and so are the
+// pairs of the removed objects. The events of the previous update are
+// discarded.
+//
+// @precondition cache != NULL
+// @precondition world != NULL
+// @precondition pairs != NULL
+// @param cache The pointer to the cache
+// @param world The pointer to the world of the objects
+// @param pairs The candidate pairs of the frame
+void contacts_update( contacts_t* cache, physics_world_t* world, physics_pairs_t* pairs );
+
+// Finds the pair
+//
+// @param cache The pointer to the cache
+// @param guid_0 The guid of the 1st object
+// @param guid_1 The guid of the 2nd object
+// @return The pointer to the pair, or NULL
+contact_t* contacts_find( contacts_t* cache, int guid_0, int guid_1 );
+
+// @param cache The pointer to the cache
+// @param num_events The pointer to the number of the events
+// @return The events of the latest update
+contact_event_t* contacts_events( contacts_t* cache, unsigned int* num_events );
+
+// Groups the touching bodies of the world into islands
+//
+// The islands are found with a union-find over the touching contacts. The
+// static bodies do not join the islands. Every body of an island gets the
+// smallest idle count of the island, so the island falls asleep only when
+// all its bodies are still, and a woken body wakes up the whole island.
+// An island rests on something if one of its bodies touches a static body
+// or its acceleration is within PHYSICS_SLEEP_ACCELERATION. The other
+// islands are falling, e.g., a stack whose ground was removed, and they
+// are woken up. Finally, the active and the sleeping bodies of the world
+// are recounted.
+//
+// @precondition cache != NULL
+// @precondition world != NULL
+// @postcondition world->islands[ i ] is the representative of the island
+// @param cache The pointer to the cache of the objects of the world. The
+//              contacts of the removed objects are skipped
+// @param world The pointer to the world
+// @return The number of the islands, including the single bodies
+unsigned int contacts_islands( contacts_t* cache, physics_world_t* world );
+
+#endif // _contacts_
@@ -0,0 +1,130 @@
+// Coroutines
+//
+// [Implementation details]
+//
+// A slot of the wheel is a doubly linked list threaded through the
+// coroutines themselves, so the scheduler does not allocate memory after
+// coro_sched_new() and a coroutine is unlinked in constant time. The wake
+// frame is absolute; a tick detaches the list of its slot, resumes the
+// coroutines whose wake frame has come and links the others back. The
+// detached list is kept in the scheduler, so a coroutine function may stop
+// the coroutines that are still in it.
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./coro.h"
+#include "./mem.h"
+
+#define _CORO_MASK ( CORO_WHEEL_SIZE - 1 )
+
+static void _coro_link( coro_sched_t* sched, coro_t* co ) {
+    coro_t** slot = &sched->wheel[ co->wake & _CORO_MASK ];
+    co->prev = NULL;
+    co->next = *slot;
+    if ( *slot ) {
+        ( *slot )->prev = co;
+    }
+    *slot = co;
+}
+
+static void _coro_unlink( coro_sched_t* sched, coro_t* co ) {
+    if ( co->prev ) {
+        co->prev->next = co->next;
+    } else if ( sched->pending == co ) {
+        sched->pending = co->next;
+    } else {
+        sched->wheel[ co->wake & _CORO_MASK ] = co->next;
+    }
+    if ( co->next ) {
+        co->next->prev = co->prev;
+    }
+    co->prev = NULL;
+    co->next = NULL;
+}
+
+coro_sched_t* coro_sched_new() {
+    coro_sched_t* sched = ( coro_sched_t* ) mem_malloc( sizeof( coro_sched_t ) );
+    memset( sched, 0, sizeof( coro_sched_t ) );
+    return sched;
+}
+
+void coro_sched_free( coro_sched_t* sched ) {
+    for ( unsigned int i = 0; i < CORO_WHEEL_SIZE; i++ ) {
+        coro_t* co = sched->wheel[i];
+        while ( co ) {
+            co->scheduled = 0;
+            co = co->next;
+        }
+    }
+    mem_free( sched );
+}
+
+void coro_start( coro_sched_t* sched, coro_t* co, coro_fn_t fn, void* data ) {
+    assert( sched && CORO_NOSCHED );
+    assert( co && CORO_NOCORO );
+    assert( fn && CORO_NOFN );
+    assert( !co->scheduled && CORO_STARTED );
+
+    co->line = 0;
+    co->fn = fn;
+    co->data = data;
+    co->wake = sched->frame + 1;
+    co->scheduled = 1;
+    _coro_link( sched, co );
+    sched->count++;
+}
+
+void coro_stop( coro_sched_t* sched, coro_t* co ) {
+    assert( sched && CORO_NOSCHED );
+    assert( co && CORO_NOCORO );
+
+    if ( !co->scheduled ) {
+        return;
+    }
+    _coro_unlink( sched, co );
+    co->scheduled = 0;
+    sched->count--;
+}
+
+unsigned int coro_tick( coro_sched_t* sched ) {
+    assert( sched && CORO_NOSCHED );
+
+    sched->frame++;
+    sched->resumed = 0;
+    sched->skipped = 0;
+    // The coroutines that are started or that sleep a whole turn of the
+    // wheel during the tick go to the list of the slot, not to this one.
+    sched->pending = sched->wheel[ sched->frame & _CORO_MASK ];
+    sched->wheel[ sched->frame & _CORO_MASK ] = NULL;
+    coro_t* co;
+    while ( ( co = sched->pending ) ) {
+        sched->pending = co->next;
+        if ( co->next ) {
+            co->next->prev = NULL;
+        }
+        co->next = NULL;
+        if ( co->wake != sched->frame ) {
+            _coro_link( sched, co );
+            sched->skipped++;
+            continue;
+        }
+        // The function may stop the coroutine or start it again.
+        co->scheduled = 0;
+        sched->count--;
+        int frames = co->fn( co, co->data );
+        sched->resumed++;
+        if ( frames != CORO_DONE && !co->scheduled ) {
+            co->wake = sched->frame + ( frames > 0 ? ( unsigned int ) frames : 1 );
+            co->scheduled = 1;
+            _coro_link( sched, co );
+            sched->count++;
+        }
+    }
+    return sched->resumed;
+}
+
+int coro_running( const coro_t* co ) {
+    return co->scheduled;
+}
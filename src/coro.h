@@ -0,0 +1,138 @@
+// Coroutines
+//
+// A coroutine is a function that can stop in the middle and continue from
+// there later, so a behaviour like "wait, strafe, fire three shots and
+// retreat" is written as straight code instead of a state machine. The
+// coroutines are stackless: the position in the function is a line number
+// stored in the coro_t, and the function jumps back to it with a switch
+// (Duff's device). The local variables are not kept over a yield; the state
+// that must survive lives in the data of the coroutine, e.g., the data of
+// the game object, which also embeds the coro_t:
+//
+//   typedef struct { coro_t co; int shots; } enemy_t;
+//
+//   static int enemy( coro_t* co, void* data ) {
+//       enemy_t* e = ( enemy_t* ) data;
+//       CORO_BEGIN( co );
+//       CORO_SLEEP( co, 30 );
+//       for ( e->shots = 0; e->shots < 3; e->shots++ ) {
+//           fire( e );
+//           CORO_SLEEP( co, 5 );
+//       }
+//       retreat( e );
+//       CORO_END( co );
+//   }
+//
+//   coro_start( sched, &e->co, enemy, e );
+//
+// A coroutine must not use switch statements of its own around a yield.
+//
+// The scheduler resumes the coroutines once per tick. A sleeping coroutine
+// waits in a timer wheel, a ring of CORO_WHEEL_SIZE slots of which a tick
+// visits only the slot of the current frame, so the coroutines that are
+// asleep cost nothing. A sleep longer than the wheel goes around it; the
+// coroutine is skipped until its wake frame.
+
+#ifndef _coro_
+#define _coro_
+
+// Messages for the diagnostics
+#define CORO_NOSCHED "Scheduler does not exist"
+#define CORO_NOCORO "Coroutine does not exist"
+#define CORO_NOFN "Coroutine function does not exist"
+#define CORO_STARTED "Coroutine is already running"
+
+// The number of the slots of the timer wheel, a power of two
+#define CORO_WHEEL_SIZE 256
+
+// Return values of a coroutine function
+#define CORO_DONE -1
+
+struct coro_t;
+
+// A coroutine function
+//
+// @param co The coroutine
+// @param data The data of the coroutine
+// @return The number of the frames until the next resume, or CORO_DONE
+typedef int ( *coro_fn_t )( struct coro_t* co, void* data );
+
+typedef struct coro_t {
+    // The line where the function continues; zero at the beginning
+    int line;
+    unsigned int wake;
+    coro_fn_t fn;
+    void* data;
+    // The slot of the wheel
+    struct coro_t* prev;
+    struct coro_t* next;
+    int scheduled;
+} coro_t;
+
+typedef struct {
+    coro_t* wheel[ CORO_WHEEL_SIZE ];
+    // The coroutines of the slot that the tick has not visited yet
+    coro_t* pending;
+    unsigned int frame;
+    // The number of the scheduled coroutines
+    unsigned int count;
+    // Statistics of the latest tick
+    unsigned int resumed;
+    unsigned int skipped;
+} coro_sched_t;
+
+// Starts the function. Must be the first statement of a coroutine
+#define CORO_BEGIN(co) switch ( ( co )->line ) { case 0:
+
+// Stops the function until the next frame
+#define CORO_YIELD(co) CORO_SLEEP( co, 1 )
+
+// Stops the function for the given number of the frames, at least one
+#define CORO_SLEEP(co, frames) \
+    do { ( co )->line = __LINE__; return ( frames ); case __LINE__:; } while ( 0 )
+
+// Ends the function. Must be the last statement of a coroutine
+#define CORO_END(co) } ( co )->line = 0; return CORO_DONE
+
+// Creates a new scheduler at the frame zero
+//
+// @return The pointer to the scheduler
+coro_sched_t* coro_sched_new();
+
+// Releases the scheduler. The coroutines are dropped
+//
+// @param sched The pointer to the scheduler
+void coro_sched_free( coro_sched_t* sched );
+
+// Starts the coroutine. The function runs first on the next tick
+//
+// @precondition sched != NULL
+// @precondition co != NULL
+// @precondition fn != NULL
+// @precondition The coroutine is zeroed or not scheduled
+// @param sched The pointer to the scheduler
+// @param co The coroutine, e.g., embedded to the data
+// @param fn The function of the coroutine
+// @param data The data that is passed to the function
+void coro_start( coro_sched_t* sched, coro_t* co, coro_fn_t fn, void* data );
+
+// Stops the coroutine. It is not resumed any more
+//
+// @precondition sched != NULL
+// @precondition co != NULL
+// @param sched The pointer to the scheduler
+// @param co The coroutine
+void coro_stop( coro_sched_t* sched, coro_t* co );
+
+// Advances to the next frame and resumes the coroutines that wake in it
+//
+// @precondition sched != NULL
+// @param sched The pointer to the scheduler
+// @return The number of the resumed coroutines
+unsigned int coro_tick( coro_sched_t* sched );
+
+// @param co The coroutine
+// @return Non-zero if the coroutine is scheduled
+int coro_running( const coro_t* co );
+
+#endif // _coro_
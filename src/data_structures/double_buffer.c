@@ -0,0 +1,120 @@
+// Double buffer
+//
+// [Implementation details]
+//
+// A dirty bit is tested before it is set, so the writes to a block that is
+// already dirty do not contend for the cache line of the bitmap. The flip
+// walks the bitmap a word at a time and skips the clean words, so a frame
+// with few writes is copied forward in time proportional to the bitmap
+// plus the dirty blocks.
+
+#include <assert.h>
+#include <string.h>
+
+#include "../mem.h"
+#include "./double_buffer.h"
+
+#define _DBLBUF_WORD_BITS 64
+
+static void _dblbuf_mark( dblbuf_t* buf, unsigned int index ) {
+    unsigned int block = index / DBLBUF_BLOCK;
+    atomic_ullong* word = &buf->dirty[ block / _DBLBUF_WORD_BITS ];
+    unsigned long long bit = 1ULL << ( block % _DBLBUF_WORD_BITS );
+    if ( !( atomic_load_explicit( word, memory_order_relaxed ) & bit ) ) {
+        atomic_fetch_or_explicit( word, bit, memory_order_relaxed );
+    }
+}
+
+dblbuf_t* dblbuf_new( size_t stride, unsigned int capacity ) {
+    assert( stride > 0 && DBLBUF_ZEROPARAM );
+    assert( capacity > 0 && DBLBUF_ZEROPARAM );
+
+    dblbuf_t* buf = ( dblbuf_t* ) mem_malloc( sizeof( dblbuf_t ) );
+    buf->front = ( unsigned char* ) mem_malloc( stride * capacity );
+    buf->back = ( unsigned char* ) mem_malloc( stride * capacity );
+    memset( buf->front, 0, stride * capacity );
+    memset( buf->back, 0, stride * capacity );
+    unsigned int num_blocks = ( capacity + DBLBUF_BLOCK - 1 ) / DBLBUF_BLOCK;
+    buf->num_words = ( num_blocks + _DBLBUF_WORD_BITS - 1 ) / _DBLBUF_WORD_BITS;
+    buf->dirty = ( atomic_ullong* ) mem_malloc( buf->num_words * sizeof( atomic_ullong ) );
+    for ( unsigned int i = 0; i < buf->num_words; i++ ) {
+        atomic_init( &buf->dirty[i], 0 );
+    }
+    buf->front_count = 0;
+    buf->back_count = 0;
+    buf->stride = stride;
+    buf->capacity = capacity;
+    buf->frame = 0;
+    buf->copied = 0;
+    return buf;
+}
+
+void dblbuf_free( dblbuf_t* buf ) {
+    mem_free( buf->front );
+    mem_free( buf->back );
+    mem_free( buf->dirty );
+    mem_free( buf );
+}
+
+const void* dblbuf_read( const dblbuf_t* buf, unsigned int index ) {
+    assert( buf && DBLBUF_NOBUFFER );
+    assert( index < buf->front_count && DBLBUF_NORECORD );
+
+    return buf->front + index * buf->stride;
+}
+
+void* dblbuf_write( dblbuf_t* buf, unsigned int index ) {
+    assert( buf && DBLBUF_NOBUFFER );
+    assert( index < buf->back_count && DBLBUF_NORECORD );
+
+    _dblbuf_mark( buf, index );
+    return buf->back + index * buf->stride;
+}
+
+const void* dblbuf_peek( const dblbuf_t* buf, unsigned int index ) {
+    assert( buf && DBLBUF_NOBUFFER );
+    assert( index < buf->back_count && DBLBUF_NORECORD );
+
+    return buf->back + index * buf->stride;
+}
+
+void dblbuf_resize( dblbuf_t* buf, unsigned int count ) {
+    assert( buf && DBLBUF_NOBUFFER );
+    assert( count <= buf->capacity && DBLBUF_TOOMANY );
+
+    if ( count > buf->back_count ) {
+        memset( buf->back + buf->back_count * buf->stride, 0, ( count - buf->back_count ) * buf->stride );
+        for ( unsigned int i = buf->back_count; i < count; i += DBLBUF_BLOCK ) {
+            _dblbuf_mark( buf, i );
+        }
+        _dblbuf_mark( buf, count - 1 );
+    }
+    buf->back_count = count;
+}
+
+void dblbuf_swap( dblbuf_t* buf ) {
+    assert( buf && DBLBUF_NOBUFFER );
+
+    unsigned char* front = buf->back;
+    buf->back = buf->front;
+    buf->front = front;
+    buf->front_count = buf->back_count;
+    buf->frame++;
+
+    // The dirty blocks of the new front, up to its count
+    buf->copied = 0;
+    for ( unsigned int w = 0; w < buf->num_words; w++ ) {
+        unsigned long long bits = atomic_exchange_explicit( &buf->dirty[w], 0, memory_order_relaxed );
+        while ( bits ) {
+            unsigned int block = w * _DBLBUF_WORD_BITS + ( unsigned int ) __builtin_ctzll( bits );
+            bits &= bits - 1;
+            unsigned int begin = block * DBLBUF_BLOCK;
+            if ( begin >= buf->front_count ) {
+                continue;
+            }
+            unsigned int end = begin + DBLBUF_BLOCK < buf->front_count ? begin + DBLBUF_BLOCK : buf->front_count;
+            memcpy( buf->back + begin * buf->stride, front + begin * buf->stride, ( end - begin ) * buf->stride );
+            buf->copied += end - begin;
+        }
+    }
+}
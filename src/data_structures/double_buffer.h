@@ -0,0 +1,116 @@
+// Double buffer
+//
+// A double buffer keeps two copies of an array of equally sized records.
+// The readers see the front, which is the state of the latest completed
+// frame; the writers fill the back, which becomes the next frame. At the
+// frame boundary dblbuf_swap() flips the two by their pointers, so the
+// readers never see a half-written frame and the writers never wait for the
+// readers.
+//
+// A write marks its block of DBLBUF_BLOCK records dirty. After a flip, the
+// new back is one frame behind, so the dirty blocks are copied forward from
+// the new front; the blocks that were not written are already equal and
+// cost nothing. A write must thus cover the whole record, i.e., read the
+// record of the back, change it and keep the rest of it as it was.
+//
+// The records may be written by several threads at once, as long as each
+// record has one writer; the dirty bits are set atomically. The front must
+// not be read during dblbuf_swap().
+
+#ifndef _dblbuf_
+#define _dblbuf_
+
+#include <stdatomic.h>
+#include <stddef.h>
+
+// Messages for the diagnostics
+#define DBLBUF_NOBUFFER "Double buffer does not exist"
+#define DBLBUF_NORECORD "Record does not exist"
+#define DBLBUF_TOOMANY "Count is bigger than the capacity"
+#define DBLBUF_ZEROPARAM "Parameter must be positive"
+
+// The number of the records per dirty bit
+#define DBLBUF_BLOCK 64
+
+typedef struct {
+    unsigned char* front;
+    unsigned char* back;
+    // The number of the records of the front and the back
+    unsigned int front_count;
+    unsigned int back_count;
+    size_t stride;
+    unsigned int capacity;
+    // A bit per block of the back that has been written since the flip
+    atomic_ullong* dirty;
+    unsigned int num_words;
+    // The number of the flips
+    unsigned int frame;
+    // Statistics: the number of the records copied forward by the latest
+    // flip
+    unsigned int copied;
+} dblbuf_t;
+
+// Creates a new double buffer
+//
+// Both buffers are zeroed and hold no records.
+//
+// @precondition stride > 0
+// @precondition capacity > 0
+// @param stride The size of a record in bytes
+// @param capacity The max number of the records
+// @return The pointer to the double buffer
+dblbuf_t* dblbuf_new( size_t stride, unsigned int capacity );
+
+// Releases the double buffer
+//
+// @param buf The pointer to the double buffer
+void dblbuf_free( dblbuf_t* buf );
+
+// Returns a record of the latest completed frame
+//
+// @precondition buf != NULL
+// @precondition index < buf->front_count
+// @param buf The pointer to the double buffer
+// @param index The index of the record
+// @return The pointer to the record
+const void* dblbuf_read( const dblbuf_t* buf, unsigned int index );
+
+// Returns a record of the next frame for writing and marks it dirty
+//
+// @precondition buf != NULL
+// @precondition index < buf->back_count
+// @param buf The pointer to the double buffer
+// @param index The index of the record
+// @return The pointer to the record, which holds its latest state
+void* dblbuf_write( dblbuf_t* buf, unsigned int index );
+
+// Returns a record of the next frame without marking it dirty, e.g., to
+// compare it with the new state before writing
+//
+// @precondition buf != NULL
+// @precondition index < buf->back_count
+// @param buf The pointer to the double buffer
+// @param index The index of the record
+// @return The pointer to the record
+const void* dblbuf_peek( const dblbuf_t* buf, unsigned int index );
+
+// Sets the number of the records of the next frame
+//
+// The records that are added are zeroed and marked dirty.
+//
+// @precondition buf != NULL
+// @precondition count <= buf->capacity
+// @param buf The pointer to the double buffer
+// @param count The number of the records
+void dblbuf_resize( dblbuf_t* buf, unsigned int count );
+
+// Publishes the next frame to the readers
+//
+// The buffers are flipped and the dirty blocks are copied forward, so the
+// back equals the front afterwards.
+//
+// @precondition buf != NULL
+// @param buf The pointer to the double buffer
+void dblbuf_swap( dblbuf_t* buf );
+
+#endif // _dblbuf_
@@ -71,6 +71,12 @@ dblnode_t* dbllist_push_to_end( dbllist_t* list, void* new_data ) {
     assert( new_data != NULL && DBLL_NEWNULL );
 
     dblnode_t *node = (dblnode_t*) mem_malloc( sizeof( dblnode_t ) );
+    return dbllist_link_to_end( list, node, new_data );
+}
+
+dblnode_t* dbllist_link_to_end( dbllist_t* list, dblnode_t* node, void* new_data ) {
+    assert( new_data != NULL && DBLL_NEWNULL );
+
     node->data = new_data;
     node->next = NULL;
     node->prev = list->tail;
@@ -90,6 +96,14 @@ dblnode_t* dbllist_push_to_end( dbllist_t* list, void* new_data ) {
     return node;
 }
 
+dblnode_t* dbllist_detach( dbllist_t* list ) {
+    dblnode_t *head = list->head;
+    list->head = NULL;
+    list->tail = NULL;
+    list->size = 0;
+    return head;
+}
+
 void* dbllist_pop( dbllist_t *list ) {
     assert( !_is_empty(list) && DBLL_POPEMPTY );
 
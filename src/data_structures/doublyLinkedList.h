@@ -68,6 +68,24 @@ dblnode_t* dbllist_push( dbllist_t* list, void* new_data );
 // @return The newly inserted node
 dblnode_t* dbllist_push_to_end( dbllist_t* list, void* new_data );
 
+// Links a node at the end of the list
+//
+// The node is not allocated, so a node that dbllist_detach() has taken off
+// a list can be reused.
+//
+// @param list The pointer to the list where the node is linked into
+// @param node The node
+// @param new_data The data of the node
+// @return The node
+dblnode_t* dbllist_link_to_end( dbllist_t* list, dblnode_t* node, void* new_data );
+
+// Takes all the nodes off the list without releasing them
+//
+// @param list The pointer to the list
+// @return The first node, or NULL if the list is empty. The nodes stay
+//         linked by next; the last one has next == NULL
+dblnode_t* dbllist_detach( dbllist_t* list );
+
 // Pops the first node from the list
 //
 // @param list The pointer to the list where the node is popped from
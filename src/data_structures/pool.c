@@ -0,0 +1,90 @@
+// Object pool
+//
+// [Implementation details]
+//
+// The free list is threaded through the next array, so releasing and
+// allocating an object is a push and a pop. The slots start in the order of
+// their indices. The generation wraps from its max value back to 1, which
+// keeps the handles non-zero; a stale handle is detected as long as its
+// slot has not been reused 2^POOL_GENERATION_BITS - 1 times.
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../mem.h"
+#include "./pool.h"
+
+// The next of a used slot
+#define _POOL_USED 0xffffffffu
+#define _POOL_MAX_GENERATION ( ( 1u << POOL_GENERATION_BITS ) - 1 )
+
+#define _pool_handle(index, generation) ( ( int ) ( ( ( generation ) << POOL_INDEX_BITS ) | ( index ) ) )
+
+pool_t* pool_new( unsigned int size, unsigned int capacity ) {
+    assert( size > 0 && POOL_ZEROPARAM );
+    assert( capacity > 0 && POOL_ZEROPARAM );
+    assert( capacity <= POOL_MAX_CAPACITY && POOL_TOOBIG );
+
+    pool_t* pool = ( pool_t* ) mem_malloc( sizeof( pool_t ) );
+    pool->slots = ( unsigned char* ) mem_malloc( ( size_t ) size * capacity );
+    pool->generations = ( unsigned short* ) mem_malloc( capacity * sizeof( unsigned short ) );
+    pool->next = ( unsigned int* ) mem_malloc( capacity * sizeof( unsigned int ) );
+    for ( unsigned int i = 0; i < capacity; i++ ) {
+        pool->generations[i] = 1;
+        pool->next[i] = i + 1;
+    }
+    pool->free = 0;
+    pool->size = size;
+    pool->capacity = capacity;
+    pool->count = 0;
+    return pool;
+}
+
+void pool_free( pool_t* pool ) {
+    mem_free( pool->slots );
+    mem_free( pool->generations );
+    mem_free( pool->next );
+    mem_free( pool );
+}
+
+int pool_alloc( pool_t* pool ) {
+    assert( pool && POOL_NOPOOL );
+
+    if ( pool->free == pool->capacity ) {
+        return POOL_NONE;
+    }
+    unsigned int index = pool->free;
+    pool->free = pool->next[ index ];
+    pool->next[ index ] = _POOL_USED;
+    pool->count++;
+    memset( pool->slots + ( size_t ) index * pool->size, 0, pool->size );
+    return _pool_handle( index, ( unsigned int ) pool->generations[ index ] );
+}
+
+int pool_release( pool_t* pool, int handle ) {
+    assert( pool && POOL_NOPOOL );
+
+    if ( !pool_get( pool, handle ) ) {
+        return POOL_STALE;
+    }
+    unsigned int index = pool_index( handle );
+    unsigned int generation = pool->generations[ index ] + 1u;
+    pool->generations[ index ] = ( unsigned short ) ( generation > _POOL_MAX_GENERATION ? 1 : generation );
+    pool->next[ index ] = pool->free;
+    pool->free = index;
+    pool->count--;
+    return POOL_SUCCESS;
+}
+
+void* pool_get( pool_t* pool, int handle ) {
+    assert( pool && POOL_NOPOOL );
+
+    unsigned int index = pool_index( handle );
+    if ( handle <= POOL_NONE || index >= pool->capacity
+            || pool->next[ index ] != _POOL_USED
+            || pool->generations[ index ] != pool_generation( handle ) ) {
+        return NULL;
+    }
+    return pool->slots + ( size_t ) index * pool->size;
+}
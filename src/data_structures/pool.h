@@ -0,0 +1,93 @@
+// Object pool
+//
+// A pool is a fixed number of equally sized slots that are allocated once
+// by pool_new(). An object of the pool is referenced by a handle, which is
+// the index of its slot and the generation of the slot:
+//
+// +-----------------+----------------+
+// | generation (11) |   index (20)   |
+// +-----------------+----------------+
+//
+// The generation of a slot is bumped when its object is released, so a
+// handle that outlives its object is detected in constant time instead of
+// referring to whatever reuses the slot. The released slots are kept in a
+// free list and reused without allocating memory.
+//
+// A handle fits a non-negative int, and POOL_NONE is never a valid handle,
+// so a zeroed field refers to no object.
+
+#ifndef _pool_
+#define _pool_
+
+// Messages for the diagnostics
+#define POOL_NOPOOL "Pool does not exist"
+#define POOL_TOOBIG "Capacity is bigger than POOL_MAX_CAPACITY"
+#define POOL_ZEROPARAM "Parameter must be positive"
+
+// Return values
+#define POOL_SUCCESS 0
+#define POOL_STALE -1
+
+// The handle of no object
+#define POOL_NONE 0
+
+#define POOL_INDEX_BITS         20
+#define POOL_GENERATION_BITS    11
+#define POOL_MAX_CAPACITY       ( 1u << POOL_INDEX_BITS )
+
+#define pool_index(handle) ( ( unsigned int ) ( handle ) & ( POOL_MAX_CAPACITY - 1 ) )
+#define pool_generation(handle) ( ( unsigned int ) ( handle ) >> POOL_INDEX_BITS )
+
+typedef struct {
+    unsigned char* slots;
+    // The generation of each slot, in range [1, 2^POOL_GENERATION_BITS)
+    unsigned short* generations;
+    // The next free slot of a free slot; the used slots are marked
+    unsigned int* next;
+    // The first free slot, or capacity if the pool is full
+    unsigned int free;
+    unsigned int size;
+    unsigned int capacity;
+    unsigned int count;
+} pool_t;
+
+// Creates a new pool
+//
+// @precondition size > 0
+// @precondition 0 < capacity <= POOL_MAX_CAPACITY
+// @param size The size of an object in bytes
+// @param capacity The max number of the objects
+// @return The pointer to the pool
+pool_t* pool_new( unsigned int size, unsigned int capacity );
+
+// Releases the pool and its objects
+//
+// @param pool The pointer to the pool
+void pool_free( pool_t* pool );
+
+// Allocates a zeroed object
+//
+// @precondition pool != NULL
+// @param pool The pointer to the pool
+// @return The handle of the object, or POOL_NONE if the pool is full
+int pool_alloc( pool_t* pool );
+
+// Releases the object
+//
+// The handles of the object become stale.
+//
+// @precondition pool != NULL
+// @param pool The pointer to the pool
+// @param handle The handle of the object
+// @return POOL_SUCCESS, or POOL_STALE if the handle is not valid
+int pool_release( pool_t* pool, int handle );
+
+// Resolves the handle
+//
+// @precondition pool != NULL
+// @param pool The pointer to the pool
+// @param handle The handle of the object
+// @return The pointer to the object, or NULL if the handle is not valid
+void* pool_get( pool_t* pool, int handle );
+
+#endif // _pool_
@@ -11,6 +11,7 @@
 
 #include "../defs.h"
 #include "../mem.h"
+#include "../profiler.h"
 #include "./doublyLinkedList.h"
 #include "./quad_tree.h"
 #include "./tree.h"
@@ -149,6 +150,8 @@ unsigned int qtree_common_quad( qtree_t *q, int index_0, int index_1 ) {
             return i;
         }
     }
+    // The indexes are in the same leaf.
+    return q->depth;
 }
 
 // Returns the node at the end of the branch
@@ -237,6 +240,7 @@ tnode_t* qtree_insert( qtree_t *q, unsigned int num_of_levels, int index, int pa
     assert( q && QUAD_NOQTREE );
     assert( q->tree && QUAD_NOTREE );
     assert( num_of_levels <= q->depth && QUAD_TOODEEP );
+    PROF_ZONE( "qtree_insert" );
 
     tnode_t* tnode = NULL;
 
@@ -0,0 +1,317 @@
+// Snapshot ring
+//
+// [Implementation details]
+//
+// An encoded frame starts with a type byte. A raw frame is followed by the
+// whole state. A XOR frame is followed by tokens of the form
+//
+// +------------+------------+-------------------+
+// | zeros (16) | count (16) | count literals... |
+// +------------+------------+-------------------+
+//
+// where zeros is the number of unchanged bytes to skip and the literals are
+// XORed into the reference. The keyframes are XOR frames against zeros, so
+// one encoder serves both.
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../defs.h"
+#include "../mem.h"
+#include "./snapshot_ring.h"
+
+#define _FRAME_RAW      0
+#define _FRAME_XOR      1
+#define _TOKEN_MAX      0xffff
+#define _TOKEN_HEADER   4
+// A literal run is closed when there are at least this many unchanged bytes
+// ahead, i.e., when a new token is cheaper than the literals.
+#define _ZERO_RUN_MIN   _TOKEN_HEADER
+
+#define _frame(r, i) ( &( r )->frames[ ( ( r )->first + ( i ) ) % ( r )->max_frames ] )
+#define _newest(r) _frame( r, ( r )->count - 1 )
+
+static void _put_u16( unsigned char* dst, unsigned int value ) {
+    dst[0] = value & 0xff;
+    dst[1] = ( value >> 8 ) & 0xff;
+}
+
+static unsigned int _get_u16( const unsigned char* src ) {
+    return src[0] | ( src[1] << 8 );
+}
+
+// Encodes the XOR of the state and the reference (NULL means zeros)
+//
+// @return The size of the encoded frame, or 0 if it would not be smaller
+//         than the raw frame
+static unsigned int _encode( unsigned char* dst, const unsigned char* cur,
+        const unsigned char* ref, unsigned int len ) {
+    unsigned int limit = len + 1;
+    unsigned int out = 0;
+    unsigned int i = 0;
+
+    dst[ out++ ] = _FRAME_XOR;
+    while ( i < len ) {
+        unsigned int zeros = 0;
+        while ( i < len && zeros < _TOKEN_MAX && cur[i] == ( ref ? ref[i] : 0 ) ) {
+            zeros++;
+            i++;
+        }
+        // The trailing zeros are implicit.
+        if ( i == len ) {
+            break;
+        }
+        unsigned int start = i;
+        while ( i < len && i - start < _TOKEN_MAX ) {
+            unsigned int run = 0;
+            while ( run < _ZERO_RUN_MIN && i + run < len
+                    && cur[ i + run ] == ( ref ? ref[ i + run ] : 0 ) ) {
+                run++;
+            }
+            if ( run == _ZERO_RUN_MIN || i + run == len ) {
+                break;
+            }
+            i += run + 1;
+        }
+        if ( i - start > _TOKEN_MAX ) {
+            i = start + _TOKEN_MAX;
+        }
+        unsigned int count = i - start;
+        if ( out + _TOKEN_HEADER + count >= limit ) {
+            return 0;
+        }
+        _put_u16( &dst[ out ], zeros );
+        _put_u16( &dst[ out + 2 ], count );
+        out += _TOKEN_HEADER;
+        for ( unsigned int j = start; j < i; j++ ) {
+            dst[ out++ ] = cur[j] ^ ( ref ? ref[j] : 0 );
+        }
+    }
+    return out;
+}
+
+// Applies the encoded frame to the state that holds the reference
+static void _decode( unsigned char* state, const unsigned char* src,
+        unsigned int size, unsigned int len ) {
+    if ( src[0] == _FRAME_RAW ) {
+        memcpy( state, &src[1], len );
+        return;
+    }
+    unsigned int in = 1;
+    unsigned int i = 0;
+    while ( in < size ) {
+        i += _get_u16( &src[ in ] );
+        unsigned int count = _get_u16( &src[ in + 2 ] );
+        in += _TOKEN_HEADER;
+        for ( unsigned int j = 0; j < count; j++ ) {
+            state[ i++ ] ^= src[ in++ ];
+        }
+    }
+}
+
+// Decodes the keyframe of the group into the state
+static void _decode_key( snapring_t* r, unsigned int key_step, unsigned char* state ) {
+    if ( key_step == r->key_step && state != r->key ) {
+        memcpy( state, r->key, r->state_size );
+        return;
+    }
+    snapframe_t* key = _frame( r, key_step - _frame( r, 0 )->step );
+    memset( state, 0, r->state_size );
+    _decode( state, &r->arena[ key->offset ], key->size, r->state_size );
+}
+
+static void _evict_group( snapring_t* r ) {
+    do {
+        r->first = ( r->first + 1 ) % r->max_frames;
+        r->count--;
+        r->evicted++;
+    } while ( r->count && _frame( r, 0 )->step != _frame( r, 0 )->key_step );
+
+    if ( r->count == 0 ) {
+        r->write = 0;
+    }
+}
+
+// Finds the offset for a frame of the given size without evicting
+//
+// @return Non-zero if the frame fits
+static int _fits( snapring_t* r, unsigned int size, unsigned int* at ) {
+    if ( r->count == 0 ) {
+        *at = 0;
+        return 1;
+    }
+    unsigned int head = _frame( r, 0 )->offset;
+    if ( r->write > head ) {
+        if ( r->write + size <= r->max_bytes ) {
+            *at = r->write;
+            return 1;
+        }
+        // Wrap around; the gap at the end is wasted.
+        if ( size <= head ) {
+            *at = 0;
+            return 1;
+        }
+    } else if ( r->write < head && r->write + size <= head ) {
+        *at = r->write;
+        return 1;
+    }
+    return 0;
+}
+
+snapring_t* snapring_new( unsigned int state_size,
+        unsigned int max_frames,
+        unsigned int max_bytes,
+        unsigned int keyframe_interval ) {
+    assert( max_frames > 0 && SNAPRING_ZEROPARAM );
+    assert( keyframe_interval > 0 && SNAPRING_ZEROPARAM );
+    assert( max_bytes > state_size && SNAPRING_TOOSMALL );
+
+    snapring_t* r = ( snapring_t* ) mem_malloc( sizeof( snapring_t ) );
+    r->state_size = state_size;
+    r->max_frames = max_frames;
+    r->max_bytes = max_bytes;
+    r->keyframe_interval = keyframe_interval;
+    r->frames = ( snapframe_t* ) mem_malloc( max_frames * sizeof( snapframe_t ) );
+    r->arena = ( unsigned char* ) mem_malloc( max_bytes );
+    r->key = ( unsigned char* ) mem_malloc( state_size );
+    r->work = ( unsigned char* ) mem_malloc( state_size );
+    r->scratch = ( unsigned char* ) mem_malloc( state_size + 1 );
+    r->evicted = 0;
+    snapring_clear( r );
+    return r;
+}
+
+void snapring_free( snapring_t* ring ) {
+    mem_free( ring->frames );
+    mem_free( ring->arena );
+    mem_free( ring->key );
+    mem_free( ring->work );
+    mem_free( ring->scratch );
+    mem_free( ring );
+}
+
+void snapring_clear( snapring_t* ring ) {
+    assert( ring && SNAPRING_NORING );
+
+    ring->first = 0;
+    ring->count = 0;
+    ring->write = 0;
+    ring->key_step = 0;
+}
+
+void snapring_push( snapring_t* ring, unsigned int step, const void* state, unsigned int length ) {
+    assert( ring && SNAPRING_NORING );
+    assert( state && SNAPRING_NOSTATE );
+    assert( length <= ring->state_size && SNAPRING_TOOBIG );
+
+    // Keep the steps consecutive.
+    if ( ring->count ) {
+        if ( step <= _newest( ring )->step && step > snapring_oldest( ring ) ) {
+            snapring_truncate( ring, step - 1 );
+        } else if ( step != _newest( ring )->step + 1 ) {
+            snapring_clear( ring );
+        }
+    }
+
+    memcpy( ring->work, state, length );
+    memset( &ring->work[ length ], 0, ring->state_size - length );
+
+    int is_key = ring->count == 0 || step - ring->key_step >= ring->keyframe_interval;
+    unsigned int size = 0;
+    unsigned int at = 0;
+
+    while ( 1 ) {
+        size = _encode( ring->scratch, ring->work, is_key ? NULL : ring->key, ring->state_size );
+        if ( size == 0 ) {
+            ring->scratch[0] = _FRAME_RAW;
+            memcpy( &ring->scratch[1], ring->work, ring->state_size );
+            size = ring->state_size + 1;
+        }
+        while ( ring->count && ( ring->count == ring->max_frames || !_fits( ring, size, &at ) ) ) {
+            _evict_group( ring );
+        }
+        // A delta cannot outlive its keyframe.
+        if ( ring->count == 0 && !is_key ) {
+            is_key = 1;
+            continue;
+        }
+        _fits( ring, size, &at );
+        break;
+    }
+
+    memcpy( &ring->arena[ at ], ring->scratch, size );
+    if ( is_key ) {
+        memcpy( ring->key, ring->work, ring->state_size );
+        ring->key_step = step;
+    }
+
+    snapframe_t* frame = _frame( ring, ring->count );
+    frame->step = step;
+    frame->key_step = ring->key_step;
+    frame->offset = at;
+    frame->size = size;
+    frame->length = length;
+    ring->count++;
+    ring->write = at + size;
+}
+
+int snapring_restore( snapring_t* ring, unsigned int step, void* state ) {
+    assert( ring && SNAPRING_NORING );
+    assert( state && SNAPRING_NOSTATE );
+
+    if ( !snapring_contains( ring, step ) ) {
+        return SNAPRING_NOTFOUND;
+    }
+    snapframe_t* frame = _frame( ring, step - snapring_oldest( ring ) );
+    _decode_key( ring, frame->key_step, ( unsigned char* ) state );
+    if ( frame->step != frame->key_step ) {
+        _decode( ( unsigned char* ) state, &ring->arena[ frame->offset ], frame->size, ring->state_size );
+    }
+    return frame->length;
+}
+
+void snapring_truncate( snapring_t* ring, unsigned int step ) {
+    assert( ring && SNAPRING_NORING );
+
+    while ( ring->count && _newest( ring )->step > step ) {
+        ring->count--;
+    }
+    if ( ring->count == 0 ) {
+        snapring_clear( ring );
+        return;
+    }
+    snapframe_t* newest = _newest( ring );
+    ring->write = newest->offset + newest->size;
+    // The newest group has changed; reload its keyframe.
+    if ( newest->key_step != ring->key_step ) {
+        ring->key_step = newest->key_step;
+        snapframe_t* key = _frame( ring, newest->key_step - snapring_oldest( ring ) );
+        memset( ring->key, 0, ring->state_size );
+        _decode( ring->key, &ring->arena[ key->offset ], key->size, ring->state_size );
+    }
+}
+
+int snapring_contains( snapring_t* ring, unsigned int step ) {
+    assert( ring && SNAPRING_NORING );
+
+    return ring->count
+        && step >= snapring_oldest( ring )
+        && step <= _newest( ring )->step;
+}
+
+unsigned int snapring_oldest( snapring_t* ring ) {
+    return _frame( ring, 0 )->step;
+}
+
+unsigned int snapring_newest( snapring_t* ring ) {
+    return _newest( ring )->step;
+}
+
+unsigned int snapring_bytes_used( snapring_t* ring ) {
+    unsigned int used = 0;
+    for ( unsigned int i = 0; i < ring->count; i++ ) {
+        used += _frame( ring, i )->size;
+    }
+    return used;
+}
@@ -0,0 +1,135 @@
+// Snapshot ring
+//
+// A snapshot ring stores the recent states of a simulation. Each state is a
+// block of bytes whose size is bounded by the state_size. The states are
+// identified by their steps, which must be consecutive.
+//
+// Every keyframe_interval:th state is a keyframe. The other states are
+// stored as a XOR delta against the keyframe of their group. The delta is
+// compressed by skipping the runs of unchanged bytes. If the compressed
+// form would be bigger than the state itself, the state is stored raw.
+//
+// The memory use is bounded by the max number of the frames and the size of
+// the byte arena. When either one runs out, the oldest group (a keyframe and
+// its deltas) is evicted.
+//
+// The head of the ring is the oldest frame. The tail of the ring is the
+// newest frame.
+
+#ifndef _snapring_
+#define _snapring_
+
+// Messages for the diagnostics
+#define SNAPRING_NORING "Snapshot ring does not exist"
+#define SNAPRING_NOSTATE "State does not exist"
+#define SNAPRING_TOOBIG "State is bigger than the state size"
+#define SNAPRING_TOOSMALL "Arena cannot hold a single state"
+#define SNAPRING_ZEROPARAM "Parameter must be positive"
+
+// Return values
+#define SNAPRING_NOTFOUND -1
+
+typedef struct {
+    unsigned int step;
+    unsigned int key_step;
+    unsigned int offset;
+    unsigned int size;
+    unsigned int length;
+} snapframe_t;
+
+typedef struct {
+    // Configuration
+    unsigned int state_size;
+    unsigned int max_frames;
+    unsigned int max_bytes;
+    unsigned int keyframe_interval;
+    // Frame headers. The frames are kept in a ring; first is the index of
+    // the head.
+    snapframe_t* frames;
+    unsigned int first;
+    unsigned int count;
+    // Byte arena for the encoded frames
+    unsigned char* arena;
+    unsigned int write;
+    // The decoded keyframe of the newest group
+    unsigned char* key;
+    unsigned int key_step;
+    // Work buffers
+    unsigned char* work;
+    unsigned char* scratch;
+    // Statistics
+    unsigned int evicted;
+} snapring_t;
+
+// Creates a new snapshot ring
+//
+// @precondition max_bytes > state_size
+// @param state_size The max size of a state in bytes
+// @param max_frames The max number of the stored frames
+// @param max_bytes The size of the byte arena for the encoded frames
+// @param keyframe_interval The number of steps between the keyframes
+// @return The pointer to the ring
+snapring_t* snapring_new( unsigned int state_size,
+        unsigned int max_frames,
+        unsigned int max_bytes,
+        unsigned int keyframe_interval );
+
+// Releases the ring
+//
+// @param ring The pointer to the ring
+void snapring_free( snapring_t* ring );
+
+// Removes all frames
+//
+// @param ring The pointer to the ring
+void snapring_clear( snapring_t* ring );
+
+// Stores a state
+//
+// If the step is not the successor of the newest stored step, the frames
+// from the step onwards are dropped (the history is rewritten), or if there
+// is a gap, the whole ring is cleared.
+//
+// @precondition ring != NULL
+// @precondition length <= ring->state_size
+// @postcondition snapring_newest( ring ) == step
+// @param ring The pointer to the ring
+// @param step The step of the state
+// @param state The pointer to the state
+// @param length The size of the state in bytes. The bytes from the length
+//               up to the state_size are considered zeros
+void snapring_push( snapring_t* ring, unsigned int step, const void* state, unsigned int length );
+
+// Restores a state
+//
+// @precondition ring != NULL
+// @param ring The pointer to the ring
+// @param step The step of the state
+// @param state The pointer to the buffer of at least state_size bytes
+// @return The length of the state, or SNAPRING_NOTFOUND
+int snapring_restore( snapring_t* ring, unsigned int step, void* state );
+
+// Drops the frames whose step is greater than the given step
+//
+// @param ring The pointer to the ring
+// @param step The last step to be kept
+void snapring_truncate( snapring_t* ring, unsigned int step );
+
+// @param ring The pointer to the ring
+// @param step The step of the state
+// @return Non-zero if the state of the step is stored
+int snapring_contains( snapring_t* ring, unsigned int step );
+
+// @param ring The pointer to the ring
+// @return The step of the oldest frame. Undefined if the ring is empty
+unsigned int snapring_oldest( snapring_t* ring );
+
+// @param ring The pointer to the ring
+// @return The step of the newest frame. Undefined if the ring is empty
+unsigned int snapring_newest( snapring_t* ring );
+
+// @param ring The pointer to the ring
+// @return The number of bytes used by the encoded frames
+unsigned int snapring_bytes_used( snapring_t* ring );
+
+#endif // _snapring_
@@ -6,6 +6,14 @@
 #define DEBUG
 //#define LOGGING
 
+// The zones of the profiler are recorded (see profiler.h). Without it, the
+// zone macros are compiled out.
+//#define PROFILE
+
+// The work is shared among the threads (pthreads). Without it, everything
+// runs on the main thread.
+#define THREADING
+
 // The size of the coordinates in bits.
 #define COORDINATE_SIZE_IN_BITS 32
 
@@ -0,0 +1,384 @@
+// Entity-component system
+//
+// [Implementation details]
+//
+// The archetypes are allocated up front, so the pointers to them stay
+// valid. An archetype is found by its mask with a linear search; there are
+// few archetypes and the search is done only on structural changes.
+//
+// The record of an entity tells its archetype and its row. A free entity
+// has the archetype _ECS_FREE and an entity that a command buffer has
+// reserved has the archetype _ECS_RESERVED.
+//
+// A command is a header, followed by the value of the component for an
+// added component, in a growing byte buffer.
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./ecs.h"
+#include "./mem.h"
+
+#define _ECS_FREE       -1
+#define _ECS_RESERVED   -2
+
+#define _ECS_CREATE     1
+#define _ECS_DESTROY    2
+#define _ECS_ADD        3
+#define _ECS_REMOVE     4
+
+typedef struct {
+    unsigned int op;
+    unsigned int entity;
+    unsigned int component;
+    // The size of the value after the header
+    unsigned int size;
+} _ecs_command_t;
+
+ecs_t* ecs_new( unsigned int capacity ) {
+    ecs_t* ecs = ( ecs_t* ) mem_malloc( sizeof( ecs_t ) );
+    ecs->num_components = 0;
+    ecs->archetypes = ( ecs_archetype_t* ) mem_malloc( ECS_MAX_ARCHETYPES * sizeof( ecs_archetype_t ) );
+    ecs->records = ( ecs_record_t* ) mem_malloc( capacity * sizeof( ecs_record_t ) );
+    ecs->free = ( unsigned int* ) mem_malloc( capacity * sizeof( unsigned int ) );
+    ecs->num_free = 0;
+    ecs->num_entities = 0;
+    ecs->capacity = capacity;
+
+    // The empty archetype
+    ecs_archetype_t* empty = &ecs->archetypes[0];
+    memset( empty, 0, sizeof( ecs_archetype_t ) );
+    ecs->num_archetypes = 1;
+    return ecs;
+}
+
+void ecs_free( ecs_t* ecs ) {
+    for ( unsigned int i = 0; i < ecs->num_archetypes; i++ ) {
+        ecs_archetype_t* a = &ecs->archetypes[i];
+        for ( unsigned int c = 0; c < ECS_MAX_COMPONENTS; c++ ) {
+            if ( a->columns[c] ) {
+                mem_free( a->columns[c] );
+            }
+        }
+        if ( a->entities ) {
+            mem_free( a->entities );
+        }
+    }
+    mem_free( ecs->archetypes );
+    mem_free( ecs->records );
+    mem_free( ecs->free );
+    mem_free( ecs );
+}
+
+int ecs_component( ecs_t* ecs, unsigned int size ) {
+    assert( ecs && ECS_NOECS );
+
+    if ( ecs->num_components == ECS_MAX_COMPONENTS ) {
+        return ECS_FULL;
+    }
+    ecs->sizes[ ecs->num_components ] = size;
+    return ecs->num_components++;
+}
+
+// Returns the archetype of the mask, creating it if needed
+static int _ecs_archetype( ecs_t* ecs, ecs_mask_t mask ) {
+    for ( unsigned int i = 0; i < ecs->num_archetypes; i++ ) {
+        if ( ecs->archetypes[i].mask == mask ) {
+            return i;
+        }
+    }
+    assert( ecs->num_archetypes < ECS_MAX_ARCHETYPES && ECS_TOOMANYARCHETYPES );
+
+    ecs_archetype_t* a = &ecs->archetypes[ ecs->num_archetypes ];
+    memset( a, 0, sizeof( ecs_archetype_t ) );
+    a->mask = mask;
+    return ecs->num_archetypes++;
+}
+
+// Grows the columns of the archetype to fit one more row
+static void _ecs_reserve( ecs_t* ecs, ecs_archetype_t* a ) {
+    if ( a->count < a->capacity ) {
+        return;
+    }
+    unsigned int capacity = a->capacity ? 2 * a->capacity : 16;
+    unsigned int* entities = ( unsigned int* ) mem_malloc( capacity * sizeof( unsigned int ) );
+    if ( a->entities ) {
+        memcpy( entities, a->entities, a->count * sizeof( unsigned int ) );
+        mem_free( a->entities );
+    }
+    a->entities = entities;
+    for ( unsigned int c = 0; c < ecs->num_components; c++ ) {
+        if ( !( a->mask & ecs_bit( c ) ) ) {
+            continue;
+        }
+        // A tag of size zero still gets a column, so that it is found
+        unsigned int bytes = capacity * ecs->sizes[c];
+        void* column = mem_malloc( bytes ? bytes : 1 );
+        if ( a->columns[c] ) {
+            memcpy( column, a->columns[c], a->count * ecs->sizes[c] );
+            mem_free( a->columns[c] );
+        }
+        a->columns[c] = column;
+    }
+    a->capacity = capacity;
+}
+
+// Removes the row by moving the last row to its place
+static void _ecs_remove_row( ecs_t* ecs, ecs_archetype_t* a, unsigned int row ) {
+    unsigned int last = --a->count;
+    if ( row == last ) {
+        return;
+    }
+    unsigned int moved = a->entities[ last ];
+    a->entities[ row ] = moved;
+    ecs->records[ moved ].row = row;
+    for ( unsigned int c = 0; c < ecs->num_components; c++ ) {
+        if ( a->columns[c] ) {
+            unsigned int size = ecs->sizes[c];
+            memcpy( ( char* ) a->columns[c] + row * size, ( char* ) a->columns[c] + last * size, size );
+        }
+    }
+}
+
+// Moves the entity to the archetype of the mask. The components of both
+// archetypes are copied and the new ones are zeroed
+static void _ecs_move( ecs_t* ecs, unsigned int entity, ecs_mask_t mask ) {
+    ecs_record_t* record = &ecs->records[ entity ];
+    int to = _ecs_archetype( ecs, mask );
+    ecs_archetype_t* src = &ecs->archetypes[ record->archetype ];
+    ecs_archetype_t* dst = &ecs->archetypes[ to ];
+
+    _ecs_reserve( ecs, dst );
+    unsigned int row = dst->count++;
+    dst->entities[ row ] = entity;
+    for ( unsigned int c = 0; c < ecs->num_components; c++ ) {
+        if ( !dst->columns[c] ) {
+            continue;
+        }
+        unsigned int size = ecs->sizes[c];
+        char* value = ( char* ) dst->columns[c] + row * size;
+        if ( src->mask & ecs_bit( c ) ) {
+            memcpy( value, ( char* ) src->columns[c] + record->row * size, size );
+        } else {
+            memset( value, 0, size );
+        }
+    }
+    _ecs_remove_row( ecs, src, record->row );
+    record->archetype = to;
+    record->row = row;
+}
+
+// Takes a free entity. Returns ECS_FULL if there is none
+static int _ecs_reserve_entity( ecs_t* ecs ) {
+    unsigned int entity;
+    if ( ecs->num_free ) {
+        entity = ecs->free[ --ecs->num_free ];
+    } else if ( ecs->num_entities < ecs->capacity ) {
+        entity = ecs->num_entities++;
+    } else {
+        return ECS_FULL;
+    }
+    ecs->records[ entity ].archetype = _ECS_RESERVED;
+    return entity;
+}
+
+// Puts the reserved entity to the empty archetype
+static void _ecs_place( ecs_t* ecs, unsigned int entity ) {
+    ecs_archetype_t* empty = &ecs->archetypes[0];
+    _ecs_reserve( ecs, empty );
+    unsigned int row = empty->count++;
+    empty->entities[ row ] = entity;
+    ecs->records[ entity ].archetype = 0;
+    ecs->records[ entity ].row = row;
+}
+
+int ecs_create( ecs_t* ecs ) {
+    assert( ecs && ECS_NOECS );
+
+    int entity = _ecs_reserve_entity( ecs );
+    if ( entity != ECS_FULL ) {
+        _ecs_place( ecs, entity );
+    }
+    return entity;
+}
+
+void ecs_destroy( ecs_t* ecs, unsigned int entity ) {
+    assert( ecs && ECS_NOECS );
+    assert( ecs_alive( ecs, entity ) && ECS_NOENTITY );
+
+    ecs_record_t* record = &ecs->records[ entity ];
+    _ecs_remove_row( ecs, &ecs->archetypes[ record->archetype ], record->row );
+    record->archetype = _ECS_FREE;
+    ecs->free[ ecs->num_free++ ] = entity;
+}
+
+int ecs_alive( ecs_t* ecs, unsigned int entity ) {
+    assert( ecs && ECS_NOECS );
+
+    return entity < ecs->num_entities && ecs->records[ entity ].archetype >= 0;
+}
+
+void* ecs_add( ecs_t* ecs, unsigned int entity, unsigned int component ) {
+    assert( ecs && ECS_NOECS );
+    assert( ecs_alive( ecs, entity ) && ECS_NOENTITY );
+    assert( component < ecs->num_components && ECS_NOCOMPONENT );
+
+    ecs_mask_t mask = ecs->archetypes[ ecs->records[ entity ].archetype ].mask;
+    if ( !( mask & ecs_bit( component ) ) ) {
+        _ecs_move( ecs, entity, mask | ecs_bit( component ) );
+    }
+    return ecs_get( ecs, entity, component );
+}
+
+void ecs_remove( ecs_t* ecs, unsigned int entity, unsigned int component ) {
+    assert( ecs && ECS_NOECS );
+    assert( ecs_alive( ecs, entity ) && ECS_NOENTITY );
+    assert( component < ecs->num_components && ECS_NOCOMPONENT );
+
+    ecs_mask_t mask = ecs->archetypes[ ecs->records[ entity ].archetype ].mask;
+    if ( mask & ecs_bit( component ) ) {
+        _ecs_move( ecs, entity, mask & ~ecs_bit( component ) );
+    }
+}
+
+void* ecs_get( ecs_t* ecs, unsigned int entity, unsigned int component ) {
+    assert( ecs && ECS_NOECS );
+    assert( ecs_alive( ecs, entity ) && ECS_NOENTITY );
+    assert( component < ecs->num_components && ECS_NOCOMPONENT );
+
+    ecs_record_t* record = &ecs->records[ entity ];
+    ecs_archetype_t* a = &ecs->archetypes[ record->archetype ];
+    if ( !a->columns[ component ] ) {
+        return NULL;
+    }
+    return ( char* ) a->columns[ component ] + record->row * ecs->sizes[ component ];
+}
+
+unsigned int ecs_run( ecs_t* ecs, ecs_mask_t mask, ecs_system_t system, void* user ) {
+    assert( ecs && ECS_NOECS );
+
+    unsigned int count = 0;
+    for ( unsigned int i = 0; i < ecs->num_archetypes; i++ ) {
+        ecs_archetype_t* a = &ecs->archetypes[i];
+        if ( a->count && ( a->mask & mask ) == mask ) {
+            system( a, user );
+            count += a->count;
+        }
+    }
+    return count;
+}
+
+ecs_commands_t* ecs_commands_new( ecs_t* ecs ) {
+    ecs_commands_t* commands = ( ecs_commands_t* ) mem_malloc( sizeof( ecs_commands_t ) );
+    commands->ecs = ecs;
+    commands->capacity = 256;
+    commands->bytes = ( unsigned char* ) mem_malloc( commands->capacity );
+    commands->size = 0;
+    commands->count = 0;
+    return commands;
+}
+
+void ecs_commands_free( ecs_commands_t* commands ) {
+    mem_free( commands->bytes );
+    mem_free( commands );
+}
+
+static void _ecs_push( ecs_commands_t* commands, unsigned int op, unsigned int entity,
+        unsigned int component, const void* value, unsigned int size ) {
+    unsigned int needed = commands->size + sizeof( _ecs_command_t ) + size;
+    if ( needed > commands->capacity ) {
+        unsigned int capacity = 2 * commands->capacity;
+        while ( capacity < needed ) {
+            capacity *= 2;
+        }
+        unsigned char* bytes = ( unsigned char* ) mem_malloc( capacity );
+        memcpy( bytes, commands->bytes, commands->size );
+        mem_free( commands->bytes );
+        commands->bytes = bytes;
+        commands->capacity = capacity;
+    }
+    _ecs_command_t command = { op, entity, component, size };
+    memcpy( commands->bytes + commands->size, &command, sizeof( _ecs_command_t ) );
+    commands->size += sizeof( _ecs_command_t );
+    if ( size ) {
+        if ( value ) {
+            memcpy( commands->bytes + commands->size, value, size );
+        } else {
+            memset( commands->bytes + commands->size, 0, size );
+        }
+        commands->size += size;
+    }
+    commands->count++;
+}
+
+int ecs_commands_create( ecs_commands_t* commands ) {
+    assert( commands && ECS_NOCOMMANDS );
+
+    int entity = _ecs_reserve_entity( commands->ecs );
+    if ( entity != ECS_FULL ) {
+        _ecs_push( commands, _ECS_CREATE, entity, 0, NULL, 0 );
+    }
+    return entity;
+}
+
+void ecs_commands_destroy( ecs_commands_t* commands, unsigned int entity ) {
+    assert( commands && ECS_NOCOMMANDS );
+
+    _ecs_push( commands, _ECS_DESTROY, entity, 0, NULL, 0 );
+}
+
+void ecs_commands_add( ecs_commands_t* commands, unsigned int entity,
+        unsigned int component, const void* value ) {
+    assert( commands && ECS_NOCOMMANDS );
+    assert( component < commands->ecs->num_components && ECS_NOCOMPONENT );
+
+    _ecs_push( commands, _ECS_ADD, entity, component, value, commands->ecs->sizes[ component ] );
+}
+
+void ecs_commands_remove( ecs_commands_t* commands, unsigned int entity,
+        unsigned int component ) {
+    assert( commands && ECS_NOCOMMANDS );
+    assert( component < commands->ecs->num_components && ECS_NOCOMPONENT );
+
+    _ecs_push( commands, _ECS_REMOVE, entity, component, NULL, 0 );
+}
+
+unsigned int ecs_commands_flush( ecs_commands_t* commands ) {
+    assert( commands && ECS_NOCOMMANDS );
+
+    ecs_t* ecs = commands->ecs;
+    unsigned int applied = 0;
+    unsigned int offset = 0;
+    while ( offset < commands->size ) {
+        _ecs_command_t command;
+        memcpy( &command, commands->bytes + offset, sizeof( _ecs_command_t ) );
+        offset += sizeof( _ecs_command_t );
+        const unsigned char* value = commands->bytes + offset;
+        offset += command.size;
+
+        if ( command.op == _ECS_CREATE ) {
+            _ecs_place( ecs, command.entity );
+            applied++;
+            continue;
+        }
+        if ( !ecs_alive( ecs, command.entity ) ) {
+            continue;
+        }
+        switch ( command.op ) {
+            case _ECS_DESTROY:
+                ecs_destroy( ecs, command.entity );
+                break;
+            case _ECS_ADD:
+                memcpy( ecs_add( ecs, command.entity, command.component ), value, command.size );
+                break;
+            case _ECS_REMOVE:
+                ecs_remove( ecs, command.entity, command.component );
+                break;
+        }
+        applied++;
+    }
+    commands->size = 0;
+    commands->count = 0;
+    return applied;
+}
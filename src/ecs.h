@@ -0,0 +1,237 @@
+// Entity-component system
+//
+// An entity is an index to the entity table; it owns nothing but its
+// components. A component is a plain struct of a registered size, and the
+// set of the components of an entity is a bit mask.
+//
+// The entities with the same mask form an archetype. An archetype keeps each
+// of its components in a dense column, so the component of the i:th entity
+// of the archetype is the i:th element of the column. A system is run over
+// all archetypes that have the components it asks for, and it goes through
+// their columns linearly:
+//
+//   static void move( ecs_archetype_t* a, void* user ) {
+//       position_t* p = ecs_column( a, POSITION, position_t );
+//       velocity_t* v = ecs_column( a, VELOCITY, velocity_t );
+//       for ( unsigned int i = 0; i < a->count; i++ ) { ... }
+//   }
+//   ecs_run( ecs, ecs_bit( POSITION ) | ecs_bit( VELOCITY ), move, NULL );
+//
+// Adding or removing a component moves the entity to another archetype, and
+// destroying an entity moves the last entity of its archetype to its row.
+// Thus, a system must not change the structure of the entities while it is
+// running; it records the changes to a command buffer instead, and the
+// buffer is flushed after the systems.
+
+#ifndef _ecs_
+#define _ecs_
+
+// Messages for the diagnostics
+#define ECS_NOECS "ECS does not exist"
+#define ECS_NOENTITY "Entity does not exist"
+#define ECS_NOCOMPONENT "Component does not exist"
+#define ECS_NOCOMMANDS "Command buffer does not exist"
+#define ECS_TOOMANYARCHETYPES "Too many archetypes"
+
+// Return values
+#define ECS_FULL -1
+
+#define ECS_MAX_COMPONENTS 32
+#define ECS_MAX_ARCHETYPES 64
+
+typedef unsigned int ecs_mask_t;
+
+// The mask of one component
+#define ecs_bit(component) ( ( ecs_mask_t ) 1 << ( component ) )
+
+// The column of the component in the archetype, or NULL
+#define ecs_column(archetype, component, type) \
+    ( ( type* ) ( archetype )->columns[ component ] )
+
+typedef struct {
+    ecs_mask_t mask;
+    // The entity of each row
+    unsigned int* entities;
+    unsigned int count;
+    unsigned int capacity;
+    // A column for each component of the mask; the others are NULL
+    void* columns[ ECS_MAX_COMPONENTS ];
+} ecs_archetype_t;
+
+// The place of an entity
+typedef struct {
+    int archetype;
+    unsigned int row;
+} ecs_record_t;
+
+typedef struct {
+    // The registered components
+    unsigned int sizes[ ECS_MAX_COMPONENTS ];
+    unsigned int num_components;
+    // The archetypes; the first one is the empty one
+    ecs_archetype_t* archetypes;
+    unsigned int num_archetypes;
+    // The entity table and the free entities
+    ecs_record_t* records;
+    unsigned int* free;
+    unsigned int num_free;
+    unsigned int num_entities;
+    unsigned int capacity;
+} ecs_t;
+
+// A system
+//
+// @param archetype The pointer to a matching archetype
+// @param user The user data of ecs_run()
+typedef void ( *ecs_system_t )( ecs_archetype_t* archetype, void* user );
+
+// A buffer of the deferred structural changes
+typedef struct {
+    ecs_t* ecs;
+    unsigned char* bytes;
+    unsigned int size;
+    unsigned int capacity;
+    unsigned int count;
+} ecs_commands_t;
+
+// Creates a new ECS
+//
+// @param capacity The max number of the entities
+// @return The pointer to the ECS
+ecs_t* ecs_new( unsigned int capacity );
+
+// Releases the ECS and its entities
+//
+// @param ecs The pointer to the ECS
+void ecs_free( ecs_t* ecs );
+
+// Registers a component
+//
+// @precondition ecs != NULL
+// @param ecs The pointer to the ECS
+// @param size The size of the component in bytes
+// @return The id of the component, or ECS_FULL
+int ecs_component( ecs_t* ecs, unsigned int size );
+
+// Creates an entity without components
+//
+// @precondition ecs != NULL
+// @param ecs The pointer to the ECS
+// @return The entity, or ECS_FULL
+int ecs_create( ecs_t* ecs );
+
+// Destroys the entity and its components
+//
+// @precondition ecs != NULL
+// @precondition ecs_alive( ecs, entity )
+// @param ecs The pointer to the ECS
+// @param entity The entity
+void ecs_destroy( ecs_t* ecs, unsigned int entity );
+
+// @precondition ecs != NULL
+// @param ecs The pointer to the ECS
+// @param entity The entity
+// @return Non-zero if the entity exists
+int ecs_alive( ecs_t* ecs, unsigned int entity );
+
+// Adds the component to the entity
+//
+// A new component is zeroed. If the entity has the component already, the
+// component is kept as it is.
+//
+// @precondition ecs != NULL
+// @precondition ecs_alive( ecs, entity )
+// @param ecs The pointer to the ECS
+// @param entity The entity
+// @param component The id of the component
+// @return The pointer to the component. It is valid until the next
+//         structural change
+void* ecs_add( ecs_t* ecs, unsigned int entity, unsigned int component );
+
+// Removes the component from the entity, if it has the component
+//
+// @precondition ecs != NULL
+// @precondition ecs_alive( ecs, entity )
+// @param ecs The pointer to the ECS
+// @param entity The entity
+// @param component The id of the component
+void ecs_remove( ecs_t* ecs, unsigned int entity, unsigned int component );
+
+// @precondition ecs != NULL
+// @precondition ecs_alive( ecs, entity )
+// @param ecs The pointer to the ECS
+// @param entity The entity
+// @param component The id of the component
+// @return The pointer to the component, or NULL if the entity does not
+//         have it
+void* ecs_get( ecs_t* ecs, unsigned int entity, unsigned int component );
+
+// Runs the system over the archetypes that have all components of the mask
+//
+// The archetypes are visited in the order of their creation.
+//
+// @precondition ecs != NULL
+// @param ecs The pointer to the ECS
+// @param mask The components that the system needs
+// @param system The system
+// @param user The user data that is passed to the system
+// @return The number of the entities that the system went through
+unsigned int ecs_run( ecs_t* ecs, ecs_mask_t mask, ecs_system_t system, void* user );
+
+// Creates a new command buffer
+//
+// @param ecs The pointer to the ECS that the commands change
+// @return The pointer to the buffer
+ecs_commands_t* ecs_commands_new( ecs_t* ecs );
+
+// Releases the command buffer. The pending commands are dropped
+//
+// @param commands The pointer to the buffer
+void ecs_commands_free( ecs_commands_t* commands );
+
+// Records the creation of an entity
+//
+// The entity is reserved at once, so the following commands can refer to
+// it, but it is created by ecs_commands_flush().
+//
+// @precondition commands != NULL
+// @param commands The pointer to the buffer
+// @return The entity, or ECS_FULL
+int ecs_commands_create( ecs_commands_t* commands );
+
+// Records the destruction of the entity
+//
+// @precondition commands != NULL
+// @param commands The pointer to the buffer
+// @param entity The entity
+void ecs_commands_destroy( ecs_commands_t* commands, unsigned int entity );
+
+// Records the addition of the component
+//
+// @precondition commands != NULL
+// @param commands The pointer to the buffer
+// @param entity The entity
+// @param component The id of the component
+// @param value The pointer to the value that is copied to the component,
+//              or NULL for a zeroed component
+void ecs_commands_add( ecs_commands_t* commands, unsigned int entity,
+        unsigned int component, const void* value );
+
+// Records the removal of the component
+//
+// @precondition commands != NULL
+// @param commands The pointer to the buffer
+// @param entity The entity
+// @param component The id of the component
+void ecs_commands_remove( ecs_commands_t* commands, unsigned int entity,
+        unsigned int component );
+
+// Applies the commands in the order they were recorded and empties the
+// buffer. The commands of an entity that has been destroyed are skipped
+//
+// @precondition commands != NULL
+// @param commands The pointer to the buffer
+// @return The number of the applied commands
+unsigned int ecs_commands_flush( ecs_commands_t* commands );
+
+#endif // _ecs_
@@ -0,0 +1,196 @@
+// Event bus
+//
+// [Implementation details]
+//
+// A channel has two buffers. The emits go to the front buffer; a dispatch
+// swaps the buffers first and then delivers the back one, so the handlers
+// may emit to the channel that they are handling. The back buffer is
+// cleared after the delivery and reused as the next front buffer.
+//
+// The buffers grow by doubling and are never shrunk.
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./events.h"
+#include "./mem.h"
+#include "./physics.h"
+#include "./data_structures/quad_tree.h"
+
+#define _EVENTS_MIN_EVENTS 16
+#define _EVENTS_MIN_RECIPIENTS 64
+
+events_t* events_new() {
+    events_t* bus = ( events_t* ) mem_malloc( sizeof( events_t ) );
+    memset( bus, 0, sizeof( events_t ) );
+    return bus;
+}
+
+void events_free( events_t* bus ) {
+    for ( unsigned int c = 0; c < bus->num_channels; c++ ) {
+        for ( int b = 0; b < 2; b++ ) {
+            events_buffer_t* buffer = &bus->channels[c].buffers[b];
+            if ( buffer->events ) {
+                mem_free( buffer->events );
+                mem_free( buffer->spans );
+            }
+            if ( buffer->recipients ) {
+                mem_free( buffer->recipients );
+            }
+        }
+    }
+    mem_free( bus );
+}
+
+int events_channel( events_t* bus, unsigned int size, unsigned int phase ) {
+    assert( bus && EVENTS_NOBUS );
+    assert( size > 0 && EVENTS_NOCHANNEL );
+    assert( phase < EVENTS_MAX_PHASES && EVENTS_BADPHASE );
+
+    if ( bus->num_channels == EVENTS_MAX_CHANNELS ) {
+        return EVENTS_FULL;
+    }
+    events_channel_t* channel = &bus->channels[ bus->num_channels ];
+    memset( channel, 0, sizeof( events_channel_t ) );
+    channel->size = size;
+    channel->phase = phase;
+    return bus->num_channels++;
+}
+
+int events_subscribe( events_t* bus, unsigned int channel, events_handler_t handler, void* user ) {
+    assert( bus && EVENTS_NOBUS );
+    assert( channel < bus->num_channels && EVENTS_NOCHANNEL );
+    assert( handler && EVENTS_NOHANDLER );
+
+    events_channel_t* ch = &bus->channels[ channel ];
+    if ( ch->num_subscribers == EVENTS_MAX_SUBSCRIBERS ) {
+        return EVENTS_FULL;
+    }
+    ch->handlers[ ch->num_subscribers ] = handler;
+    ch->users[ ch->num_subscribers ] = user;
+    return ch->num_subscribers++;
+}
+
+// Appends an event without recipients to the front buffer
+static void* _events_push( events_channel_t* ch, const void* event ) {
+    events_buffer_t* buffer = &ch->buffers[ ch->front ];
+    if ( buffer->count == buffer->capacity ) {
+        unsigned int capacity = buffer->capacity ? 2 * buffer->capacity : _EVENTS_MIN_EVENTS;
+        unsigned char* events = ( unsigned char* ) mem_malloc( capacity * ch->size );
+        events_span_t* spans = ( events_span_t* ) mem_malloc( capacity * sizeof( events_span_t ) );
+        if ( buffer->events ) {
+            memcpy( events, buffer->events, buffer->count * ch->size );
+            memcpy( spans, buffer->spans, buffer->count * sizeof( events_span_t ) );
+            mem_free( buffer->events );
+            mem_free( buffer->spans );
+        }
+        buffer->events = events;
+        buffer->spans = spans;
+        buffer->capacity = capacity;
+    }
+    void* slot = buffer->events + buffer->count * ch->size;
+    if ( event ) {
+        memcpy( slot, event, ch->size );
+    } else {
+        memset( slot, 0, ch->size );
+    }
+    buffer->spans[ buffer->count ].first = buffer->num_recipients;
+    buffer->spans[ buffer->count ].count = 0;
+    buffer->count++;
+    ch->stats.frame_events++;
+    ch->stats.total_events++;
+    return slot;
+}
+
+void* events_emit( events_t* bus, unsigned int channel, const void* event ) {
+    assert( bus && EVENTS_NOBUS );
+    assert( channel < bus->num_channels && EVENTS_NOCHANNEL );
+
+    return _events_push( &bus->channels[ channel ], event );
+}
+
+// Appends the guid of the object to the recipients of the front buffer
+static void _events_add_recipient( physics_obj_t* obj, void* data ) {
+    events_buffer_t* buffer = ( events_buffer_t* ) data;
+    if ( buffer->num_recipients == buffer->max_recipients ) {
+        unsigned int capacity = buffer->max_recipients ? 2 * buffer->max_recipients : _EVENTS_MIN_RECIPIENTS;
+        int* recipients = ( int* ) mem_malloc( capacity * sizeof( int ) );
+        if ( buffer->recipients ) {
+            memcpy( recipients, buffer->recipients, buffer->num_recipients * sizeof( int ) );
+            mem_free( buffer->recipients );
+        }
+        buffer->recipients = recipients;
+        buffer->max_recipients = capacity;
+    }
+    buffer->recipients[ buffer->num_recipients++ ] = obj->guid;
+}
+
+unsigned int events_broadcast( events_t* bus, unsigned int channel, qtree_t* q,
+        int x0, int y0, int x1, int y1, unsigned int mask, const void* event ) {
+    assert( bus && EVENTS_NOBUS );
+    assert( channel < bus->num_channels && EVENTS_NOCHANNEL );
+    assert( q && QUAD_NOQTREE );
+
+    events_channel_t* ch = &bus->channels[ channel ];
+    events_buffer_t* buffer = &ch->buffers[ ch->front ];
+    unsigned int first = buffer->num_recipients;
+    unsigned int count = physics_query( q, x0, y0, x1, y1, mask, _events_add_recipient, buffer );
+    if ( !count ) {
+        return 0;
+    }
+    _events_push( ch, event );
+    buffer->spans[ buffer->count - 1 ].first = first;
+    buffer->spans[ buffer->count - 1 ].count = count;
+    ch->stats.frame_recipients += count;
+    return count;
+}
+
+unsigned int events_dispatch( events_t* bus, unsigned int phase ) {
+    assert( bus && EVENTS_NOBUS );
+    assert( phase < EVENTS_MAX_PHASES && EVENTS_BADPHASE );
+
+    unsigned int delivered = 0;
+    for ( unsigned int c = 0; c < bus->num_channels; c++ ) {
+        events_channel_t* ch = &bus->channels[c];
+        if ( ch->phase != phase || !ch->buffers[ ch->front ].count ) {
+            continue;
+        }
+        events_buffer_t* buffer = &ch->buffers[ ch->front ];
+        ch->front ^= 1;
+        events_batch_t batch;
+        batch.channel = c;
+        batch.events = buffer->events;
+        batch.size = ch->size;
+        batch.count = buffer->count;
+        batch.spans = buffer->spans;
+        batch.recipients = buffer->recipients;
+        for ( unsigned int s = 0; s < ch->num_subscribers; s++ ) {
+            ch->handlers[s]( &batch, ch->users[s] );
+        }
+        delivered += buffer->count;
+        ch->stats.deliveries++;
+        buffer->count = 0;
+        buffer->num_recipients = 0;
+    }
+    return delivered;
+}
+
+void events_frame( events_t* bus ) {
+    assert( bus && EVENTS_NOBUS );
+
+    for ( unsigned int c = 0; c < bus->num_channels; c++ ) {
+        events_stats_t* stats = &bus->channels[c].stats;
+        stats->last_events = stats->frame_events;
+        stats->last_recipients = stats->frame_recipients;
+        stats->frame_events = 0;
+        stats->frame_recipients = 0;
+    }
+}
+
+const events_stats_t* events_stats( events_t* bus, unsigned int channel ) {
+    assert( bus && EVENTS_NOBUS );
+    assert( channel < bus->num_channels && EVENTS_NOCHANNEL );
+
+    return &bus->channels[ channel ].stats;
+}
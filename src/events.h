@@ -0,0 +1,203 @@
+// Event bus
+//
+// The events are sent through typed channels instead of being pushed to the
+// objects one by one. A channel is registered with the size of its events
+// and the phase where they are delivered. The events of a channel are copied
+// into a contiguous buffer of the channel as they are emitted, and
+// events_dispatch() hands the whole buffer to each subscriber of the channel
+// at once; the game calls it at fixed points of the frame, one per phase.
+//
+// A broadcast is an event with recipients. events_broadcast() resolves the
+// recipients of a box through a quad-tree query (see physics_query) and
+// stores their guids next to the event, so an explosion that hits 200
+// objects is one event and 200 integers in the buffers of the channel:
+//
+//   static void on_explosion( const events_batch_t* batch, void* user ) {
+//       for ( unsigned int i = 0; i < batch->count; i++ ) {
+//           const explosion_t* e = events_at( batch, i, explosion_t );
+//           const int* guids = events_recipients( batch, i );
+//           for ( unsigned int j = 0; j < batch->spans[i].count; j++ ) { ... }
+//       }
+//   }
+//
+// The events that are emitted during a delivery, e.g., by the subscribers,
+// are delivered at the next dispatch of the phase. The buffers are kept from
+// one frame to the next, so they are rarely reallocated.
+
+#ifndef _events_
+#define _events_
+
+#include "./physics.h"
+#include "./data_structures/quad_tree.h"
+
+// Messages for the diagnostics
+#define EVENTS_NOBUS "Event bus does not exist"
+#define EVENTS_NOCHANNEL "Channel does not exist"
+#define EVENTS_NOHANDLER "Handler does not exist"
+#define EVENTS_BADPHASE "Phase is out of range"
+
+// Return values
+#define EVENTS_FULL -1
+
+#define EVENTS_MAX_CHANNELS 32
+#define EVENTS_MAX_PHASES 4
+#define EVENTS_MAX_SUBSCRIBERS 8
+
+// The recipients of an event in the recipients of its batch. An event that
+// is not a broadcast has no recipients
+typedef struct {
+    unsigned int first;
+    unsigned int count;
+} events_span_t;
+
+// The events of one channel that are delivered at once
+typedef struct {
+    unsigned int channel;
+    const void* events;
+    unsigned int size;
+    unsigned int count;
+    const events_span_t* spans;
+    const int* recipients;
+} events_batch_t;
+
+// The i:th event of the batch
+#define events_at(batch, i, type) \
+    ( ( const type* ) ( ( const char* ) ( batch )->events + ( i ) * ( batch )->size ) )
+
+// The guids of the recipients of the i:th event of the batch
+#define events_recipients(batch, i) \
+    ( ( batch )->recipients + ( batch )->spans[i].first )
+
+// A subscriber
+//
+// @param batch The events of the channel
+// @param user The data that was given with the subscription
+typedef void ( *events_handler_t )( const events_batch_t* batch, void* user );
+
+typedef struct {
+    unsigned char* events;
+    events_span_t* spans;
+    unsigned int count;
+    unsigned int capacity;
+    int* recipients;
+    unsigned int num_recipients;
+    unsigned int max_recipients;
+} events_buffer_t;
+
+// The statistics of a channel
+typedef struct {
+    // The number of the events and the recipients emitted in the current
+    // frame and in the previous one
+    unsigned int frame_events;
+    unsigned int frame_recipients;
+    unsigned int last_events;
+    unsigned int last_recipients;
+    unsigned long long total_events;
+    // The number of the deliveries, one per dispatch with events
+    unsigned int deliveries;
+} events_stats_t;
+
+typedef struct {
+    unsigned int size;
+    unsigned int phase;
+    events_handler_t handlers[ EVENTS_MAX_SUBSCRIBERS ];
+    void* users[ EVENTS_MAX_SUBSCRIBERS ];
+    unsigned int num_subscribers;
+    // The buffer that is being filled and the one that is being delivered
+    events_buffer_t buffers[2];
+    unsigned int front;
+    events_stats_t stats;
+} events_channel_t;
+
+typedef struct {
+    events_channel_t channels[ EVENTS_MAX_CHANNELS ];
+    unsigned int num_channels;
+} events_t;
+
+// Creates a new event bus without channels
+//
+// @return The pointer to the bus
+events_t* events_new();
+
+// Releases the bus. The undelivered events are dropped
+//
+// @param bus The pointer to the bus
+void events_free( events_t* bus );
+
+// Registers a channel
+//
+// @precondition bus != NULL
+// @precondition size > 0
+// @precondition phase < EVENTS_MAX_PHASES
+// @param bus The pointer to the bus
+// @param size The size of the events of the channel
+// @param phase The phase where the events are delivered
+// @return The id of the channel, or EVENTS_FULL
+int events_channel( events_t* bus, unsigned int size, unsigned int phase );
+
+// Subscribes to the events of the channel
+//
+// @precondition bus != NULL
+// @precondition channel < bus->num_channels
+// @precondition handler != NULL
+// @param bus The pointer to the bus
+// @param channel The id of the channel
+// @param handler The function that receives the batches of the channel
+// @param user The data that is passed to the handler
+// @return The index of the subscription, or EVENTS_FULL
+int events_subscribe( events_t* bus, unsigned int channel, events_handler_t handler, void* user );
+
+// Emits an event
+//
+// @precondition bus != NULL
+// @precondition channel < bus->num_channels
+// @param bus The pointer to the bus
+// @param channel The id of the channel
+// @param event The event that is copied, or NULL for a zeroed one
+// @return The pointer to the event in the buffer. It is valid until the
+//         next emit to the channel
+void* events_emit( events_t* bus, unsigned int channel, const void* event );
+
+// Emits an event to the objects of the tree that overlap the box
+//
+// No event is emitted if there are no recipients.
+//
+// @precondition bus != NULL
+// @precondition channel < bus->num_channels
+// @precondition q != NULL
+// @param bus The pointer to the bus
+// @param channel The id of the channel
+// @param q The tree of the objects
+// @param x0 The left side of the box
+// @param y0 The top side of the box
+// @param x1 The right side of the box
+// @param y1 The bottom side of the box
+// @param mask The categories of the recipients
+// @param event The event that is copied, or NULL for a zeroed one
+// @return The number of the recipients
+unsigned int events_broadcast( events_t* bus, unsigned int channel, qtree_t* q,
+        int x0, int y0, int x1, int y1, unsigned int mask, const void* event );
+
+// Delivers the events of the channels of the phase
+//
+// @precondition bus != NULL
+// @precondition phase < EVENTS_MAX_PHASES
+// @param bus The pointer to the bus
+// @param phase The phase
+// @return The number of the delivered events
+unsigned int events_dispatch( events_t* bus, unsigned int phase );
+
+// Ends the frame of the statistics
+//
+// @precondition bus != NULL
+// @param bus The pointer to the bus
+void events_frame( events_t* bus );
+
+// @precondition bus != NULL
+// @precondition channel < bus->num_channels
+// @param bus The pointer to the bus
+// @param channel The id of the channel
+// @return The statistics of the channel
+const events_stats_t* events_stats( events_t* bus, unsigned int channel );
+
+#endif // _events_
@@ -0,0 +1,197 @@
+// Finite state machines
+//
+// [Implementation details]
+//
+// The table is filled from the top down: the row of a state is the row of
+// its parent with the transitions of the state itself written over it, so
+// an inherited transition costs nothing at the dispatch. The states are
+// visited by their depth, one pass per level, so the row of the parent is
+// complete when its children are filled.
+//
+// The depth of a state is the number of its ancestors. The common ancestor
+// of two states is found by lifting the deeper one to the depth of the
+// other and then both of them in turns.
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./fsm.h"
+#include "./mem.h"
+
+static unsigned int _fsm_depth( const fsm_state_t* states, unsigned int state ) {
+    unsigned int depth = 0;
+    while ( states[ state ].parent != FSM_NONE ) {
+        state = states[ state ].parent;
+        depth++;
+    }
+    return depth;
+}
+
+static int _fsm_valid( const fsm_def_t* def ) {
+    if ( !def->num_states || def->num_states > FSM_MAX_STATES || def->num_events > FSM_MAX_EVENTS
+            || def->num_transitions > FSM_MAX_TRANSITIONS || def->initial >= def->num_states ) {
+        return 0;
+    }
+    for ( unsigned int s = 0; s < def->num_states; s++ ) {
+        // The chain of the parents ends within the max depth.
+        unsigned int state = s;
+        unsigned int depth = 0;
+        while ( def->states[ state ].parent != FSM_NONE ) {
+            state = def->states[ state ].parent;
+            if ( state >= def->num_states || ++depth >= FSM_MAX_DEPTH ) {
+                return 0;
+            }
+        }
+        unsigned int initial = def->states[s].initial;
+        if ( initial != FSM_NONE && ( initial >= def->num_states || def->states[ initial ].parent != s ) ) {
+            return 0;
+        }
+    }
+    for ( unsigned int i = 0; i < def->num_transitions; i++ ) {
+        const fsm_transition_t* t = &def->transitions[i];
+        if ( t->state >= def->num_states || t->target >= def->num_states || t->event >= def->num_events ) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+fsm_machine_t* fsm_new( const fsm_def_t* def ) {
+    if ( !def || !_fsm_valid( def ) ) {
+        return NULL;
+    }
+    fsm_machine_t* machine = ( fsm_machine_t* ) mem_malloc( sizeof( fsm_machine_t ) );
+    machine->num_states = def->num_states;
+    machine->num_events = def->num_events;
+    machine->initial = def->initial;
+    machine->states = ( fsm_state_t* ) mem_malloc( def->num_states * sizeof( fsm_state_t ) );
+    memcpy( machine->states, def->states, def->num_states * sizeof( fsm_state_t ) );
+    unsigned int num_transitions = def->num_transitions ? def->num_transitions : 1;
+    machine->transitions = ( fsm_transition_t* ) mem_malloc( num_transitions * sizeof( fsm_transition_t ) );
+    memcpy( machine->transitions, def->transitions, def->num_transitions * sizeof( fsm_transition_t ) );
+    unsigned int size = def->num_states * def->num_events;
+    machine->table = ( unsigned char* ) mem_malloc( size ? size : 1 );
+    memset( machine->table, FSM_NONE, size );
+
+    // The own transitions; the first one of a state and an event wins.
+    for ( unsigned int i = def->num_transitions; i-- > 0; ) {
+        const fsm_transition_t* t = &def->transitions[i];
+        machine->table[ t->state * def->num_events + t->event ] = ( unsigned char ) i;
+    }
+    // The inherited ones, the shallow states first
+    for ( unsigned int depth = 1; depth < FSM_MAX_DEPTH; depth++ ) {
+        for ( unsigned int s = 0; s < def->num_states; s++ ) {
+            if ( _fsm_depth( def->states, s ) != depth ) {
+                continue;
+            }
+            unsigned char* row = &machine->table[ s * def->num_events ];
+            const unsigned char* parent = &machine->table[ def->states[s].parent * def->num_events ];
+            for ( unsigned int e = 0; e < def->num_events; e++ ) {
+                if ( row[e] == FSM_NONE ) {
+                    row[e] = parent[e];
+                }
+            }
+        }
+    }
+    return machine;
+}
+
+void fsm_free( fsm_machine_t* machine ) {
+    mem_free( machine->table );
+    mem_free( machine->transitions );
+    mem_free( machine->states );
+    mem_free( machine );
+}
+
+// Enters the initial children of the state down to a leaf
+static unsigned int _fsm_descend( const fsm_machine_t* machine, unsigned int state, void* agent ) {
+    while ( machine->states[ state ].initial != FSM_NONE ) {
+        state = machine->states[ state ].initial;
+        if ( machine->states[ state ].enter ) {
+            machine->states[ state ].enter( agent );
+        }
+    }
+    return state;
+}
+
+// Enters the states from below the ancestor down to the state
+static void _fsm_enter( const fsm_machine_t* machine, unsigned int ancestor, unsigned int state, void* agent ) {
+    unsigned char path[ FSM_MAX_DEPTH ];
+    unsigned int length = 0;
+    while ( state != ancestor ) {
+        path[ length++ ] = ( unsigned char ) state;
+        state = machine->states[ state ].parent;
+    }
+    while ( length > 0 ) {
+        fsm_action_t enter = machine->states[ path[ --length ] ].enter;
+        if ( enter ) {
+            enter( agent );
+        }
+    }
+}
+
+void fsm_start( const fsm_machine_t* machine, fsm_t* fsm, void* agent ) {
+    assert( machine && FSM_NOMACHINE );
+    assert( fsm && FSM_NOINSTANCE );
+
+    _fsm_enter( machine, FSM_NONE, machine->initial, agent );
+    fsm->state = ( unsigned char ) _fsm_descend( machine, machine->initial, agent );
+}
+
+int fsm_dispatch( const fsm_machine_t* machine, fsm_t* fsm, unsigned int event, void* agent ) {
+    assert( machine && FSM_NOMACHINE );
+    assert( fsm && FSM_NOINSTANCE );
+    assert( event < machine->num_events && FSM_BADEVENT );
+
+    unsigned int index = machine->table[ fsm->state * machine->num_events + event ];
+    if ( index == FSM_NONE ) {
+        return FSM_IGNORED;
+    }
+    const fsm_transition_t* t = &machine->transitions[ index ];
+    const fsm_state_t* states = machine->states;
+
+    // The common ancestor of the current state and the parent of the
+    // target, so that the target is always entered. The depths are counted
+    // from FSM_NONE, the parent of the top-level states.
+    unsigned int source = fsm->state;
+    unsigned int a = source;
+    unsigned int b = states[ t->target ].parent;
+    int depth_a = _fsm_depth( states, a ) + 1;
+    int depth_b = b == FSM_NONE ? 0 : ( int ) _fsm_depth( states, b ) + 1;
+    for ( ; depth_a > depth_b; depth_a-- ) {
+        a = states[a].parent;
+    }
+    for ( ; depth_b > depth_a; depth_b-- ) {
+        b = states[b].parent;
+    }
+    while ( a != b ) {
+        a = states[a].parent;
+        b = states[b].parent;
+    }
+
+    for ( unsigned int s = source; s != a; s = states[s].parent ) {
+        if ( states[s].exit ) {
+            states[s].exit( agent );
+        }
+    }
+    if ( t->action ) {
+        t->action( agent );
+    }
+    _fsm_enter( machine, a, t->target, agent );
+    fsm->state = ( unsigned char ) _fsm_descend( machine, t->target, agent );
+    return FSM_HANDLED;
+}
+
+int fsm_in( const fsm_machine_t* machine, const fsm_t* fsm, unsigned int state ) {
+    assert( machine && FSM_NOMACHINE );
+
+    unsigned int s = fsm->state;
+    while ( s != FSM_NONE ) {
+        if ( s == state ) {
+            return 1;
+        }
+        s = machine->states[s].parent;
+    }
+    return 0;
+}
@@ -0,0 +1,154 @@
+// Finite state machines
+//
+// A state machine is defined by two tables: the states, each with its
+// parent, its initial child and its entry and exit actions, and the
+// transitions, each from a state on an event to a target state. The tables
+// are plain arrays, so they can be const data in the code or built from a
+// level file (see lvl_load_fsm):
+//
+//   static const fsm_state_t states[] = {
+//       //  parent     initial     enter   exit
+//       { FSM_NONE,   PATROL,     NULL,   NULL },     // ALIVE
+//       { ALIVE,      FSM_NONE,   walk,   NULL },     // PATROL
+//       { ALIVE,      FSM_NONE,   run,    NULL },     // CHASE
+//       { FSM_NONE,   FSM_NONE,   fall,   NULL },     // DEAD
+//   };
+//   static const fsm_transition_t transitions[] = {
+//       { PATROL, SEE, CHASE, NULL },
+//       { CHASE, LOSE, PATROL, NULL },
+//       { ALIVE, DIE, DEAD, scream },
+//   };
+//
+// The states are hierarchical. The machine is always in a leaf state; a
+// composite state, i.e., one with children, is entered through its initial
+// child. An event that the current state does not handle is handled by its
+// nearest ancestor that does, so DIE above moves both PATROL and CHASE to
+// DEAD. A transition exits the states from the current one up to the
+// nearest common ancestor of the current and the target state, runs the
+// action of the transition and enters the states down to the target. A
+// transition to the state itself or to one of its ancestors exits and
+// re-enters the target.
+//
+// fsm_new() compiles the tables into a machine: the lookup table of the
+// transition of each state on each event, with the hierarchy resolved. The
+// machine is shared by all instances of the definition, and an instance is
+// the state only, a single byte. The agent of the actions is given at each
+// call, so 10k agents cost 10k bytes and a dispatch is one table lookup.
+
+#ifndef _fsm_
+#define _fsm_
+
+// Messages for the diagnostics
+#define FSM_NOMACHINE "Machine does not exist"
+#define FSM_NOINSTANCE "Instance does not exist"
+#define FSM_BADEVENT "Event is out of range"
+
+// The state or the transition that does not exist
+#define FSM_NONE 0xff
+
+// Return values
+#define FSM_HANDLED 1
+#define FSM_IGNORED 0
+
+#define FSM_MAX_STATES 255
+#define FSM_MAX_EVENTS 255
+#define FSM_MAX_TRANSITIONS 255
+#define FSM_MAX_DEPTH 8
+
+// An action
+//
+// @param agent The agent that was given to the call
+typedef void ( *fsm_action_t )( void* agent );
+
+typedef struct {
+    // The parent state, or FSM_NONE for a top-level state
+    unsigned char parent;
+    // The child that is entered with the state, or FSM_NONE for a leaf
+    unsigned char initial;
+    fsm_action_t enter;
+    fsm_action_t exit;
+} fsm_state_t;
+
+typedef struct {
+    unsigned char state;
+    unsigned char event;
+    unsigned char target;
+    // The action that is run between the exits and the entries, or NULL
+    fsm_action_t action;
+} fsm_transition_t;
+
+typedef struct {
+    const fsm_state_t* states;
+    unsigned int num_states;
+    const fsm_transition_t* transitions;
+    unsigned int num_transitions;
+    unsigned int num_events;
+    // The state that an instance starts in
+    unsigned char initial;
+} fsm_def_t;
+
+// A compiled definition
+typedef struct {
+    fsm_state_t* states;
+    unsigned int num_states;
+    fsm_transition_t* transitions;
+    unsigned int num_events;
+    unsigned char initial;
+    // The index of the transition of each state on each event, or FSM_NONE
+    // if the event is ignored; the row of a state is num_events long. The
+    // first transition of a state on an event wins
+    unsigned char* table;
+} fsm_machine_t;
+
+// An instance of a machine
+typedef struct {
+    unsigned char state;
+} fsm_t;
+
+// Compiles the definition into a machine
+//
+// The machine copies the tables, so the definition may be released.
+//
+// @param def The definition
+// @return The pointer to the machine, or NULL if the definition is not
+//         valid, e.g., a state is out of range, the parents form a cycle or
+//         the initial child of a state is not its child
+fsm_machine_t* fsm_new( const fsm_def_t* def );
+
+// Releases the machine
+//
+// @param machine The pointer to the machine
+void fsm_free( fsm_machine_t* machine );
+
+// Enters the initial state of the machine
+//
+// @precondition machine != NULL
+// @precondition fsm != NULL
+// @param machine The machine of the instance
+// @param fsm The instance
+// @param agent The agent that is passed to the entry actions
+void fsm_start( const fsm_machine_t* machine, fsm_t* fsm, void* agent );
+
+// Handles the event
+//
+// The actions must not dispatch events to the same instance.
+//
+// @precondition machine != NULL
+// @precondition fsm != NULL
+// @precondition event < machine->num_events
+// @param machine The machine of the instance
+// @param fsm The instance
+// @param event The event
+// @param agent The agent that is passed to the actions
+// @return FSM_HANDLED if a transition was taken, otherwise FSM_IGNORED
+int fsm_dispatch( const fsm_machine_t* machine, fsm_t* fsm, unsigned int event, void* agent );
+
+// @precondition machine != NULL
+// @param machine The machine
+// @param fsm The instance
+// @param state The state
+// @return Non-zero if the instance is in the state or in one of its
+//         descendants
+int fsm_in( const fsm_machine_t* machine, const fsm_t* fsm, unsigned int state );
+
+#endif // _fsm_
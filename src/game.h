@@ -4,20 +4,165 @@
 
 #include "obj.h"
 #include "./data_structures/doublyLinkedList.h"
+#include "./contacts.h"
+#include "./coro.h"
+#include "./ecs.h"
+#include "./events.h"
+#include "./jobs.h"
+#include "./physics.h"
+#include "./projectiles.h"
+#include "./scheduler.h"
+#include "./tilemap.h"
+#include "./timestep.h"
+
+// Messages for the diagnostics
+#define GAME_BADTYPE "Type of the object is out of range"
+
+// Return values
+#define GAME_SUCCESS 0
+#define GAME_FULL -1
+#define GAME_STALE -2
+
+// The max number of the pooled game objects (see loop_spawn)
+#define GAME_MAX_OBJECTS 4096
+
+// The max number of the physics bodies in the scene
+#define GAME_MAX_BODIES 4096
+
+// The max number of the published states of the game objects; the objects
+// beyond it are not published (see loop_obj_states)
+#define GAME_MAX_OBJ_STATES 16384
+
+// The number of the bodies per job when their states are published
+#define GAME_PUBLISH_CHUNK 1024
+
+// The max number of the live projectiles and their size
+#define GAME_MAX_PROJECTILES 20000
+#define GAME_PROJECTILE_SIZE 4
+
+// The number of the threads of the job system, including the main thread
+#define GAME_THREADS 4
+
+// The max number of the object types. The type of an object is in range
+// [0, GAME_MAX_TYPES)
+#define GAME_MAX_TYPES 32
+
+// The time budget of the scheduled tasks per frame in nanoseconds
+#define GAME_SCHEDULER_BUDGET_NS 2000000ULL
+
+// The max number of the entities in the scene
+#define GAME_MAX_ENTITIES 65536
+
+// The seed of the random numbers of loop_rand() after init()
+#define GAME_DEFAULT_SEED 1
+
+// The phases of the events (see loop_events)
+//
+// GAME_PHASE_UPDATE   After the updates and the scripts of each step
+// GAME_PHASE_PHYSICS  After the collisions of each step
+// GAME_PHASE_FRAME    After the steps, before the scheduled tasks
+#define GAME_PHASE_UPDATE   0
+#define GAME_PHASE_PHYSICS  1
+#define GAME_PHASE_FRAME    2
+
+// The components of the entities (see loop_ecs). The ids are registered in
+// this order by init()
+#define GAME_POSITION   0
+#define GAME_SIZE       1
+#define GAME_VELOCITY   2
+#define GAME_TYPE       3
+#define GAME_SCRIPT     4
 
 typedef struct game_obj_t {
     struct obj_t* obj;
+    // The handle of loop_spawn(), or 0 for the objects of loop_add()
+    int handle;
+    // The bucket and the place in it, set by the loop when the object joins
+    int bucket;
+    unsigned int slot;
     int type;
     int x;
     int y;
     int w;
     int h;
     int v;
-    dbllist_t *events;
     int (*update)( int dt );
     void *data;
 } game_obj_t;
 
+// An update of all objects of one type
+//
+// @param objs The objects of the type
+// @param count The number of the objects
+// @param dt The step size
+typedef void (*game_batch_t)( game_obj_t** objs, unsigned int count, int dt );
+
+// The timing of the updates of one type
+typedef struct {
+    // The number of the objects of the type
+    unsigned int count;
+    // The number of the updates of the type, one per step
+    unsigned int batches;
+    // The time spent in the updates in the latest frame and in total
+    unsigned long long frame_ns;
+    unsigned long long total_ns;
+} game_type_stats_t;
+
+typedef struct {
+    int x;
+    int y;
+} game_position_t;
+
+typedef struct {
+    int w;
+    int h;
+} game_size_t;
+
+typedef struct {
+    int v;
+} game_velocity_t;
+
+typedef struct {
+    int type;
+} game_type_t;
+
+// The input of a frame: the pressed buttons as bits and the position of a
+// stick or a pointer
+typedef struct {
+    unsigned int buttons;
+    int x;
+    int y;
+} game_input_t;
+
+// The published state of a body (see loop_body_states)
+typedef struct {
+    int guid;
+    int x;
+    int y;
+    int vx;
+    int vy;
+    unsigned int w;
+    unsigned int h;
+} game_body_state_t;
+
+// The published state of a game object (see loop_obj_states). The handle
+// tells the objects that take the same place apart
+typedef struct {
+    int handle;
+    int type;
+    int x;
+    int y;
+    int w;
+    int h;
+} game_obj_state_t;
+
+// The behaviour of an entity. The update is called once per step
+typedef struct {
+    struct obj_t* obj;
+    int (*update)( int dt );
+    void *data;
+} game_script_t;
+
 // Initializes this game
 //
 // @return The end result of the initialization
@@ -25,8 +170,198 @@ int init();
 
 // Updates the game objects
 //
-// @param dt The time delta
+// The frame time is consumed in fixed steps (see timestep.h). For each step,
+// the objects of loop_add() and the scripts of the entities are updated with
+// the fixed step size, the physics is advanced by one step and, at last, the
+// commands of loop_commands() are applied. After the steps, the tasks of
+// loop_scheduler() are run within GAME_SCHEDULER_BUDGET_NS.
+//
+// The objects are updated type by type: the batch of the type, if any, is
+// called once for all objects of the type, otherwise the update of each
+// object is called. The objects that are added or removed during the frame
+// are added or removed after the last step of the frame.
+//
+// @param dt The time delta in milliseconds
 // @return The end result of the loop
 int loop( int dt );
 
+// Releases the structures allocated by init()
+void quit();
+
+// Adds the object to the scene at the end of the frame
+//
+// @precondition 0 <= obj->type < GAME_MAX_TYPES
+// @param obj The pointer to the game object
+void loop_add( game_obj_t* obj );
+
+// Removes the object from the scene at the end of the frame
+//
+// The object leaves the bucket that it joined, even if its type has
+// changed since. An object that is not in the scene is ignored.
+//
+// @param obj The pointer to the game object
+void loop_remove( game_obj_t* obj );
+
+// Spawns an object from the pool of the scene
+//
+// The object is zeroed and added to the scene at the end of the frame; its
+// fields, the type at least, must be set before that. The pool is allocated
+// by init(), so spawning does not allocate memory.
+//
+// @return The handle of the object, or GAME_FULL if the pool is full
+int loop_spawn();
+
+// Removes the object of loop_spawn() from the scene at the end of the frame
+//
+// The object is then returned to the pool and its handle goes stale.
+//
+// @param handle The handle of the object
+// @return GAME_SUCCESS, or GAME_STALE if the handle is not valid
+int loop_despawn( int handle );
+
+// Resolves the handle of loop_spawn() in constant time
+//
+// @param handle The handle of the object
+// @return The pointer to the object, or NULL if the handle is not valid
+game_obj_t* loop_obj( int handle );
+
+// Sets the batch update of the type
+//
+// @precondition 0 <= type < GAME_MAX_TYPES
+// @param type The type of the objects
+// @param batch The update of all objects of the type, or NULL to call the
+//              update of each object
+void loop_set_batch( int type, game_batch_t batch );
+
+// @precondition 0 <= type < GAME_MAX_TYPES
+// @param type The type of the objects
+// @return The timing of the updates of the type
+const game_type_stats_t* loop_type_stats( int type );
+
+// Moves the content of the object to a new entity
+//
+// The entity gets the position, the size, the velocity and the type of the
+// object, and a script if the object has an update or data. The
+// object itself is not kept; it must not be added with loop_add().
+//
+// @param obj The pointer to the game object
+// @return The entity, or ECS_FULL
+int loop_migrate( game_obj_t* obj );
+
+// @return The entities of the scene
+ecs_t* loop_ecs();
+
+// @return The command buffer that is flushed at the end of each step. The
+//         scripts change the entities through it
+ecs_commands_t* loop_commands();
+
+// @return The scheduler of the deferrable tasks, e.g., the path finding
+scheduler_t* loop_scheduler();
+
+// @return The scheduler of the coroutines of the scene. It is ticked once
+//         per step, after the scripts, so a sleep is counted in steps
+coro_sched_t* loop_coros();
+
+// @return The event bus of the scene. The channels are delivered at the
+//         phase points GAME_PHASE_*
+events_t* loop_events();
+
+// Emits an event to the bodies that overlap the box
+//
+// The recipients are resolved through the quad tree of the latest step.
+//
+// @precondition channel < loop_events()->num_channels
+// @param channel The id of the channel
+// @param x0 The left side of the box
+// @param y0 The top side of the box
+// @param x1 The right side of the box
+// @param y1 The bottom side of the box
+// @param event The event that is copied, or NULL for a zeroed one
+// @return The number of the recipients
+unsigned int loop_broadcast( unsigned int channel, int x0, int y0, int x1, int y1, const void* event );
+
+// @return The job system of the loop. Only the thread that called init() and
+//         the jobs may submit to it
+jobs_t* loop_jobs();
+
+// @return The timestep of the loop. Use timestep_alpha() for the rendering
+timestep_t* loop_timestep();
+
+// @return The physics world of the scene
+physics_world_t* loop_world();
+
+// @return The contact cache of the scene. The events of the cache are
+//         the contacts of the latest step
+contacts_t* loop_contacts();
+
+// @return The projectile pool of the scene. The hits of the pool are the
+//         hits of the latest step
+projectile_pool_t* loop_projectiles();
+
+// Sets the tile map of the level, e.g., one from lvl_load_tilemap()
+//
+// The loop takes the ownership of the map and releases the previous one.
+//
+// @param map The pointer to the map, or NULL for no map
+void loop_set_tilemap( tilemap_t* map );
+
+// @return The tile map of the scene, or NULL. The hits of the map are the
+//         hits of the latest step
+tilemap_t* loop_tilemap();
+
+// Sets the input of the next frames
+//
+// The game logic reads the input through loop_input() instead of the
+// devices, so a recorded input replays the same game (see replay.h).
+//
+// @param input The input that is copied
+void loop_set_input( const game_input_t* input );
+
+// @return The input of the frame. It is zeroed by init()
+const game_input_t* loop_input();
+
+// Seeds the random numbers of the scene
+//
+// @param seed The seed. Zero is replaced by GAME_DEFAULT_SEED
+void loop_srand( unsigned int seed );
+
+// Returns the next random number of the scene
+//
+// The game logic takes its random numbers from here instead of rand(), so
+// they are a part of the state that loop_checksum() covers.
+//
+// @return A 32-bit random number
+unsigned int loop_rand();
+
+// Hashes the state of the scene
+//
+// The hash covers the bodies of the physics world, the random numbers and
+// the timestep; it is fast enough to be taken after every frame.
+//
+// @return The hash
+unsigned int loop_checksum();
+
+// Returns the state of the bodies as of the end of the latest loop()
+//
+// The states are double buffered (see double_buffer.h): loop() fills the
+// next ones while the latest stay intact, and publishes the next ones by a
+// flip at its end. So the rendering, the AI or the networking may read
+// them in parallel with loop(), e.g., from jobs that are waited for before
+// the next frame, as long as no reader runs over the end of loop(). The
+// states are in the order of the bodies of the world.
+//
+// @param count The pointer to the number of the states that is written
+// @return The pointer to the states
+const game_body_state_t* loop_body_states( unsigned int* count );
+
+// Returns the state of the game objects as of the end of the latest loop()
+//
+// The states are double buffered like loop_body_states(). They are in the
+// order of the objects within their types, the types in ascending order,
+// and at most GAME_MAX_OBJ_STATES.
+//
+// @param count The pointer to the number of the states that is written
+// @return The pointer to the states
+const game_obj_state_t* loop_obj_states( unsigned int* count );
+
 #endif // #ifndef _game_
@@ -0,0 +1,262 @@
+// Headless simulation
+//
+// [Implementation details]
+//
+// The guid of the body of a game object is kept in the data of the object.
+// The objects are of one type whose batch bounces the bodies off the sides
+// of the region and copies their positions to the objects, so the game
+// logic of the scenario is timed with the frames. Only loop() is timed;
+// the allocations are the difference of the counters over it. The spawn
+// and the kicks take their random numbers from loop_rand(), so they are a
+// part of the state of the checksum. The player has its own xorshift with
+// the same seed, as it is not run when a replay gives the input, and its
+// draws must not shift those of the scene. A replay is read through once
+// before the run, so a corrupt one is rejected before the scene is created.
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "./game.h"
+#include "./headless.h"
+#include "./mem.h"
+#include "./physics.h"
+#include "./replay.h"
+#include "./data_structures/quad_tree.h"
+#include "./loaders/lvl_loader.h"
+
+#define _HEADLESS_TYPE      0
+#define _HEADLESS_REGION    ( 1 << REGION_DIM_IN_BITS )
+#define _HEADLESS_MIN_SIZE  4
+#define _HEADLESS_MAX_SIZE  16
+#define _HEADLESS_MAX_SPEED 3
+// The button of the player, which kicks the boxes within the radius
+#define _HEADLESS_KICK          0x1
+#define _HEADLESS_KICK_RADIUS   64
+// The player kicks once per so many frames on average, and moves at most
+// so far per frame
+#define _HEADLESS_KICK_ODDS     16
+#define _HEADLESS_PLAYER_SPEED  8
+
+// The state of the xorshift generator of the player
+static unsigned int _headless_random = GAME_DEFAULT_SEED;
+
+static unsigned int _headless_rand() {
+    unsigned int x = _headless_random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    _headless_random = x;
+    return x;
+}
+
+static unsigned long long _headless_now_ns() {
+    struct timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return ( unsigned long long ) t.tv_sec * 1000000000ULL + ( unsigned long long ) t.tv_nsec;
+}
+
+static int _headless_compare( const void* a, const void* b ) {
+    double d = *( const double* ) a - *( const double* ) b;
+    return ( d > 0 ) - ( d < 0 );
+}
+
+static int _headless_clamp( int v, int min, int max ) {
+    return v < min ? min : v > max ? max : v;
+}
+
+static void _headless_bounce( game_obj_t** objs, unsigned int count, int dt ) {
+    ( void ) dt;
+    physics_world_t* world = loop_world();
+    const game_input_t* input = loop_input();
+    for ( unsigned int i = 0; i < count; i++ ) {
+        physics_obj_t* obj = physics_world_find( world, ( int ) ( intptr_t ) objs[i]->data );
+        physics_body_t* body = obj->body;
+        if ( ( input->buttons & _HEADLESS_KICK )
+                && abs( body->x - input->x ) < _HEADLESS_KICK_RADIUS
+                && abs( body->y - input->y ) < _HEADLESS_KICK_RADIUS ) {
+            body->vx = ( int ) ( loop_rand() % ( 2 * _HEADLESS_MAX_SPEED + 1 ) ) - _HEADLESS_MAX_SPEED;
+            body->vy = ( int ) ( loop_rand() % ( 2 * _HEADLESS_MAX_SPEED + 1 ) ) - _HEADLESS_MAX_SPEED;
+        }
+        if ( ( body->x < 0 && body->vx < 0 )
+                || ( body->x + ( int ) body->w > _HEADLESS_REGION && body->vx > 0 ) ) {
+            body->vx = -body->vx;
+        }
+        if ( ( body->y < 0 && body->vy < 0 )
+                || ( body->y + ( int ) body->h > _HEADLESS_REGION && body->vy > 0 ) ) {
+            body->vy = -body->vy;
+        }
+        objs[i]->x = body->x;
+        objs[i]->y = body->y;
+    }
+}
+
+static void _headless_spawn( unsigned int num_objects ) {
+    physics_world_t* world = loop_world();
+    for ( unsigned int i = 0; i < num_objects; i++ ) {
+        physics_body_t body;
+        memset( &body, 0, sizeof( physics_body_t ) );
+        body.w = _HEADLESS_MIN_SIZE + loop_rand() % ( _HEADLESS_MAX_SIZE - _HEADLESS_MIN_SIZE );
+        body.h = _HEADLESS_MIN_SIZE + loop_rand() % ( _HEADLESS_MAX_SIZE - _HEADLESS_MIN_SIZE );
+        body.x = ( int ) ( loop_rand() % ( _HEADLESS_REGION - body.w ) );
+        body.y = ( int ) ( loop_rand() % ( _HEADLESS_REGION - body.h ) );
+        body.vx = ( int ) ( loop_rand() % ( 2 * _HEADLESS_MAX_SPEED + 1 ) ) - _HEADLESS_MAX_SPEED;
+        body.vy = ( int ) ( loop_rand() % ( 2 * _HEADLESS_MAX_SPEED + 1 ) ) - _HEADLESS_MAX_SPEED;
+        body.m = 1;
+        int index = physics_world_add( world, &body );
+
+        game_obj_t* obj = loop_obj( loop_spawn() );
+        obj->type = _HEADLESS_TYPE;
+        obj->x = body.x;
+        obj->y = body.y;
+        obj->w = ( int ) body.w;
+        obj->h = ( int ) body.h;
+        obj->data = ( void* ) ( intptr_t ) world->objs[ index ].guid;
+    }
+}
+
+// The input of the simulated player for the next frame
+static void _headless_player( game_input_t* input ) {
+    input->x = _headless_clamp( input->x + ( int ) ( _headless_rand() % ( 2 * _HEADLESS_PLAYER_SPEED + 1 ) )
+        - _HEADLESS_PLAYER_SPEED, 0, _HEADLESS_REGION );
+    input->y = _headless_clamp( input->y + ( int ) ( _headless_rand() % ( 2 * _HEADLESS_PLAYER_SPEED + 1 ) )
+        - _HEADLESS_PLAYER_SPEED, 0, _HEADLESS_REGION );
+    input->buttons = _headless_rand() % _HEADLESS_KICK_ODDS ? 0 : _HEADLESS_KICK;
+}
+
+// Returns the number of the frames of the replay, or -1 if it is corrupt
+static int _headless_count_frames( replay_t* replay ) {
+    game_input_t input;
+    int result;
+    replay_rewind( replay );
+    while ( ( result = replay_next( replay, &input, NULL ) ) == REPLAY_SUCCESS ) {
+    }
+    int count = result == REPLAY_END ? ( int ) replay->frame : -1;
+    replay_rewind( replay );
+    return count;
+}
+
+// Runs a frame with the input of the player or of the replay, and records
+// and verifies its checksum
+//
+// @return The time of loop() in nanoseconds, or zero if the frame diverged
+static unsigned long long _headless_frame( const headless_config_t* config, game_input_t* input, int dt ) {
+    unsigned int expected = 0;
+    if ( config->replay ) {
+        replay_next( config->replay, input, &expected );
+    } else {
+        _headless_player( input );
+    }
+    loop_set_input( input );
+    unsigned long long start = _headless_now_ns();
+    loop( dt );
+    unsigned long long ns = _headless_now_ns() - start;
+
+    unsigned int checksum = loop_checksum();
+    if ( config->record ) {
+        replay_record( config->record, input, checksum );
+    }
+    if ( config->replay && checksum != expected ) {
+        return 0;
+    }
+    return ns ? ns : 1;
+}
+
+int headless_run( const headless_config_t* config, headless_report_t* report ) {
+    assert( config && HEADLESS_NOCONFIG );
+    assert( report && HEADLESS_NOREPORT );
+
+    memset( report, 0, sizeof( headless_report_t ) );
+    report->num_objects = config->replay ? config->replay->num_objects : config->num_objects;
+    report->num_steps = config->num_steps;
+    report->seed = config->replay ? config->replay->seed : config->seed;
+    report->diverged = -1;
+    if ( report->num_objects > HEADLESS_MAX_OBJECTS ) {
+        return HEADLESS_TOOMANY;
+    }
+    if ( config->replay ) {
+        if ( config->replay->level != replay_hash( config->level ) ) {
+            return HEADLESS_OTHERLEVEL;
+        }
+        int num_frames = _headless_count_frames( config->replay );
+        if ( num_frames < 0 ) {
+            return HEADLESS_BADREPLAY;
+        }
+        // The first frame is not measured
+        report->num_steps = num_frames ? ( unsigned int ) num_frames - 1 : 0;
+    }
+
+    mem_reset_peak();
+    init();
+    if ( config->level ) {
+        tilemap_t* map = lvl_load_tilemap( config->level );
+        if ( !map ) {
+            quit();
+            return HEADLESS_BADLEVEL;
+        }
+        loop_set_tilemap( map );
+    }
+    _headless_random = report->seed ? report->seed : GAME_DEFAULT_SEED;
+    loop_srand( report->seed );
+    loop_set_batch( _HEADLESS_TYPE, _headless_bounce );
+    _headless_spawn( report->num_objects );
+
+    // The spawned objects join at the end of the first frame, which is not
+    // measured.
+    int dt = config->replay ? config->replay->dt : timestep_dt( loop_timestep() );
+    game_input_t input = { 0, _HEADLESS_REGION / 2, _HEADLESS_REGION / 2 };
+    int result = HEADLESS_SUCCESS;
+    unsigned int num_steps = 0;
+    double* times = ( double* ) mem_malloc( ( report->num_steps ? report->num_steps : 1 ) * sizeof( double ) );
+    double total = 0;
+    if ( !_headless_frame( config, &input, dt ) ) {
+        report->diverged = 0;
+        result = HEADLESS_DIVERGED;
+    }
+    for ( ; num_steps < report->num_steps && result == HEADLESS_SUCCESS; num_steps++ ) {
+        mem_stats_t before;
+        mem_stats_t after;
+        mem_stats( &before );
+        unsigned long long ns = _headless_frame( config, &input, dt );
+        mem_stats( &after );
+        if ( !ns ) {
+            report->diverged = ( int ) num_steps + 1;
+            result = HEADLESS_DIVERGED;
+            break;
+        }
+        times[ num_steps ] = ns / 1000000.0;
+        total += times[ num_steps ];
+        report->allocs += after.allocs - before.allocs;
+    }
+
+    report->num_steps = num_steps;
+    if ( num_steps ) {
+        qsort( times, num_steps, sizeof( double ), _headless_compare );
+        report->mean_ms = total / num_steps;
+        report->p50_ms = times[ ( num_steps - 1 ) / 2 ];
+        report->p99_ms = times[ ( num_steps * 99 + 99 ) / 100 - 1 ];
+        report->max_ms = times[ num_steps - 1 ];
+        report->allocs_per_frame = ( double ) report->allocs / num_steps;
+        report->realtime = total > 0 ? ( double ) num_steps * dt / total : 0;
+    }
+    report->checksum = loop_checksum();
+    mem_free( times );
+    quit();
+
+    mem_stats_t stats;
+    mem_stats( &stats );
+    report->peak_bytes = stats.peak;
+    return result;
+}
+
+void headless_print( FILE* out, const headless_report_t* report ) {
+    fprintf( out, "headless objects=%u steps=%u seed=%u mean_ms=%.4f p50_ms=%.4f p99_ms=%.4f"
+        " max_ms=%.4f allocs=%llu allocs_per_frame=%.2f peak_bytes=%llu realtime=%.1f"
+        " diverged=%d checksum=%08x\n",
+        report->num_objects, report->num_steps, report->seed, report->mean_ms,
+        report->p50_ms, report->p99_ms, report->max_ms, report->allocs,
+        report->allocs_per_frame, report->peak_bytes, report->realtime,
+        report->diverged, report->checksum );
+}
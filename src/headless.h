@@ -0,0 +1,115 @@
+// Headless simulation
+//
+// Runs the scene without rendering to measure the engine under load. A
+// scenario of num_objects boxes is generated from the seed: each box is a
+// physics body and a pooled game object of loop_spawn(), and the boxes
+// bounce inside the region of the quad tree. The tile map of a level file
+// may be added to the scenario. The scene is then driven through loop() one
+// fixed step per frame for num_steps frames, with the physics, the quad
+// tree, the broadphase and the solver as in the game.
+//
+// The input of each frame comes from a simulated player whose random
+// choices follow from the seed: now and then it kicks the boxes near its
+// position. The input and the checksum of each frame may be recorded (see
+// replay.h). A recording may then be replayed instead of the player, in
+// which case the seed, the number of the objects and the frames are those
+// of the recording, the level must be that of the recording, and the run
+// stops at the first frame whose checksum differs from the recorded one.
+// The frames run back to back, so a run is much faster than real time.
+//
+// The report holds the distribution of the frame times, the allocations
+// per frame and the peak of the allocated bytes. The allocations are
+// counted only if the build defines MEM_STATS (see mem.h), as `make
+// headless` and `make bench` do. The loop_checksum() of the final scene
+// tells if two runs of the same scenario simulated the same thing.
+//
+// headless_print() writes the report as one line of key=value pairs, like
+// the benchmarks, so the runs of different commits can be compared by a
+// script.
+
+#ifndef _headless_
+#define _headless_
+
+#include <stdio.h>
+
+#include "./game.h"
+#include "./replay.h"
+
+// Messages for the diagnostics
+#define HEADLESS_NOCONFIG "Configuration does not exist"
+#define HEADLESS_NOREPORT "Report does not exist"
+
+// Return values
+#define HEADLESS_SUCCESS 0
+#define HEADLESS_TOOMANY -1
+#define HEADLESS_BADLEVEL -2
+#define HEADLESS_DIVERGED -3
+#define HEADLESS_BADREPLAY -4
+#define HEADLESS_OTHERLEVEL -5
+
+// The max number of the objects of a scenario
+#define HEADLESS_MAX_OBJECTS ( GAME_MAX_BODIES < GAME_MAX_OBJECTS ? GAME_MAX_BODIES : GAME_MAX_OBJECTS )
+
+// The defaults of the benchmark
+#define HEADLESS_DEFAULT_OBJECTS    1000
+#define HEADLESS_DEFAULT_STEPS      300
+#define HEADLESS_DEFAULT_SEED       1
+
+typedef struct {
+    unsigned int num_objects;
+    unsigned int num_steps;
+    unsigned int seed;
+    // The contents of a level file whose tile map is used, or NULL
+    const char* level;
+    // The recording that the frames are appended to, or NULL. It is created
+    // with the scenario of the run (see replay_new)
+    replay_t* record;
+    // The recording that is replayed, or NULL. The replay is rewound first
+    replay_t* replay;
+} headless_config_t;
+
+typedef struct {
+    unsigned int num_objects;
+    unsigned int num_steps;
+    unsigned int seed;
+    // The frame times in milliseconds
+    double mean_ms;
+    double p50_ms;
+    double p99_ms;
+    double max_ms;
+    // The allocations made in the frames
+    unsigned long long allocs;
+    double allocs_per_frame;
+    // The max of the allocated bytes during the run, including init()
+    unsigned long long peak_bytes;
+    // The loop_checksum() after the last frame
+    unsigned int checksum;
+    // The simulated time per the wall time of the frames
+    double realtime;
+    // The first frame whose checksum differs from the replayed one, or -1
+    int diverged;
+} headless_report_t;
+
+// Runs the scenario
+//
+// The scene is created with init() and released with quit(), so the loop
+// must not be initialized by the caller.
+//
+// @precondition config != NULL
+// @precondition report != NULL
+// @param config The scenario
+// @param report The pointer to the report that is written
+// @return HEADLESS_SUCCESS, HEADLESS_TOOMANY if the scene cannot hold the
+//         objects, HEADLESS_BADLEVEL if the level has no valid tile map,
+//         HEADLESS_DIVERGED if the replay diverged, HEADLESS_BADREPLAY if
+//         the replay is corrupt or HEADLESS_OTHERLEVEL if the level is not
+//         that of the replay
+int headless_run( const headless_config_t* config, headless_report_t* report );
+
+// Writes the report as one line of key=value pairs
+//
+// @param out The stream
+// @param report The report
+void headless_print( FILE* out, const headless_report_t* report );
+
+#endif // _headless_
@@ -0,0 +1,413 @@
+// Job system
+//
+// [Implementation details]
+//
+// The deque follows "Correct and Efficient Work-Stealing for Weak Memory
+// Models" (Lê et al., 2013). The slots are written with the release and
+// read with the acquire order, so the contents of a job are visible to the
+// thread that takes it.
+//
+// The pending count is incremented before a job is pushed and decremented
+// when it is taken, so it is never less than the number of the jobs in the
+// deques. A thread goes to sleep only when it is zero. A sleeper is counted
+// before it checks the pending count and a submitter checks the sleepers
+// after it has incremented the pending count, so either the sleeper sees
+// the job or the submitter wakes it up.
+//
+// The jobs that wait for a counter are kept in a list in the counter. The
+// list is guarded by a spin lock, and the counter is checked under the
+// lock, so a job is never added to a list that has already been released.
+// The thread that decrements a counter marks the counter busy until it has
+// released the list; jobs_wait() waits for that too, so the caller may
+// reuse the counter as soon as jobs_wait() returns.
+
+#include <assert.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "./defs.h"
+#include "./jobs.h"
+#include "./mem.h"
+
+// The attempts to find a job before a thread goes to sleep
+#define _JOBS_SPINS 64
+
+static _Thread_local jobs_t* _jobs_owner = NULL;
+static _Thread_local int _jobs_index = -1;
+static _Thread_local unsigned int _jobs_seed = 1;
+
+// A part of the range of jobs_parallel_for() in chunks
+typedef struct {
+    struct _jobs_for_t* loop;
+    unsigned int first;
+    unsigned int last;
+} _jobs_range_t;
+
+typedef struct _jobs_for_t {
+    jobs_t* jobs;
+    jobs_range_fn_t fn;
+    void* data;
+    unsigned int count;
+    unsigned int chunk;
+    jobs_counter_t counter;
+    // A job and a range for each chunk that may begin a part
+    jobs_job_t parts[ JOBS_MAX_CHUNKS ];
+    _jobs_range_t ranges[ JOBS_MAX_CHUNKS ];
+} _jobs_for_t;
+
+//  ****************************************
+//   Deque
+//  ****************************************
+
+// Pushes the job to the bottom. Returns zero if the deque is full
+static int _jobs_push_bottom( jobs_deque_t* d, jobs_job_t* job ) {
+    long b = atomic_load_explicit( &d->bottom, memory_order_relaxed );
+    long t = atomic_load_explicit( &d->top, memory_order_acquire );
+    if ( b - t >= JOBS_DEQUE_SIZE ) {
+        return 0;
+    }
+    atomic_store_explicit( &d->slots[ b & ( JOBS_DEQUE_SIZE - 1 ) ], job, memory_order_release );
+    atomic_store_explicit( &d->bottom, b + 1, memory_order_release );
+    return 1;
+}
+
+// Takes the job from the bottom, or NULL
+static jobs_job_t* _jobs_take_bottom( jobs_deque_t* d ) {
+    long b = atomic_load_explicit( &d->bottom, memory_order_relaxed ) - 1;
+    atomic_store_explicit( &d->bottom, b, memory_order_relaxed );
+    atomic_thread_fence( memory_order_seq_cst );
+    long t = atomic_load_explicit( &d->top, memory_order_relaxed );
+
+    jobs_job_t* job = NULL;
+    if ( t <= b ) {
+        job = atomic_load_explicit( &d->slots[ b & ( JOBS_DEQUE_SIZE - 1 ) ], memory_order_acquire );
+        if ( t == b ) {
+            // The last job; a thief may race for it.
+            if ( !atomic_compare_exchange_strong_explicit( &d->top, &t, t + 1,
+                    memory_order_seq_cst, memory_order_relaxed ) ) {
+                job = NULL;
+            }
+            atomic_store_explicit( &d->bottom, b + 1, memory_order_relaxed );
+        }
+    } else {
+        atomic_store_explicit( &d->bottom, b + 1, memory_order_relaxed );
+    }
+    return job;
+}
+
+// Steals the job from the top, or NULL
+static jobs_job_t* _jobs_steal_top( jobs_deque_t* d ) {
+    long t = atomic_load_explicit( &d->top, memory_order_acquire );
+    atomic_thread_fence( memory_order_seq_cst );
+    long b = atomic_load_explicit( &d->bottom, memory_order_acquire );
+    if ( t >= b ) {
+        return NULL;
+    }
+    jobs_job_t* job = atomic_load_explicit( &d->slots[ t & ( JOBS_DEQUE_SIZE - 1 ) ], memory_order_acquire );
+    if ( !atomic_compare_exchange_strong_explicit( &d->top, &t, t + 1,
+            memory_order_seq_cst, memory_order_relaxed ) ) {
+        return NULL;
+    }
+    return job;
+}
+
+//  ****************************************
+//   Scheduling
+//  ****************************************
+
+static void _jobs_wake( jobs_t* jobs ) {
+#ifdef THREADING
+    if ( atomic_load( &jobs->sleepers ) > 0 ) {
+        pthread_mutex_lock( &jobs->mutex );
+        pthread_cond_signal( &jobs->wake );
+        pthread_mutex_unlock( &jobs->mutex );
+    }
+#else
+    ( void ) jobs;
+#endif
+}
+
+static void _jobs_execute( jobs_t* jobs, jobs_job_t* job );
+
+// Pushes the job to the deque of the calling thread
+static void _jobs_push( jobs_t* jobs, jobs_job_t* job ) {
+    atomic_fetch_add( &jobs->pending, 1 );
+    if ( !_jobs_push_bottom( &jobs->deques[ _jobs_index ], job ) ) {
+        atomic_fetch_sub( &jobs->pending, 1 );
+        _jobs_execute( jobs, job );
+        return;
+    }
+    _jobs_wake( jobs );
+}
+
+// Decrements the counter and releases its waiting jobs at zero
+static void _jobs_signal( jobs_t* jobs, jobs_counter_t* counter ) {
+    atomic_fetch_add( &counter->busy, 1 );
+    if ( atomic_fetch_sub( &counter->value, 1 ) != 1 ) {
+        atomic_fetch_sub( &counter->busy, 1 );
+        return;
+    }
+    while ( atomic_flag_test_and_set_explicit( &counter->lock, memory_order_acquire ) ) {
+    }
+    jobs_job_t* job = counter->waiting;
+    counter->waiting = NULL;
+    atomic_flag_clear_explicit( &counter->lock, memory_order_release );
+    atomic_fetch_sub( &counter->busy, 1 );
+    while ( job ) {
+        jobs_job_t* next = job->next;
+        _jobs_push( jobs, job );
+        job = next;
+    }
+}
+
+static void _jobs_execute( jobs_t* jobs, jobs_job_t* job ) {
+    // The counter is read first; the job may be reused once it is signalled.
+    jobs_counter_t* counter = job->counter;
+    job->fn( job->data );
+    atomic_fetch_add_explicit( &jobs->executed, 1, memory_order_relaxed );
+    if ( counter ) {
+        _jobs_signal( jobs, counter );
+    }
+}
+
+// Takes a job of the own deque or steals one. Returns NULL if there is none
+static jobs_job_t* _jobs_find( jobs_t* jobs ) {
+    jobs_job_t* job = _jobs_take_bottom( &jobs->deques[ _jobs_index ] );
+    if ( !job && jobs->num_threads > 1 ) {
+        // xorshift
+        _jobs_seed ^= _jobs_seed << 13;
+        _jobs_seed ^= _jobs_seed >> 17;
+        _jobs_seed ^= _jobs_seed << 5;
+        unsigned int first = _jobs_seed % jobs->num_threads;
+        for ( unsigned int i = 0; i < jobs->num_threads && !job; i++ ) {
+            unsigned int victim = ( first + i ) % jobs->num_threads;
+            if ( victim != ( unsigned int ) _jobs_index ) {
+                job = _jobs_steal_top( &jobs->deques[ victim ] );
+            }
+        }
+        if ( job ) {
+            atomic_fetch_add_explicit( &jobs->stolen, 1, memory_order_relaxed );
+        }
+    }
+    if ( job ) {
+        atomic_fetch_sub( &jobs->pending, 1 );
+    }
+    return job;
+}
+
+#ifdef THREADING
+static void* _jobs_work( void* arg ) {
+    jobs_worker_t* worker = ( jobs_worker_t* ) arg;
+    jobs_t* jobs = worker->jobs;
+    _jobs_owner = jobs;
+    _jobs_index = worker->index;
+    _jobs_seed = 2654435761u * ( worker->index + 1 );
+
+    unsigned int idle = 0;
+    while ( !atomic_load( &jobs->quit ) ) {
+        jobs_job_t* job = _jobs_find( jobs );
+        if ( job ) {
+            _jobs_execute( jobs, job );
+            idle = 0;
+            continue;
+        }
+        if ( ++idle < _JOBS_SPINS ) {
+            sched_yield();
+            continue;
+        }
+        pthread_mutex_lock( &jobs->mutex );
+        atomic_fetch_add( &jobs->sleepers, 1 );
+        while ( atomic_load( &jobs->pending ) <= 0 && !atomic_load( &jobs->quit ) ) {
+            pthread_cond_wait( &jobs->wake, &jobs->mutex );
+        }
+        atomic_fetch_sub( &jobs->sleepers, 1 );
+        pthread_mutex_unlock( &jobs->mutex );
+        idle = 0;
+    }
+    return NULL;
+}
+#endif
+
+//  ****************************************
+//   Interface
+//  ****************************************
+
+jobs_t* jobs_new( unsigned int num_threads ) {
+    jobs_t* jobs = ( jobs_t* ) mem_malloc( sizeof( jobs_t ) );
+    if ( !num_threads ) {
+        long cores = sysconf( _SC_NPROCESSORS_ONLN );
+        num_threads = cores > 0 ? ( unsigned int ) cores : 1;
+    }
+    if ( num_threads > JOBS_MAX_THREADS ) {
+        num_threads = JOBS_MAX_THREADS;
+    }
+#ifndef THREADING
+    num_threads = 1;
+#endif
+    jobs->num_threads = num_threads;
+    jobs->deques = ( jobs_deque_t* ) mem_malloc( num_threads * sizeof( jobs_deque_t ) );
+    for ( unsigned int i = 0; i < num_threads; i++ ) {
+        atomic_init( &jobs->deques[i].top, 0 );
+        atomic_init( &jobs->deques[i].bottom, 0 );
+    }
+    atomic_init( &jobs->pending, 0 );
+    atomic_init( &jobs->executed, 0 );
+    atomic_init( &jobs->stolen, 0 );
+    _jobs_owner = jobs;
+    _jobs_index = 0;
+
+#ifdef THREADING
+    pthread_mutex_init( &jobs->mutex, NULL );
+    pthread_cond_init( &jobs->wake, NULL );
+    atomic_init( &jobs->sleepers, 0 );
+    atomic_init( &jobs->quit, 0 );
+    // The deques of the threads that could not be started stay empty.
+    unsigned int started = 1;
+    for ( ; started < num_threads; started++ ) {
+        jobs->workers[ started ].jobs = jobs;
+        jobs->workers[ started ].index = started;
+        if ( pthread_create( &jobs->threads[ started ], NULL, _jobs_work, &jobs->workers[ started ] ) ) {
+            break;
+        }
+    }
+    jobs->num_started = started;
+#endif
+    return jobs;
+}
+
+void jobs_free( jobs_t* jobs ) {
+#ifdef THREADING
+    pthread_mutex_lock( &jobs->mutex );
+    atomic_store( &jobs->quit, 1 );
+    pthread_cond_broadcast( &jobs->wake );
+    pthread_mutex_unlock( &jobs->mutex );
+    for ( unsigned int i = 1; i < jobs->num_started; i++ ) {
+        pthread_join( jobs->threads[i], NULL );
+    }
+    pthread_mutex_destroy( &jobs->mutex );
+    pthread_cond_destroy( &jobs->wake );
+#endif
+    if ( _jobs_owner == jobs ) {
+        _jobs_owner = NULL;
+        _jobs_index = -1;
+    }
+    mem_free( jobs->deques );
+    mem_free( jobs );
+}
+
+void jobs_counter_init( jobs_counter_t* counter ) {
+    assert( counter && JOBS_NOCOUNTER );
+
+    atomic_init( &counter->value, 0 );
+    atomic_init( &counter->busy, 0 );
+    atomic_flag_clear( &counter->lock );
+    counter->waiting = NULL;
+}
+
+void jobs_submit( jobs_t* jobs, jobs_job_t* job ) {
+    assert( jobs && JOBS_NOJOBS );
+    assert( job && JOBS_NOJOB );
+    assert( _jobs_owner == jobs && JOBS_NOTMEMBER );
+
+    if ( job->counter ) {
+        atomic_fetch_add( &job->counter->value, 1 );
+    }
+    jobs_counter_t* after = job->after;
+    if ( after ) {
+        while ( atomic_flag_test_and_set_explicit( &after->lock, memory_order_acquire ) ) {
+        }
+        if ( atomic_load( &after->value ) > 0 ) {
+            job->next = after->waiting;
+            after->waiting = job;
+            atomic_flag_clear_explicit( &after->lock, memory_order_release );
+            return;
+        }
+        atomic_flag_clear_explicit( &after->lock, memory_order_release );
+    }
+    _jobs_push( jobs, job );
+}
+
+void jobs_wait( jobs_t* jobs, jobs_counter_t* counter ) {
+    assert( jobs && JOBS_NOJOBS );
+    assert( counter && JOBS_NOCOUNTER );
+    assert( _jobs_owner == jobs && JOBS_NOTMEMBER );
+
+    while ( atomic_load( &counter->value ) > 0 ) {
+        jobs_job_t* job = _jobs_find( jobs );
+        if ( job ) {
+            _jobs_execute( jobs, job );
+        } else {
+            sched_yield();
+        }
+    }
+    while ( atomic_load( &counter->busy ) > 0 ) {
+        sched_yield();
+    }
+}
+
+// Splits the upper halves of the range off to new jobs and runs the rest
+static void _jobs_for_part( void* data ) {
+    _jobs_range_t* range = ( _jobs_range_t* ) data;
+    _jobs_for_t* loop = range->loop;
+    while ( range->last - range->first > 1 ) {
+        unsigned int mid = ( range->first + range->last ) / 2;
+        _jobs_range_t* upper = &loop->ranges[ mid ];
+        upper->loop = loop;
+        upper->first = mid;
+        upper->last = range->last;
+        jobs_job_t* job = &loop->parts[ mid ];
+        job->fn = _jobs_for_part;
+        job->data = upper;
+        job->counter = &loop->counter;
+        job->after = NULL;
+        jobs_submit( loop->jobs, job );
+        range->last = mid;
+    }
+    unsigned int begin = range->first * loop->chunk;
+    unsigned int end = begin + loop->chunk;
+    loop->fn( loop->data, begin, end < loop->count ? end : loop->count );
+}
+
+void jobs_parallel_for( jobs_t* jobs, unsigned int count, unsigned int min_chunk,
+        jobs_range_fn_t fn, void* data ) {
+    assert( jobs && JOBS_NOJOBS );
+    assert( _jobs_owner == jobs && JOBS_NOTMEMBER );
+
+    if ( !count ) {
+        return;
+    }
+    if ( !min_chunk ) {
+        min_chunk = 1;
+    }
+    unsigned int max_chunks = jobs->num_threads * JOBS_CHUNKS_PER_THREAD;
+    unsigned int num_chunks = ( count + min_chunk - 1 ) / min_chunk;
+    if ( num_chunks > max_chunks ) {
+        num_chunks = max_chunks;
+    }
+    if ( num_chunks <= 1 || jobs->num_threads == 1 ) {
+        fn( data, 0, count );
+        return;
+    }
+
+    _jobs_for_t loop;
+    loop.jobs = jobs;
+    loop.fn = fn;
+    loop.data = data;
+    loop.count = count;
+    loop.chunk = ( count + num_chunks - 1 ) / num_chunks;
+    // The chunks may end early, when count is not divisible.
+    num_chunks = ( count + loop.chunk - 1 ) / loop.chunk;
+    jobs_counter_init( &loop.counter );
+
+    loop.ranges[0].loop = &loop;
+    loop.ranges[0].first = 0;
+    loop.ranges[0].last = num_chunks;
+    _jobs_for_part( &loop.ranges[0] );
+    jobs_wait( jobs, &loop.counter );
+}
+
+int jobs_thread_index( jobs_t* jobs ) {
+    return _jobs_owner == jobs ? _jobs_index : -1;
+}
@@ -0,0 +1,182 @@
+// Job system
+//
+// The job system runs small units of work, jobs, on a pool of threads, one
+// per core. The thread that creates the job system is the thread 0 of the
+// pool; it runs jobs too while it waits for them (jobs_wait), so nothing
+// is left idle.
+//
+// Each thread has a work-stealing deque (Chase-Lev). A thread pushes the
+// jobs it submits to the bottom of its own deque and takes them back from
+// the bottom, so the latest work, whose data is still in the cache, runs
+// first. A thread with nothing to do steals from the top of the deque of a
+// random other thread. The threads sleep when there are no jobs at all.
+//
+// A job is a function, a pointer to its data and two optional counters:
+//
+// counter  is incremented when the job is submitted and decremented when
+//          it has run. jobs_wait() waits until the counter is zero, so a
+//          counter shared by several jobs waits for all of them.
+// after    is the counter the job depends on. The job is held back until
+//          the counter is zero, and then submitted.
+//
+// The jobs and the counters are owned by the caller, so the job system does
+// not allocate memory after jobs_new(). A job must stay valid until its
+// counter has been waited for.
+//
+// jobs_parallel_for() runs a function over the range of indices. The range
+// is cut into chunks, a few per thread but no smaller than the given
+// minimum; the chunks are then split in halves recursively, so an idle
+// thread steals a large part of the range at once.
+//
+// Only the threads of the pool may submit jobs, i.e., the thread that
+// created the job system and the jobs themselves. Without THREADING (see
+// defs.h), the pool has only the thread 0.
+
+#ifndef _jobs_
+#define _jobs_
+
+#include <stdatomic.h>
+
+#include "./defs.h"
+
+#ifdef THREADING
+#include <pthread.h>
+#endif
+
+// Messages for the diagnostics
+#define JOBS_NOJOBS "Job system does not exist"
+#define JOBS_NOJOB "Job does not exist"
+#define JOBS_NOCOUNTER "Counter does not exist"
+#define JOBS_NOTMEMBER "Thread does not belong to the job system"
+
+#define JOBS_MAX_THREADS 16
+// The capacity of a deque, a power of two. The jobs that do not fit run
+// at once on the submitting thread
+#define JOBS_DEQUE_SIZE 4096
+// The number of the chunks of jobs_parallel_for() per thread
+#define JOBS_CHUNKS_PER_THREAD 4
+#define JOBS_MAX_CHUNKS ( JOBS_MAX_THREADS * JOBS_CHUNKS_PER_THREAD )
+
+struct jobs_job_t;
+
+typedef struct {
+    atomic_int value;
+    // The number of the threads that are decrementing the counter
+    atomic_int busy;
+    // The jobs that wait for the counter to reach zero
+    atomic_flag lock;
+    struct jobs_job_t* waiting;
+} jobs_counter_t;
+
+// A job
+//
+// @param data The data of the job
+typedef void ( *jobs_fn_t )( void* data );
+
+// A part of the range of jobs_parallel_for()
+//
+// @param data The data of the loop
+// @param begin The first index
+// @param end The index after the last one
+typedef void ( *jobs_range_fn_t )( void* data, unsigned int begin, unsigned int end );
+
+typedef struct jobs_job_t {
+    jobs_fn_t fn;
+    void* data;
+    jobs_counter_t* counter;
+    jobs_counter_t* after;
+    // The next job that waits for the same counter
+    struct jobs_job_t* next;
+} jobs_job_t;
+
+typedef struct {
+    atomic_long top;
+    // The top is stolen by the others, the bottom is owned by the thread
+    char padding[ 64 - sizeof( atomic_long ) ];
+    atomic_long bottom;
+    _Atomic( jobs_job_t* ) slots[ JOBS_DEQUE_SIZE ];
+} jobs_deque_t;
+
+struct jobs_t;
+
+// The start arguments of a thread
+typedef struct {
+    struct jobs_t* jobs;
+    int index;
+} jobs_worker_t;
+
+typedef struct jobs_t {
+    unsigned int num_threads;
+    jobs_deque_t* deques;
+    // The number of the submitted jobs that have not been taken
+    atomic_int pending;
+    // Statistics
+    atomic_uint executed;
+    atomic_uint stolen;
+#ifdef THREADING
+    pthread_t threads[ JOBS_MAX_THREADS ];
+    jobs_worker_t workers[ JOBS_MAX_THREADS ];
+    unsigned int num_started;
+    pthread_mutex_t mutex;
+    pthread_cond_t wake;
+    atomic_int sleepers;
+    atomic_int quit;
+#endif
+} jobs_t;
+
+// Creates a new job system and starts its threads
+//
+// The calling thread becomes the thread 0 of the pool.
+//
+// @param num_threads The number of the threads including the caller, or 0
+//                    for one per core. At most JOBS_MAX_THREADS
+// @return The pointer to the job system
+jobs_t* jobs_new( unsigned int num_threads );
+
+// Stops the threads and releases the job system
+//
+// @precondition There are no jobs left
+// @param jobs The pointer to the job system
+void jobs_free( jobs_t* jobs );
+
+// Initializes the counter to zero
+//
+// @param counter The pointer to the counter
+void jobs_counter_init( jobs_counter_t* counter );
+
+// Submits the job
+//
+// @precondition jobs != NULL
+// @precondition job != NULL
+// @precondition The caller is a thread of the pool
+// @param jobs The pointer to the job system
+// @param job The pointer to the job
+void jobs_submit( jobs_t* jobs, jobs_job_t* job );
+
+// Runs the jobs until the counter is zero
+//
+// @precondition jobs != NULL
+// @precondition counter != NULL
+// @precondition The caller is a thread of the pool
+// @param jobs The pointer to the job system
+// @param counter The pointer to the counter
+void jobs_wait( jobs_t* jobs, jobs_counter_t* counter );
+
+// Runs the function over the indices [0, count) and waits for it
+//
+// @precondition jobs != NULL
+// @precondition The caller is a thread of the pool
+// @param jobs The pointer to the job system
+// @param count The number of the indices
+// @param min_chunk The min number of the indices per call
+// @param fn The function that is called for each part of the range
+// @param data The data that is passed to the function
+void jobs_parallel_for( jobs_t* jobs, unsigned int count, unsigned int min_chunk,
+        jobs_range_fn_t fn, void* data );
+
+// @param jobs The pointer to the job system
+// @return The index of the calling thread in the pool, or -1 if the thread
+//         does not belong to it
+int jobs_thread_index( jobs_t* jobs );
+
+#endif // _jobs_
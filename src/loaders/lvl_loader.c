@@ -1,7 +1,357 @@
-#include "lvl_loader.h"
+// Level loader
+//
+// [Implementation details]
+//
+// The sections are read from the tokens of sjson_parse(). A section is the
+// first key of its name at the top level of the file; the keys of the
+// nested objects and the strings do not count. The parse stops at the end
+// of the section or at its first invalid member. The members that the
+// loader does not know are skipped.
+//
+// The tile map section is read in two passes: the first one validates the
+// members and measures the rows, the second one sets the solid tiles of the
+// map that the first pass sized.
+//
+// The state machine section is read into the tables of a definition, which
+// fsm_new() validates and compiles; the tables are released after that.
 
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
 
-void parse(char *buf) {
+#include "../fsm.h"
+#include "../mem.h"
+#include "../profiler.h"
+#include "../tilemap.h"
+#include "../parsers/sjson.h"
+#include "./lvl_loader.h"
 
-	for
+// The states of a section
+#define _SECTION_BEFORE 0
+#define _SECTION_OPEN   1
+#define _SECTION_IN     2
+#define _SECTION_DONE   3
+
+// The reader of a section, the object of a top-level key
+//
+// The depth of a token is the number of the objects and the arrays that
+// enclose it; the brackets of an array are at the depth of the array. So
+// the members of the section are at the depth 1. The member is the index
+// of the key of the current member in the members, or -1 if it is not one
+// of them.
+typedef struct {
+    const char* name;
+    const char* const* members;
+    unsigned int num_members;
+    int state;
+    int valid;
+    unsigned int depth;
+    int member;
+} _section_t;
+
+static void _section_init( _section_t* s, const char* name, const char* const* members,
+        unsigned int num_members ) {
+    s->name = name;
+    s->members = members;
+    s->num_members = num_members;
+    s->state = _SECTION_BEFORE;
+    s->valid = 1;
+    s->depth = 0;
+    s->member = -1;
+}
+
+static int _matches( const char* name, const char* text, size_t length ) {
+    return strlen( name ) == length && !strncmp( name, text, length );
+}
+
+// Follows the token through the section. Returns the depth of the token
+// if it belongs to the value of a member, or 0 if the section itself takes
+// it
+static unsigned int _section_token( _section_t* s, const sjson_token_t* token, const char* text ) {
+    if ( token->type == SJSON_END_OBJECT || token->type == SJSON_END_ARRAY ) {
+        s->depth--;
+    }
+    unsigned int depth = s->depth;
+    if ( token->type == SJSON_BEGIN_OBJECT || token->type == SJSON_BEGIN_ARRAY ) {
+        s->depth++;
+    }
+
+    if ( s->state == _SECTION_BEFORE ) {
+        if ( depth == 0 && token->type == SJSON_KEY && _matches( s->name, text, token->length ) ) {
+            s->state = _SECTION_OPEN;
+        }
+        return 0;
+    }
+    if ( s->state == _SECTION_OPEN ) {
+        s->state = _SECTION_IN;
+        s->valid = token->type == SJSON_BEGIN_OBJECT;
+        return 0;
+    }
+    if ( depth == 0 ) {
+        s->state = _SECTION_DONE;
+        return 0;
+    }
+    if ( depth == 1 && token->type == SJSON_KEY ) {
+        s->member = -1;
+        for ( unsigned int i = 0; i < s->num_members; i++ ) {
+            if ( _matches( s->members[i], text, token->length ) ) {
+                s->member = ( int ) i;
+            }
+        }
+        return 0;
+    }
+    return depth;
+}
+
+// Parses the level for the section. Returns nonzero if the section was
+// found whole and valid
+static int _section_parse( _section_t* s, const char* buf, sjson_handler_t handler, void* user ) {
+    sjson_parse( buf, strlen( buf ), handler, user );
+    return s->state == _SECTION_DONE && s->valid;
+}
+
+// Reads the integer of the number token. Returns zero if it is not one
+static int _integer( const sjson_token_t* token, const char* text, long* value ) {
+    char digits[ 24 ];
+    if ( token->type != SJSON_NUMBER || token->length >= sizeof( digits ) ) {
+        return 0;
+    }
+    memcpy( digits, text, token->length );
+    digits[ token->length ] = '\0';
+    char* end;
+    *value = strtol( digits, &end, 10 );
+    return end != digits && *end == '\0';
+}
+
+// The members of the tile map section
+#define _TILEMAP_X      0
+#define _TILEMAP_Y      1
+#define _TILEMAP_TILE   2
+#define _TILEMAP_ROWS   3
+
+static const char* const _tilemap_members[] = { "x", "y", "tile", "rows" };
+
+typedef struct {
+    _section_t section;
+    long values[3];
+    int has_rows;
+    unsigned int width;
+    unsigned int height;
+    // The map of the second pass, or NULL in the first pass
+    tilemap_t* map;
+} _tilemap_reader_t;
+
+static int _tilemap_token( void* user, const sjson_token_t* token, const char* text ) {
+    _tilemap_reader_t* r = ( _tilemap_reader_t* ) user;
+    _section_t* s = &r->section;
+    unsigned int depth = _section_token( s, token, text );
+    if ( !depth ) {
+        return s->state == _SECTION_DONE || !s->valid;
+    }
+    switch ( s->member ) {
+        case _TILEMAP_X:
+        case _TILEMAP_Y:
+        case _TILEMAP_TILE:
+            s->valid = depth == 1 && _integer( token, text, &r->values[ s->member ] );
+            break;
+        case _TILEMAP_ROWS:
+            if ( depth == 1 && token->type == SJSON_BEGIN_ARRAY ) {
+                s->valid = !r->has_rows;
+                r->has_rows = 1;
+            } else if ( depth == 2 && token->type == SJSON_STRING ) {
+                if ( r->height > 0 && token->length != r->width ) {
+                    s->valid = 0;
+                    break;
+                }
+                if ( r->map ) {
+                    for ( unsigned int tx = 0; tx < token->length; tx++ ) {
+                        if ( text[tx] == '#' ) {
+                            tilemap_set( r->map, tx, r->height, 1 );
+                        }
+                    }
+                }
+                r->width = ( unsigned int ) token->length;
+                r->height++;
+            } else {
+                s->valid = depth == 1 && token->type == SJSON_END_ARRAY;
+            }
+            break;
+        default:
+            // The other members are skipped
+            break;
+    }
+    return !s->valid;
+}
+
+static int _tilemap_pass( _tilemap_reader_t* r, const char* buf, tilemap_t* map ) {
+    _section_init( &r->section, "tilemap", _tilemap_members, 4 );
+    r->values[ _TILEMAP_X ] = 0;
+    r->values[ _TILEMAP_Y ] = 0;
+    r->values[ _TILEMAP_TILE ] = 0;
+    r->has_rows = 0;
+    r->width = 0;
+    r->height = 0;
+    r->map = map;
+    return _section_parse( &r->section, buf, _tilemap_token, r );
+}
+
+tilemap_t* lvl_load_tilemap( const char* buf ) {
+    PROF_ZONE( "lvl_load_tilemap" );
+    _tilemap_reader_t reader;
+    if ( !_tilemap_pass( &reader, buf, NULL ) ) {
+        return NULL;
+    }
+    long x0 = reader.values[ _TILEMAP_X ];
+    long y0 = reader.values[ _TILEMAP_Y ];
+    long tile = reader.values[ _TILEMAP_TILE ];
+    if ( !reader.has_rows || tile <= 0 || ( tile & ( tile - 1 ) ) ) {
+        return NULL;
+    }
+
+    if ( tile > ( 1L << TILEMAP_MAX_TILE_BITS ) ) {
+        return NULL;
+    }
+    unsigned int tile_bits = 0;
+    while ( ( 1L << tile_bits ) < tile ) {
+        tile_bits++;
+    }
+    // The whole map is in the int coordinates of the world.
+    if ( x0 < INT_MIN || y0 < INT_MIN
+            || x0 + ( ( long long ) reader.width << tile_bits ) > INT_MAX
+            || y0 + ( ( long long ) reader.height << tile_bits ) > INT_MAX ) {
+        return NULL;
+    }
+    tilemap_t* map = tilemap_new( reader.width, reader.height, ( int ) x0, ( int ) y0, tile_bits );
+    // The first pass has validated the section
+    _tilemap_pass( &reader, buf, map );
+    return map;
+}
+
+// The members of the state machine section
+#define _FSM_INITIAL        0
+#define _FSM_EVENTS         1
+#define _FSM_STATES         2
+#define _FSM_TRANSITIONS    3
+
+static const char* const _fsm_members[] = { "initial", "events", "states", "transitions" };
+
+typedef struct {
+    _section_t section;
+    long initial;
+    long num_events;
+    // The tuples of the states and the transitions and the field of the
+    // current tuple
+    int ( *tuples[2] )[4];
+    unsigned int max_tuples[2];
+    unsigned int num_tuples[2];
+    unsigned int field;
+} _fsm_reader_t;
+
+static int _fsm_token( void* user, const sjson_token_t* token, const char* text ) {
+    _fsm_reader_t* r = ( _fsm_reader_t* ) user;
+    _section_t* s = &r->section;
+    unsigned int depth = _section_token( s, token, text );
+    if ( !depth ) {
+        return s->state == _SECTION_DONE || !s->valid;
+    }
+    if ( s->member == _FSM_INITIAL ) {
+        s->valid = depth == 1 && _integer( token, text, &r->initial );
+    } else if ( s->member == _FSM_EVENTS ) {
+        s->valid = depth == 1 && _integer( token, text, &r->num_events );
+    } else if ( s->member == _FSM_STATES || s->member == _FSM_TRANSITIONS ) {
+        // An array of the arrays of four integers
+        unsigned int list = s->member == _FSM_STATES ? 0 : 1;
+        long value;
+        if ( depth == 1 && token->type == SJSON_BEGIN_ARRAY ) {
+            r->num_tuples[ list ] = 0;
+        } else if ( depth == 2 && token->type == SJSON_BEGIN_ARRAY ) {
+            s->valid = r->num_tuples[ list ] < r->max_tuples[ list ];
+            r->field = 0;
+        } else if ( depth == 3 && _integer( token, text, &value ) ) {
+            s->valid = r->field < 4 && value >= -1 && value < FSM_NONE;
+            if ( s->valid ) {
+                r->tuples[ list ][ r->num_tuples[ list ] ][ r->field++ ] = ( int ) value;
+            }
+        } else if ( depth == 2 && token->type == SJSON_END_ARRAY ) {
+            s->valid = r->field == 4;
+            r->num_tuples[ list ]++;
+        } else {
+            s->valid = depth == 1 && token->type == SJSON_END_ARRAY;
+        }
+    }
+    return !s->valid;
+}
+
+// The state or the action of the index, -1 for none
+static unsigned char _fsm_index( int index ) {
+    return index < 0 ? FSM_NONE : ( unsigned char ) index;
+}
+
+static fsm_action_t _fsm_action( int index, const fsm_action_t* actions, unsigned int num_actions, int* valid ) {
+    if ( index < 0 ) {
+        return NULL;
+    }
+    if ( ( unsigned int ) index >= num_actions ) {
+        *valid = 0;
+        return NULL;
+    }
+    return actions[ index ];
+}
+
+fsm_machine_t* lvl_load_fsm( const char* buf, const fsm_action_t* actions, unsigned int num_actions ) {
+    PROF_ZONE( "lvl_load_fsm" );
+    _fsm_reader_t reader;
+    _section_init( &reader.section, "fsm", _fsm_members, 4 );
+    reader.initial = -1;
+    reader.num_events = -1;
+    int ( *states )[4] = ( int (*)[4] ) mem_malloc( FSM_MAX_STATES * sizeof( int[4] ) );
+    int ( *transitions )[4] = ( int (*)[4] ) mem_malloc( FSM_MAX_TRANSITIONS * sizeof( int[4] ) );
+    reader.tuples[0] = states;
+    reader.tuples[1] = transitions;
+    reader.max_tuples[0] = FSM_MAX_STATES;
+    reader.max_tuples[1] = FSM_MAX_TRANSITIONS;
+    reader.num_tuples[0] = 0;
+    reader.num_tuples[1] = 0;
+    reader.field = 0;
+    int valid = _section_parse( &reader.section, buf, _fsm_token, &reader );
+    long initial = reader.initial;
+    long num_events = reader.num_events;
+    unsigned int num_states = reader.num_tuples[0];
+    unsigned int num_transitions = reader.num_tuples[1];
+    valid = valid && initial >= 0 && initial < FSM_NONE && num_events >= 0 && num_events <= FSM_MAX_EVENTS;
+
+    fsm_machine_t* machine = NULL;
+    if ( valid ) {
+        fsm_state_t* def_states = ( fsm_state_t* ) mem_malloc( ( num_states + 1 ) * sizeof( fsm_state_t ) );
+        fsm_transition_t* def_transitions =
+            ( fsm_transition_t* ) mem_malloc( ( num_transitions + 1 ) * sizeof( fsm_transition_t ) );
+        for ( unsigned int i = 0; i < num_states; i++ ) {
+            def_states[i].parent = _fsm_index( states[i][0] );
+            def_states[i].initial = _fsm_index( states[i][1] );
+            def_states[i].enter = _fsm_action( states[i][2], actions, num_actions, &valid );
+            def_states[i].exit = _fsm_action( states[i][3], actions, num_actions, &valid );
+        }
+        for ( unsigned int i = 0; i < num_transitions; i++ ) {
+            // A missing state is out of range; fsm_new() rejects it.
+            def_transitions[i].state = _fsm_index( transitions[i][0] );
+            def_transitions[i].event = _fsm_index( transitions[i][1] );
+            def_transitions[i].target = _fsm_index( transitions[i][2] );
+            def_transitions[i].action = _fsm_action( transitions[i][3], actions, num_actions, &valid );
+        }
+        if ( valid ) {
+            fsm_def_t def;
+            def.states = def_states;
+            def.num_states = num_states;
+            def.transitions = def_transitions;
+            def.num_transitions = num_transitions;
+            def.num_events = ( unsigned int ) num_events;
+            def.initial = ( unsigned char ) initial;
+            machine = fsm_new( &def );
+        }
+        mem_free( def_transitions );
+        mem_free( def_states );
+    }
+    mem_free( transitions );
+    mem_free( states );
+    return machine;
 }
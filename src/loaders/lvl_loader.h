@@ -1,6 +1,50 @@
+// Level loader
+//
+// A level is written in the semi-json format (see parsers/sjson.h). A
+// section is a top-level member of the file whose value is an object; the
+// first one of its name counts. The static geometry of the level is the
+// section
+//
+//   "tilemap":{ "x":0 "y":0 "tile":16 "rows":[ "####" "#..#" "####" ] }
+//
+// where x and y are the top-left corner of the map in the world, tile is the
+// size of a tile, a power of two up to 2^TILEMAP_MAX_TILE_BITS, and each
+// string of the rows is a row of tiles. '#' is a solid tile; any other
+// character is an empty one. All rows must be equally long, and the whole
+// map must be in the int coordinates of the world. The commas between the
+// members are optional.
+//
+// A state machine of the level (see fsm.h) is the section
+//
+//   "fsm":{ "initial":1 "events":3
+//           "states":[ [ -1 1 -1 -1 ] [ 0 -1 0 -1 ] [ -1 -1 1 -1 ] ]
+//           "transitions":[ [ 0 2 2 2 ] ] }
+//
+// where each state is [ parent initial enter exit ] and each transition is
+// [ state event target action ]. The states are the indices of the states
+// array and the actions are the indices of the actions that the game gives
+// to the loader; -1 is none.
+
 #ifndef lvl_loader
 #define lvl_loader
 
-void parse(char *buf);
+#include "../fsm.h"
+#include "../tilemap.h"
+
+// Loads the tile map of the level
+//
+// @param buf The contents of the level file, a null-terminated string
+// @return The pointer to a new map, or NULL if the level has no valid
+//         tile map section
+tilemap_t* lvl_load_tilemap( const char* buf );
+
+// Loads the state machine of the level
+//
+// @param buf The contents of the level file, a null-terminated string
+// @param actions The actions that the indices of the section refer to
+// @param num_actions The number of the actions
+// @return The pointer to a new machine, or NULL if the level has no valid
+//         state machine section
+fsm_machine_t* lvl_load_fsm( const char* buf, const fsm_action_t* actions, unsigned int num_actions );
 
-#endif // lvl_loader
\ No newline at end of file
+#endif // lvl_loader
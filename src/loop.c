@@ -1,10 +1,596 @@
+// Main loop
+//
+// The loop owns the scene, i.e., the game objects, the entities and the
+// physics world, and drives them with a fixed timestep. The input and the
+// random numbers of the game logic come from the loop, so a frame depends
+// only on the state and the input of loop_set_input().
+//
+// The game objects are kept in a bucket per type, and each bucket is
+// updated as a contiguous slice, so the same update code runs for all
+// objects of a type in a row. The objects are added to and removed from
+// the buckets at the end of the frame, so the buckets do not change under
+// the updates. The objects of loop_spawn() live in a fixed pool and are
+// referenced by handles, so a despawned object is neither reallocated nor
+// reached through a stale reference.
+//
+// The scripts of the entities are run archetype by archetype, and the
+// structural changes that they make through loop_commands() are applied
+// after the step. The coroutines of loop_coros() that wake in the step are
+// resumed after the scripts.
+//
+// The work that may slip to later frames is left to the scheduler, which
+// runs after the steps within its budget. The events of the frame are
+// collected into the channels of loop_events() and delivered in batches at
+// the phase points of the step and the frame.
+//
+// The parallel work of the frame, e.g., the broadphase and the solver, runs
+// on the job system of the loop, whose thread 0 is the thread that called
+// init().
+//
+// After each physics step, the bodies are sorted into the quad tree and the
+// candidate pairs, collected by the parallel broadphase, are fed to the
+// contact cache, whose events are available through loop_contacts(). The
+// touching bodies are then grouped into islands for sleeping and their
+// contacts are resolved by the solver, island by island. The projectiles
+// are moved with the bodies and tested against the same tree; their hits
+// are available through loop_projectiles(). The tile map of the level, if
+// any, is tested against the bodies next to the broadphase; its hits are
+// available through loop_tilemap().
+//
+// The hot fields of the bodies and the objects are published at the end of
+// the frame into double buffers, which the readers may read during the
+// next frame. The rendering is expected to call timestep_alpha() after
+// loop() and blend the bodies with physics_interpolate().
 
-// Make the execution environment
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
-// Main loop
+#include "./broadphase.h"
+#include "./contacts.h"
+#include "./coro.h"
+#include "./defs.h"
+#include "./ecs.h"
+#include "./events.h"
+#include "./game.h"
+#include "./jobs.h"
+#include "./mem.h"
+#include "./physics.h"
+#include "./profiler.h"
+#include "./projectiles.h"
+#include "./scheduler.h"
+#include "./solver.h"
+#include "./tilemap.h"
+#include "./timestep.h"
+#include "./data_structures/double_buffer.h"
+#include "./data_structures/pool.h"
+#include "./data_structures/quad_tree.h"
+
+static timestep_t _loop_timestep;
+static game_input_t _loop_input;
+// The state of the xorshift generator of loop_rand()
+static unsigned int _loop_random = GAME_DEFAULT_SEED;
+
+// The objects of one type
+typedef struct {
+    game_obj_t** objs;
+    unsigned int capacity;
+    game_batch_t batch;
+    game_type_stats_t stats;
+} _loop_bucket_t;
+
+// An addition or a removal at the end of the frame. The handle of a
+// spawned object is released with its removal
+typedef struct {
+    game_obj_t* obj;
+    int handle;
+    int add;
+} _loop_pending_t;
+
+static _loop_bucket_t _loop_buckets[ GAME_MAX_TYPES ];
+static _loop_pending_t* _loop_pending = NULL;
+static unsigned int _loop_num_pending = 0;
+static unsigned int _loop_max_pending = 0;
+static pool_t* _loop_objs = NULL;
+static jobs_t* _loop_jobs = NULL;
+static ecs_t* _loop_ecs = NULL;
+static ecs_commands_t* _loop_commands = NULL;
+static physics_world_t* _loop_world = NULL;
+static qtree_t* _loop_bsp = NULL;
+static broadphase_t* _loop_broadphase = NULL;
+static physics_pairs_t* _loop_pairs = NULL;
+static contacts_t* _loop_contacts = NULL;
+static solver_t* _loop_solver = NULL;
+static projectile_pool_t* _loop_projectiles = NULL;
+static tilemap_t* _loop_tilemap = NULL;
+static scheduler_t* _loop_scheduler = NULL;
+static events_t* _loop_events = NULL;
+static coro_sched_t* _loop_coros = NULL;
+static dblbuf_t* _loop_body_states = NULL;
+static dblbuf_t* _loop_obj_states = NULL;
+
+static unsigned long long _loop_now_ns() {
+    struct timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return ( unsigned long long ) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+// Updates the objects type by type
+static void _loop_update( int dt ) {
+    for ( unsigned int type = 0; type < GAME_MAX_TYPES; type++ ) {
+        _loop_bucket_t* bucket = &_loop_buckets[ type ];
+        unsigned int count = bucket->stats.count;
+        if ( !count ) {
+            continue;
+        }
+        unsigned long long start = _loop_now_ns();
+        if ( bucket->batch ) {
+            bucket->batch( bucket->objs, count, dt );
+        } else {
+            for ( unsigned int i = 0; i < count; i++ ) {
+                if ( bucket->objs[i]->update ) {
+                    bucket->objs[i]->update( dt );
+                }
+            }
+        }
+        unsigned long long elapsed = _loop_now_ns() - start;
+        bucket->stats.batches++;
+        bucket->stats.frame_ns += elapsed;
+        bucket->stats.total_ns += elapsed;
+    }
+}
+
+// Adds and removes the objects of the frame in the order of the calls
+//
+// An object keeps the bucket and the place where it joined, so it is
+// removed from there in constant time even if its type has changed since.
+static void _loop_apply_pending() {
+    for ( unsigned int i = 0; i < _loop_num_pending; i++ ) {
+        game_obj_t* obj = _loop_pending[i].obj;
+        if ( _loop_pending[i].add ) {
+            _loop_bucket_t* bucket = &_loop_buckets[ obj->type ];
+            if ( bucket->stats.count == bucket->capacity ) {
+                unsigned int capacity = bucket->capacity ? 2 * bucket->capacity : 16;
+                game_obj_t** objs = ( game_obj_t** ) mem_malloc( capacity * sizeof( game_obj_t* ) );
+                if ( bucket->objs ) {
+                    memcpy( objs, bucket->objs, bucket->stats.count * sizeof( game_obj_t* ) );
+                    mem_free( bucket->objs );
+                }
+                bucket->objs = objs;
+                bucket->capacity = capacity;
+            }
+            obj->bucket = obj->type;
+            obj->slot = bucket->stats.count;
+            bucket->objs[ bucket->stats.count++ ] = obj;
+            continue;
+        }
+        // An object that is not in its bucket, e.g., one removed twice, is
+        // skipped
+        if ( obj->bucket < 0 || obj->bucket >= GAME_MAX_TYPES ) {
+            continue;
+        }
+        _loop_bucket_t* bucket = &_loop_buckets[ obj->bucket ];
+        if ( obj->slot >= bucket->stats.count || bucket->objs[ obj->slot ] != obj ) {
+            continue;
+        }
+        // The last object of the bucket takes the place of the removed one
+        game_obj_t* last = bucket->objs[ --bucket->stats.count ];
+        bucket->objs[ obj->slot ] = last;
+        last->slot = obj->slot;
+        if ( _loop_pending[i].handle != POOL_NONE ) {
+            pool_release( _loop_objs, _loop_pending[i].handle );
+        }
+    }
+    _loop_num_pending = 0;
+}
+
+static void _loop_defer( game_obj_t* obj, int handle, int add ) {
+    assert( ( !add || ( obj->type >= 0 && obj->type < GAME_MAX_TYPES ) ) && GAME_BADTYPE );
+
+    if ( _loop_num_pending == _loop_max_pending ) {
+        unsigned int capacity = _loop_max_pending ? 2 * _loop_max_pending : 64;
+        _loop_pending_t* pending = ( _loop_pending_t* ) mem_malloc( capacity * sizeof( _loop_pending_t ) );
+        if ( _loop_pending ) {
+            memcpy( pending, _loop_pending, _loop_num_pending * sizeof( _loop_pending_t ) );
+            mem_free( _loop_pending );
+        }
+        _loop_pending = pending;
+        _loop_max_pending = capacity;
+    }
+    _loop_pending[ _loop_num_pending ].obj = obj;
+    _loop_pending[ _loop_num_pending ].handle = handle;
+    _loop_pending[ _loop_num_pending ].add = add;
+    _loop_num_pending++;
+}
+
+// Runs the update of each script of the archetype
+static void _loop_scripts( ecs_archetype_t* a, void* user ) {
+    int dt = *( int* ) user;
+    game_script_t* scripts = ecs_column( a, GAME_SCRIPT, game_script_t );
+    for ( unsigned int i = 0; i < a->count; i++ ) {
+        if ( scripts[i].update ) {
+            scripts[i].update( dt );
+        }
+    }
+}
+
+// Writes the states of the bodies [begin, end) that changed. A sleeping
+// body at the same index as in the previous frame has not moved
+static void _loop_publish_bodies( void* data, unsigned int begin, unsigned int end ) {
+    ( void ) data;
+    for ( unsigned int i = begin; i < end; i++ ) {
+        physics_body_t* body = &_loop_world->bodies[i];
+        const game_body_state_t* prev = ( const game_body_state_t* ) dblbuf_peek( _loop_body_states, i );
+        int guid = _loop_world->objs[i].guid;
+        // A sleeping body may still be moved by the game, so it is compared
+        // like the others.
+        if ( prev->guid == guid && prev->x == body->x && prev->y == body->y && prev->vx == body->vx
+                && prev->vy == body->vy && prev->w == body->w && prev->h == body->h ) {
+            continue;
+        }
+        game_body_state_t* state = ( game_body_state_t* ) dblbuf_write( _loop_body_states, i );
+        state->guid = guid;
+        state->x = body->x;
+        state->y = body->y;
+        state->vx = body->vx;
+        state->vy = body->vy;
+        state->w = body->w;
+        state->h = body->h;
+    }
+}
+
+// Writes the states of the objects that changed and flips the buffers
+static void _loop_publish() {
+    dblbuf_resize( _loop_body_states, _loop_world->count );
+    jobs_parallel_for( _loop_jobs, _loop_world->count, GAME_PUBLISH_CHUNK, _loop_publish_bodies, NULL );
+
+    unsigned int count = 0;
+    for ( unsigned int type = 0; type < GAME_MAX_TYPES; type++ ) {
+        count += _loop_buckets[ type ].stats.count;
+    }
+    count = count < GAME_MAX_OBJ_STATES ? count : GAME_MAX_OBJ_STATES;
+    dblbuf_resize( _loop_obj_states, count );
+    unsigned int index = 0;
+    for ( unsigned int type = 0; type < GAME_MAX_TYPES; type++ ) {
+        _loop_bucket_t* bucket = &_loop_buckets[ type ];
+        for ( unsigned int i = 0; i < bucket->stats.count && index < count; i++, index++ ) {
+            game_obj_t* obj = bucket->objs[i];
+            const game_obj_state_t* prev = ( const game_obj_state_t* ) dblbuf_peek( _loop_obj_states, index );
+            if ( prev->handle == obj->handle && prev->type == obj->type && prev->x == obj->x
+                    && prev->y == obj->y && prev->w == obj->w && prev->h == obj->h ) {
+                continue;
+            }
+            game_obj_state_t* state = ( game_obj_state_t* ) dblbuf_write( _loop_obj_states, index );
+            state->handle = obj->handle;
+            state->type = obj->type;
+            state->x = obj->x;
+            state->y = obj->y;
+            state->w = obj->w;
+            state->h = obj->h;
+        }
+    }
+
+    dblbuf_swap( _loop_body_states );
+    dblbuf_swap( _loop_obj_states );
+}
+
+static void _loop_collide() {
+    physics_clear_bsp( _loop_bsp );
+    physics_construct_bsp( _loop_bsp, _loop_world );
+    projectiles_collide( _loop_projectiles, _loop_bsp );
+    physics_pairs_clear( _loop_pairs );
+    broadphase_collect( _loop_broadphase, _loop_bsp, _loop_pairs );
+    if ( _loop_tilemap ) {
+        tilemap_collide( _loop_tilemap, _loop_world );
+    }
+    contacts_update( _loop_contacts, _loop_world, _loop_pairs );
+    contacts_islands( _loop_contacts, _loop_world );
+    solver_solve( _loop_solver, _loop_contacts, _loop_world );
+}
+
+int init() {
+    timestep_init( &_loop_timestep, TIMESTEP_DEFAULT_RATE, TIMESTEP_DEFAULT_MAX_STEPS );
+    memset( &_loop_input, 0, sizeof( game_input_t ) );
+    _loop_random = GAME_DEFAULT_SEED;
+    memset( _loop_buckets, 0, sizeof( _loop_buckets ) );
+    _loop_num_pending = 0;
+    _loop_objs = pool_new( sizeof( game_obj_t ), GAME_MAX_OBJECTS );
+    _loop_jobs = jobs_new( GAME_THREADS );
+    _loop_ecs = ecs_new( GAME_MAX_ENTITIES );
+    int position = ecs_component( _loop_ecs, sizeof( game_position_t ) );
+    int size = ecs_component( _loop_ecs, sizeof( game_size_t ) );
+    int velocity = ecs_component( _loop_ecs, sizeof( game_velocity_t ) );
+    int type = ecs_component( _loop_ecs, sizeof( game_type_t ) );
+    int script = ecs_component( _loop_ecs, sizeof( game_script_t ) );
+    assert( position == GAME_POSITION && size == GAME_SIZE && velocity == GAME_VELOCITY
+        && type == GAME_TYPE && script == GAME_SCRIPT );
+    _loop_commands = ecs_commands_new( _loop_ecs );
+    _loop_world = physics_world_new( GAME_MAX_BODIES );
+    _loop_bsp = qtree_new();
+    _loop_broadphase = broadphase_new( BROADPHASE_DEFAULT_LEVEL, _loop_jobs );
+    _loop_pairs = physics_pairs_new( GAME_MAX_BODIES );
+    _loop_contacts = contacts_new( GAME_MAX_BODIES );
+    _loop_solver = solver_new( _loop_jobs );
+    _loop_projectiles = projectiles_new( GAME_MAX_PROJECTILES,
+        GAME_PROJECTILE_SIZE, GAME_PROJECTILE_SIZE,
+        PHYSICS_CATEGORY_DEFAULT, PHYSICS_MASK_ALL );
+    _loop_scheduler = scheduler_new( NULL );
+    _loop_events = events_new();
+    _loop_coros = coro_sched_new();
+    _loop_body_states = dblbuf_new( sizeof( game_body_state_t ), GAME_MAX_BODIES );
+    _loop_obj_states = dblbuf_new( sizeof( game_obj_state_t ), GAME_MAX_OBJ_STATES );
+    return GAME_SUCCESS;
+}
+
+void quit() {
+    for ( unsigned int type = 0; type < GAME_MAX_TYPES; type++ ) {
+        if ( _loop_buckets[ type ].objs ) {
+            mem_free( _loop_buckets[ type ].objs );
+        }
+    }
+    memset( _loop_buckets, 0, sizeof( _loop_buckets ) );
+    if ( _loop_pending ) {
+        mem_free( _loop_pending );
+    }
+    ecs_commands_free( _loop_commands );
+    ecs_free( _loop_ecs );
+    physics_world_free( _loop_world );
+    physics_free_bsp( _loop_bsp );
+    broadphase_free( _loop_broadphase );
+    physics_pairs_free( _loop_pairs );
+    contacts_free( _loop_contacts );
+    solver_free( _loop_solver );
+    projectiles_free( _loop_projectiles );
+    if ( _loop_tilemap ) {
+        tilemap_free( _loop_tilemap );
+    }
+    scheduler_free( _loop_scheduler );
+    events_free( _loop_events );
+    coro_sched_free( _loop_coros );
+    dblbuf_free( _loop_body_states );
+    dblbuf_free( _loop_obj_states );
+    jobs_free( _loop_jobs );
+    pool_free( _loop_objs );
+    _loop_pending = NULL;
+    _loop_num_pending = 0;
+    _loop_max_pending = 0;
+    _loop_ecs = NULL;
+    _loop_commands = NULL;
+    _loop_world = NULL;
+    _loop_bsp = NULL;
+    _loop_broadphase = NULL;
+    _loop_pairs = NULL;
+    _loop_contacts = NULL;
+    _loop_solver = NULL;
+    _loop_projectiles = NULL;
+    _loop_tilemap = NULL;
+    _loop_scheduler = NULL;
+    _loop_events = NULL;
+    _loop_coros = NULL;
+    _loop_body_states = NULL;
+    _loop_obj_states = NULL;
+    _loop_jobs = NULL;
+    _loop_objs = NULL;
+}
+
+int loop( int dt ) {
+    // The zones of the previous frame
+    PROF_FRAME();
+    PROF_ZONE( "loop" );
+    unsigned int steps = timestep_advance( &_loop_timestep, dt );
+    int step_dt = timestep_dt( &_loop_timestep );
+
+    for ( unsigned int type = 0; type < GAME_MAX_TYPES; type++ ) {
+        _loop_buckets[ type ].stats.frame_ns = 0;
+    }
+    for ( unsigned int i = 0; i < steps; i++ ) {
+        PROF_BEGIN( "loop_step" );
+        PROF_BEGIN( "loop_update" );
+        _loop_update( step_dt );
+        ecs_run( _loop_ecs, ecs_bit( GAME_SCRIPT ), _loop_scripts, &step_dt );
+        coro_tick( _loop_coros );
+        events_dispatch( _loop_events, GAME_PHASE_UPDATE );
+        PROF_END();
+        PROF_BEGIN( "physics_step" );
+        physics_step( _loop_world );
+        projectiles_step( _loop_projectiles );
+        PROF_END();
+        PROF_BEGIN( "loop_collide" );
+        _loop_collide();
+        events_dispatch( _loop_events, GAME_PHASE_PHYSICS );
+        PROF_END();
+        ecs_commands_flush( _loop_commands );
+        PROF_END();
+    }
+    _loop_apply_pending();
+    events_dispatch( _loop_events, GAME_PHASE_FRAME );
+    PROF_BEGIN( "loop_scheduler" );
+    scheduler_run( _loop_scheduler, GAME_SCHEDULER_BUDGET_NS );
+    PROF_END();
+    events_frame( _loop_events );
+    PROF_BEGIN( "loop_publish" );
+    _loop_publish();
+    PROF_END();
+
+    return GAME_SUCCESS;
+}
+
+void loop_add( game_obj_t* obj ) {
+    obj->handle = POOL_NONE;
+    _loop_defer( obj, POOL_NONE, 1 );
+}
+
+void loop_remove( game_obj_t* obj ) {
+    _loop_defer( obj, POOL_NONE, 0 );
+}
+
+int loop_spawn() {
+    int handle = pool_alloc( _loop_objs );
+    if ( handle == POOL_NONE ) {
+        return GAME_FULL;
+    }
+    game_obj_t* obj = ( game_obj_t* ) pool_get( _loop_objs, handle );
+    obj->handle = handle;
+    _loop_defer( obj, POOL_NONE, 1 );
+    return handle;
+}
+
+int loop_despawn( int handle ) {
+    game_obj_t* obj = ( game_obj_t* ) pool_get( _loop_objs, handle );
+    if ( !obj ) {
+        return GAME_STALE;
+    }
+    _loop_defer( obj, handle, 0 );
+    return GAME_SUCCESS;
+}
+
+game_obj_t* loop_obj( int handle ) {
+    return ( game_obj_t* ) pool_get( _loop_objs, handle );
+}
+
+void loop_set_batch( int type, game_batch_t batch ) {
+    assert( type >= 0 && type < GAME_MAX_TYPES && GAME_BADTYPE );
+
+    _loop_buckets[ type ].batch = batch;
+}
+
+const game_type_stats_t* loop_type_stats( int type ) {
+    assert( type >= 0 && type < GAME_MAX_TYPES && GAME_BADTYPE );
+
+    return &_loop_buckets[ type ].stats;
+}
+
+int loop_migrate( game_obj_t* obj ) {
+    int entity = ecs_create( _loop_ecs );
+    if ( entity == ECS_FULL ) {
+        return ECS_FULL;
+    }
+    game_position_t* position = ( game_position_t* ) ecs_add( _loop_ecs, entity, GAME_POSITION );
+    position->x = obj->x;
+    position->y = obj->y;
+    game_size_t* size = ( game_size_t* ) ecs_add( _loop_ecs, entity, GAME_SIZE );
+    size->w = obj->w;
+    size->h = obj->h;
+    game_velocity_t* velocity = ( game_velocity_t* ) ecs_add( _loop_ecs, entity, GAME_VELOCITY );
+    velocity->v = obj->v;
+    game_type_t* type = ( game_type_t* ) ecs_add( _loop_ecs, entity, GAME_TYPE );
+    type->type = obj->type;
+    if ( obj->update || obj->data ) {
+        game_script_t* script = ( game_script_t* ) ecs_add( _loop_ecs, entity, GAME_SCRIPT );
+        script->obj = obj->obj;
+        script->update = obj->update;
+        script->data = obj->data;
+    }
+    return entity;
+}
+
+ecs_t* loop_ecs() {
+    return _loop_ecs;
+}
+
+ecs_commands_t* loop_commands() {
+    return _loop_commands;
+}
+
+scheduler_t* loop_scheduler() {
+    return _loop_scheduler;
+}
+
+coro_sched_t* loop_coros() {
+    return _loop_coros;
+}
+
+events_t* loop_events() {
+    return _loop_events;
+}
+
+unsigned int loop_broadcast( unsigned int channel, int x0, int y0, int x1, int y1, const void* event ) {
+    return events_broadcast( _loop_events, channel, _loop_bsp, x0, y0, x1, y1, PHYSICS_MASK_ALL, event );
+}
+
+jobs_t* loop_jobs() {
+    return _loop_jobs;
+}
+
+timestep_t* loop_timestep() {
+    return &_loop_timestep;
+}
+
+physics_world_t* loop_world() {
+    return _loop_world;
+}
+
+contacts_t* loop_contacts() {
+    return _loop_contacts;
+}
+
+projectile_pool_t* loop_projectiles() {
+    return _loop_projectiles;
+}
+
+void loop_set_tilemap( tilemap_t* map ) {
+    if ( _loop_tilemap ) {
+        tilemap_free( _loop_tilemap );
+    }
+    _loop_tilemap = map;
+}
+
+tilemap_t* loop_tilemap() {
+    return _loop_tilemap;
+}
+
+const game_body_state_t* loop_body_states( unsigned int* count ) {
+    *count = _loop_body_states->front_count;
+    return ( const game_body_state_t* ) _loop_body_states->front;
+}
+
+const game_obj_state_t* loop_obj_states( unsigned int* count ) {
+    *count = _loop_obj_states->front_count;
+    return ( const game_obj_state_t* ) _loop_obj_states->front;
+}
+
+void loop_set_input( const game_input_t* input ) {
+    _loop_input = *input;
+}
+
+const game_input_t* loop_input() {
+    return &_loop_input;
+}
+
+void loop_srand( unsigned int seed ) {
+    _loop_random = seed ? seed : GAME_DEFAULT_SEED;
+}
 
-// Load first level.
+unsigned int loop_rand() {
+    unsigned int x = _loop_random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    _loop_random = x;
+    return x;
+}
 
-// Allocate the scene and other structures
+// The words are mixed 64 bits at a time, which is several times faster than
+// a hash of the bytes.
+static unsigned long long _loop_mix( unsigned long long hash, unsigned long long word ) {
+    hash ^= word;
+    hash *= 0x9e3779b97f4a7c15ULL;
+    return hash ^ ( hash >> 32 );
+}
 
-// Start tasks and update loop
+unsigned int loop_checksum() {
+    unsigned long long hash = _loop_mix( 0, _loop_random );
+    hash = _loop_mix( hash, _loop_timestep.accumulator );
+    hash = _loop_mix( hash, _loop_world->count );
+    const unsigned int* words = ( const unsigned int* ) _loop_world->bodies;
+    size_t num_words = _loop_world->count * sizeof( physics_body_t ) / sizeof( unsigned int );
+    size_t i = 0;
+    for ( ; i + 1 < num_words; i += 2 ) {
+        hash = _loop_mix( hash, ( ( unsigned long long ) words[ i + 1 ] << 32 ) | words[i] );
+    }
+    if ( i < num_words ) {
+        hash = _loop_mix( hash, words[i] );
+    }
+    return ( unsigned int ) ( hash ^ ( hash >> 32 ) );
+}
@@ -1,28 +1,108 @@
 // Memory Management Module
 //
 // @author Tuomas Koskimies
+//
+// [Implementation details]
+//
+// The statistics are atomic, since the jobs may allocate too. The header of
+// a block is as big as the max alignment, so the block stays aligned. The
+// tests allocate through cmocka, whose list of the blocks is not thread
+// safe, so a lock serializes the allocations there.
 
+#include <stddef.h>
 #include <stdlib.h>
 
 #ifdef TEST
+#include <pthread.h>
 #include <setjmp.h>
 #include <stdarg.h>
-#include <stddef.h>
 #include <cmocka.h>
+
+static pthread_mutex_t _mem_lock = PTHREAD_MUTEX_INITIALIZER;
 #endif
 
-void *mem_malloc(size_t size) {
+#include "./mem.h"
+
+#ifdef MEM_STATS
+#include <stdatomic.h>
+
+#define _MEM_HEADER sizeof( max_align_t )
+
+static atomic_ullong _mem_allocs;
+static atomic_ullong _mem_frees;
+static atomic_size_t _mem_bytes;
+static atomic_size_t _mem_peak;
+#endif
+
+static void *_mem_alloc(size_t size) {
 #ifdef TEST
-    return test_malloc( size );
+    pthread_mutex_lock( &_mem_lock );
+    void *ptr = test_malloc( size );
+    pthread_mutex_unlock( &_mem_lock );
+    return ptr;
 #else
     return malloc( size );
 #endif
 }
 
-void mem_free(void *ptr) {
+static void _mem_release(void *ptr) {
 #ifdef TEST
-    return test_free( ptr );
+    pthread_mutex_lock( &_mem_lock );
+    test_free( ptr );
+    pthread_mutex_unlock( &_mem_lock );
 #else
     return free( ptr );
 #endif
 }
+
+void *mem_malloc(size_t size) {
+#ifdef MEM_STATS
+    unsigned char *block = ( unsigned char* ) _mem_alloc( _MEM_HEADER + size );
+    if ( !block ) {
+        return NULL;
+    }
+    *( size_t* ) block = size;
+    atomic_fetch_add( &_mem_allocs, 1 );
+    size_t bytes = atomic_fetch_add( &_mem_bytes, size ) + size;
+    size_t peak = atomic_load( &_mem_peak );
+    while ( bytes > peak && !atomic_compare_exchange_weak( &_mem_peak, &peak, bytes ) ) {
+    }
+    return block + _MEM_HEADER;
+#else
+    return _mem_alloc( size );
+#endif
+}
+
+void mem_free(void *ptr) {
+#ifdef MEM_STATS
+    if ( !ptr ) {
+        return;
+    }
+    unsigned char *block = ( unsigned char* ) ptr - _MEM_HEADER;
+    atomic_fetch_add( &_mem_frees, 1 );
+    atomic_fetch_sub( &_mem_bytes, *( size_t* ) block );
+    _mem_release( block );
+#else
+    _mem_release( ptr );
+#endif
+}
+
+void mem_stats( mem_stats_t* stats ) {
+#ifdef MEM_STATS
+    stats->allocs = atomic_load( &_mem_allocs );
+    stats->frees = atomic_load( &_mem_frees );
+    stats->bytes = atomic_load( &_mem_bytes );
+    stats->peak = atomic_load( &_mem_peak );
+#else
+    stats->allocs = 0;
+    stats->frees = 0;
+    stats->bytes = 0;
+    stats->peak = 0;
+#endif
+}
+
+void mem_reset_peak() {
+#ifdef MEM_STATS
+    atomic_store( &_mem_peak, atomic_load( &_mem_bytes ) );
+#endif
+}
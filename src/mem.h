@@ -2,6 +2,14 @@
 //
 // This memory manager provides a simple and fast memory allocator.
 //
+// Compiled with MEM_STATS, the allocator counts the allocations and the
+// bytes in use, e.g., for the headless benchmark (see headless.h). Each
+// block then carries a header with its size, so a block of mem_malloc()
+// must not be released by free() or the other way round. For the same
+// reason MEM_STATS does not go with TEST, whose tests release the blocks of
+// test_malloc() with mem_free(). Without MEM_STATS the statistics stay
+// zero.
+//
 // (c) Tuomas Koskimies, 2018
 
 #ifndef _mem_
@@ -9,12 +17,26 @@
 
 #include <stdlib.h>
 
+typedef struct {
+    unsigned long long allocs;
+    unsigned long long frees;
+    // The bytes in use and the max of them since the latest reset
+    size_t bytes;
+    size_t peak;
+} mem_stats_t;
+
 void *mem_malloc(size_t size);
 
 void mem_free(void *ptr);
 
+// @param stats The pointer to the statistics that are written
+void mem_stats( mem_stats_t* stats );
+
+// Sets the peak to the bytes in use
+void mem_reset_peak();
+
 //void *mem_malloc_lin(struct Block **block, size_t size);
 
 //void mem_free_lin(void *ptr);
 
-#endif // _mem_
\ No newline at end of file
+#endif // _mem_
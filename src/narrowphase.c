@@ -0,0 +1,305 @@
+// Batched narrowphase
+//
+// [Implementation details]
+//
+// The comparisons give a mask per lane. The mask is turned into bits and the
+// indices are written out without branches: every lane writes its index to
+// the next free slot, but only the overlapping lanes advance the slot. The
+// slot never passes the lane, so the writes stay within the hit buffer.
+//
+// The tail that does not fill a full vector is tested one by one, and so is
+// everything with the scalar kernel. The AVX2 kernels carry the target
+// attribute, like those of sjson, so they are compiled into every x86
+// build; the first call checks the CPU and picks the widest kernel.
+
+#include <assert.h>
+#include <stdlib.h>
+
+#include "./defs.h"
+#include "./mem.h"
+#include "./narrowphase.h"
+#include "./physics.h"
+
+#if ( defined( __x86_64__ ) || defined( __i386__ ) ) && defined( __SSE2__ )
+#include <immintrin.h>
+#define _NARROWPHASE_SSE2
+#if defined( __GNUC__ )
+#define _NARROWPHASE_AVX2
+#endif
+#endif
+
+narrowphase_boxes_t* narrowphase_boxes_new( unsigned int capacity ) {
+    narrowphase_boxes_t* boxes = ( narrowphase_boxes_t* ) mem_malloc( sizeof( narrowphase_boxes_t ) );
+    capacity = capacity ? capacity : 1;
+    boxes->x0 = ( int* ) mem_malloc( capacity * sizeof( int ) );
+    boxes->y0 = ( int* ) mem_malloc( capacity * sizeof( int ) );
+    boxes->x1 = ( int* ) mem_malloc( capacity * sizeof( int ) );
+    boxes->y1 = ( int* ) mem_malloc( capacity * sizeof( int ) );
+    boxes->count = 0;
+    boxes->capacity = capacity;
+    return boxes;
+}
+
+void narrowphase_boxes_free( narrowphase_boxes_t* boxes ) {
+    mem_free( boxes->x0 );
+    mem_free( boxes->y0 );
+    mem_free( boxes->x1 );
+    mem_free( boxes->y1 );
+    mem_free( boxes );
+}
+
+void narrowphase_gather( narrowphase_boxes_t* boxes, physics_world_t* world ) {
+    assert( boxes && NARROWPHASE_NOBOXES );
+    assert( world && PHYSICS_NOWORLD );
+    assert( world->count <= boxes->capacity && NARROWPHASE_TOOSMALL );
+
+    physics_body_t* body = world->bodies;
+    for ( unsigned int i = 0; i < world->count; i++, body++ ) {
+        boxes->x0[i] = body->x;
+        boxes->y0[i] = body->y;
+        boxes->x1[i] = body->x + ( int ) body->w;
+        boxes->y1[i] = body->y + ( int ) body->h;
+    }
+    boxes->count = world->count;
+}
+
+static int _overlap( narrowphase_boxes_t* boxes, unsigned int a, unsigned int b ) {
+    return boxes->x0[a] < boxes->x1[b]
+        && boxes->x0[b] < boxes->x1[a]
+        && boxes->y0[a] < boxes->y1[b]
+        && boxes->y0[b] < boxes->y1[a];
+}
+
+// Writes the indices base + k of the set bits k of the mask of the lanes
+static unsigned int _compact( unsigned int bits, unsigned int width, unsigned int base,
+        unsigned int* hits ) {
+    unsigned int n = 0;
+    for ( unsigned int k = 0; k < width; k++ ) {
+        hits[n] = base + k;
+        n += ( bits >> k ) & 1;
+    }
+    return n;
+}
+
+// Copies the hits of the lanes of one vector of one_vs_many
+static unsigned int _compact_others( unsigned int bits, unsigned int width,
+        const unsigned int* others, unsigned int* hits ) {
+    unsigned int n = 0;
+    for ( unsigned int k = 0; k < width; k++ ) {
+        hits[n] = others[k];
+        n += ( bits >> k ) & 1;
+    }
+    return n;
+}
+
+#ifdef _NARROWPHASE_SSE2
+// Loads the values of the array at the indices of the 4 lanes
+static __m128i _gather_sse2( const int* values, const int* i ) {
+    return _mm_set_epi32( values[ i[3] ], values[ i[2] ], values[ i[1] ], values[ i[0] ] );
+}
+
+// Tests the boxes a[k] against the boxes b[k] of the 4 lanes
+static unsigned int _overlap_sse2( narrowphase_boxes_t* boxes, const int* a, const int* b ) {
+    __m128i ax0 = _gather_sse2( boxes->x0, a );
+    __m128i ay0 = _gather_sse2( boxes->y0, a );
+    __m128i ax1 = _gather_sse2( boxes->x1, a );
+    __m128i ay1 = _gather_sse2( boxes->y1, a );
+    __m128i bx0 = _gather_sse2( boxes->x0, b );
+    __m128i by0 = _gather_sse2( boxes->y0, b );
+    __m128i bx1 = _gather_sse2( boxes->x1, b );
+    __m128i by1 = _gather_sse2( boxes->y1, b );
+
+    __m128i m = _mm_and_si128(
+        _mm_and_si128( _mm_cmplt_epi32( ax0, bx1 ), _mm_cmplt_epi32( bx0, ax1 ) ),
+        _mm_and_si128( _mm_cmplt_epi32( ay0, by1 ), _mm_cmplt_epi32( by0, ay1 ) ) );
+    return ( unsigned int ) _mm_movemask_ps( _mm_castsi128_ps( m ) );
+}
+
+// Tests the full vectors of the pairs from *i on and advances *i past them
+static unsigned int _pairs_sse2( narrowphase_boxes_t* boxes, physics_pairs_t* pairs,
+        unsigned int* hits, unsigned int* i ) {
+    unsigned int n = 0;
+    int a[4];
+    int b[4];
+    for ( ; *i + 4 <= pairs->count; *i += 4 ) {
+        physics_pair_t* pair = &pairs->pairs[ *i ];
+        for ( unsigned int k = 0; k < 4; k++ ) {
+            a[k] = pair[k].obj_0->index;
+            b[k] = pair[k].obj_1->index;
+        }
+        n += _compact( _overlap_sse2( boxes, a, b ), 4, *i, hits + n );
+    }
+    return n;
+}
+
+static unsigned int _one_vs_many_sse2( narrowphase_boxes_t* boxes, unsigned int index,
+        const unsigned int* others, unsigned int count, unsigned int* hits, unsigned int* i ) {
+    unsigned int n = 0;
+    int a[4] = { ( int ) index, ( int ) index, ( int ) index, ( int ) index };
+    for ( ; *i + 4 <= count; *i += 4 ) {
+        unsigned int bits = _overlap_sse2( boxes, a, ( const int* ) ( others + *i ) );
+        n += _compact_others( bits, 4, others + *i, hits + n );
+    }
+    return n;
+}
+#endif
+
+#ifdef _NARROWPHASE_AVX2
+// Tests the boxes a[k] against the boxes b[k] of the 8 lanes
+__attribute__(( target( "avx2" ) ))
+static unsigned int _overlap_avx2( narrowphase_boxes_t* boxes, __m256i a, __m256i b ) {
+    __m256i ax0 = _mm256_i32gather_epi32( boxes->x0, a, 4 );
+    __m256i ay0 = _mm256_i32gather_epi32( boxes->y0, a, 4 );
+    __m256i ax1 = _mm256_i32gather_epi32( boxes->x1, a, 4 );
+    __m256i ay1 = _mm256_i32gather_epi32( boxes->y1, a, 4 );
+    __m256i bx0 = _mm256_i32gather_epi32( boxes->x0, b, 4 );
+    __m256i by0 = _mm256_i32gather_epi32( boxes->y0, b, 4 );
+    __m256i bx1 = _mm256_i32gather_epi32( boxes->x1, b, 4 );
+    __m256i by1 = _mm256_i32gather_epi32( boxes->y1, b, 4 );
+
+    __m256i m = _mm256_and_si256(
+        _mm256_and_si256( _mm256_cmpgt_epi32( bx1, ax0 ), _mm256_cmpgt_epi32( ax1, bx0 ) ),
+        _mm256_and_si256( _mm256_cmpgt_epi32( by1, ay0 ), _mm256_cmpgt_epi32( ay1, by0 ) ) );
+    return ( unsigned int ) _mm256_movemask_ps( _mm256_castsi256_ps( m ) );
+}
+
+__attribute__(( target( "avx2" ) ))
+static unsigned int _pairs_avx2( narrowphase_boxes_t* boxes, physics_pairs_t* pairs,
+        unsigned int* hits, unsigned int* i ) {
+    unsigned int n = 0;
+    int a[8];
+    int b[8];
+    for ( ; *i + 8 <= pairs->count; *i += 8 ) {
+        physics_pair_t* pair = &pairs->pairs[ *i ];
+        for ( unsigned int k = 0; k < 8; k++ ) {
+            a[k] = pair[k].obj_0->index;
+            b[k] = pair[k].obj_1->index;
+        }
+        unsigned int bits = _overlap_avx2( boxes,
+            _mm256_loadu_si256( ( const __m256i* ) a ),
+            _mm256_loadu_si256( ( const __m256i* ) b ) );
+        n += _compact( bits, 8, *i, hits + n );
+    }
+    return n;
+}
+
+__attribute__(( target( "avx2" ) ))
+static unsigned int _one_vs_many_avx2( narrowphase_boxes_t* boxes, unsigned int index,
+        const unsigned int* others, unsigned int count, unsigned int* hits, unsigned int* i ) {
+    unsigned int n = 0;
+    __m256i a = _mm256_set1_epi32( ( int ) index );
+    for ( ; *i + 8 <= count; *i += 8 ) {
+        unsigned int bits = _overlap_avx2( boxes, a,
+            _mm256_loadu_si256( ( const __m256i* ) ( others + *i ) ) );
+        n += _compact_others( bits, 8, others + *i, hits + n );
+    }
+    return n;
+}
+
+static int _narrowphase_has_avx2() {
+#ifdef __AVX2__
+    return 1;
+#else
+    return __builtin_cpu_supports( "avx2" );
+#endif
+}
+#endif
+
+// The selected instruction set, or -1 until the first call picks the best
+static int _narrowphase_isa = -1;
+
+static int _narrowphase_supports( int isa ) {
+    switch ( isa ) {
+    case NARROWPHASE_SCALAR:
+        return 1;
+#ifdef _NARROWPHASE_SSE2
+    case NARROWPHASE_SSE2:
+        return 1;
+#endif
+#ifdef _NARROWPHASE_AVX2
+    case NARROWPHASE_AVX2:
+        return _narrowphase_has_avx2();
+#endif
+    default:
+        return 0;
+    }
+}
+
+int narrowphase_isa() {
+    if ( _narrowphase_isa < 0 ) {
+        _narrowphase_isa = NARROWPHASE_SCALAR;
+        for ( int isa = NARROWPHASE_AVX2; isa > NARROWPHASE_SCALAR; isa-- ) {
+            if ( _narrowphase_supports( isa ) ) {
+                _narrowphase_isa = isa;
+                break;
+            }
+        }
+    }
+    return _narrowphase_isa;
+}
+
+int narrowphase_select( int isa ) {
+    if ( !_narrowphase_supports( isa ) ) {
+        return 0;
+    }
+    _narrowphase_isa = isa;
+    return 1;
+}
+
+unsigned int narrowphase_pairs( narrowphase_boxes_t* boxes, physics_pairs_t* pairs,
+        unsigned int* hits ) {
+    assert( boxes && NARROWPHASE_NOBOXES );
+    assert( pairs && NARROWPHASE_NOPAIRS );
+    assert( hits && NARROWPHASE_NOHITS );
+
+    unsigned int n = 0;
+    unsigned int i = 0;
+    switch ( narrowphase_isa() ) {
+#ifdef _NARROWPHASE_AVX2
+    case NARROWPHASE_AVX2:
+        n = _pairs_avx2( boxes, pairs, hits, &i );
+        break;
+#endif
+#ifdef _NARROWPHASE_SSE2
+    case NARROWPHASE_SSE2:
+        n = _pairs_sse2( boxes, pairs, hits, &i );
+        break;
+#endif
+    default:
+        break;
+    }
+    for ( ; i < pairs->count; i++ ) {
+        physics_pair_t* pair = &pairs->pairs[i];
+        hits[n] = i;
+        n += _overlap( boxes, pair->obj_0->index, pair->obj_1->index );
+    }
+    return n;
+}
+
+unsigned int narrowphase_one_vs_many( narrowphase_boxes_t* boxes, unsigned int index,
+        const unsigned int* others, unsigned int count, unsigned int* hits ) {
+    assert( boxes && NARROWPHASE_NOBOXES );
+    assert( hits && NARROWPHASE_NOHITS );
+
+    unsigned int n = 0;
+    unsigned int i = 0;
+    switch ( narrowphase_isa() ) {
+#ifdef _NARROWPHASE_AVX2
+    case NARROWPHASE_AVX2:
+        n = _one_vs_many_avx2( boxes, index, others, count, hits, &i );
+        break;
+#endif
+#ifdef _NARROWPHASE_SSE2
+    case NARROWPHASE_SSE2:
+        n = _one_vs_many_sse2( boxes, index, others, count, hits, &i );
+        break;
+#endif
+    default:
+        break;
+    }
+    for ( ; i < count; i++ ) {
+        hits[n] = others[i];
+        n += _overlap( boxes, index, others[i] );
+    }
+    return n;
+}
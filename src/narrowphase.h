@@ -0,0 +1,103 @@
+// Batched narrowphase
+//
+// The boxes of the bodies are gathered into a structure of arrays, so the
+// overlap test can be done for several pairs at once. With SSE2, four pairs
+// are tested per instruction; with AVX2, eight. Without either, the pairs
+// are tested one by one. The AVX2 kernels are built with the target
+// attribute and picked at run time when the CPU has AVX2, so the default
+// build does not need -mavx2. All variants give the same results as
+// physics_check_two_bodies().
+//
+// The results are compacted: only the indices of the overlapping pairs are
+// written out, in the order of the input.
+
+#ifndef _narrowphase_
+#define _narrowphase_
+
+#include "./physics.h"
+
+// Messages for the diagnostics
+#define NARROWPHASE_NOBOXES "Box arrays do not exist"
+#define NARROWPHASE_NOPAIRS "Pair buffer does not exist"
+#define NARROWPHASE_NOHITS "Hit buffer does not exist"
+#define NARROWPHASE_TOOSMALL "Box arrays are smaller than the world"
+
+// The instruction sets of the kernels
+#define NARROWPHASE_SCALAR  0
+#define NARROWPHASE_SSE2    1
+#define NARROWPHASE_AVX2    2
+
+// The boxes of the bodies as a structure of arrays
+//
+// The box of the body i spans [ x0[i], x1[i] ) x [ y0[i], y1[i] ).
+typedef struct {
+    int* x0;
+    int* y0;
+    int* x1;
+    int* y1;
+    unsigned int count;
+    unsigned int capacity;
+} narrowphase_boxes_t;
+
+// Creates new box arrays
+//
+// @param capacity The max number of the boxes
+// @return The pointer to the box arrays
+narrowphase_boxes_t* narrowphase_boxes_new( unsigned int capacity );
+
+// Releases the box arrays
+//
+// @param boxes The pointer to the box arrays
+void narrowphase_boxes_free( narrowphase_boxes_t* boxes );
+
+// Copies the boxes of the bodies of the world. The box of a body is stored
+// at the index of the body
+//
+// @precondition boxes != NULL
+// @precondition world != NULL
+// @precondition world->count <= boxes->capacity
+// @param boxes The pointer to the box arrays
+// @param world The pointer to the world
+void narrowphase_gather( narrowphase_boxes_t* boxes, physics_world_t* world );
+
+// Tests the candidate pairs
+//
+// The boxes are looked up by the indices of the objects.
+//
+// @precondition boxes != NULL
+// @precondition pairs != NULL
+// @precondition hits != NULL and has room for pairs->count indices
+// @param boxes The pointer to the gathered boxes
+// @param pairs The pointer to the candidate pairs
+// @param hits The array where the indices of the overlapping pairs are
+//             written to
+// @return The number of the overlapping pairs
+unsigned int narrowphase_pairs( narrowphase_boxes_t* boxes, physics_pairs_t* pairs,
+        unsigned int* hits );
+
+// Tests one box against many
+//
+// @precondition boxes != NULL
+// @precondition hits != NULL and has room for count indices
+// @param boxes The pointer to the gathered boxes
+// @param index The index of the box that is tested
+// @param others The indices of the other boxes
+// @param count The number of the other boxes
+// @param hits The array where the indices of the overlapping boxes (the
+//             values of others) are written to
+// @return The number of the overlapping boxes
+unsigned int narrowphase_one_vs_many( narrowphase_boxes_t* boxes, unsigned int index,
+        const unsigned int* others, unsigned int count, unsigned int* hits );
+
+// Selects the instruction set of the kernels. By default the best one that
+// the CPU supports is used; the tests select each in turn to compare them.
+//
+// @param isa NARROWPHASE_SCALAR, NARROWPHASE_SSE2 or NARROWPHASE_AVX2
+// @return 1 if the build and the CPU support the instruction set and it is
+//         selected, 0 if the selection does not change
+int narrowphase_select( int isa );
+
+// @return The selected instruction set
+int narrowphase_isa();
+
+#endif // _narrowphase_
@@ -1,28 +1,503 @@
+// Parser for a semi-json (sjson) format
+//
+// [Implementation details]
+//
+// A chunk is tokenized a slice at a time. The first pass builds the
+// structural index of the slice, a 64-bit word of the bitmap per 64 bytes:
+//
+//   1. The bytes of the block are classified into the masks of the quotes,
+//      the backslashes, the structural characters, the whitespace and the
+//      characters of the bare words. With SSE2, four compares of 16 bytes
+//      and their movemasks make each mask; with AVX2, two of 32 bytes.
+//   2. The escaped bytes follow the odd runs of backslashes. The starts of
+//      the runs on the odd bits are added to the backslashes, so a carry
+//      flips the parity of each run that starts on an odd bit; the escaped
+//      bytes are then those after a run that has the other parity than its
+//      end. The carry out of the add tells if the next block starts escaped.
+//   3. The bytes within the strings are the prefix-XOR of the quotes that
+//      are not escaped, i.e., a carry-less multiply by all ones, done with
+//      six shifts. The top bit carries into the next block.
+//   4. The index is the quotes, and outside the strings the structural and
+//      the other characters and the first characters of the words.
+//
+// The scalar fallback runs the same rules as a state machine a byte at a
+// time, for the CPUs without SSE2 and for the tests that compare the two.
+//
+// The second pass walks the bits of the index. A string ends at the next
+// indexed position, and the position after it tells if it is a key, so only
+// the words are scanned by a lookup per byte in the table of the character
+// classes. A token that runs past the slice is finished by scanning the
+// chunk, and the next slice starts after it, so each slice starts outside
+// the strings. A string is not passed to the handler until the next
+// character that is not whitespace is known, as a colon turns it into a key;
+// so is a bare word until its end is known. If the chunk ends before that,
+// the token stays unconsumed and is scanned again with the next chunk.
 
+#include <assert.h>
+#include <string.h>
 
 #include "sjson.h"
 
-// parse
-// input: text buffer
-// 1. read next character
-// 2. if '"' and there its not open, start new string; Otherwise close it
-// 3. if '{', open a new object
-// 4. if '}', close the previous object
-// 5. if '[', open a new array
-// 6. if ']', close the previous array
-// 7. if ':', read the value for the previous name
-// The structure is a tree
-// How you read the structure. What kind of structure it is?
-// json toimii dynaamisissa kielissä paremmin, koska se samalla määrittelee 
-// tietorakenteen jota ohjlma voi käyttää. Sen sijaan C:ssä tietorakenne,
-// esimerkiksi tietue iin märiteltävä etkäteen ja tämän jälken joudutaan 
-// kuvaamaan json esitys tietueille. Kömpelöä. Onko jopa liian kömpelöä 
-// eli pitäisikö miettiä tietue pohjaista ratkaisua.
-// Mutta olisiko ihanne lukea suoraan tietueita? Silloin ei tarvitsisi
-// toteuttaa json-parseria, jonka perusongeelma on, että se joudutaan
-// kuvaamaan tietueiksi.
+#if ( defined( __x86_64__ ) || defined( __i386__ ) ) && defined( __SSE2__ )
+#include <immintrin.h>
+#define _SJSON_SSE2
+#if defined( __GNUC__ )
+#define _SJSON_AVX2
+#endif
+#endif
+
+// The character classes
+#define _SJSON_OTHER    0
+#define _SJSON_SPACE    1
+#define _SJSON_STRUCT   2
+#define _SJSON_QUOTE    3
+#define _SJSON_WORD     4
+
+#define _SJSON_OBJECT   0
+#define _SJSON_ARRAY    1
+
+static const unsigned char _sjson_classes[ 256 ] = {
+    [ ' ' ] = _SJSON_SPACE, [ '\t' ] = _SJSON_SPACE, [ '\n' ] = _SJSON_SPACE,
+    [ '\r' ] = _SJSON_SPACE, [ ',' ] = _SJSON_SPACE,
+    [ '{' ] = _SJSON_STRUCT, [ '}' ] = _SJSON_STRUCT, [ '[' ] = _SJSON_STRUCT,
+    [ ']' ] = _SJSON_STRUCT, [ ':' ] = _SJSON_STRUCT,
+    [ '"' ] = _SJSON_QUOTE,
+    [ '0' ... '9' ] = _SJSON_WORD, [ 'a' ... 'z' ] = _SJSON_WORD, [ 'A' ... 'Z' ] = _SJSON_WORD,
+    [ '-' ] = _SJSON_WORD, [ '+' ] = _SJSON_WORD, [ '.' ] = _SJSON_WORD, [ '_' ] = _SJSON_WORD,
+};
+
+static int _sjson_fail( sjson_parser_t* parser, int error, size_t offset ) {
+    parser->error = error;
+    parser->error_offset = offset;
+    return error;
+}
+
+static int _sjson_emit( sjson_parser_t* parser, int type, const char* data, size_t begin, size_t end ) {
+    sjson_token_t token = { type, parser->offset + begin, end - begin };
+    parser->num_tokens++;
+    if ( parser->handler( parser->user, &token, data + begin ) ) {
+        return _sjson_fail( parser, SJSON_STOPPED, token.offset );
+    }
+    return SJSON_SUCCESS;
+}
+
+// Opens or closes an object or an array
+static int _sjson_struct( sjson_parser_t* parser, const char* data, size_t i ) {
+    char c = data[i];
+    if ( c == '{' || c == '[' ) {
+        if ( parser->depth == SJSON_MAX_DEPTH ) {
+            return _sjson_fail( parser, SJSON_TOODEEP, parser->offset + i );
+        }
+        parser->stack[ parser->depth++ ] = c == '{' ? _SJSON_OBJECT : _SJSON_ARRAY;
+        return _sjson_emit( parser, c == '{' ? SJSON_BEGIN_OBJECT : SJSON_BEGIN_ARRAY, data, i, i + 1 );
+    }
+    if ( c == ':' ) {
+        // A colon that does not follow a string
+        return _sjson_fail( parser, SJSON_BADCHAR, parser->offset + i );
+    }
+    unsigned char kind = c == '}' ? _SJSON_OBJECT : _SJSON_ARRAY;
+    if ( !parser->depth || parser->stack[ parser->depth - 1 ] != kind ) {
+        return _sjson_fail( parser, SJSON_MISMATCH, parser->offset + i );
+    }
+    parser->depth--;
+    return _sjson_emit( parser, c == '}' ? SJSON_END_OBJECT : SJSON_END_ARRAY, data, i, i + 1 );
+}
+
+// The masks of the classes of a block
+typedef struct {
+    unsigned long long quote;
+    unsigned long long backslash;
+    unsigned long long structural;
+    unsigned long long space;
+    unsigned long long word;
+} _sjson_masks_t;
+
+// The state that carries from a block to the next
+typedef struct {
+    // 1 if the first byte of the next block is escaped
+    unsigned long long escaped;
+    // All ones if the next block starts within a string
+    unsigned long long in_string;
+    // 1 if the last byte of the block is in a word outside the strings
+    unsigned long long word;
+} _sjson_carry_t;
+
+#define _SJSON_EVEN 0x5555555555555555ULL
+
+static inline unsigned long long _sjson_prefix_xor( unsigned long long x ) {
+    x ^= x << 1;
+    x ^= x << 2;
+    x ^= x << 4;
+    x ^= x << 8;
+    x ^= x << 16;
+    x ^= x << 32;
+    return x;
+}
+
+// Turns the masks of a block into its bits of the index
+static inline __attribute__(( always_inline ))
+unsigned long long _sjson_block( const _sjson_masks_t* m, _sjson_carry_t* carry ) {
+    unsigned long long backslash = m->backslash & ~carry->escaped;
+    unsigned long long follows = backslash << 1 | carry->escaped;
+    unsigned long long odd_starts = backslash & ~_SJSON_EVEN & ~follows;
+    unsigned long long sums;
+    carry->escaped = __builtin_uaddll_overflow( odd_starts, backslash, &sums );
+    unsigned long long escaped = ( _SJSON_EVEN ^ ( sums << 1 ) ) & follows;
+
+    unsigned long long quote = m->quote & ~escaped;
+    unsigned long long in = _sjson_prefix_xor( quote ) ^ carry->in_string;
+    carry->in_string = 0 - ( in >> 63 );
+    unsigned long long outside = ~( in | quote );
+
+    unsigned long long word = m->word & outside;
+    unsigned long long starts = word & ~( word << 1 | carry->word );
+    carry->word = word >> 63;
+    unsigned long long other = ~( m->structural | m->space | m->word | m->quote );
+    return quote | ( ( m->structural | other ) & outside ) | starts;
+}
+
+#ifdef _SJSON_SSE2
+// The bytes that are within [lo, hi], unsigned
+static inline __m128i _sjson_range_sse2( __m128i x, char lo, char hi ) {
+    __m128i t = _mm_add_epi8( x, _mm_set1_epi8( ( char ) ( 0x80 - lo ) ) );
+    return _mm_cmpgt_epi8( _mm_set1_epi8( ( char ) ( 0x80 + hi - lo + 1 ) ), t );
+}
+
+static inline void _sjson_masks_sse2( const char* data, _sjson_masks_t* m ) {
+    memset( m, 0, sizeof( _sjson_masks_t ) );
+    for ( int k = 0; k < 4; k++ ) {
+        __m128i x = _mm_loadu_si128( ( const __m128i* ) ( data + 16 * k ) );
+        // { and [, } and ] differ by the bit 0x20
+        __m128i folded = _mm_or_si128( x, _mm_set1_epi8( 0x20 ) );
+        __m128i comma = _mm_cmpeq_epi8( x, _mm_set1_epi8( ',' ) );
+        __m128i structural = _mm_or_si128(
+            _mm_or_si128( _mm_cmpeq_epi8( folded, _mm_set1_epi8( '{' ) ),
+                          _mm_cmpeq_epi8( folded, _mm_set1_epi8( '}' ) ) ),
+            _mm_cmpeq_epi8( x, _mm_set1_epi8( ':' ) ) );
+        __m128i space = _mm_or_si128(
+            _mm_or_si128( _mm_cmpeq_epi8( x, _mm_set1_epi8( ' ' ) ), _sjson_range_sse2( x, '\t', '\n' ) ),
+            _mm_or_si128( _mm_cmpeq_epi8( x, _mm_set1_epi8( '\r' ) ), comma ) );
+        // The digits, the letters and + - . _ (the comma is within + and .)
+        __m128i word = _mm_or_si128(
+            _mm_or_si128( _sjson_range_sse2( x, '0', '9' ), _sjson_range_sse2( folded, 'a', 'z' ) ),
+            _mm_or_si128( _mm_andnot_si128( comma, _sjson_range_sse2( x, '+', '.' ) ),
+                          _mm_cmpeq_epi8( x, _mm_set1_epi8( '_' ) ) ) );
+        int shift = 16 * k;
+        m->quote |= ( unsigned long long ) ( unsigned int ) _mm_movemask_epi8(
+            _mm_cmpeq_epi8( x, _mm_set1_epi8( '"' ) ) ) << shift;
+        m->backslash |= ( unsigned long long ) ( unsigned int ) _mm_movemask_epi8(
+            _mm_cmpeq_epi8( x, _mm_set1_epi8( '\\' ) ) ) << shift;
+        m->structural |= ( unsigned long long ) ( unsigned int ) _mm_movemask_epi8( structural ) << shift;
+        m->space |= ( unsigned long long ) ( unsigned int ) _mm_movemask_epi8( space ) << shift;
+        m->word |= ( unsigned long long ) ( unsigned int ) _mm_movemask_epi8( word ) << shift;
+    }
+}
+
+static void _sjson_index_sse2( const char* data, size_t size, unsigned long long* index ) {
+    _sjson_carry_t carry = { 0, 0, 0 };
+    _sjson_masks_t m;
+    size_t w = 0;
+    for ( ; w < size / 64; w++ ) {
+        _sjson_masks_sse2( data + w * 64, &m );
+        index[w] = _sjson_block( &m, &carry );
+    }
+    if ( size % 64 ) {
+        // The tail is padded with spaces, which are not indexed
+        char tail[ 64 ];
+        memset( tail, ' ', sizeof( tail ) );
+        memcpy( tail, data + w * 64, size % 64 );
+        _sjson_masks_sse2( tail, &m );
+        index[w] = _sjson_block( &m, &carry );
+    }
+}
+#endif
+
+#ifdef _SJSON_AVX2
+__attribute__(( target( "avx2" ) ))
+static inline __m256i _sjson_range_avx2( __m256i x, char lo, char hi ) {
+    __m256i t = _mm256_add_epi8( x, _mm256_set1_epi8( ( char ) ( 0x80 - lo ) ) );
+    return _mm256_cmpgt_epi8( _mm256_set1_epi8( ( char ) ( 0x80 + hi - lo + 1 ) ), t );
+}
+
+__attribute__(( target( "avx2" ) ))
+static inline void _sjson_masks_avx2( const char* data, _sjson_masks_t* m ) {
+    memset( m, 0, sizeof( _sjson_masks_t ) );
+    for ( int k = 0; k < 2; k++ ) {
+        __m256i x = _mm256_loadu_si256( ( const __m256i* ) ( data + 32 * k ) );
+        __m256i folded = _mm256_or_si256( x, _mm256_set1_epi8( 0x20 ) );
+        __m256i comma = _mm256_cmpeq_epi8( x, _mm256_set1_epi8( ',' ) );
+        __m256i structural = _mm256_or_si256(
+            _mm256_or_si256( _mm256_cmpeq_epi8( folded, _mm256_set1_epi8( '{' ) ),
+                             _mm256_cmpeq_epi8( folded, _mm256_set1_epi8( '}' ) ) ),
+            _mm256_cmpeq_epi8( x, _mm256_set1_epi8( ':' ) ) );
+        __m256i space = _mm256_or_si256(
+            _mm256_or_si256( _mm256_cmpeq_epi8( x, _mm256_set1_epi8( ' ' ) ), _sjson_range_avx2( x, '\t', '\n' ) ),
+            _mm256_or_si256( _mm256_cmpeq_epi8( x, _mm256_set1_epi8( '\r' ) ), comma ) );
+        __m256i word = _mm256_or_si256(
+            _mm256_or_si256( _sjson_range_avx2( x, '0', '9' ), _sjson_range_avx2( folded, 'a', 'z' ) ),
+            _mm256_or_si256( _mm256_andnot_si256( comma, _sjson_range_avx2( x, '+', '.' ) ),
+                             _mm256_cmpeq_epi8( x, _mm256_set1_epi8( '_' ) ) ) );
+        int shift = 32 * k;
+        m->quote |= ( unsigned long long ) ( unsigned int ) _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8( x, _mm256_set1_epi8( '"' ) ) ) << shift;
+        m->backslash |= ( unsigned long long ) ( unsigned int ) _mm256_movemask_epi8(
+            _mm256_cmpeq_epi8( x, _mm256_set1_epi8( '\\' ) ) ) << shift;
+        m->structural |= ( unsigned long long ) ( unsigned int ) _mm256_movemask_epi8( structural ) << shift;
+        m->space |= ( unsigned long long ) ( unsigned int ) _mm256_movemask_epi8( space ) << shift;
+        m->word |= ( unsigned long long ) ( unsigned int ) _mm256_movemask_epi8( word ) << shift;
+    }
+}
+
+__attribute__(( target( "avx2" ) ))
+static void _sjson_index_avx2( const char* data, size_t size, unsigned long long* index ) {
+    _sjson_carry_t carry = { 0, 0, 0 };
+    _sjson_masks_t m;
+    size_t w = 0;
+    for ( ; w < size / 64; w++ ) {
+        _sjson_masks_avx2( data + w * 64, &m );
+        index[w] = _sjson_block( &m, &carry );
+    }
+    if ( size % 64 ) {
+        char tail[ 64 ];
+        memset( tail, ' ', sizeof( tail ) );
+        memcpy( tail, data + w * 64, size % 64 );
+        _sjson_masks_avx2( tail, &m );
+        index[w] = _sjson_block( &m, &carry );
+    }
+}
+
+static int _sjson_has_avx2() {
+#ifdef __AVX2__
+    return 1;
+#else
+    return __builtin_cpu_supports( "avx2" );
+#endif
+}
+#endif
+
+void sjson_index_scalar( const char* data, size_t size, unsigned long long* index ) {
+    assert( ( data || !size ) && SJSON_NODATA );
+    assert( index && SJSON_NODATA );
+
+    const unsigned char* bytes = ( const unsigned char* ) data;
+    memset( index, 0, ( size + 63 ) / 64 * sizeof( unsigned long long ) );
+    int in_string = 0;
+    int escape = 0;
+    int in_word = 0;
+    for ( size_t i = 0; i < size; i++ ) {
+        int escaped = escape;
+        escape = !escaped && bytes[i] == '\\';
+        unsigned char cls = _sjson_classes[ bytes[i] ];
+        int set = 0;
+        if ( cls == _SJSON_QUOTE && !escaped ) {
+            in_string = !in_string;
+            set = 1;
+        } else if ( in_string ) {
+            set = 0;
+        } else if ( cls == _SJSON_WORD ) {
+            set = !in_word;
+        } else {
+            set = cls == _SJSON_STRUCT || cls == _SJSON_OTHER;
+        }
+        in_word = !in_string && cls == _SJSON_WORD;
+        if ( set ) {
+            index[ i / 64 ] |= 1ULL << ( i % 64 );
+        }
+    }
+}
+
+void sjson_index( const char* data, size_t size, unsigned long long* index ) {
+    assert( ( data || !size ) && SJSON_NODATA );
+    assert( index && SJSON_NODATA );
+
+#ifdef _SJSON_AVX2
+    if ( _sjson_has_avx2() ) {
+        _sjson_index_avx2( data, size, index );
+        return;
+    }
+#endif
+#ifdef _SJSON_SSE2
+    _sjson_index_sse2( data, size, index );
+#else
+    sjson_index_scalar( data, size, index );
+#endif
+}
+
+const char* sjson_index_isa() {
+#ifdef _SJSON_AVX2
+    if ( _sjson_has_avx2() ) {
+        return "avx2";
+    }
+#endif
+#ifdef _SJSON_SSE2
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+void sjson_init( sjson_parser_t* parser, sjson_handler_t handler, void* user ) {
+    assert( parser && SJSON_NOPARSER );
+
+    parser->handler = handler;
+    parser->user = user;
+    parser->offset = 0;
+    parser->depth = 0;
+    parser->error = SJSON_SUCCESS;
+    parser->error_offset = 0;
+    parser->num_tokens = 0;
+}
+
+// The walk over the bits of an index
+typedef struct {
+    const unsigned long long* index;
+    size_t num_words;
+    size_t w;
+    unsigned long long bits;
+} _sjson_walk_t;
+
+// @return The next indexed position, or SIZE_MAX if none
+static inline size_t _sjson_peek( _sjson_walk_t* walk ) {
+    while ( !walk->bits ) {
+        if ( ++walk->w >= walk->num_words ) {
+            walk->w = walk->num_words;
+            return ( size_t ) -1;
+        }
+        walk->bits = walk->index[ walk->w ];
+    }
+    return walk->w * 64 + ( size_t ) __builtin_ctzll( walk->bits );
+}
+
+static inline void _sjson_pop( _sjson_walk_t* walk ) {
+    walk->bits &= walk->bits - 1;
+}
+
+// Tokenizes the slice [base, base + n) of the chunk by its index
+//
+// Each indexed position starts a token or ends a string, so the tokens are
+// taken in the order of the bits.
 //
-// Huomattavasti järkevämpää on käyttää kirjastofunkitioita 
+// @param consumed The end of the tokens that are done, which is where the
+//                 next slice starts, or the start of the token that stopped
+// @return Nonzero if the tokenizing stopped at an incomplete token, an
+//         error or the handler
+static int _sjson_slice( sjson_parser_t* parser, const char* data, size_t size, int last,
+                         size_t base, size_t n, size_t* consumed ) {
+    const unsigned char* bytes = ( const unsigned char* ) data;
+    _sjson_walk_t walk = { parser->index, ( n + 63 ) / 64, 0, parser->index[0] };
+    size_t r;
+    while ( ( r = _sjson_peek( &walk ) ) != ( size_t ) -1 ) {
+        _sjson_pop( &walk );
+        size_t i = base + r;
+        unsigned char cls = _sjson_classes[ bytes[i] ];
+        size_t end;
+        if ( cls == _SJSON_STRUCT ) {
+            if ( _sjson_struct( parser, data, i ) ) {
+                *consumed = i;
+                return 1;
+            }
+            continue;
+        } else if ( cls == _SJSON_WORD ) {
+            end = i + 1;
+            while ( end < size && _sjson_classes[ bytes[ end ] ] == _SJSON_WORD ) {
+                end++;
+            }
+            if ( end == size && !last ) {
+                *consumed = i;
+                return 1;
+            }
+            int type = ( bytes[i] >= '0' && bytes[i] <= '9' ) || bytes[i] == '-' ? SJSON_NUMBER : SJSON_LITERAL;
+            if ( _sjson_emit( parser, type, data, i, end ) ) {
+                *consumed = i;
+                return 1;
+            }
+        } else if ( cls == _SJSON_QUOTE ) {
+            // The closing quote is the next indexed position, unless the
+            // string runs past the slice
+            size_t close = _sjson_peek( &walk );
+            size_t next = ( size_t ) -1;
+            if ( close != ( size_t ) -1 ) {
+                _sjson_pop( &walk );
+                close += base;
+                next = _sjson_peek( &walk );
+            } else {
+                close = i + 1;
+                while ( close < size && bytes[ close ] != '"' ) {
+                    close += bytes[ close ] == '\\' ? 2 : 1;
+                }
+                if ( close >= size ) {
+                    if ( last ) {
+                        _sjson_fail( parser, SJSON_UNTERMINATED, parser->offset + i );
+                    }
+                    *consumed = i;
+                    return 1;
+                }
+            }
+            // A key if the next character that is not whitespace is a colon
+            if ( next != ( size_t ) -1 ) {
+                next += base;
+            } else {
+                next = close + 1 > base + n ? close + 1 : base + n;
+                while ( next < size && _sjson_classes[ bytes[ next ] ] == _SJSON_SPACE ) {
+                    next++;
+                }
+                if ( next == size && !last ) {
+                    *consumed = i;
+                    return 1;
+                }
+            }
+            int key = next < size && bytes[ next ] == ':';
+            if ( _sjson_emit( parser, key ? SJSON_KEY : SJSON_STRING, data, i + 1, close ) ) {
+                *consumed = i;
+                return 1;
+            }
+            if ( key ) {
+                _sjson_pop( &walk );
+            }
+            end = key ? next + 1 : close + 1;
+        } else {
+            _sjson_fail( parser, SJSON_BADCHAR, parser->offset + i );
+            *consumed = i;
+            return 1;
+        }
+
+        if ( end > base + n ) {
+            // The next slice starts after the token
+            *consumed = end;
+            return 0;
+        }
+    }
+    *consumed = base + n;
+    return 0;
+}
+
+size_t sjson_feed( sjson_parser_t* parser, const char* data, size_t size, int last ) {
+    assert( parser && SJSON_NOPARSER );
+    assert( ( data || !size ) && SJSON_NODATA );
 
+    if ( parser->error ) {
+        return 0;
+    }
+    // The start of the first token that is not complete
+    size_t consumed = 0;
+    while ( consumed < size ) {
+        size_t n = size - consumed < SJSON_SLICE ? size - consumed : SJSON_SLICE;
+        sjson_index( data + consumed, n, parser->index );
+        if ( _sjson_slice( parser, data, size, last, consumed, n, &consumed ) ) {
+            break;
+        }
+    }
 
+    if ( !parser->error && last && consumed == size && parser->depth ) {
+        _sjson_fail( parser, SJSON_UNTERMINATED, parser->offset + size );
+    }
+    parser->offset += consumed;
+    return consumed;
+}
 
+int sjson_parse( const char* data, size_t size, sjson_handler_t handler, void* user ) {
+    sjson_parser_t parser;
+    sjson_init( &parser, handler, user );
+    sjson_feed( &parser, data, size, 1 );
+    return parser.error;
+}
@@ -1,5 +1,5 @@
 // Parser for a semi-json (sjson) format
-// 
+//
 // A semi-json format is a format that resembles with the json, but gives
 // no guarantee that it handles all the aspects of the json format.
 //
@@ -7,9 +7,165 @@
 // semi-json format is a good option to get rid of some nuances of the
 // json that are unnecessary for the yaag.
 //
+// The differences to the json are:
+//
+//   - A file is a sequence of values and key-value pairs; it needs no
+//     enclosing object
+//   - The commas are optional. A comma is a separator like a whitespace
+//   - The key-value pairs may appear in the arrays too
+//   - A bare word is a number if it starts with a digit or a minus sign,
+//     otherwise a literal, e.g., true, false or null
+//
+//   "version":"1.0.1"
+//   "objects":[ { "type":"attacker" "x":1.0 "y":2.0 } ]
+//
+// The tokenizer is of the SAX style: it calls the handler for each token
+// as it goes. A token is a slice of the input, (type, offset, length), so
+// nothing is copied or allocated. The strings and the keys are sliced
+// without their quotes, and their escapes are left as they are.
+//
+// The input may be a buffer or a mmap'd file at once (sjson_parse) or a
+// stream of chunks (sjson_feed). A chunk may end within a token; the
+// tokens that are not complete are left unconsumed, and the caller feeds
+// them again at the start of the next chunk. The offsets of the tokens are
+// counted from the start of the stream.
+//
+// A chunk is tokenized in two passes over slices of SJSON_SLICE bytes. The
+// first pass builds the structural index of the slice (see sjson_index()),
+// 64 bytes at a time with SSE2 or AVX2 where the CPU has them. The second
+// pass visits only the indexed positions, so the whitespace and the contents
+// of the strings are never looked at byte by byte.
+//
 // (c) Tuomas Koskimies, 2019
 
 #ifndef _sjson_
 #define _sjson_
 
+#include <stddef.h>
+
+// Messages for the diagnostics
+#define SJSON_NOPARSER "Parser does not exist"
+#define SJSON_NODATA "Data does not exist"
+
+// Return values and errors
+#define SJSON_SUCCESS 0
+#define SJSON_STOPPED -1
+#define SJSON_BADCHAR -2
+#define SJSON_MISMATCH -3
+#define SJSON_TOODEEP -4
+#define SJSON_UNTERMINATED -5
+
+// The max nesting of the objects and the arrays
+#define SJSON_MAX_DEPTH 64
+
+// The bytes per a pass of the structural index, a multiple of 64
+#define SJSON_SLICE 16384
+
+// The types of the tokens
+#define SJSON_BEGIN_OBJECT  0
+#define SJSON_END_OBJECT    1
+#define SJSON_BEGIN_ARRAY   2
+#define SJSON_END_ARRAY     3
+// A string followed by a colon
+#define SJSON_KEY           4
+#define SJSON_STRING        5
+#define SJSON_NUMBER        6
+#define SJSON_LITERAL       7
+
+typedef struct {
+    int type;
+    // The offset from the start of the stream and the length in bytes
+    size_t offset;
+    size_t length;
+} sjson_token_t;
+
+// Handles a token
+//
+// @param user The user data of the parser
+// @param token The token
+// @param text The text of the token, valid until the handler returns
+// @return Zero to continue, nonzero to stop the parsing
+typedef int ( *sjson_handler_t )( void* user, const sjson_token_t* token, const char* text );
+
+typedef struct {
+    sjson_handler_t handler;
+    void* user;
+    // The offset of the next byte to be fed
+    size_t offset;
+    // The open objects and arrays
+    unsigned int depth;
+    unsigned char stack[ SJSON_MAX_DEPTH ];
+    // SJSON_SUCCESS or the first error and its offset
+    int error;
+    size_t error_offset;
+    // Statistics
+    unsigned int num_tokens;
+    // The structural index of the current slice
+    unsigned long long index[ SJSON_SLICE / 64 ];
+} sjson_parser_t;
+
+// Initializes the parser at the start of a stream
+//
+// @precondition parser != NULL
+// @param parser The pointer to the parser
+// @param handler The handler of the tokens
+// @param user The user data of the handler
+void sjson_init( sjson_parser_t* parser, sjson_handler_t handler, void* user );
+
+// Tokenizes the next chunk of the stream
+//
+// The tokens that the chunk completes are passed to the handler. The rest
+// of the chunk, from the start of the first incomplete token, is not
+// consumed; it must be fed again, followed by the next bytes of the stream.
+// With last, the chunk ends the stream, so every token is complete and the
+// objects and the arrays must be closed.
+//
+// @precondition parser != NULL
+// @precondition data != NULL || size == 0
+// @param parser The pointer to the parser
+// @param data The chunk
+// @param size The size of the chunk in bytes
+// @param last Nonzero if the chunk ends the stream
+// @return The number of the consumed bytes. After an error or a stop,
+//         nothing more is consumed and parser->error tells why
+size_t sjson_feed( sjson_parser_t* parser, const char* data, size_t size, int last );
+
+// Tokenizes a whole buffer, e.g., a mmap'd file
+//
+// @precondition data != NULL || size == 0
+// @param data The buffer
+// @param size The size of the buffer in bytes
+// @param handler The handler of the tokens
+// @param user The user data of the handler
+// @return SJSON_SUCCESS or the error (see sjson_parser_t)
+int sjson_parse( const char* data, size_t size, sjson_handler_t handler, void* user );
+
+// Builds the structural index of the data
+//
+// The index is a bitmap with a bit per byte, 64 bytes per word, and the
+// bit of a byte is set if a token may start or end there:
+//
+//   - A quote that is not escaped, i.e., the start or the end of a string
+//   - A brace, a bracket or a colon outside the strings
+//   - The first character of a bare word outside the strings
+//   - Any other character outside the strings, which is an error
+//
+// The data starts outside the strings. A backslash escapes the next
+// character; outside the strings it is an error itself. The strings are
+// found by a prefix-XOR of the quotes, and the escapes by the carries of the
+// odd runs of backslashes, as in simdjson. The classes of the bytes are
+// compared 16 bytes at a time with SSE2 or 32 bytes at a time with AVX2;
+// sjson_index_scalar() builds the identical index a byte at a time.
+//
+// @precondition data != NULL || size == 0
+// @precondition index != NULL
+// @param data The data
+// @param size The size of the data in bytes
+// @param index The bitmap of ( size + 63 ) / 64 words that is written
+void sjson_index( const char* data, size_t size, unsigned long long* index );
+void sjson_index_scalar( const char* data, size_t size, unsigned long long* index );
+
+// @return The instruction set of sjson_index(): "avx2", "sse2" or "scalar"
+const char* sjson_index_isa();
+
 #endif
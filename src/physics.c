@@ -1,3 +1,16 @@
+#include <assert.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./defs.h"
+#include "./mem.h"
+#include "./physics.h"
+#include "./profiler.h"
+#include "./timestep.h"
+#include "./data_structures/snapshot_ring.h"
+
 #ifdef NONE
 void qtree_dft( tnode_t* root, dbllist_t* lst ) {
     if ( !root ) {
@@ -37,8 +50,641 @@ void qtree_dft( tnode_t* root, dbllist_t* lst ) {
 }
 #endif
 
+physics_world_t* physics_world_new( unsigned int capacity ) {
+    physics_world_t* world = ( physics_world_t* ) mem_malloc( sizeof( physics_world_t ) );
+    world->objs = ( physics_obj_t* ) mem_malloc( capacity * sizeof( physics_obj_t ) );
+    world->bodies = ( physics_body_t* ) mem_malloc( capacity * sizeof( physics_body_t ) );
+    world->prev = ( physics_body_t* ) mem_malloc( capacity * sizeof( physics_body_t ) );
+    world->islands = ( unsigned int* ) mem_malloc( capacity * sizeof( unsigned int ) );
+    world->handles = pool_new( sizeof( unsigned int ), capacity );
+    // The unused bodies are zeroed, so the snapshots stay deterministic.
+    memset( world->bodies, 0, capacity * sizeof( physics_body_t ) );
+    memset( world->prev, 0, capacity * sizeof( physics_body_t ) );
+    world->count = 0;
+    world->capacity = capacity;
+    world->step = 0;
+    world->num_active = 0;
+    world->num_sleeping = 0;
+    return world;
+}
+
+void physics_world_free( physics_world_t* world ) {
+    mem_free( world->objs );
+    mem_free( world->bodies );
+    mem_free( world->prev );
+    mem_free( world->islands );
+    pool_free( world->handles );
+    mem_free( world );
+}
+
+#ifdef DEBUG
+static void _physics_forget( physics_world_t* world );
+#endif
+
+int physics_world_add( physics_world_t* world, physics_body_t* body ) {
+    assert( world && PHYSICS_NOWORLD );
+    assert( body && PHYSICS_NOBODY );
+
+    if ( world->count == world->capacity ) {
+        return PHYSICS_FULL;
+    }
+    // A new body has no history, so the previous state equals the current.
+    world->bodies[ world->count ] = *body;
+    world->prev[ world->count ] = *body;
+    world->islands[ world->count ] = world->count;
+
+    physics_obj_t* obj = &world->objs[ world->count ];
+    obj->guid = pool_alloc( world->handles );
+    *( unsigned int* ) pool_get( world->handles, obj->guid ) = world->count;
+    obj->index = world->count;
+    obj->type = 0;
+    obj->flags = 0;
+    obj->category = PHYSICS_CATEGORY_DEFAULT;
+    obj->mask = PHYSICS_MASK_ALL;
+    obj->objs = NULL;
+    obj->body = &world->bodies[ world->count ];
+    world->count++;
+#ifdef DEBUG
+    _physics_forget( world );
+#endif
+    return world->count - 1;
+}
+
+int physics_world_remove( physics_world_t* world, int guid ) {
+    assert( world && PHYSICS_NOWORLD );
+
+    unsigned int* slot = ( unsigned int* ) pool_get( world->handles, guid );
+    if ( !slot ) {
+        return PHYSICS_STALE;
+    }
+    unsigned int index = *slot;
+    unsigned int last = --world->count;
+    if ( index != last ) {
+        world->bodies[ index ] = world->bodies[ last ];
+        world->prev[ index ] = world->prev[ last ];
+        physics_obj_t* obj = &world->objs[ index ];
+        *obj = world->objs[ last ];
+        obj->index = index;
+        obj->body = &world->bodies[ index ];
+        *( unsigned int* ) pool_get( world->handles, obj->guid ) = index;
+    }
+    memset( &world->bodies[ last ], 0, sizeof( physics_body_t ) );
+    memset( &world->prev[ last ], 0, sizeof( physics_body_t ) );
+    pool_release( world->handles, guid );
+#ifdef DEBUG
+    _physics_forget( world );
+#endif
+    return PHYSICS_SUCCESS;
+}
+
+physics_obj_t* physics_world_find( physics_world_t* world, int guid ) {
+    assert( world && PHYSICS_NOWORLD );
+
+    unsigned int* slot = ( unsigned int* ) pool_get( world->handles, guid );
+    return slot ? &world->objs[ *slot ] : NULL;
+}
+
+// After the integration, the velocity is the change of the position over
+// the step. The acceleration is left to contacts_islands(), as a body that
+// rests on another under gravity accelerates but does not move.
+static int _physics_is_still( physics_body_t* body ) {
+    return abs( body->vx ) <= PHYSICS_SLEEP_VELOCITY
+        && abs( body->vy ) <= PHYSICS_SLEEP_VELOCITY;
+}
+
+void physics_step( physics_world_t* world ) {
+    assert( world && PHYSICS_NOWORLD );
+
+    memcpy( world->prev, world->bodies, world->count * sizeof( physics_body_t ) );
+
+    world->num_active = 0;
+    world->num_sleeping = 0;
+
+    physics_body_t* body = world->bodies;
+    for ( unsigned int i = 0; i < world->count; i++, body++ ) {
+        if ( physics_is_sleeping( body ) ) {
+            // A sleeping body is not integrated, so only a push wakes it up.
+            if ( _physics_is_still( body ) ) {
+                world->num_sleeping++;
+                continue;
+            }
+            body->idle = 0;
+        }
+        body->vx += body->ax;
+        body->vy += body->ay;
+        body->x += body->vx;
+        body->y += body->vy;
+        body->idle = _physics_is_still( body ) ? body->idle + 1 : 0;
+        world->num_active++;
+    }
+
+    world->step++;
+
+#ifdef DEBUG
+    physics_debug_record( world );
+#endif
+}
+
+void physics_wake( physics_world_t* world, unsigned int index ) {
+    assert( world && PHYSICS_NOWORLD );
+    assert( index < world->count && PHYSICS_NOBODY );
+
+    world->bodies[ index ].idle = 0;
+}
+
+void physics_interpolate( physics_world_t* world, unsigned int index,
+        unsigned int alpha, int* x, int* y ) {
+    assert( world && PHYSICS_NOWORLD );
+    assert( index < world->count && PHYSICS_NOBODY );
+
+    physics_body_t* prev = &world->prev[ index ];
+    physics_body_t* curr = &world->bodies[ index ];
+    // The division truncates towards zero, so the negative movements are
+    // rounded the same way as the positive ones.
+    *x = prev->x + ( ( curr->x - prev->x ) * ( int ) alpha ) / TIMESTEP_ALPHA_ONE;
+    *y = prev->y + ( ( curr->y - prev->y ) * ( int ) alpha ) / TIMESTEP_ALPHA_ONE;
+}
+
+physics_pairs_t* physics_pairs_new( unsigned int capacity ) {
+    physics_pairs_t* pairs = ( physics_pairs_t* ) mem_malloc( sizeof( physics_pairs_t ) );
+    pairs->capacity = capacity ? capacity : 1;
+    pairs->pairs = ( physics_pair_t* ) mem_malloc( pairs->capacity * sizeof( physics_pair_t ) );
+    pairs->count = 0;
+    pairs->rejected = 0;
+    pairs->sleeping = 0;
+    return pairs;
+}
+
+void physics_pairs_free( physics_pairs_t* pairs ) {
+    mem_free( pairs->pairs );
+    mem_free( pairs );
+}
+
+void physics_pairs_reserve( physics_pairs_t* pairs, unsigned int capacity ) {
+    if ( capacity <= pairs->capacity ) {
+        return;
+    }
+    physics_pair_t* grown = ( physics_pair_t* ) mem_malloc( capacity * sizeof( physics_pair_t ) );
+    memcpy( grown, pairs->pairs, pairs->count * sizeof( physics_pair_t ) );
+    mem_free( pairs->pairs );
+    pairs->pairs = grown;
+    pairs->capacity = capacity;
+}
+
+void physics_pairs_push( physics_pairs_t* pairs, physics_obj_t* obj_0, physics_obj_t* obj_1 ) {
+    if ( pairs->count == pairs->capacity ) {
+        physics_pairs_reserve( pairs, 2 * pairs->capacity );
+    }
+    pairs->pairs[ pairs->count ].obj_0 = obj_0;
+    pairs->pairs[ pairs->count ].obj_1 = obj_1;
+    pairs->count++;
+}
+
+void physics_bounds( physics_obj_t* obj, int* x0, int* y0, int* x1, int* y1 ) {
+    physics_body_t* body = obj->body;
+
+    *x0 = body->x;
+    *y0 = body->y;
+    *x1 = body->x + ( int ) body->w;
+    *y1 = body->y + ( int ) body->h;
+    if ( obj->flags & PHYSICS_FLAG_FAST ) {
+        if ( body->vx > 0 ) {
+            *x0 -= body->vx;
+        } else {
+            *x1 -= body->vx;
+        }
+        if ( body->vy > 0 ) {
+            *y0 -= body->vy;
+        } else {
+            *y1 -= body->vy;
+        }
+    }
+}
+
+// Returns the index of the layer of the category
+static unsigned int _physics_layer( unsigned int category ) {
+    assert( category && !( category & ( category - 1 ) ) && PHYSICS_BADCATEGORY );
+    assert( category < ( 1u << PHYSICS_NUM_LAYERS ) && PHYSICS_BADCATEGORY );
+
+    unsigned int layer = 0;
+    while ( !( category & 1 ) ) {
+        category >>= 1;
+        layer++;
+    }
+    return layer;
+}
+
+static physics_bucket_t* _physics_bucket_new() {
+    physics_bucket_t* bucket = ( physics_bucket_t* ) mem_malloc( sizeof( physics_bucket_t ) );
+    bucket->categories = 0;
+    for ( int i = 0; i < PHYSICS_NUM_LAYERS; i++ ) {
+        bucket->layers[i] = NULL;
+    }
+    bucket->spare = NULL;
+    return bucket;
+}
+
+static void _physics_bucket_free( void* data ) {
+    physics_bucket_t* bucket = ( physics_bucket_t* ) data;
+    if ( !bucket ) {
+        return;
+    }
+    for ( int i = 0; i < PHYSICS_NUM_LAYERS; i++ ) {
+        if ( bucket->layers[i] ) {
+            dbllist_remove( bucket->layers[i], NULL );
+            dbllist_free( bucket->layers[i] );
+        }
+    }
+    while ( bucket->spare ) {
+        dblnode_t* node = bucket->spare;
+        bucket->spare = node->next;
+        mem_free( node );
+    }
+    mem_free( bucket );
+}
+
+tnode_t* physics_insert( qtree_t* q, physics_obj_t* obj ) {
+    assert( q && QUAD_NOQTREE );
+    assert( obj && obj->body && PHYSICS_NOBODY );
+
+    int x0, y0, x1, y1;
+    physics_bounds( obj, &x0, &y0, &x1, &y1 );
+    // An empty box still occupies its corner.
+    if ( x1 == x0 ) {
+        x1++;
+    }
+    if ( y1 == y0 ) {
+        y1++;
+    }
+    int index_tl = qtree_point_index( q, x0, y0 );
+    int index_br = qtree_point_index( q, x1 - 1, y1 - 1 );
+
+    tnode_t* tnode = NULL;
+    if ( index_tl == COORDINATE_OUSIDE || index_br == COORDINATE_OUSIDE ) {
+        tnode = qtree_branch( q, 0, 0 );
+    } else {
+        tnode = qtree_branch( q, qtree_common_quad( q, index_tl, index_br ), index_tl );
+    }
+
+    if ( !tnode->data ) {
+        tnode->data = _physics_bucket_new();
+    }
+    physics_bucket_t* bucket = ( physics_bucket_t* ) tnode->data;
+    unsigned int layer = _physics_layer( obj->category );
+    if ( !bucket->layers[ layer ] ) {
+        bucket->layers[ layer ] = dbllist_new();
+    }
+    // The root exists now, as the branch goes through it.
+    physics_bucket_t* root = ( physics_bucket_t* ) q->tree->root->data;
+    if ( root && root->spare ) {
+        dblnode_t* node = root->spare;
+        root->spare = node->next;
+        dbllist_link_to_end( bucket->layers[ layer ], node, obj );
+    } else {
+        dbllist_push_to_end( bucket->layers[ layer ], obj );
+    }
+    bucket->categories |= obj->category;
+
+    return tnode;
+}
+
+qtree_t* physics_construct_bsp( qtree_t* q, physics_world_t* world ) {
+    assert( q && QUAD_NOQTREE );
+    assert( world && PHYSICS_NOWORLD );
+
+    for ( unsigned int i = 0; i < world->count; i++ ) {
+        physics_insert( q, &world->objs[i] );
+    }
+    return q;
+}
+
+// Moves the nodes of the lists of the subtree to the spares of the root
+static void _physics_clear_node( tnode_t* node, physics_bucket_t* root ) {
+    physics_bucket_t* bucket = ( physics_bucket_t* ) node->data;
+    if ( bucket ) {
+        for ( int i = 0; i < PHYSICS_NUM_LAYERS; i++ ) {
+            if ( bucket->layers[i] && bucket->layers[i]->size ) {
+                dblnode_t* tail = bucket->layers[i]->tail;
+                tail->next = root->spare;
+                root->spare = dbllist_detach( bucket->layers[i] );
+            }
+        }
+        bucket->categories = 0;
+    }
+    if ( node->children ) {
+        dblnode_t* child = dbllist_head( node->children );
+        while ( child ) {
+            _physics_clear_node( ( tnode_t* ) child->data, root );
+            child = child->next;
+        }
+    }
+}
+
+void physics_clear_bsp( qtree_t* q ) {
+    assert( q && QUAD_NOQTREE );
+
+    if ( q->tree->root ) {
+        if ( !q->tree->root->data ) {
+            q->tree->root->data = _physics_bucket_new();
+        }
+        _physics_clear_node( q->tree->root, ( physics_bucket_t* ) q->tree->root->data );
+    }
+}
+
+void physics_free_bsp( qtree_t* q ) {
+    assert( q && QUAD_NOQTREE );
+
+    if ( q->tree->root ) {
+        tree_remove( q->tree, q->tree->root, _physics_bucket_free );
+    }
+    qtree_free( q );
+}
+
+void physics_pairs_clear( physics_pairs_t* pairs ) {
+    pairs->count = 0;
+    pairs->rejected = 0;
+    pairs->sleeping = 0;
+}
+
+// Pairs the object with the objects of the bucket
+//
+// The layers that the mask of the object excludes are skipped as a whole.
+// If first is given, only the objects after it in its layer are paired and
+// the lower layers are skipped, so each pair of a bucket is emitted once.
+static void _physics_pair_bucket( physics_obj_t* obj, physics_bucket_t* bucket,
+        dblnode_t* first, physics_pairs_t* pairs ) {
+    unsigned int layer_first = first ? _physics_layer( obj->category ) : 0;
+
+    for ( unsigned int layer = layer_first; layer < PHYSICS_NUM_LAYERS; layer++ ) {
+        dbllist_t* objs = bucket->layers[ layer ];
+        if ( !objs ) {
+            continue;
+        }
+        dblnode_t* other = dbllist_head( objs );
+        if ( first && layer == layer_first ) {
+            other = first->next;
+        } else if ( !( obj->mask & ( 1u << layer ) ) ) {
+            // The whole layer is skipped; its objects count as rejected.
+            pairs->rejected += dbllist_size( objs );
+            continue;
+        }
+        while ( other ) {
+            physics_obj_t* obj_1 = ( physics_obj_t* ) other->data;
+            if ( !( obj->mask & obj_1->category ) || !( obj_1->mask & obj->category ) ) {
+                pairs->rejected++;
+            } else if ( physics_is_sleeping( obj->body ) && physics_is_sleeping( obj_1->body ) ) {
+                pairs->sleeping++;
+            } else {
+                physics_pairs_push( pairs, obj, obj_1 );
+            }
+            other = other->next;
+        }
+    }
+}
+
+void physics_check_node( tnode_t* node, physics_bucket_t** ancestors,
+        unsigned int num_ancestors, physics_pairs_t* pairs ) {
+    physics_bucket_t* bucket = ( physics_bucket_t* ) node->data;
+    if ( !bucket || !bucket->categories ) {
+        return;
+    }
+    for ( int layer = 0; layer < PHYSICS_NUM_LAYERS; layer++ ) {
+        if ( !bucket->layers[ layer ] ) {
+            continue;
+        }
+        dblnode_t* other = dbllist_head( bucket->layers[ layer ] );
+        while ( other ) {
+            physics_obj_t* obj = ( physics_obj_t* ) other->data;
+            // Against the ancestors.
+            for ( unsigned int i = 0; i < num_ancestors; i++ ) {
+                _physics_pair_bucket( obj, ancestors[i], NULL, pairs );
+            }
+            // Against the rest of the bucket.
+            _physics_pair_bucket( obj, bucket, other, pairs );
+            other = other->next;
+        }
+    }
+}
+
+void physics_check_subtree( tnode_t* root, physics_bucket_t** ancestors,
+        unsigned int num_ancestors, physics_pairs_t* pairs ) {
+    physics_check_node( root, ancestors, num_ancestors, pairs );
+    if ( !root->children ) {
+        return;
+    }
+
+    // The children see the bucket of this node as an ancestor.
+    physics_bucket_t* bucket = ( physics_bucket_t* ) root->data;
+    if ( bucket && bucket->categories ) {
+        assert( num_ancestors < PHYSICS_MAX_DEPTH && PHYSICS_TOODEEP );
+        ancestors[ num_ancestors++ ] = bucket;
+    }
+    dblnode_t* child = dbllist_head( root->children );
+    while ( child ) {
+        physics_check_subtree( ( tnode_t* ) child->data, ancestors, num_ancestors, pairs );
+        child = child->next;
+    }
+}
+
+static unsigned int _physics_query_node( tnode_t* node, int subtree, int x0, int y0, int x1, int y1,
+        unsigned int mask, physics_visit_t fn, void* data ) {
+    unsigned int count = 0;
+    physics_bucket_t* bucket = ( physics_bucket_t* ) node->data;
+    if ( bucket && ( bucket->categories & mask ) ) {
+        for ( int layer = 0; layer < PHYSICS_NUM_LAYERS; layer++ ) {
+            if ( !bucket->layers[ layer ] || !( mask & ( 1u << layer ) ) ) {
+                continue;
+            }
+            dblnode_t* other = dbllist_head( bucket->layers[ layer ] );
+            while ( other ) {
+                physics_obj_t* obj = ( physics_obj_t* ) other->data;
+                int ox0, oy0, ox1, oy1;
+                physics_bounds( obj, &ox0, &oy0, &ox1, &oy1 );
+                if ( ox0 < x1 && x0 < ox1 && oy0 < y1 && y0 < oy1 ) {
+                    fn( obj, data );
+                    count++;
+                }
+                other = other->next;
+            }
+        }
+    }
+    if ( subtree && node->children ) {
+        dblnode_t* child = dbllist_head( node->children );
+        while ( child ) {
+            count += _physics_query_node( ( tnode_t* ) child->data, 1, x0, y0, x1, y1, mask, fn, data );
+            child = child->next;
+        }
+    }
+    return count;
+}
+
+unsigned int physics_query( qtree_t* q, int x0, int y0, int x1, int y1, unsigned int mask,
+        physics_visit_t fn, void* data ) {
+    assert( q && QUAD_NOQTREE );
+    assert( fn && PHYSICS_NOVISIT );
+
+    if ( !q->tree->root || x1 <= x0 || y1 <= y0 ) {
+        return 0;
+    }
+    int index_tl = qtree_point_index( q, x0, y0 );
+    int index_br = qtree_point_index( q, x1 - 1, y1 - 1 );
+    if ( index_tl == COORDINATE_OUSIDE || index_br == COORDINATE_OUSIDE ) {
+        return _physics_query_node( q->tree->root, 1, x0, y0, x1, y1, mask, fn, data );
+    }
+    // The objects that overlap the box are in the node of the box, in its
+    // ancestors or in its subtree (see physics_insert).
+    unsigned int level = qtree_common_quad( q, index_tl, index_br );
+    unsigned int count = 0;
+    for ( unsigned int l = 0; l <= level; l++ ) {
+        tnode_t* node = qtree_get_node( q, l, index_tl );
+        if ( !node ) {
+            break;
+        }
+        count += _physics_query_node( node, l == level, x0, y0, x1, y1, mask, fn, data );
+    }
+    return count;
+}
+
+void physics_check_collisions( tnode_t* root, dbllist_t* lst, physics_pairs_t* pairs ) {
+    PROF_ZONE( "physics_check_collisions" );
+    if ( !root ) {
+        return;
+    }
+
+    physics_bucket_t* ancestors[ PHYSICS_MAX_DEPTH ];
+    unsigned int num_ancestors = 0;
+    if ( lst ) {
+        dblnode_t* ancestor = dbllist_head( lst );
+        while ( ancestor ) {
+            assert( num_ancestors < PHYSICS_MAX_DEPTH && PHYSICS_TOODEEP );
+            ancestors[ num_ancestors++ ] = ( physics_bucket_t* ) ancestor->data;
+            ancestor = ancestor->next;
+        }
+    }
+    physics_check_subtree( root, ancestors, num_ancestors, pairs );
+}
+
+int physics_check_two_bodies( physics_obj_t* obj_0, physics_obj_t* obj_1 ) {
+    physics_body_t* b_0 = obj_0->body;
+    physics_body_t* b_1 = obj_1->body;
+
+    return b_0->x < b_1->x + ( int ) b_1->w
+        && b_1->x < b_0->x + ( int ) b_0->w
+        && b_0->y < b_1->y + ( int ) b_1->h
+        && b_1->y < b_0->y + ( int ) b_0->h;
+}
+
+// Computes the interval when the moving segment [ a0, a1 ) overlaps the
+// segment [ b0, b1 ) in one axis
+//
+// @return Zero if the segments never overlap
+static int _physics_sweep_axis( long long a0, long long a1, long long b0, long long b1,
+        long long d, long long* t_entry, long long* t_exit ) {
+    if ( d == 0 ) {
+        *t_entry = LLONG_MIN;
+        *t_exit = LLONG_MAX;
+        return a0 < b1 && b0 < a1;
+    }
+    if ( d > 0 ) {
+        *t_entry = ( b0 - a1 ) * PHYSICS_TOI_ONE / d;
+        *t_exit = ( b1 - a0 ) * PHYSICS_TOI_ONE / d;
+    } else {
+        *t_entry = ( b1 - a0 ) * PHYSICS_TOI_ONE / d;
+        *t_exit = ( b0 - a1 ) * PHYSICS_TOI_ONE / d;
+    }
+    return 1;
+}
+
+int physics_sweep_box( int x_0, int y_0, unsigned int w_0, unsigned int h_0,
+        int dx, int dy, int x_1, int y_1, unsigned int w_1, unsigned int h_1,
+        unsigned int* toi ) {
+    long long entry_x, exit_x, entry_y, exit_y;
+    if ( !_physics_sweep_axis( x_0, ( long long ) x_0 + w_0, x_1, ( long long ) x_1 + w_1, dx, &entry_x, &exit_x )
+            || !_physics_sweep_axis( y_0, ( long long ) y_0 + h_0, y_1, ( long long ) y_1 + h_1, dy, &entry_y, &exit_y ) ) {
+        return 0;
+    }
+
+    long long t_entry = entry_x > entry_y ? entry_x : entry_y;
+    long long t_exit = exit_x < exit_y ? exit_x : exit_y;
+    // Meeting exactly at the end of the step is touching, not overlapping.
+    if ( t_entry >= t_exit || t_entry >= PHYSICS_TOI_ONE || t_exit <= 0 ) {
+        return 0;
+    }
+    *toi = t_entry < 0 ? 0 : ( unsigned int ) t_entry;
+    return 1;
+}
+
+int physics_sweep_two_bodies( physics_obj_t* obj_0, physics_obj_t* obj_1, unsigned int* toi ) {
+    physics_body_t* b_0 = obj_0->body;
+    physics_body_t* b_1 = obj_1->body;
+
+    // The movement of the 1st body relative to the 2nd one, from the
+    // positions at the beginning of the step.
+    return physics_sweep_box( b_0->x - b_0->vx, b_0->y - b_0->vy, b_0->w, b_0->h,
+        b_0->vx - b_1->vx, b_0->vy - b_1->vy,
+        b_1->x - b_1->vx, b_1->y - b_1->vy, b_1->w, b_1->h, toi );
+}
+
 #ifdef DEBUG
 unsigned int _physics_curr_step = 0;
+physics_world_t* _physics_debug_world = NULL;
+snapring_t* _physics_history = NULL;
+
+// Restores the attached world to the given step of the history
+static void _physics_restore( unsigned int step ) {
+    physics_world_t* world = _physics_debug_world;
+    int length = snapring_restore( _physics_history, step, world->bodies );
+    assert( length != SNAPRING_NOTFOUND );
+
+    // The interpolation has no history after a jump.
+    world->count = length / sizeof( physics_body_t );
+    memcpy( world->prev, world->bodies, world->capacity * sizeof( physics_body_t ) );
+    world->step = step;
+    _physics_curr_step = step;
+}
+
+// Restarts the history of the attached world from its current step
+//
+// The snapshots hold only the bodies, so a step before an addition or a
+// removal could not give back the objects and the handles of that step.
+static void _physics_forget( physics_world_t* world ) {
+    if ( world != _physics_debug_world || !_physics_history ) {
+        return;
+    }
+    snapring_clear( _physics_history );
+    physics_debug_record( world );
+}
+
+void physics_debug_attach( physics_world_t* world,
+        unsigned int max_frames,
+        unsigned int max_bytes,
+        unsigned int keyframe_interval ) {
+    assert( world && PHYSICS_NOWORLD );
+
+    physics_debug_detach();
+    _physics_debug_world = world;
+    _physics_history = snapring_new( world->capacity * sizeof( physics_body_t ),
+            max_frames, max_bytes, keyframe_interval );
+    physics_debug_record( world );
+}
+
+void physics_debug_detach() {
+    if ( _physics_history ) {
+        snapring_free( _physics_history );
+    }
+    _physics_history = NULL;
+    _physics_debug_world = NULL;
+    _physics_curr_step = 0;
+}
+
+void physics_debug_record( physics_world_t* world ) {
+    if ( world != _physics_debug_world || !_physics_history ) {
+        return;
+    }
+    snapring_push( _physics_history, world->step, world->bodies,
+            world->count * sizeof( physics_body_t ) );
+    _physics_curr_step = world->step;
+}
 
 // Returns the current step (>0) of the simulation
 //
@@ -49,13 +695,48 @@ unsigned int physics_current_step() {
     return _physics_curr_step;
 }
 
-void physics_next_step( unsigned int step_count ) {}
-void physics_prev_step( unsigned int step_count ) {}
+void physics_next_step( unsigned int step_count ) {
+    if ( !_physics_history ) {
+        return;
+    }
+    for ( unsigned int i = 0; i < step_count; i++ ) {
+        unsigned int next = _physics_debug_world->step + 1;
+        // Replay the history as long as there is one; then simulate.
+        if ( snapring_contains( _physics_history, next ) ) {
+            _physics_restore( next );
+        } else {
+            physics_step( _physics_debug_world );
+        }
+    }
+}
+
+void physics_prev_step( unsigned int step_count ) {
+    if ( !_physics_history || !snapring_contains( _physics_history, _physics_curr_step ) ) {
+        return;
+    }
+    unsigned int oldest = snapring_oldest( _physics_history );
+    unsigned int step = _physics_curr_step - oldest < step_count
+        ? oldest
+        : _physics_curr_step - step_count;
+    _physics_restore( step );
+}
+
 unsigned int physics_add_rigid_body() {}
 void physics_del_rigid_body() {}
 void physics_print_bsp() {}
 void physics_print_state() {}
 void physics_print_obj( int guid ) {
-
+    physics_obj_t* obj = _physics_debug_world
+        ? physics_world_find( _physics_debug_world, guid )
+        : NULL;
+    if ( !obj ) {
+        printf( "obj %d: stale\n", guid );
+        return;
+    }
+    physics_body_t* b = obj->body;
+    printf( "obj %d: index %u type %d flags 0x%x category 0x%x mask 0x%x\n",
+        guid, obj->index, obj->type, obj->flags, obj->category, obj->mask );
+    printf( "    x %d y %d w %u h %u vx %d vy %d ax %d ay %d m %u idle %u\n",
+        b->x, b->y, b->w, b->h, b->vx, b->vy, b->ax, b->ay, b->m, b->idle );
 }
 #endif // #ifdef DEBUG
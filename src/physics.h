@@ -2,14 +2,66 @@
 #ifndef _physics_
 #define _physics_
 
+#include "./defs.h"
 #include "./data_structures/doublyLinkedList.h"
+#include "./data_structures/pool.h"
 #include "./data_structures/quad_tree.h"
 
-typedef struct {
-    int guid;
-    int type;
-    dbllist_t* objs;
-} physics_obj_t;
+// Messages for the diagnostics
+#define PHYSICS_NOWORLD "World does not exist"
+#define PHYSICS_NOBODY "Body does not exist"
+#define PHYSICS_NOVISIT "Visit function does not exist"
+#define PHYSICS_WORLDFULL "World is full"
+#define PHYSICS_BADCATEGORY "Category must be a single layer bit"
+#define PHYSICS_TOODEEP "Tree is deeper than PHYSICS_MAX_DEPTH"
+
+// Return values
+#define PHYSICS_SUCCESS 0
+#define PHYSICS_FULL -1
+#define PHYSICS_STALE -2
+
+// Object flags
+//
+// PHYSICS_FLAG_FAST  The object may move farther than its size in one step.
+//                    Its swept bounds are used in the broadphase and its
+//                    pairs are tested with physics_sweep_two_bodies().
+#define PHYSICS_FLAG_FAST   0x1
+
+// Collision layers
+//
+// Each object belongs to one layer; its category is the bit of the layer.
+// The mask tells the layers that the object collides with. A pair is
+// accepted only if the category of each object is in the mask of the other.
+#define PHYSICS_NUM_LAYERS          8
+#define PHYSICS_CATEGORY_DEFAULT    0x1
+#define PHYSICS_MASK_ALL            ( ( 1u << PHYSICS_NUM_LAYERS ) - 1 )
+
+// Sleeping
+//
+// A body whose velocity stays within the threshold for PHYSICS_SLEEP_STEPS
+// steps falls asleep. The velocity is checked after the integration, when
+// it is the change of the position over the step, so a body that rests on
+// another under gravity counts as still: the solver cancels what gravity
+// adds. An island of bodies whose acceleration is beyond its threshold
+// stays asleep only while it rests on a static body (see contacts_islands).
+// A sleeping body is not integrated and the pairs of two sleeping bodies
+// are not emitted by the broadphase.
+// The touching bodies form islands (see contacts_islands) that fall asleep
+// and wake up together. A body with zero mass is static and does not join
+// the islands.
+#define PHYSICS_SLEEP_STEPS         50
+#define PHYSICS_SLEEP_VELOCITY      0
+#define PHYSICS_SLEEP_ACCELERATION  0
+
+#define physics_is_sleeping(body) ( ( body )->idle >= PHYSICS_SLEEP_STEPS )
+#define physics_is_static(body) ( ( body )->m == 0 )
+
+// The max number of the ancestors of a node in the broadphase
+#define PHYSICS_MAX_DEPTH   16
+
+// The fixed-point one of the time of impact
+#define PHYSICS_TOI_BITS    16
+#define PHYSICS_TOI_ONE     ( 1 << PHYSICS_TOI_BITS )
 
 // 
 typedef struct {
@@ -26,15 +78,401 @@ typedef struct {
     int Lx;
     int Ly;
     unsigned int m;
+    // Sleeping
+    unsigned int idle;
+    // The part of the solved velocities below one unit that is not yet
+    // moved, in 1/SOLVER_ONE units (see solver.h)
+    int rx;
+    int ry;
 } physics_body_t;
 
+// The guid is a handle of the world (see pool.h); it stays the same while
+// the object lives and goes stale when it is removed. The index is the
+// current index of the body in the world, which changes on a removal.
+typedef struct {
+    int guid;
+    unsigned int index;
+    int type;
+    unsigned int flags;
+    unsigned int category;
+    unsigned int mask;
+    dbllist_t* objs;
+    physics_body_t* body;
+} physics_obj_t;
+
+// The data of a quad-tree node
+//
+// The objects of the node are kept in the per-layer lists, so a query can
+// skip the layers that its mask excludes. The categories is the union of
+// the categories of the objects. The spare nodes of the lists are kept in
+// the bucket of the root, linked by next, and reused by the inserts.
+typedef struct {
+    unsigned int categories;
+    dbllist_t* layers[ PHYSICS_NUM_LAYERS ];
+    dblnode_t* spare;
+} physics_bucket_t;
+
+// A visit of physics_query()
+//
+// @param obj The object that overlaps the box
+// @param data The data of the query
+typedef void ( *physics_visit_t )( physics_obj_t* obj, void* data );
+
+// A candidate pair of the broadphase
+typedef struct {
+    physics_obj_t* obj_0;
+    physics_obj_t* obj_1;
+} physics_pair_t;
+
+// A growing buffer of the candidate pairs
+//
+// The rejected is the number of the pairs that the layer filter rejected
+// and the sleeping is the number of the pairs of two sleeping bodies.
+typedef struct {
+    physics_pair_t* pairs;
+    unsigned int count;
+    unsigned int capacity;
+    unsigned int rejected;
+    unsigned int sleeping;
+} physics_pairs_t;
+
 typedef struct {
 
 } physics_collider_2D_t;
 
-qtree_t* physics_construct_bsp( tnode_t* root );
+// A simulated world
+//
+// The bodies are stored in a contiguous array. The state of the previous
+// step is kept next to the current one so that the rendering can blend
+// between the two (see timestep.h).
+//
+// The islands map each body to the index of the representative body of its
+// island. The num_active and num_sleeping count the bodies of the latest
+// step. The handles map the guids to the indices of the bodies.
+typedef struct {
+    physics_obj_t* objs;
+    physics_body_t* bodies;
+    physics_body_t* prev;
+    unsigned int* islands;
+    pool_t* handles;
+    unsigned int count;
+    unsigned int capacity;
+    unsigned int step;
+    unsigned int num_active;
+    unsigned int num_sleeping;
+} physics_world_t;
+
+// Creates a new world
+//
+// @param capacity The max number of the bodies in the world
+// @return The pointer to the world
+physics_world_t* physics_world_new( unsigned int capacity );
+
+// Releases the world and its bodies
+//
+// @param world The pointer to the world
+void physics_world_free( physics_world_t* world );
+
+// Adds a copy of the body to the world
+//
+// The body gets a physics object, world->objs[ index ], with a new guid.
+//
+// @precondition world != NULL
+// @precondition body != NULL
+// @param world The pointer to the world
+// @param body The pointer to the body that is copied
+// @return The index of the body in the world, or PHYSICS_FULL
+int physics_world_add( physics_world_t* world, physics_body_t* body );
+
+// Removes the body of the object from the world
+//
+// The last body of the world takes the index of the removed one; its guid
+// does not change. The guid of the removed object goes stale, so the
+// lookups of it fail instead of finding the body that reuses the slot.
+//
+// @precondition world != NULL
+// @param world The pointer to the world
+// @param guid The guid of the object
+// @return PHYSICS_SUCCESS, or PHYSICS_STALE if the guid is not valid
+int physics_world_remove( physics_world_t* world, int guid );
+
+// Looks up the object in constant time
+//
+// @precondition world != NULL
+// @param world The pointer to the world
+// @param guid The guid of the object
+// @return The pointer to the object, or NULL if the guid is not valid
+physics_obj_t* physics_world_find( physics_world_t* world, int guid );
+
+// Advances the world by one fixed step
+//
+// The velocities and the positions are integrated with the semi-implicit
+// Euler method. The velocities are given in units per step and the
+// accelerations in units per step^2.
+//
+// The sleeping bodies are skipped. A sleeping body whose velocity or
+// acceleration has been changed over the thresholds wakes up.
+//
+// @precondition world != NULL
+// @postcondition world->prev holds the state before the step
+// @param world The pointer to the world
+void physics_step( physics_world_t* world );
+
+// Wakes up the body
+//
+// @precondition world != NULL
+// @precondition index < world->count
+// @param world The pointer to the world
+// @param index The index of the body
+void physics_wake( physics_world_t* world, unsigned int index );
+
+// Returns the position of the body blended between the previous and the
+// current step
+//
+// @precondition world != NULL
+// @precondition index < world->count
+// @param world The pointer to the world
+// @param index The index of the body
+// @param alpha The interpolation factor in range [0, TIMESTEP_ALPHA_ONE]
+// @param x The pointer to the interpolated x coordinate
+// @param y The pointer to the interpolated y coordinate
+void physics_interpolate( physics_world_t* world, unsigned int index,
+        unsigned int alpha, int* x, int* y );
+
+// Creates a new pair buffer
+//
+// @param capacity The initial capacity of the buffer
+// @return The pointer to the buffer
+physics_pairs_t* physics_pairs_new( unsigned int capacity );
+
+// Releases the pair buffer
+//
+// @param pairs The pointer to the buffer
+void physics_pairs_free( physics_pairs_t* pairs );
+
+// Empties the buffer and zeroes the counters
+//
+// @param pairs The pointer to the buffer
+void physics_pairs_clear( physics_pairs_t* pairs );
+
+// Grows the buffer to hold at least the given number of pairs
+//
+// The pairs in the buffer are kept. A buffer that has enough room for the
+// pairs of a pass is not reallocated during the pass.
+//
+// @param pairs The pointer to the buffer
+// @param capacity The number of the pairs
+void physics_pairs_reserve( physics_pairs_t* pairs, unsigned int capacity );
+
+// Appends a pair to the buffer. The buffer grows as needed
+//
+// @param pairs The pointer to the buffer
+// @param obj_0 The pointer to the 1st object
+// @param obj_1 The pointer to the 2nd object
+void physics_pairs_push( physics_pairs_t* pairs, physics_obj_t* obj_0, physics_obj_t* obj_1 );
+
+// Returns the bounds of the object in the broadphase
+//
+// For a fast object, the bounds cover the movement of the latest step, i.e.,
+// the box at ( x - vx, y - vy ) and the box at ( x, y ).
+//
+// @precondition obj != NULL && obj->body != NULL
+// @param obj The pointer to the object
+// @param x0 The pointer to the left edge
+// @param y0 The pointer to the top edge
+// @param x1 The pointer to the right edge (exclusive)
+// @param y1 The pointer to the bottom edge (exclusive)
+void physics_bounds( physics_obj_t* obj, int* x0, int* y0, int* x1, int* y1 );
+
+// Inserts the object into the smallest quadrant that contains its bounds
+//
+// The objects outside of the region of the tree are inserted into the root.
+// The data of the node is a physics_bucket_t.
+//
+// @precondition q != NULL
+// @precondition obj != NULL && obj->body != NULL
+// @param q The pointer to the tree
+// @param obj The pointer to the object
+// @return The node where the object was inserted to
+tnode_t* physics_insert( qtree_t* q, physics_obj_t* obj );
+
+// Inserts all objects of the world into the tree
+//
+// @precondition q != NULL
+// @precondition world != NULL
+// @param q The pointer to the tree
+// @param world The pointer to the world
+// @return The tree for chaining
+qtree_t* physics_construct_bsp( qtree_t* q, physics_world_t* world );
+
+// Empties the object lists of the tree. The nodes of the tree and of the
+// lists are kept for the next physics_construct_bsp(), so rebuilding a tree
+// of the same objects does not allocate
+//
+// @param q The pointer to the tree
+void physics_clear_bsp( qtree_t* q );
+
+// Releases the tree and its nodes. The objects are not released
+//
+// @param q The pointer to the tree
+void physics_free_bsp( qtree_t* q );
+
 qtree_t* physics_update_bsp();
-void physics_check_collisions( tnode_t* root, dbllist_t* lst );
+
+// Collects the candidate pairs of the subtree
+//
+// The objects of a node are paired with each other and with the objects of
+// the ancestors of the node. The pairs that the layers exclude are counted
+// to pairs->rejected and never emitted.
+//
+// @precondition pairs != NULL
+// @param root The root of the subtree
+// @param lst The buckets of the ancestors of the root, or NULL
+// @param pairs The buffer where the pairs are appended to
+void physics_check_collisions( tnode_t* root, dbllist_t* lst, physics_pairs_t* pairs );
+
+// Collects the candidate pairs of the objects of one node
+//
+// The objects of the node are paired with each other and with the objects
+// of the ancestor buckets. The children are not visited.
+//
+// @precondition node != NULL
+// @precondition pairs != NULL
+// @param node The node
+// @param ancestors The buckets of the ancestors of the node
+// @param num_ancestors The number of the ancestor buckets
+// @param pairs The buffer where the pairs are appended to
+void physics_check_node( tnode_t* node, physics_bucket_t** ancestors,
+        unsigned int num_ancestors, physics_pairs_t* pairs );
+
+// Collects the candidate pairs of the subtree
+//
+// Equals to physics_check_collisions() with the ancestors given as an
+// array. The array is used as a stack for the deeper levels.
+//
+// @precondition root != NULL
+// @precondition pairs != NULL
+// @param root The root of the subtree
+// @param ancestors The array of PHYSICS_MAX_DEPTH buckets whose first
+//                  num_ancestors are the buckets of the ancestors of the root
+// @param num_ancestors The number of the ancestor buckets
+// @param pairs The buffer where the pairs are appended to
+void physics_check_subtree( tnode_t* root, physics_bucket_t** ancestors,
+        unsigned int num_ancestors, physics_pairs_t* pairs );
+
+// Visits the objects of the tree that overlap the box
+//
+// Only the nodes on the path to the box and the subtree of the box are
+// searched.
+//
+// @precondition q != NULL
+// @precondition fn != NULL
+// @param q The tree
+// @param x0 The left side of the box
+// @param y0 The top side of the box
+// @param x1 The right side of the box
+// @param y1 The bottom side of the box
+// @param mask The categories of the objects that are visited
+// @param fn The function that is called for each object
+// @param data The data that is passed to the function
+// @return The number of the visited objects
+unsigned int physics_query( qtree_t* q, int x0, int y0, int x1, int y1, unsigned int mask,
+        physics_visit_t fn, void* data );
+
+// Tests whether the bounding boxes of the objects overlap
+//
+// @precondition obj_0->body != NULL && obj_1->body != NULL
+// @param obj_0 The pointer to the 1st object
+// @param obj_1 The pointer to the 2nd object
+// @return Non-zero if the objects overlap
 int physics_check_two_bodies( physics_obj_t* obj_0, physics_obj_t* obj_1 );
 
+// Tests whether the bounding boxes of the objects met during the latest step
+//
+// The bodies are assumed to have moved from ( x - vx, y - vy ) to ( x, y )
+// along a straight line. The test is done in the frame of the 2nd body.
+//
+// @precondition obj_0->body != NULL && obj_1->body != NULL
+// @param obj_0 The pointer to the 1st object
+// @param obj_1 The pointer to the 2nd object
+// @param toi The pointer to the time of impact in range
+//            [0, PHYSICS_TOI_ONE]. Zero if the boxes overlapped at the
+//            beginning of the step
+// @return Non-zero if the boxes overlapped at some point of the step
+int physics_sweep_two_bodies( physics_obj_t* obj_0, physics_obj_t* obj_1, unsigned int* toi );
+
+// Tests whether the moving box meets the still box
+//
+// @param x_0 The x coordinate of the moving box at the beginning
+// @param y_0 The y coordinate of the moving box at the beginning
+// @param w_0 The width of the moving box
+// @param h_0 The height of the moving box
+// @param dx The movement of the box in x
+// @param dy The movement of the box in y
+// @param x_1 The x coordinate of the still box
+// @param y_1 The y coordinate of the still box
+// @param w_1 The width of the still box
+// @param h_1 The height of the still box
+// @param toi The pointer to the time of impact (see physics_sweep_two_bodies)
+// @return Non-zero if the boxes overlap at some point of the movement
+int physics_sweep_box( int x_0, int y_0, unsigned int w_0, unsigned int h_0,
+        int dx, int dy, int x_1, int y_1, unsigned int w_1, unsigned int h_1,
+        unsigned int* toi );
+
+#ifdef DEBUG
+// Starts recording the steps of the world
+//
+// Every step of the world is stored to a snapshot ring (see
+// snapshot_ring.h), so the simulation can be stepped back and forth with
+// physics_prev_step() and physics_next_step(). Only one world can be
+// attached at a time. The snapshots hold only the bodies, so adding or
+// removing a body restarts the history from the current step.
+//
+// @precondition world != NULL
+// @precondition max_bytes > world->capacity * sizeof( physics_body_t ), so
+//               a keyframe of a full world fits
+// @param world The pointer to the world
+// @param max_frames The max number of the recorded steps
+// @param max_bytes The max number of bytes used by the recorded steps
+// @param keyframe_interval The number of steps between the keyframes
+void physics_debug_attach( physics_world_t* world,
+        unsigned int max_frames,
+        unsigned int max_bytes,
+        unsigned int keyframe_interval );
+
+// Stops recording and releases the history
+void physics_debug_detach();
+
+// Records the current state of the world if it is attached
+//
+// @param world The pointer to the world
+void physics_debug_record( physics_world_t* world );
+
+// Returns the current step (>0) of the simulation
+//
+// @return The current step of the simulation
+unsigned int physics_current_step();
+
+// Moves the attached world forward
+//
+// The recorded steps are restored; when the history runs out, the world is
+// simulated further.
+//
+// @param step_count The number of steps
+void physics_next_step( unsigned int step_count );
+
+// Moves the attached world backward
+//
+// The world stops at the oldest recorded step. Simulating from a restored
+// step rewrites the history after it.
+//
+// @param step_count The number of steps
+void physics_prev_step( unsigned int step_count );
+
+// Prints the object of the attached world
+//
+// @param guid The guid of the object
+void physics_print_obj( int guid );
+#endif // #ifdef DEBUG
+
 #endif // _physics_
\ No newline at end of file
@@ -0,0 +1,377 @@
+// Profiler
+//
+// [Implementation details]
+//
+// A thread finds its buffer through a thread-local pointer. The buffers are
+// registered in a fixed table by an atomic counter, and the count of the
+// events of a buffer is published with a release store, so the readers see
+// the events that are counted. The buffers are allocated with malloc()
+// instead of mem_malloc(), so the profiler neither shows up in the
+// statistics of MEM_STATS nor trips the leak checks of the tests. The epoch
+// is bumped by prof_free(), after which the threads register again.
+//
+// A begin is recorded only if its end and the ends of the open zones still
+// fit, so a buffer never holds an end without its begin. Once a begin has
+// been dropped, so are the zones within it; the dropped zones are thus the
+// innermost ones, and the dropped counter tells how many of the next ends
+// are dropped too.
+//
+// The events are stamped with the time stamp counter of the CPU where there
+// is one, as it is read several times faster than the clock of the system.
+// The ticks are converted by the ratio of the elapsed ticks and the elapsed
+// nanoseconds since the start of the recording, which is measured anew at
+// each aggregation and export.
+//
+// The aggregation keeps a stack of the open zones per thread across the
+// frames. At the start of a frame, the zones of the stacks are entered into
+// the new tree, so a zone that spans frames keeps its parents. Unless a
+// capture is on, the aggregation then rewinds the buffers: the open zones
+// are on the stacks, so their events are not needed anymore. A begin is
+// first matched against the latest zone of its depth, which in a loop of
+// zones is the same one, so the search of the tree is mostly skipped.
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined( __x86_64__ ) || defined( __i386__ )
+#include <x86intrin.h>
+#endif
+
+#include "./profiler.h"
+
+typedef struct {
+    // The name of a begin, or NULL for an end
+    const char* name;
+    unsigned long long ticks;
+} _prof_event_t;
+
+typedef struct {
+    _prof_event_t* events;
+    atomic_uint count;
+    // The number of the dropped zones
+    atomic_uint lost;
+    // Written by the thread only: the open and the open dropped zones
+    unsigned int open;
+    unsigned int dropped;
+    // Read by the aggregation only: the first event of the next frame, the
+    // stack of the open zones, the open zones beyond PROF_MAX_DEPTH and the
+    // latest zone entered at each depth
+    unsigned int read;
+    unsigned int depth;
+    unsigned int skipped;
+    const char* names[ PROF_MAX_DEPTH ];
+    unsigned long long starts[ PROF_MAX_DEPTH ];
+    int zones[ PROF_MAX_DEPTH ];
+    int latest[ PROF_MAX_DEPTH ];
+} _prof_thread_t;
+
+static _Atomic( _prof_thread_t* ) _prof_threads[ PROF_MAX_THREADS ];
+static atomic_uint _prof_num_threads;
+static atomic_uint _prof_epoch = 1;
+// The time of the first registration, which is the zero of the trace, and
+// the nanoseconds per tick
+static atomic_ullong _prof_start_ticks;
+static atomic_ullong _prof_start_ns;
+static double _prof_scale = 1.0;
+static int _prof_capture = 0;
+static _Thread_local _prof_thread_t* _prof_self = NULL;
+static _Thread_local unsigned int _prof_self_epoch = 0;
+
+static prof_zone_t _prof_zones[ PROF_MAX_ZONES ];
+static unsigned int _prof_num_zones = 0;
+
+static unsigned long long _prof_now_ns() {
+    struct timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return ( unsigned long long ) t.tv_sec * 1000000000ULL + ( unsigned long long ) t.tv_nsec;
+}
+
+static inline unsigned long long _prof_ticks() {
+#if defined( __x86_64__ ) || defined( __i386__ )
+    return __rdtsc();
+#else
+    return _prof_now_ns();
+#endif
+}
+
+// Starts the recording at the current time
+static void _prof_start() {
+    atomic_store( &_prof_start_ns, _prof_now_ns() );
+    atomic_store( &_prof_start_ticks, _prof_ticks() );
+}
+
+// Measures the nanoseconds per tick
+static void _prof_calibrate() {
+#if defined( __x86_64__ ) || defined( __i386__ )
+    unsigned long long ns = _prof_now_ns() - atomic_load( &_prof_start_ns );
+    unsigned long long ticks = _prof_ticks() - atomic_load( &_prof_start_ticks );
+    if ( ns && ticks ) {
+        _prof_scale = ( double ) ns / ( double ) ticks;
+    }
+#endif
+}
+
+// Returns the buffer of the calling thread, or NULL if the table is full
+static _prof_thread_t* _prof_thread() {
+    unsigned int epoch = atomic_load_explicit( &_prof_epoch, memory_order_relaxed );
+    if ( _prof_self_epoch == epoch ) {
+        return _prof_self;
+    }
+    _prof_self_epoch = epoch;
+    _prof_self = NULL;
+    unsigned int index = atomic_fetch_add( &_prof_num_threads, 1 );
+    if ( index >= PROF_MAX_THREADS ) {
+        return NULL;
+    }
+    _prof_thread_t* t = ( _prof_thread_t* ) malloc( sizeof( _prof_thread_t ) );
+    memset( t, 0, sizeof( _prof_thread_t ) );
+    t->events = ( _prof_event_t* ) malloc( PROF_MAX_EVENTS * sizeof( _prof_event_t ) );
+    if ( !atomic_load( &_prof_start_ticks ) ) {
+        _prof_start();
+    }
+    atomic_store( &_prof_threads[ index ], t );
+    _prof_self = t;
+    return t;
+}
+
+// The number of the registered buffers
+static unsigned int _prof_count_threads() {
+    unsigned int n = atomic_load( &_prof_num_threads );
+    return n < PROF_MAX_THREADS ? n : PROF_MAX_THREADS;
+}
+
+int prof_begin( const char* name ) {
+    assert( name && PROF_NONAME );
+
+    _prof_thread_t* t = _prof_thread();
+    if ( !t ) {
+        return 0;
+    }
+    unsigned int count = atomic_load_explicit( &t->count, memory_order_relaxed );
+    if ( t->dropped || count + t->open + 2 > PROF_MAX_EVENTS ) {
+        t->dropped++;
+        atomic_fetch_add_explicit( &t->lost, 1, memory_order_relaxed );
+        return 0;
+    }
+    t->events[ count ].name = name;
+    t->events[ count ].ticks = _prof_ticks();
+    t->open++;
+    atomic_store_explicit( &t->count, count + 1, memory_order_release );
+    return 0;
+}
+
+void prof_end() {
+    _prof_thread_t* t = _prof_thread();
+    if ( !t ) {
+        return;
+    }
+    if ( t->dropped ) {
+        t->dropped--;
+        return;
+    }
+    if ( !t->open ) {
+        return;
+    }
+    unsigned int count = atomic_load_explicit( &t->count, memory_order_relaxed );
+    t->events[ count ].name = NULL;
+    t->events[ count ].ticks = _prof_ticks();
+    t->open--;
+    atomic_store_explicit( &t->count, count + 1, memory_order_release );
+}
+
+void _prof_cleanup( int* zone ) {
+    ( void ) zone;
+    prof_end();
+}
+
+// Finds or adds the child of the parent with the name
+static int _prof_node( int parent, const char* name ) {
+    for ( unsigned int i = 0; i < _prof_num_zones; i++ ) {
+        prof_zone_t* z = &_prof_zones[i];
+        if ( z->parent == parent && ( z->name == name || !strcmp( z->name, name ) ) ) {
+            return ( int ) i;
+        }
+    }
+    if ( _prof_num_zones == PROF_MAX_ZONES ) {
+        return -1;
+    }
+    prof_zone_t* z = &_prof_zones[ _prof_num_zones ];
+    z->name = name;
+    z->parent = parent;
+    z->depth = parent < 0 ? 0 : _prof_zones[ parent ].depth + 1;
+    z->count = 0;
+    z->ns = 0;
+    return ( int ) _prof_num_zones++;
+}
+
+// Finds or adds the zone of a begin at the current depth of the thread. The
+// zones repeat, so the latest zone of the depth is tried before the search
+static int _prof_child( _prof_thread_t* t, int parent, const char* name ) {
+    int latest = t->latest[ t->depth ];
+    if ( ( unsigned int ) latest < _prof_num_zones && _prof_zones[ latest ].name == name
+            && _prof_zones[ latest ].parent == parent ) {
+        return latest;
+    }
+    t->latest[ t->depth ] = _prof_node( parent, name );
+    return t->latest[ t->depth ];
+}
+
+unsigned int prof_frame( const prof_zone_t** zones ) {
+    _prof_calibrate();
+    _prof_num_zones = 0;
+    unsigned int num_threads = _prof_count_threads();
+    for ( unsigned int i = 0; i < num_threads; i++ ) {
+        _prof_thread_t* t = atomic_load( &_prof_threads[i] );
+        if ( !t ) {
+            continue;
+        }
+        // The open zones of the previous frames
+        for ( unsigned int d = 0; d < t->depth; d++ ) {
+            int parent = d ? t->zones[ d - 1 ] : -1;
+            t->zones[d] = parent < 0 && d ? -1 : _prof_node( parent, t->names[d] );
+        }
+        unsigned int count = atomic_load_explicit( &t->count, memory_order_acquire );
+        for ( ; t->read < count; t->read++ ) {
+            _prof_event_t* e = &t->events[ t->read ];
+            if ( e->name ) {
+                if ( t->skipped || t->depth == PROF_MAX_DEPTH ) {
+                    t->skipped++;
+                    continue;
+                }
+                int parent = t->depth ? t->zones[ t->depth - 1 ] : -1;
+                t->names[ t->depth ] = e->name;
+                t->starts[ t->depth ] = e->ticks;
+                t->zones[ t->depth ] = parent < 0 && t->depth ? -1 : _prof_child( t, parent, e->name );
+                t->depth++;
+            } else if ( t->skipped ) {
+                t->skipped--;
+            } else if ( t->depth ) {
+                t->depth--;
+                int zone = t->zones[ t->depth ];
+                if ( zone >= 0 ) {
+                    _prof_zones[ zone ].count++;
+                    _prof_zones[ zone ].ns += ( unsigned long long ) ( ( e->ticks - t->starts[ t->depth ] ) * _prof_scale );
+                }
+            }
+        }
+        if ( !_prof_capture ) {
+            atomic_store_explicit( &t->count, 0, memory_order_relaxed );
+            t->read = 0;
+        }
+    }
+    if ( zones ) {
+        *zones = _prof_zones;
+    }
+    return _prof_num_zones;
+}
+
+void prof_print( FILE* out ) {
+    assert( out && PROF_NOOUT );
+
+    for ( unsigned int i = 0; i < _prof_num_zones; i++ ) {
+        prof_zone_t* z = &_prof_zones[i];
+        fprintf( out, "%*s%s %.3f ms %u\n", 2 * ( int ) z->depth, "", z->name, z->ns / 1000000.0, z->count );
+    }
+}
+
+// Writes the name as a JSON string
+static void _prof_string( FILE* out, const char* name ) {
+    fputc( '"', out );
+    for ( const char* c = name; *c; c++ ) {
+        if ( *c == '"' || *c == '\\' ) {
+            fputc( '\\', out );
+        }
+        if ( ( unsigned char ) *c >= 0x20 ) {
+            fputc( *c, out );
+        }
+    }
+    fputc( '"', out );
+}
+
+unsigned int prof_export( FILE* out ) {
+    assert( out && PROF_NOOUT );
+
+    unsigned int written = 0;
+    _prof_calibrate();
+    unsigned long long start = atomic_load( &_prof_start_ticks );
+    unsigned int num_threads = _prof_count_threads();
+    fprintf( out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[" );
+    for ( unsigned int i = 0; i < num_threads; i++ ) {
+        _prof_thread_t* t = atomic_load( &_prof_threads[i] );
+        if ( !t ) {
+            continue;
+        }
+        fprintf( out, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,"
+            "\"args\":{\"name\":\"thread %u\"}}", written || i ? "," : "", i, i );
+        unsigned int count = atomic_load_explicit( &t->count, memory_order_acquire );
+        for ( unsigned int j = 0; j < count; j++ ) {
+            _prof_event_t* e = &t->events[j];
+            double ts = ( double ) ( long long ) ( e->ticks - start ) * _prof_scale / 1000.0;
+            if ( e->name ) {
+                fprintf( out, ",\n{\"name\":" );
+                _prof_string( out, e->name );
+                fprintf( out, ",\"ph\":\"B\",\"ts\":%.3f,\"pid\":0,\"tid\":%u}", ts, i );
+            } else {
+                fprintf( out, ",\n{\"ph\":\"E\",\"ts\":%.3f,\"pid\":0,\"tid\":%u}", ts, i );
+            }
+            written++;
+        }
+    }
+    fprintf( out, "\n]}\n" );
+    return written;
+}
+
+void prof_capture( int enable ) {
+    _prof_capture = enable;
+}
+
+unsigned int prof_dropped() {
+    unsigned int lost = 0;
+    unsigned int num_threads = _prof_count_threads();
+    for ( unsigned int i = 0; i < num_threads; i++ ) {
+        _prof_thread_t* t = atomic_load( &_prof_threads[i] );
+        if ( t ) {
+            lost += atomic_load_explicit( &t->lost, memory_order_relaxed );
+        }
+    }
+    return lost;
+}
+
+void prof_reset() {
+    unsigned int num_threads = _prof_count_threads();
+    for ( unsigned int i = 0; i < num_threads; i++ ) {
+        _prof_thread_t* t = atomic_load( &_prof_threads[i] );
+        if ( !t ) {
+            continue;
+        }
+        atomic_store( &t->count, 0 );
+        atomic_store( &t->lost, 0 );
+        t->open = 0;
+        t->dropped = 0;
+        t->read = 0;
+        t->depth = 0;
+        t->skipped = 0;
+    }
+    _prof_num_zones = 0;
+    _prof_start();
+}
+
+void prof_free() {
+    unsigned int num_threads = _prof_count_threads();
+    for ( unsigned int i = 0; i < num_threads; i++ ) {
+        _prof_thread_t* t = atomic_load( &_prof_threads[i] );
+        if ( t ) {
+            free( t->events );
+            free( t );
+            atomic_store( &_prof_threads[i], NULL );
+        }
+    }
+    atomic_store( &_prof_num_threads, 0 );
+    _prof_capture = 0;
+    atomic_fetch_add( &_prof_epoch, 1 );
+    _prof_num_zones = 0;
+    atomic_store( &_prof_start_ticks, 0 );
+}
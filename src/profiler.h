@@ -0,0 +1,139 @@
+// Profiler
+//
+// The zones of the code are timed with the macros:
+//
+//   void physics_step( physics_world_t* world ) {
+//       PROF_ZONE( "physics_step" );            // Until the end of the scope
+//       ...
+//       PROF_BEGIN( "integrate" );
+//       ...
+//       PROF_END();
+//   }
+//
+// The macros are compiled out unless PROFILE is defined (see defs.h), so
+// the zones cost nothing in a normal build. The functions are always
+// available, e.g., for the tests and the benchmarks. PROF_ZONE() ends the
+// zone at the end of its scope, so it suits the functions with many
+// returns; without GCC's cleanup attribute it is compiled out.
+//
+// A zone is a begin and an end event in the buffer of the thread. Each
+// thread gets its own buffer at its first zone, so the threads of the job
+// system record without locks. A buffer holds PROF_MAX_EVENTS events; the
+// zones that do not fit are dropped and counted.
+//
+// prof_frame() aggregates the events since its previous call into a
+// hierarchy: a zone within another is its child, and the zones with the same
+// name under the same parent are merged. The aggregated events are then
+// dropped, so the buffers are reused from one frame to the next. During a
+// capture (see prof_capture()) they are kept instead, and prof_export()
+// writes them in the trace format of Chrome and Perfetto (chrome://tracing,
+// ui.perfetto.dev).
+//
+// The aggregation, the export and prof_reset() read the buffers of all
+// threads, so they must be called when the other threads do not record,
+// e.g., between the frames.
+
+#ifndef _profiler_
+#define _profiler_
+
+#include <stdio.h>
+
+#include "./defs.h"
+
+// Messages for the diagnostics
+#define PROF_NOOUT "Output does not exist"
+#define PROF_NONAME "Zone must have a name"
+
+// The max number of the events per thread
+#define PROF_MAX_EVENTS     ( 1 << 16 )
+// The max number of the recording threads
+#define PROF_MAX_THREADS    64
+// The max number of the aggregated zones and their depth
+#define PROF_MAX_ZONES      256
+#define PROF_MAX_DEPTH      32
+
+// An aggregated zone of a frame
+typedef struct {
+    const char* name;
+    // The index of the parent zone, or -1 for a root
+    int parent;
+    unsigned int depth;
+    // The number of the ended zones and their total time, the time of the
+    // children included
+    unsigned int count;
+    unsigned long long ns;
+} prof_zone_t;
+
+#ifdef PROFILE
+#define PROF_BEGIN(name) prof_begin( name )
+#define PROF_END() prof_end()
+#define PROF_FRAME() prof_frame( NULL )
+#if defined( __GNUC__ )
+#define _PROF_CONCAT(a, b) a##b
+#define _PROF_NAME(line) _PROF_CONCAT( _prof_zone_, line )
+#define PROF_ZONE(name) \
+    int _PROF_NAME( __LINE__ ) __attribute__(( cleanup( _prof_cleanup ), unused )) = prof_begin( name )
+#else
+#define PROF_ZONE(name) ( ( void ) 0 )
+#endif
+#else
+#define PROF_BEGIN(name) ( ( void ) 0 )
+#define PROF_END() ( ( void ) 0 )
+#define PROF_FRAME() ( ( void ) 0 )
+#define PROF_ZONE(name) ( ( void ) 0 )
+#endif
+
+// Begins a zone on the calling thread
+//
+// @precondition name != NULL
+// @param name The name of the zone. The pointer is stored, so the name must
+//             live until the events are exported, e.g., a string literal
+// @return Zero
+int prof_begin( const char* name );
+
+// Ends the latest zone of the calling thread
+void prof_end();
+
+// Aggregates the events since the previous call
+//
+// A zone that is still open is counted at the frame where it ends.
+//
+// @param zones The pointer to the zones that are set, or NULL. The parents
+//              come before their children
+// @return The number of the zones
+unsigned int prof_frame( const prof_zone_t** zones );
+
+// Writes the zones of the latest prof_frame() as an indented tree
+//
+// @precondition out != NULL
+// @param out The stream
+void prof_print( FILE* out );
+
+// Starts or stops a capture
+//
+// During a capture, prof_frame() keeps the events in the buffers, which
+// then hold a trace of the frames until they are full.
+//
+// @param enable Nonzero to start, zero to stop
+void prof_capture( int enable );
+
+// Writes the recorded events as a Chrome trace
+//
+// @precondition out != NULL
+// @param out The stream
+// @return The number of the written events
+unsigned int prof_export( FILE* out );
+
+// @return The number of the zones that did not fit into the buffers
+unsigned int prof_dropped();
+
+// Drops the recorded events and the aggregates
+void prof_reset();
+
+// Releases the buffers of the threads and stops the capture
+void prof_free();
+
+// Ends the zone of PROF_ZONE()
+void _prof_cleanup( int* zone );
+
+#endif // _profiler_
@@ -0,0 +1,384 @@
+// Projectiles
+//
+// [Implementation details]
+//
+// The cells are the leaves of the tree in the row-major order. A projectile
+// whose top-left corner is at ( x, y ) overlaps the box [ x0, x1 ) x
+// [ y0, y1 ) only if x0 - w < x < x1 and y0 - h < y < y1. During the step it
+// moved at most ( max_vx, max_vy ), the max speeds of the pool, so the range
+// is grown by them and the object is tested against the cells of that
+// range. The projectiles in the range are compared a vector at a time, and
+// only the candidates get the swept test.
+//
+// The sort is a stable counting sort, so the order of the projectiles, and
+// thus the order of the hits, only depends on the spawns and the removals.
+
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined( __AVX2__ ) || defined( __SSE2__ )
+#include <immintrin.h>
+#endif
+
+#include "./defs.h"
+#include "./mem.h"
+#include "./physics.h"
+#include "./projectiles.h"
+#include "./data_structures/doublyLinkedList.h"
+#include "./data_structures/quad_tree.h"
+
+#if defined( __AVX2__ )
+#define _WIDTH 8
+#elif defined( __SSE2__ )
+#define _WIDTH 4
+#else
+#define _WIDTH 1
+#endif
+
+#define _NUM_ARRAYS 6
+
+// The arrays of the pool in the order of the scratch arrays
+static int** _array( projectile_pool_t* pool, int i ) {
+    int** arrays[ _NUM_ARRAYS ] = { &pool->x, &pool->y, &pool->vx, &pool->vy, &pool->life, &pool->tag };
+    return arrays[i];
+}
+
+projectile_pool_t* projectiles_new( unsigned int capacity, unsigned int w, unsigned int h,
+        unsigned int category, unsigned int mask ) {
+    projectile_pool_t* pool = ( projectile_pool_t* ) mem_malloc( sizeof( projectile_pool_t ) );
+    pool->capacity = capacity ? capacity : 1;
+    for ( int i = 0; i < _NUM_ARRAYS; i++ ) {
+        *_array( pool, i ) = ( int* ) mem_malloc( pool->capacity * sizeof( int ) );
+        pool->scratch[i] = ( int* ) mem_malloc( pool->capacity * sizeof( int ) );
+    }
+    pool->count = 0;
+    pool->w = w;
+    pool->h = h;
+    pool->category = category;
+    pool->mask = mask;
+    pool->flags = 0;
+    pool->max_hits = 16;
+    pool->hits = ( projectile_hit_t* ) mem_malloc( pool->max_hits * sizeof( projectile_hit_t ) );
+    pool->num_hits = 0;
+    pool->cells = NULL;
+    pool->num_cells = 0;
+    pool->max_vx = 0;
+    pool->max_vy = 0;
+    return pool;
+}
+
+void projectiles_free( projectile_pool_t* pool ) {
+    for ( int i = 0; i < _NUM_ARRAYS; i++ ) {
+        mem_free( *_array( pool, i ) );
+        mem_free( pool->scratch[i] );
+    }
+    mem_free( pool->hits );
+    if ( pool->cells ) {
+        mem_free( pool->cells );
+    }
+    mem_free( pool );
+}
+
+void projectiles_clear( projectile_pool_t* pool ) {
+    pool->count = 0;
+    pool->num_hits = 0;
+}
+
+int projectiles_spawn( projectile_pool_t* pool, int x, int y, int vx, int vy,
+        int life, int tag ) {
+    assert( pool && PROJECTILES_NOPOOL );
+
+    if ( pool->count == pool->capacity ) {
+        return PROJECTILES_FULL;
+    }
+    unsigned int i = pool->count++;
+    pool->x[i] = x;
+    pool->y[i] = y;
+    pool->vx[i] = vx;
+    pool->vy[i] = vy;
+    pool->life[i] = life;
+    pool->tag[i] = tag;
+    return i;
+}
+
+void projectiles_remove( projectile_pool_t* pool, unsigned int index ) {
+    assert( pool && PROJECTILES_NOPOOL );
+    assert( index < pool->count && PROJECTILES_NOPROJECTILE );
+
+    unsigned int last = --pool->count;
+    pool->x[ index ] = pool->x[ last ];
+    pool->y[ index ] = pool->y[ last ];
+    pool->vx[ index ] = pool->vx[ last ];
+    pool->vy[ index ] = pool->vy[ last ];
+    pool->life[ index ] = pool->life[ last ];
+    pool->tag[ index ] = pool->tag[ last ];
+}
+
+// Removes the projectiles whose life has run out. The removal goes
+// backwards, so the moved projectile has already been checked.
+static unsigned int _remove_dead( projectile_pool_t* pool ) {
+    unsigned int removed = 0;
+    for ( unsigned int i = pool->count; i-- > 0; ) {
+        if ( pool->life[i] <= 0 ) {
+            projectiles_remove( pool, i );
+            removed++;
+        }
+    }
+    return removed;
+}
+
+unsigned int projectiles_step( projectile_pool_t* pool ) {
+    assert( pool && PROJECTILES_NOPOOL );
+
+    unsigned int i = 0;
+#if defined( __AVX2__ )
+    __m256i one = _mm256_set1_epi32( 1 );
+    for ( ; i + _WIDTH <= pool->count; i += _WIDTH ) {
+        __m256i* x = ( __m256i* ) &pool->x[i];
+        __m256i* y = ( __m256i* ) &pool->y[i];
+        __m256i* life = ( __m256i* ) &pool->life[i];
+        _mm256_storeu_si256( x, _mm256_add_epi32( _mm256_loadu_si256( x ),
+            _mm256_loadu_si256( ( __m256i* ) &pool->vx[i] ) ) );
+        _mm256_storeu_si256( y, _mm256_add_epi32( _mm256_loadu_si256( y ),
+            _mm256_loadu_si256( ( __m256i* ) &pool->vy[i] ) ) );
+        _mm256_storeu_si256( life, _mm256_sub_epi32( _mm256_loadu_si256( life ), one ) );
+    }
+#elif defined( __SSE2__ )
+    __m128i one = _mm_set1_epi32( 1 );
+    for ( ; i + _WIDTH <= pool->count; i += _WIDTH ) {
+        __m128i* x = ( __m128i* ) &pool->x[i];
+        __m128i* y = ( __m128i* ) &pool->y[i];
+        __m128i* life = ( __m128i* ) &pool->life[i];
+        _mm_storeu_si128( x, _mm_add_epi32( _mm_loadu_si128( x ),
+            _mm_loadu_si128( ( __m128i* ) &pool->vx[i] ) ) );
+        _mm_storeu_si128( y, _mm_add_epi32( _mm_loadu_si128( y ),
+            _mm_loadu_si128( ( __m128i* ) &pool->vy[i] ) ) );
+        _mm_storeu_si128( life, _mm_sub_epi32( _mm_loadu_si128( life ), one ) );
+    }
+#endif
+    for ( ; i < pool->count; i++ ) {
+        pool->x[i] += pool->vx[i];
+        pool->y[i] += pool->vy[i];
+        pool->life[i]--;
+    }
+    return _remove_dead( pool );
+}
+
+static void _push_hit( projectile_pool_t* pool, int tag, int guid ) {
+    if ( pool->num_hits == pool->max_hits ) {
+        projectile_hit_t* grown = ( projectile_hit_t* ) mem_malloc( 2 * pool->max_hits * sizeof( projectile_hit_t ) );
+        memcpy( grown, pool->hits, pool->num_hits * sizeof( projectile_hit_t ) );
+        mem_free( pool->hits );
+        pool->hits = grown;
+        pool->max_hits *= 2;
+    }
+    pool->hits[ pool->num_hits ].tag = tag;
+    pool->hits[ pool->num_hits ].guid = guid;
+    pool->num_hits++;
+}
+
+// Sorts the projectiles by their cells. The projectiles outside of the
+// region are removed first.
+static void _sort( projectile_pool_t* pool, qtree_t* q ) {
+    unsigned int side = 1u << q->depth;
+    unsigned int shift = q->dim - q->depth;
+    unsigned int num_cells = side * side;
+    if ( num_cells != pool->num_cells ) {
+        if ( pool->cells ) {
+            mem_free( pool->cells );
+        }
+        pool->cells = ( unsigned int* ) mem_malloc( ( num_cells + 1 ) * sizeof( unsigned int ) );
+        pool->num_cells = num_cells;
+    }
+
+    for ( unsigned int i = 0; i < pool->count; i++ ) {
+        if ( pool->x[i] < ( long long ) q->x0 || pool->x[i] > ( long long ) q->x1
+                || pool->y[i] < ( long long ) q->y0 || pool->y[i] > ( long long ) q->y1 ) {
+            pool->life[i] = 0;
+        }
+    }
+    _remove_dead( pool );
+
+    pool->max_vx = 0;
+    pool->max_vy = 0;
+    for ( unsigned int i = 0; i < pool->count; i++ ) {
+        int vx = abs( pool->vx[i] );
+        int vy = abs( pool->vy[i] );
+        pool->max_vx = vx > pool->max_vx ? vx : pool->max_vx;
+        pool->max_vy = vy > pool->max_vy ? vy : pool->max_vy;
+    }
+
+    unsigned int* cells = pool->cells;
+    memset( cells, 0, ( num_cells + 1 ) * sizeof( unsigned int ) );
+    for ( unsigned int i = 0; i < pool->count; i++ ) {
+        unsigned int cx = ( pool->x[i] - q->x0 ) >> shift;
+        unsigned int cy = ( pool->y[i] - q->y0 ) >> shift;
+        cells[ cy * side + cx + 1 ]++;
+    }
+    for ( unsigned int c = 0; c < num_cells; c++ ) {
+        cells[ c + 1 ] += cells[c];
+    }
+    // The scatter advances the starts; they are restored afterwards.
+    for ( unsigned int i = 0; i < pool->count; i++ ) {
+        unsigned int cx = ( pool->x[i] - q->x0 ) >> shift;
+        unsigned int cy = ( pool->y[i] - q->y0 ) >> shift;
+        unsigned int j = cells[ cy * side + cx ]++;
+        for ( int a = 0; a < _NUM_ARRAYS; a++ ) {
+            pool->scratch[a][j] = ( *_array( pool, a ) )[i];
+        }
+    }
+    for ( unsigned int c = num_cells; c > 0; c-- ) {
+        cells[c] = cells[ c - 1 ];
+    }
+    cells[0] = 0;
+    for ( int a = 0; a < _NUM_ARRAYS; a++ ) {
+        int* tmp = *_array( pool, a );
+        *_array( pool, a ) = pool->scratch[a];
+        pool->scratch[a] = tmp;
+    }
+}
+
+// Tells if the projectile met the box [ x0, x1 ) x [ y0, y1 ) during the
+// latest step
+static int _swept_hit( projectile_pool_t* pool, unsigned int i, int x0, int y0, int x1, int y1 ) {
+    unsigned int toi;
+    return physics_sweep_box( pool->x[i] - pool->vx[i], pool->y[i] - pool->vy[i], pool->w, pool->h,
+        pool->vx[i], pool->vy[i], x0, y0, ( unsigned int ) ( x1 - x0 ), ( unsigned int ) ( y1 - y0 ), &toi );
+}
+
+static void _hit( projectile_pool_t* pool, physics_obj_t* obj, unsigned int i,
+        int x0, int y0, int x1, int y1 ) {
+    if ( !_swept_hit( pool, i, x0, y0, x1, y1 ) ) {
+        return;
+    }
+    _push_hit( pool, pool->tag[i], obj->guid );
+    if ( !( pool->flags & PROJECTILES_FLAG_PIERCE ) ) {
+        pool->life[i] = 0;
+    }
+}
+
+// Tests the object, the box [ x0, x1 ) x [ y0, y1 ), against the
+// projectiles [ first, last )
+//
+// The projectiles that end the step at ( x, y ) with lx < x < hx and
+// ly < y < hy are tested with the swept test.
+static void _hit_range( projectile_pool_t* pool, physics_obj_t* obj, unsigned int first,
+        unsigned int last, int x0, int y0, int x1, int y1 ) {
+    int lx = x0 - ( int ) pool->w - pool->max_vx;
+    int ly = y0 - ( int ) pool->h - pool->max_vy;
+    int hx = x1 + pool->max_vx;
+    int hy = y1 + pool->max_vy;
+    // The pierce lets the dead projectiles hit, so every hit is reported.
+    int min_life = pool->flags & PROJECTILES_FLAG_PIERCE ? INT_MIN : 0;
+    unsigned int i = first;
+#if _WIDTH > 1
+    for ( ; i + _WIDTH <= last; i += _WIDTH ) {
+#if defined( __AVX2__ )
+        __m256i x = _mm256_loadu_si256( ( __m256i* ) &pool->x[i] );
+        __m256i y = _mm256_loadu_si256( ( __m256i* ) &pool->y[i] );
+        __m256i life = _mm256_loadu_si256( ( __m256i* ) &pool->life[i] );
+        __m256i m = _mm256_and_si256(
+            _mm256_and_si256( _mm256_cmpgt_epi32( x, _mm256_set1_epi32( lx ) ),
+                              _mm256_cmpgt_epi32( _mm256_set1_epi32( hx ), x ) ),
+            _mm256_and_si256( _mm256_cmpgt_epi32( y, _mm256_set1_epi32( ly ) ),
+                              _mm256_cmpgt_epi32( _mm256_set1_epi32( hy ), y ) ) );
+        m = _mm256_and_si256( m, _mm256_cmpgt_epi32( life, _mm256_set1_epi32( min_life ) ) );
+        unsigned int bits = ( unsigned int ) _mm256_movemask_ps( _mm256_castsi256_ps( m ) );
+#else
+        __m128i x = _mm_loadu_si128( ( __m128i* ) &pool->x[i] );
+        __m128i y = _mm_loadu_si128( ( __m128i* ) &pool->y[i] );
+        __m128i life = _mm_loadu_si128( ( __m128i* ) &pool->life[i] );
+        __m128i m = _mm_and_si128(
+            _mm_and_si128( _mm_cmpgt_epi32( x, _mm_set1_epi32( lx ) ),
+                           _mm_cmplt_epi32( x, _mm_set1_epi32( hx ) ) ),
+            _mm_and_si128( _mm_cmpgt_epi32( y, _mm_set1_epi32( ly ) ),
+                           _mm_cmplt_epi32( y, _mm_set1_epi32( hy ) ) ) );
+        m = _mm_and_si128( m, _mm_cmpgt_epi32( life, _mm_set1_epi32( min_life ) ) );
+        unsigned int bits = ( unsigned int ) _mm_movemask_ps( _mm_castsi128_ps( m ) );
+#endif
+        // The candidates are rare, so the lanes are only visited when there
+        // is one.
+        for ( unsigned int k = 0; bits; k++, bits >>= 1 ) {
+            if ( bits & 1 ) {
+                _hit( pool, obj, i + k, x0, y0, x1, y1 );
+            }
+        }
+    }
+#endif
+    for ( ; i < last; i++ ) {
+        if ( pool->x[i] > lx && pool->x[i] < hx && pool->y[i] > ly && pool->y[i] < hy
+                && pool->life[i] > min_life ) {
+            _hit( pool, obj, i, x0, y0, x1, y1 );
+        }
+    }
+}
+
+// Tests the object against the cells that its bounds cover
+static void _collide_obj( projectile_pool_t* pool, qtree_t* q, physics_obj_t* obj ) {
+    int x0, y0, x1, y1;
+    physics_bounds( obj, &x0, &y0, &x1, &y1 );
+    int lx = x0 - ( int ) pool->w - pool->max_vx;
+    int ly = y0 - ( int ) pool->h - pool->max_vy;
+
+    // The range of the top-left corners in the region
+    long long cx0 = ( long long ) lx + 1 > q->x0 ? ( long long ) lx + 1 : q->x0;
+    long long cy0 = ( long long ) ly + 1 > q->y0 ? ( long long ) ly + 1 : q->y0;
+    long long cx1 = ( long long ) x1 + pool->max_vx - 1 < q->x1 ? ( long long ) x1 + pool->max_vx - 1 : q->x1;
+    long long cy1 = ( long long ) y1 + pool->max_vy - 1 < q->y1 ? ( long long ) y1 + pool->max_vy - 1 : q->y1;
+    if ( cx0 > cx1 || cy0 > cy1 ) {
+        return;
+    }
+    unsigned int side = 1u << q->depth;
+    unsigned int shift = q->dim - q->depth;
+    unsigned int c_x0 = ( unsigned int ) ( cx0 - q->x0 ) >> shift;
+    unsigned int c_x1 = ( unsigned int ) ( cx1 - q->x0 ) >> shift;
+    unsigned int c_y0 = ( unsigned int ) ( cy0 - q->y0 ) >> shift;
+    unsigned int c_y1 = ( unsigned int ) ( cy1 - q->y0 ) >> shift;
+    for ( unsigned int cy = c_y0; cy <= c_y1; cy++ ) {
+        // The cells of a row are adjacent, so a row is one range.
+        unsigned int first = pool->cells[ cy * side + c_x0 ];
+        unsigned int last = pool->cells[ cy * side + c_x1 + 1 ];
+        _hit_range( pool, obj, first, last, x0, y0, x1, y1 );
+    }
+}
+
+static void _collide_node( projectile_pool_t* pool, qtree_t* q, tnode_t* node ) {
+    physics_bucket_t* bucket = ( physics_bucket_t* ) node->data;
+    if ( bucket && bucket->categories ) {
+        for ( unsigned int layer = 0; layer < PHYSICS_NUM_LAYERS; layer++ ) {
+            if ( !bucket->layers[ layer ] || !( pool->mask & ( 1u << layer ) ) ) {
+                continue;
+            }
+            dblnode_t* other = dbllist_head( bucket->layers[ layer ] );
+            while ( other ) {
+                physics_obj_t* obj = ( physics_obj_t* ) other->data;
+                if ( obj->mask & pool->category ) {
+                    _collide_obj( pool, q, obj );
+                }
+                other = other->next;
+            }
+        }
+    }
+    if ( node->children ) {
+        dblnode_t* child = dbllist_head( node->children );
+        while ( child ) {
+            _collide_node( pool, q, ( tnode_t* ) child->data );
+            child = child->next;
+        }
+    }
+}
+
+unsigned int projectiles_collide( projectile_pool_t* pool, qtree_t* q ) {
+    assert( pool && PROJECTILES_NOPOOL );
+    assert( q && QUAD_NOQTREE );
+
+    pool->num_hits = 0;
+    _sort( pool, q );
+    if ( q->tree->root && pool->count ) {
+        _collide_node( pool, q, q->tree->root );
+    }
+    _remove_dead( pool );
+    return pool->num_hits;
+}
@@ -0,0 +1,142 @@
+// Projectiles
+//
+// The projectiles are too many and too simple to be physics objects. A pool
+// keeps the projectiles of one kind, e.g., the bullets of the player, in a
+// structure of arrays. All projectiles of a pool have the same size and the
+// same collision layer.
+//
+// A projectile is spawned to the end of the arrays and removed by moving the
+// last projectile to its place, so both are O(1). Thus, the index of a
+// projectile is not stable; the tag identifies the projectile for the game.
+//
+// projectiles_step() moves the projectiles by their velocities and ages
+// them. The projectiles whose life runs out are removed.
+//
+// projectiles_collide() tests the projectiles against the objects of the
+// quad tree in one pass. The projectiles are sorted by the leaf cell of
+// their top-left corner, so the projectiles near an object are next to each
+// other in the arrays. The tree is walked once, and each object is tested
+// against the cells that its bounds, grown by the size and the max speed of
+// the projectiles, cover. A projectile hits an object if it met the object
+// anywhere on its path of the latest step (see physics_sweep_box), so a
+// projectile faster than the width of an object does not pass through it.
+// The hits are reported in the order of the walk. A projectile that
+// hits something is removed, unless the pool pierces. The projectiles that
+// leave the region of the tree are removed too.
+//
+// The tests and the movement are done for 4 (SSE2) or 8 (AVX2) projectiles
+// at a time.
+
+#ifndef _projectiles_
+#define _projectiles_
+
+#include "./physics.h"
+#include "./data_structures/quad_tree.h"
+
+// Messages for the diagnostics
+#define PROJECTILES_NOPOOL "Projectile pool does not exist"
+#define PROJECTILES_NOPROJECTILE "Projectile does not exist"
+
+// Return values
+#define PROJECTILES_FULL -1
+
+// Pool flags
+//
+// PROJECTILES_FLAG_PIERCE  The projectiles are not removed when they hit.
+#define PROJECTILES_FLAG_PIERCE 0x1
+
+// A hit of a projectile
+typedef struct {
+    int tag;
+    int guid;
+} projectile_hit_t;
+
+typedef struct {
+    // The projectiles
+    int* x;
+    int* y;
+    int* vx;
+    int* vy;
+    int* life;
+    int* tag;
+    unsigned int count;
+    unsigned int capacity;
+    // The shared properties
+    unsigned int w;
+    unsigned int h;
+    unsigned int category;
+    unsigned int mask;
+    unsigned int flags;
+    // The hits of the latest projectiles_collide()
+    projectile_hit_t* hits;
+    unsigned int num_hits;
+    unsigned int max_hits;
+    // The scratch of the sort: the first projectile of each cell
+    unsigned int* cells;
+    unsigned int num_cells;
+    int* scratch[6];
+    // The max speeds of the latest sort
+    int max_vx;
+    int max_vy;
+} projectile_pool_t;
+
+// Creates a new pool
+//
+// @param capacity The max number of the live projectiles
+// @param w The width of the projectiles
+// @param h The height of the projectiles
+// @param category The collision layer bit of the projectiles
+// @param mask The layers that the projectiles hit
+// @return The pointer to the pool
+projectile_pool_t* projectiles_new( unsigned int capacity, unsigned int w, unsigned int h,
+        unsigned int category, unsigned int mask );
+
+// Releases the pool
+//
+// @param pool The pointer to the pool
+void projectiles_free( projectile_pool_t* pool );
+
+// Removes all projectiles
+//
+// @param pool The pointer to the pool
+void projectiles_clear( projectile_pool_t* pool );
+
+// Spawns a projectile
+//
+// @precondition pool != NULL
+// @param pool The pointer to the pool
+// @param x The x coordinate of the top-left corner
+// @param y The y coordinate of the top-left corner
+// @param vx The velocity in units per step
+// @param vy The velocity in units per step
+// @param life The number of the steps that the projectile lives
+// @param tag The tag that is reported with the hits
+// @return The index of the projectile, or PROJECTILES_FULL
+int projectiles_spawn( projectile_pool_t* pool, int x, int y, int vx, int vy,
+        int life, int tag );
+
+// Removes the projectile. The last projectile takes its index
+//
+// @precondition pool != NULL
+// @precondition index < pool->count
+// @param pool The pointer to the pool
+// @param index The index of the projectile
+void projectiles_remove( projectile_pool_t* pool, unsigned int index );
+
+// Moves and ages the projectiles by one step
+//
+// @precondition pool != NULL
+// @param pool The pointer to the pool
+// @return The number of the expired projectiles
+unsigned int projectiles_step( projectile_pool_t* pool );
+
+// Tests the projectiles against the objects of the tree
+//
+// @precondition pool != NULL
+// @precondition q != NULL
+// @param pool The pointer to the pool
+// @param q The pointer to the tree whose node data are physics buckets
+// @return The number of the hits. See pool->hits
+unsigned int projectiles_collide( projectile_pool_t* pool, qtree_t* q );
+
+#endif // _projectiles_
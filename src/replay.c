@@ -0,0 +1,231 @@
+// Input recording and replay
+//
+// [Implementation details]
+//
+// The stream grows by doubling, like the buckets of the loop. A varint is
+// seven bits per byte, the low bits first, with the high bit set on all but
+// the last byte, so a 32-bit value takes at most five bytes. The bits of the
+// flags beyond the three fields must be zero, which catches most streams
+// that are read from a wrong position.
+
+#include <assert.h>
+#include <string.h>
+
+#include "./mem.h"
+#include "./replay.h"
+
+#define _REPLAY_BUTTONS     0x1
+#define _REPLAY_X           0x2
+#define _REPLAY_Y           0x4
+#define _REPLAY_MAX_FRAME   ( 1 + 3 * 5 + 4 )
+#define _REPLAY_MIN_CAPACITY 256
+
+static const unsigned char _replay_magic[4] = { 'Y', 'R', 'P', '2' };
+
+static void _replay_put_u32( unsigned char* p, unsigned int v ) {
+    p[0] = ( unsigned char ) v;
+    p[1] = ( unsigned char ) ( v >> 8 );
+    p[2] = ( unsigned char ) ( v >> 16 );
+    p[3] = ( unsigned char ) ( v >> 24 );
+}
+
+static unsigned int _replay_get_u32( const unsigned char* p ) {
+    return ( unsigned int ) p[0] | ( unsigned int ) p[1] << 8
+        | ( unsigned int ) p[2] << 16 | ( unsigned int ) p[3] << 24;
+}
+
+static unsigned char* _replay_put_varint( unsigned char* p, unsigned int v ) {
+    while ( v >= 0x80 ) {
+        *p++ = ( unsigned char ) ( v | 0x80 );
+        v >>= 7;
+    }
+    *p++ = ( unsigned char ) v;
+    return p;
+}
+
+// Reads a varint from [*p, end); returns zero if it is cut short or too long
+static int _replay_get_varint( const unsigned char** p, const unsigned char* end, unsigned int* v ) {
+    unsigned int value = 0;
+    for ( unsigned int shift = 0; shift < 35; shift += 7 ) {
+        if ( *p == end ) {
+            return 0;
+        }
+        unsigned char byte = *( *p )++;
+        value |= ( unsigned int ) ( byte & 0x7f ) << shift;
+        if ( !( byte & 0x80 ) ) {
+            *v = value;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static unsigned int _replay_zigzag( int v ) {
+    return ( ( unsigned int ) v << 1 ) ^ ( unsigned int ) -( int ) ( ( unsigned int ) v >> 31 );
+}
+
+static int _replay_unzigzag( unsigned int v ) {
+    return ( int ) ( ( v >> 1 ) ^ -( v & 1 ) );
+}
+
+static void _replay_reserve( replay_t* replay, size_t size ) {
+    if ( replay->size + size <= replay->capacity ) {
+        return;
+    }
+    size_t capacity = replay->capacity ? 2 * replay->capacity : _REPLAY_MIN_CAPACITY;
+    while ( capacity < replay->size + size ) {
+        capacity *= 2;
+    }
+    unsigned char* data = ( unsigned char* ) mem_malloc( capacity );
+    if ( replay->data ) {
+        memcpy( data, replay->data, replay->size );
+        mem_free( replay->data );
+    }
+    replay->data = data;
+    replay->capacity = capacity;
+}
+
+static replay_t* _replay_alloc( size_t capacity ) {
+    replay_t* replay = ( replay_t* ) mem_malloc( sizeof( replay_t ) );
+    memset( replay, 0, sizeof( replay_t ) );
+    _replay_reserve( replay, capacity );
+    return replay;
+}
+
+replay_t* replay_new( unsigned int seed, int dt, unsigned int num_objects, unsigned int level ) {
+    assert( dt > 0 && REPLAY_BADDT );
+
+    replay_t* replay = _replay_alloc( REPLAY_HEADER_SIZE );
+    replay->seed = seed;
+    replay->dt = dt;
+    replay->num_objects = num_objects;
+    replay->level = level;
+    memcpy( replay->data, _replay_magic, sizeof( _replay_magic ) );
+    _replay_put_u32( replay->data + 4, seed );
+    _replay_put_u32( replay->data + 8, ( unsigned int ) dt );
+    _replay_put_u32( replay->data + 12, num_objects );
+    _replay_put_u32( replay->data + 16, level );
+    replay->size = REPLAY_HEADER_SIZE;
+    replay->pos = REPLAY_HEADER_SIZE;
+    return replay;
+}
+
+replay_t* replay_open( const unsigned char* data, size_t size ) {
+    assert( data && REPLAY_NODATA );
+
+    if ( size < REPLAY_HEADER_SIZE || memcmp( data, _replay_magic, sizeof( _replay_magic ) ) ) {
+        return NULL;
+    }
+    int dt = ( int ) _replay_get_u32( data + 8 );
+    if ( dt <= 0 ) {
+        return NULL;
+    }
+    replay_t* replay = _replay_alloc( size );
+    replay->seed = _replay_get_u32( data + 4 );
+    replay->dt = dt;
+    replay->num_objects = _replay_get_u32( data + 12 );
+    replay->level = _replay_get_u32( data + 16 );
+    memcpy( replay->data, data, size );
+    replay->size = size;
+    replay->pos = REPLAY_HEADER_SIZE;
+    return replay;
+}
+
+unsigned int replay_hash( const char* level ) {
+    if ( !level ) {
+        return REPLAY_NOLEVEL;
+    }
+    unsigned int hash = 2166136261u;
+    for ( const char* p = level; *p; p++ ) {
+        hash = ( hash ^ ( unsigned char ) *p ) * 16777619u;
+    }
+    // A level never hashes to no level
+    return hash != REPLAY_NOLEVEL ? hash : 1;
+}
+
+void replay_free( replay_t* replay ) {
+    assert( replay && REPLAY_NOREPLAY );
+
+    mem_free( replay->data );
+    mem_free( replay );
+}
+
+void replay_record( replay_t* replay, const game_input_t* input, unsigned int checksum ) {
+    assert( replay && REPLAY_NOREPLAY );
+    assert( input && REPLAY_NOINPUT );
+
+    _replay_reserve( replay, _REPLAY_MAX_FRAME );
+    unsigned char* flags = replay->data + replay->size;
+    unsigned char* p = flags + 1;
+    *flags = 0;
+    if ( input->buttons != replay->recorded.buttons ) {
+        *flags |= _REPLAY_BUTTONS;
+        p = _replay_put_varint( p, input->buttons ^ replay->recorded.buttons );
+    }
+    if ( input->x != replay->recorded.x ) {
+        *flags |= _REPLAY_X;
+        p = _replay_put_varint( p, _replay_zigzag( ( int ) ( ( unsigned int ) input->x - ( unsigned int ) replay->recorded.x ) ) );
+    }
+    if ( input->y != replay->recorded.y ) {
+        *flags |= _REPLAY_Y;
+        p = _replay_put_varint( p, _replay_zigzag( ( int ) ( ( unsigned int ) input->y - ( unsigned int ) replay->recorded.y ) ) );
+    }
+    _replay_put_u32( p, checksum );
+    replay->size = ( size_t ) ( p + 4 - replay->data );
+    replay->recorded = *input;
+    replay->num_frames++;
+}
+
+int replay_next( replay_t* replay, game_input_t* input, unsigned int* checksum ) {
+    assert( replay && REPLAY_NOREPLAY );
+    assert( input && REPLAY_NOINPUT );
+
+    const unsigned char* p = replay->data + replay->pos;
+    const unsigned char* end = replay->data + replay->size;
+    if ( p == end ) {
+        return REPLAY_END;
+    }
+    unsigned char flags = *p++;
+    if ( flags & ~( _REPLAY_BUTTONS | _REPLAY_X | _REPLAY_Y ) ) {
+        return REPLAY_CORRUPT;
+    }
+    game_input_t next = replay->input;
+    unsigned int v;
+    if ( flags & _REPLAY_BUTTONS ) {
+        if ( !_replay_get_varint( &p, end, &v ) ) {
+            return REPLAY_CORRUPT;
+        }
+        next.buttons ^= v;
+    }
+    if ( flags & _REPLAY_X ) {
+        if ( !_replay_get_varint( &p, end, &v ) ) {
+            return REPLAY_CORRUPT;
+        }
+        next.x = ( int ) ( ( unsigned int ) next.x + ( unsigned int ) _replay_unzigzag( v ) );
+    }
+    if ( flags & _REPLAY_Y ) {
+        if ( !_replay_get_varint( &p, end, &v ) ) {
+            return REPLAY_CORRUPT;
+        }
+        next.y = ( int ) ( ( unsigned int ) next.y + ( unsigned int ) _replay_unzigzag( v ) );
+    }
+    if ( end - p < 4 ) {
+        return REPLAY_CORRUPT;
+    }
+    if ( checksum ) {
+        *checksum = _replay_get_u32( p );
+    }
+    replay->pos = ( size_t ) ( p + 4 - replay->data );
+    replay->input = next;
+    replay->frame++;
+    *input = next;
+    return REPLAY_SUCCESS;
+}
+
+void replay_rewind( replay_t* replay ) {
+    assert( replay && REPLAY_NOREPLAY );
+
+    replay->pos = REPLAY_HEADER_SIZE;
+    replay->frame = 0;
+    memset( &replay->input, 0, sizeof( game_input_t ) );
+}
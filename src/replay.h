@@ -0,0 +1,122 @@
+// Input recording and replay
+//
+// A recording is the input of each frame (see loop_set_input) and the
+// checksum of the scene after the frame (see loop_checksum), preceded by
+// the scenario: the seed of the random numbers, the time delta of the
+// frames, the number of the objects and the hash of the level. Replaying
+// the input through loop() with the same scenario repeats the frames
+// exactly, so two versions of the engine can be timed on the same work,
+// and the first frame whose checksum differs tells where they part.
+//
+// The stream is binary and compact:
+//
+//   header  "YRP2", the seed, the time delta, the number of the objects and
+//           the hash of the level as 32-bit little endian
+//   frame   a byte of flags, the changed fields as varints and the
+//           checksum as 32-bit little endian
+//
+// The flags tell which fields of the input differ from the previous frame.
+// The buttons are stored as the XOR of the previous ones and the position as
+// the zigzag-coded delta, so a frame whose input did not change is five
+// bytes.
+
+#ifndef _replay_
+#define _replay_
+
+#include <stddef.h>
+
+#include "./game.h"
+
+// Messages for the diagnostics
+#define REPLAY_NOREPLAY "Replay does not exist"
+#define REPLAY_NOINPUT "Input does not exist"
+#define REPLAY_NODATA "Data does not exist"
+#define REPLAY_BADDT "Time delta must be positive"
+
+// Return values
+#define REPLAY_SUCCESS 0
+#define REPLAY_END -1
+#define REPLAY_CORRUPT -2
+
+// The size of the header of the stream
+#define REPLAY_HEADER_SIZE 20
+
+// The hash of no level
+#define REPLAY_NOLEVEL 0
+
+typedef struct {
+    // The stream
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+    unsigned int seed;
+    int dt;
+    unsigned int num_objects;
+    unsigned int level;
+    // The number of the frames of replay_record() and their latest input,
+    // against which the next one is coded
+    unsigned int num_frames;
+    game_input_t recorded;
+    // The position of the next frame to be read, the number of the frames
+    // read so far and the latest input that was read
+    size_t pos;
+    unsigned int frame;
+    game_input_t input;
+} replay_t;
+
+// Creates an empty recording
+//
+// @precondition dt > 0
+// @param seed The seed of loop_srand()
+// @param dt The time delta of the frames in milliseconds
+// @param num_objects The number of the objects of the scenario
+// @param level The hash of the level (see replay_hash)
+// @return The pointer to the recording
+replay_t* replay_new( unsigned int seed, int dt, unsigned int num_objects, unsigned int level );
+
+// Hashes the contents of a level file
+//
+// @param level The contents of the level file, or NULL for no level
+// @return The FNV-1a hash of the contents, or REPLAY_NOLEVEL for no level
+unsigned int replay_hash( const char* level );
+
+// Opens a stream for replaying
+//
+// @precondition data != NULL
+// @param data The stream that is copied
+// @param size The size of the stream in bytes
+// @return The pointer to the replay, or NULL if the header is not valid
+replay_t* replay_open( const unsigned char* data, size_t size );
+
+// Releases the replay
+//
+// @param replay The pointer to the replay
+void replay_free( replay_t* replay );
+
+// Appends a frame to the recording
+//
+// @precondition replay != NULL
+// @precondition input != NULL
+// @param replay The pointer to the recording
+// @param input The input of the frame
+// @param checksum The checksum of the scene after the frame
+void replay_record( replay_t* replay, const game_input_t* input, unsigned int checksum );
+
+// Reads the next frame
+//
+// @precondition replay != NULL
+// @precondition input != NULL
+// @param replay The pointer to the replay
+// @param input The pointer to the input that is written
+// @param checksum The pointer to the checksum that is written, or NULL
+// @return REPLAY_SUCCESS, REPLAY_END after the last frame or REPLAY_CORRUPT
+//         if the frame is cut short or malformed
+int replay_next( replay_t* replay, game_input_t* input, unsigned int* checksum );
+
+// Starts the reading from the first frame again
+//
+// @precondition replay != NULL
+// @param replay The pointer to the replay
+void replay_rewind( replay_t* replay );
+
+#endif // _replay_
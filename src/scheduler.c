@@ -0,0 +1,161 @@
+// Scheduler
+//
+// [Implementation details]
+//
+// A queue is an array in the order of the submission. scheduler_run() goes
+// through the tasks that were queued at the beginning of the frame and
+// compacts the deferred ones to the front; the tasks that were submitted
+// during the frame are moved after them.
+//
+// The first cost of a kind is taken as its estimate as such. Until then, the
+// estimate is zero, so a task of a new kind runs when any budget is left.
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "./mem.h"
+#include "./scheduler.h"
+
+static unsigned long long _scheduler_monotonic() {
+    struct timespec t;
+    clock_gettime( CLOCK_MONOTONIC, &t );
+    return ( unsigned long long ) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+scheduler_t* scheduler_new( scheduler_clock_t clock ) {
+    scheduler_t* s = ( scheduler_t* ) mem_malloc( sizeof( scheduler_t ) );
+    memset( s, 0, sizeof( scheduler_t ) );
+    s->clock = clock ? clock : _scheduler_monotonic;
+    s->max_age = SCHEDULER_DEFAULT_MAX_AGE;
+    return s;
+}
+
+void scheduler_free( scheduler_t* s ) {
+    for ( unsigned int p = 0; p < SCHEDULER_NUM_PRIORITIES; p++ ) {
+        if ( s->queues[p].jobs ) {
+            mem_free( s->queues[p].jobs );
+        }
+    }
+    mem_free( s );
+}
+
+int scheduler_kind( scheduler_t* s, scheduler_task_t task, int priority ) {
+    assert( s && SCHEDULER_NOSCHEDULER );
+    assert( priority >= 0 && priority < SCHEDULER_NUM_PRIORITIES && SCHEDULER_BADPRIORITY );
+
+    if ( s->num_kinds == SCHEDULER_MAX_KINDS ) {
+        return SCHEDULER_FULL;
+    }
+    scheduler_kind_t* kind = &s->kinds[ s->num_kinds ];
+    memset( kind, 0, sizeof( scheduler_kind_t ) );
+    kind->task = task;
+    kind->priority = priority;
+    return s->num_kinds++;
+}
+
+void scheduler_submit( scheduler_t* s, unsigned int kind, void* data ) {
+    assert( s && SCHEDULER_NOSCHEDULER );
+    assert( kind < s->num_kinds && SCHEDULER_NOKIND );
+
+    scheduler_queue_t* queue = &s->queues[ s->kinds[ kind ].priority ];
+    if ( queue->count == queue->capacity ) {
+        unsigned int capacity = queue->capacity ? 2 * queue->capacity : 16;
+        scheduler_job_t* jobs = ( scheduler_job_t* ) mem_malloc( capacity * sizeof( scheduler_job_t ) );
+        if ( queue->jobs ) {
+            memcpy( jobs, queue->jobs, queue->count * sizeof( scheduler_job_t ) );
+            mem_free( queue->jobs );
+        }
+        queue->jobs = jobs;
+        queue->capacity = capacity;
+    }
+    scheduler_job_t* job = &queue->jobs[ queue->count++ ];
+    job->kind = kind;
+    job->data = data;
+    job->frame = s->frame;
+}
+
+// Runs the job and updates the statistics of its kind
+static unsigned long long _scheduler_execute( scheduler_t* s, scheduler_job_t job ) {
+    scheduler_kind_t* kind = &s->kinds[ job.kind ];
+    unsigned long long start = s->clock();
+    kind->task( job.data );
+    unsigned long long cost = s->clock() - start;
+
+    scheduler_stats_t* stats = &kind->stats;
+    if ( stats->runs == 0 ) {
+        stats->estimate_ns = cost;
+    } else if ( cost >= stats->estimate_ns ) {
+        stats->estimate_ns += ( cost - stats->estimate_ns ) >> SCHEDULER_AVERAGE_BITS;
+    } else {
+        stats->estimate_ns -= ( stats->estimate_ns - cost ) >> SCHEDULER_AVERAGE_BITS;
+    }
+    stats->last_ns = cost;
+    stats->runs++;
+    unsigned int latency = s->frame - job.frame;
+    stats->total_latency += latency;
+    if ( latency > stats->max_latency ) {
+        stats->max_latency = latency;
+    }
+    return cost;
+}
+
+unsigned int scheduler_run( scheduler_t* s, unsigned long long budget_ns ) {
+    assert( s && SCHEDULER_NOSCHEDULER );
+
+    s->used_ns = 0;
+    s->ran = 0;
+    s->deferred = 0;
+    // The tasks submitted by the tasks are left for the next frame.
+    unsigned int counts[ SCHEDULER_NUM_PRIORITIES ];
+    for ( unsigned int p = 0; p < SCHEDULER_NUM_PRIORITIES; p++ ) {
+        counts[p] = s->queues[p].count;
+    }
+    for ( unsigned int p = 0; p < SCHEDULER_NUM_PRIORITIES; p++ ) {
+        unsigned int count = counts[p];
+        if ( !count ) {
+            continue;
+        }
+        unsigned int kept = 0;
+        for ( unsigned int i = 0; i < count; i++ ) {
+            // A task may grow the queue, so the jobs are not cached.
+            scheduler_job_t job = s->queues[p].jobs[i];
+            scheduler_stats_t* stats = &s->kinds[ job.kind ].stats;
+            int starved = s->frame - job.frame >= s->max_age;
+            int fits = s->used_ns + stats->estimate_ns <= budget_ns;
+            if ( p == SCHEDULER_CRITICAL || fits || starved ) {
+                stats->starved += !fits && starved && p != SCHEDULER_CRITICAL;
+                s->used_ns += _scheduler_execute( s, job );
+                s->ran++;
+            } else {
+                stats->deferrals++;
+                s->deferred++;
+                s->queues[p].jobs[ kept++ ] = job;
+            }
+        }
+        scheduler_queue_t* queue = &s->queues[p];
+        memmove( &queue->jobs[ kept ], &queue->jobs[ count ],
+            ( queue->count - count ) * sizeof( scheduler_job_t ) );
+        queue->count = kept + queue->count - count;
+    }
+    s->frame++;
+    return s->ran;
+}
+
+const scheduler_stats_t* scheduler_stats( scheduler_t* s, unsigned int kind ) {
+    assert( s && SCHEDULER_NOSCHEDULER );
+    assert( kind < s->num_kinds && SCHEDULER_NOKIND );
+
+    return &s->kinds[ kind ].stats;
+}
+
+unsigned int scheduler_pending( scheduler_t* s ) {
+    assert( s && SCHEDULER_NOSCHEDULER );
+
+    unsigned int count = 0;
+    for ( unsigned int p = 0; p < SCHEDULER_NUM_PRIORITIES; p++ ) {
+        count += s->queues[p].count;
+    }
+    return count;
+}
@@ -0,0 +1,159 @@
+// Scheduler
+//
+// The scheduler runs the work that does not have to be done in a given
+// frame, e.g., the path finding, the re-planning of the AI and the decoding
+// of the assets, within a time budget per frame.
+//
+// A kind of task is registered with its function and its priority class.
+// The tasks are submitted to the queue of their class and run by
+// scheduler_run() once per frame, the classes in the order of the priority
+// and the tasks of a class in the order of the submission. The scheduler
+// keeps a moving average of the cost of each kind. A task whose estimated
+// cost exceeds what is left of the budget is deferred to the next frame,
+// while the cheaper tasks behind it may still run.
+//
+// SCHEDULER_CRITICAL  The tasks always run, regardless of the budget.
+// SCHEDULER_HIGH      The tasks run first when the budget allows.
+// SCHEDULER_NORMAL
+// SCHEDULER_LOW       The tasks slip to later frames first.
+//
+// A task that has been deferred for max_age frames runs regardless of the
+// budget, so the low priorities are not starved by a steady load.
+
+#ifndef _scheduler_
+#define _scheduler_
+
+// Messages for the diagnostics
+#define SCHEDULER_NOSCHEDULER "Scheduler does not exist"
+#define SCHEDULER_NOKIND "Task kind does not exist"
+#define SCHEDULER_BADPRIORITY "Priority is out of range"
+
+// Return values
+#define SCHEDULER_FULL -1
+
+// Priority classes
+#define SCHEDULER_CRITICAL  0
+#define SCHEDULER_HIGH      1
+#define SCHEDULER_NORMAL    2
+#define SCHEDULER_LOW       3
+#define SCHEDULER_NUM_PRIORITIES 4
+
+#define SCHEDULER_MAX_KINDS 32
+// The frames after which a deferred task runs regardless of the budget
+#define SCHEDULER_DEFAULT_MAX_AGE 8
+// The weight of the latest cost in the moving average, 1 / 2^bits
+#define SCHEDULER_AVERAGE_BITS 3
+
+// A task
+//
+// @param data The data that was submitted with the task
+typedef void ( *scheduler_task_t )( void* data );
+
+// A clock in nanoseconds
+typedef unsigned long long ( *scheduler_clock_t )( void );
+
+// The statistics of a kind of task
+//
+// The latency of a task is the number of the frames from the submission to
+// the run; a task that runs in the frame of its submission has zero latency.
+typedef struct {
+    // The moving average of the cost and the latest cost
+    unsigned long long estimate_ns;
+    unsigned long long last_ns;
+    unsigned int runs;
+    // The number of the times that a task was deferred
+    unsigned int deferrals;
+    // The number of the runs of the starved tasks over the budget
+    unsigned int starved;
+    unsigned long long total_latency;
+    unsigned int max_latency;
+} scheduler_stats_t;
+
+typedef struct {
+    scheduler_task_t task;
+    int priority;
+    scheduler_stats_t stats;
+} scheduler_kind_t;
+
+// A submitted task
+typedef struct {
+    unsigned int kind;
+    void* data;
+    unsigned int frame;
+} scheduler_job_t;
+
+typedef struct {
+    scheduler_job_t* jobs;
+    unsigned int count;
+    unsigned int capacity;
+} scheduler_queue_t;
+
+typedef struct {
+    // Configuration
+    scheduler_clock_t clock;
+    unsigned int max_age;
+    // State
+    scheduler_kind_t kinds[ SCHEDULER_MAX_KINDS ];
+    unsigned int num_kinds;
+    scheduler_queue_t queues[ SCHEDULER_NUM_PRIORITIES ];
+    unsigned int frame;
+    // Statistics of the latest frame
+    unsigned long long used_ns;
+    unsigned int ran;
+    unsigned int deferred;
+} scheduler_t;
+
+// Creates a new scheduler
+//
+// @param clock The clock that measures the tasks, or NULL for the
+//              monotonic clock of the system
+// @return The pointer to the scheduler
+scheduler_t* scheduler_new( scheduler_clock_t clock );
+
+// Releases the scheduler. The queued tasks are dropped
+//
+// @param s The pointer to the scheduler
+void scheduler_free( scheduler_t* s );
+
+// Registers a kind of task
+//
+// @precondition s != NULL
+// @precondition 0 <= priority < SCHEDULER_NUM_PRIORITIES
+// @param s The pointer to the scheduler
+// @param task The function of the tasks
+// @param priority The priority class of the tasks
+// @return The id of the kind, or SCHEDULER_FULL
+int scheduler_kind( scheduler_t* s, scheduler_task_t task, int priority );
+
+// Submits a task
+//
+// A task may submit new tasks. They are queued for the next frame.
+//
+// @precondition s != NULL
+// @precondition kind < s->num_kinds
+// @param s The pointer to the scheduler
+// @param kind The id of the kind
+// @param data The data that is passed to the task
+void scheduler_submit( scheduler_t* s, unsigned int kind, void* data );
+
+// Runs the tasks of a frame within the budget
+//
+// @precondition s != NULL
+// @param s The pointer to the scheduler
+// @param budget_ns The time budget of the frame
+// @return The number of the tasks that were run
+unsigned int scheduler_run( scheduler_t* s, unsigned long long budget_ns );
+
+// @precondition s != NULL
+// @precondition kind < s->num_kinds
+// @param s The pointer to the scheduler
+// @param kind The id of the kind
+// @return The statistics of the kind
+const scheduler_stats_t* scheduler_stats( scheduler_t* s, unsigned int kind );
+
+// @precondition s != NULL
+// @param s The pointer to the scheduler
+// @return The number of the queued tasks
+unsigned int scheduler_pending( scheduler_t* s );
+
+#endif // _scheduler_
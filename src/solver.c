@@ -0,0 +1,345 @@
+// Contact solver
+//
+// [Implementation details]
+//
+// The velocities are scaled by SOLVER_ONE and the inverse masses by
+// 2^_INV_BITS. The inverse mass of a dynamic body is at least one, so the
+// bodies heavier than 2^24 are solved as 2^24. An impulse is a mass times a
+// scaled velocity. With the velocities below 2^15 units per step, the
+// products stay within 64 bits.
+//
+// The constraints are counting sorted by the root of the island, which is
+// the smallest index of the island (see contacts_islands), so the batches
+// come in a fixed order.
+//
+// The solved velocities are rounded to whole units. The part below one unit
+// is added to the remainder of the body, which moves the body by a unit
+// once it reaches a half. So a push out of less than half a unit per step,
+// e.g., the Baumgarte push of a shallow penetration, adds up over the steps
+// instead of being rounded away.
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./contacts.h"
+#include "./jobs.h"
+#include "./mem.h"
+#include "./physics.h"
+#include "./solver.h"
+
+#define _INV_BITS 24
+#define _MIN_CONSTRAINTS 16
+
+solver_t* solver_new( jobs_t* jobs ) {
+    solver_t* solver = ( solver_t* ) mem_malloc( sizeof( solver_t ) );
+    solver->iterations = SOLVER_DEFAULT_ITERATIONS;
+    solver->restitution = SOLVER_DEFAULT_RESTITUTION;
+    solver->friction = SOLVER_DEFAULT_FRICTION;
+    solver->baumgarte = SOLVER_DEFAULT_BAUMGARTE;
+    solver->slop = SOLVER_DEFAULT_SLOP;
+    solver->jobs = jobs;
+    solver->vx = NULL;
+    solver->vy = NULL;
+    solver->offsets = NULL;
+    solver->max_bodies = 0;
+    solver->constraints = NULL;
+    solver->sorted = NULL;
+    solver->batches = NULL;
+    solver->num_constraints = 0;
+    solver->max_constraints = 0;
+    solver->num_batches = 0;
+    return solver;
+}
+
+static void _free_bodies( solver_t* solver ) {
+    if ( solver->max_bodies ) {
+        mem_free( solver->vx );
+        mem_free( solver->vy );
+        mem_free( solver->offsets );
+    }
+}
+
+static void _free_constraints( solver_t* solver ) {
+    if ( solver->max_constraints ) {
+        mem_free( solver->constraints );
+        mem_free( solver->sorted );
+        mem_free( solver->batches );
+    }
+}
+
+void solver_free( solver_t* solver ) {
+    _free_bodies( solver );
+    _free_constraints( solver );
+    mem_free( solver );
+}
+
+void solver_configure( solver_t* solver, unsigned int iterations,
+        unsigned int restitution, unsigned int friction ) {
+    assert( solver && SOLVER_NOSOLVER );
+    assert( restitution <= SOLVER_ONE && SOLVER_BADFACTOR );
+    assert( friction <= SOLVER_ONE && SOLVER_BADFACTOR );
+
+    solver->iterations = iterations;
+    solver->restitution = restitution;
+    solver->friction = friction;
+}
+
+static void _reserve( solver_t* solver, unsigned int num_bodies, unsigned int num_constraints ) {
+    if ( num_bodies > solver->max_bodies ) {
+        _free_bodies( solver );
+        solver->vx = ( long long* ) mem_malloc( num_bodies * sizeof( long long ) );
+        solver->vy = ( long long* ) mem_malloc( num_bodies * sizeof( long long ) );
+        solver->offsets = ( unsigned int* ) mem_malloc( ( num_bodies + 1 ) * sizeof( unsigned int ) );
+        solver->max_bodies = num_bodies;
+    }
+    if ( num_constraints > solver->max_constraints ) {
+        unsigned int max = solver->max_constraints ? solver->max_constraints : _MIN_CONSTRAINTS;
+        while ( max < num_constraints ) {
+            max *= 2;
+        }
+        _free_constraints( solver );
+        solver->constraints = ( solver_constraint_t* ) mem_malloc( max * sizeof( solver_constraint_t ) );
+        solver->sorted = ( solver_constraint_t* ) mem_malloc( max * sizeof( solver_constraint_t ) );
+        solver->batches = ( solver_batch_t* ) mem_malloc( max * sizeof( solver_batch_t ) );
+        solver->max_constraints = max;
+    }
+}
+
+// The inverse mass of a dynamic body is at least one, so a body heavier
+// than 2^_INV_BITS is solved as if it were that heavy, not as a static one
+static long long _inv_mass( physics_body_t* body ) {
+    if ( physics_is_static( body ) ) {
+        return 0;
+    }
+    long long inv_m = ( 1LL << _INV_BITS ) / body->m;
+    return inv_m ? inv_m : 1;
+}
+
+// Rounds the scaled velocity to the nearest integer, halves away from zero
+static int _round( long long v ) {
+    return ( int ) ( v >= 0 ? ( v + SOLVER_ONE / 2 ) / SOLVER_ONE : -( ( -v + SOLVER_ONE / 2 ) / SOLVER_ONE ) );
+}
+
+// Moves the body by the part of the scaled velocity below one unit
+static void _carry( long long v, int vx, int* r, int* x ) {
+    *r += ( int ) ( v - ( long long ) vx * SOLVER_ONE );
+    if ( *r >= SOLVER_ONE / 2 ) {
+        *r -= SOLVER_ONE;
+        ( *x )++;
+    } else if ( *r < -SOLVER_ONE / 2 ) {
+        *r += SOLVER_ONE;
+        ( *x )--;
+    }
+}
+
+// Applies the impulse p along ( dx, dy ) to the 2nd body and the opposite
+// to the 1st body
+static void _apply( solver_t* solver, solver_constraint_t* c, long long p, int dx, int dy ) {
+    if ( c->inv_m0 ) {
+        long long dv = p * c->inv_m0 / ( 1LL << _INV_BITS );
+        solver->vx[ c->index_0 ] -= dv * dx;
+        solver->vy[ c->index_0 ] -= dv * dy;
+    }
+    if ( c->inv_m1 ) {
+        long long dv = p * c->inv_m1 / ( 1LL << _INV_BITS );
+        solver->vx[ c->index_1 ] += dv * dx;
+        solver->vy[ c->index_1 ] += dv * dy;
+    }
+}
+
+static long long _relative_velocity( solver_t* solver, solver_constraint_t* c, int dx, int dy ) {
+    return ( solver->vx[ c->index_1 ] - solver->vx[ c->index_0 ] ) * dx
+        + ( solver->vy[ c->index_1 ] - solver->vy[ c->index_0 ] ) * dy;
+}
+
+// Sets up the constraint of the contact. Returns zero if the contact needs
+// no solving
+static int _setup( solver_t* solver, physics_world_t* world, contact_t* contact,
+        solver_constraint_t* c ) {
+    physics_obj_t* obj_0 = physics_world_find( world, contact->guid_0 );
+    physics_obj_t* obj_1 = physics_world_find( world, contact->guid_1 );
+    if ( !obj_0 || !obj_1 ) {
+        return 0;
+    }
+    physics_body_t* b_0 = obj_0->body;
+    physics_body_t* b_1 = obj_1->body;
+    if ( !contact->touching
+            || ( physics_is_static( b_0 ) && physics_is_static( b_1 ) )
+            || ( physics_is_sleeping( b_0 ) && physics_is_sleeping( b_1 ) ) ) {
+        return 0;
+    }
+
+    // The normal along the axis of the smaller overlap
+    int ox = ( b_0->x + ( int ) b_0->w < b_1->x + ( int ) b_1->w ? b_0->x + ( int ) b_0->w : b_1->x + ( int ) b_1->w )
+        - ( b_0->x > b_1->x ? b_0->x : b_1->x );
+    int oy = ( b_0->y + ( int ) b_0->h < b_1->y + ( int ) b_1->h ? b_0->y + ( int ) b_0->h : b_1->y + ( int ) b_1->h )
+        - ( b_0->y > b_1->y ? b_0->y : b_1->y );
+    int depth;
+    if ( ox < oy ) {
+        c->nx = 2 * b_1->x + ( int ) b_1->w >= 2 * b_0->x + ( int ) b_0->w ? 1 : -1;
+        c->ny = 0;
+        depth = ox;
+    } else {
+        c->nx = 0;
+        c->ny = 2 * b_1->y + ( int ) b_1->h >= 2 * b_0->y + ( int ) b_0->h ? 1 : -1;
+        depth = oy;
+    }
+
+    c->contact = contact;
+    c->index_0 = obj_0->index;
+    c->index_1 = obj_1->index;
+    c->inv_m0 = _inv_mass( b_0 );
+    c->inv_m1 = _inv_mass( b_1 );
+    // Nothing can move, like two static bodies
+    if ( !c->inv_m0 && !c->inv_m1 ) {
+        return 0;
+    }
+
+    // The bounce is based on the approach before the warm start.
+    long long vn = _relative_velocity( solver, c, c->nx, c->ny );
+    c->target = 0;
+    if ( vn < -( long long ) SOLVER_BOUNCE_THRESHOLD * SOLVER_ONE ) {
+        c->target = -vn * solver->restitution / SOLVER_ONE;
+    }
+    if ( depth > ( int ) solver->slop ) {
+        long long bias = ( long long ) solver->baumgarte * ( depth - ( int ) solver->slop );
+        if ( bias > c->target ) {
+            c->target = bias;
+        }
+    }
+
+    c->impulse_n = 0;
+    c->impulse_t = 0;
+    if ( contact->nx == c->nx && contact->ny == c->ny ) {
+        c->impulse_n = contact->impulse_n;
+        c->impulse_t = contact->impulse_t;
+        _apply( solver, c, c->impulse_n, c->nx, c->ny );
+        _apply( solver, c, c->impulse_t, c->ny, -c->nx );
+    }
+    return 1;
+}
+
+static void _solve_constraint( solver_t* solver, solver_constraint_t* c ) {
+    long long k = c->inv_m0 + c->inv_m1;
+
+    // The normal impulse
+    long long vn = _relative_velocity( solver, c, c->nx, c->ny );
+    long long p = ( c->target - vn ) * ( 1LL << _INV_BITS ) / k;
+    long long impulse = c->impulse_n + p;
+    if ( impulse < 0 ) {
+        impulse = 0;
+    }
+    _apply( solver, c, impulse - c->impulse_n, c->nx, c->ny );
+    c->impulse_n = impulse;
+
+    // The friction impulse
+    long long vt = _relative_velocity( solver, c, c->ny, -c->nx );
+    long long max = c->impulse_n * solver->friction / SOLVER_ONE;
+    p = -vt * ( 1LL << _INV_BITS ) / k;
+    impulse = c->impulse_t + p;
+    if ( impulse > max ) {
+        impulse = max;
+    } else if ( impulse < -max ) {
+        impulse = -max;
+    }
+    _apply( solver, c, impulse - c->impulse_t, c->ny, -c->nx );
+    c->impulse_t = impulse;
+}
+
+// Solves the batches [begin, end)
+static void _work( void* data, unsigned int begin, unsigned int end ) {
+    solver_t* solver = ( solver_t* ) data;
+
+    for ( unsigned int b = begin; b < end; b++ ) {
+        solver_batch_t* batch = &solver->batches[b];
+        for ( unsigned int it = 0; it < solver->iterations; it++ ) {
+            for ( unsigned int i = 0; i < batch->count; i++ ) {
+                _solve_constraint( solver, &solver->constraints[ batch->first + i ] );
+            }
+        }
+    }
+}
+
+// Sorts the constraints by the island and splits them into the batches
+static void _batch( solver_t* solver, physics_world_t* world ) {
+    unsigned int* offsets = solver->offsets;
+    memset( offsets, 0, ( world->count + 1 ) * sizeof( unsigned int ) );
+    for ( unsigned int i = 0; i < solver->num_constraints; i++ ) {
+        solver_constraint_t* c = &solver->constraints[i];
+        unsigned int index = c->inv_m0 ? c->index_0 : c->index_1;
+        offsets[ world->islands[ index ] + 1 ]++;
+    }
+    solver->num_batches = 0;
+    for ( unsigned int root = 0; root < world->count; root++ ) {
+        if ( offsets[ root + 1 ] ) {
+            solver_batch_t* batch = &solver->batches[ solver->num_batches++ ];
+            batch->first = offsets[ root ];
+            batch->count = offsets[ root + 1 ];
+        }
+        offsets[ root + 1 ] += offsets[ root ];
+    }
+    for ( unsigned int i = 0; i < solver->num_constraints; i++ ) {
+        solver_constraint_t* c = &solver->constraints[i];
+        unsigned int index = c->inv_m0 ? c->index_0 : c->index_1;
+        solver->sorted[ offsets[ world->islands[ index ] ]++ ] = *c;
+    }
+    solver_constraint_t* tmp = solver->constraints;
+    solver->constraints = solver->sorted;
+    solver->sorted = tmp;
+}
+
+unsigned int solver_solve( solver_t* solver, contacts_t* cache, physics_world_t* world ) {
+    assert( solver && SOLVER_NOSOLVER );
+    assert( cache && CONTACTS_NOCACHE );
+    assert( world && PHYSICS_NOWORLD );
+
+    _reserve( solver, world->count, cache->count );
+    for ( unsigned int i = 0; i < world->count; i++ ) {
+        solver->vx[i] = ( long long ) world->bodies[i].vx * SOLVER_ONE;
+        solver->vy[i] = ( long long ) world->bodies[i].vy * SOLVER_ONE;
+    }
+
+    solver->num_constraints = 0;
+    for ( unsigned int i = 0; i < cache->count; i++ ) {
+        contact_t* contact = &cache->contacts[i];
+        if ( _setup( solver, world, contact, &solver->constraints[ solver->num_constraints ] ) ) {
+            solver->num_constraints++;
+        } else {
+            contact->nx = 0;
+            contact->ny = 0;
+            contact->impulse_n = 0;
+            contact->impulse_t = 0;
+        }
+    }
+    if ( !solver->num_constraints ) {
+        solver->num_batches = 0;
+        return 0;
+    }
+    _batch( solver, world );
+
+    if ( solver->jobs ) {
+        jobs_parallel_for( solver->jobs, solver->num_batches, 1, _work, solver );
+    } else {
+        _work( solver, 0, solver->num_batches );
+    }
+
+    // Store the impulses for the warm start and the velocities.
+    for ( unsigned int i = 0; i < solver->num_constraints; i++ ) {
+        solver_constraint_t* c = &solver->constraints[i];
+        c->contact->nx = c->nx;
+        c->contact->ny = c->ny;
+        c->contact->impulse_n = c->impulse_n;
+        c->contact->impulse_t = c->impulse_t;
+    }
+    for ( unsigned int i = 0; i < world->count; i++ ) {
+        physics_body_t* body = &world->bodies[i];
+        if ( !physics_is_static( body ) ) {
+            body->vx = _round( solver->vx[i] );
+            body->vy = _round( solver->vy[i] );
+            _carry( solver->vx[i], body->vx, &body->rx, &body->x );
+            _carry( solver->vy[i], body->vy, &body->ry, &body->y );
+        }
+    }
+    return solver->num_constraints;
+}
@@ -0,0 +1,144 @@
+// Contact solver
+//
+// The solver resolves the touching contacts of the contact cache with
+// sequential impulses. The contact between two boxes has the normal along
+// the axis of the smaller overlap, pointing from the 1st body to the 2nd.
+// For each contact, the solver iterates:
+//
+// - the normal impulse that stops the approach of the bodies, bounces them
+//   back by the restitution and pushes them apart by a fraction of the
+//   penetration (Baumgarte). The accumulated impulse is kept non-negative.
+// - the friction impulse that stops the sliding of the bodies. The
+//   accumulated impulse is kept within the friction times the normal
+//   impulse.
+//
+// The accumulated impulses are stored to the contacts and applied at the
+// beginning of the next solve, if the normal has not changed (warm start).
+// Thus, the stacks settle in a few iterations.
+//
+// The math is done in fixed point with SOLVER_BITS fractional bits and
+// 64-bit intermediates, so the results do not depend on the machine. The
+// inverse mass of a static body (m == 0) is zero. The velocities of the
+// bodies are whole units; the rest is kept in the remainders (rx, ry) of
+// the bodies and moved once it adds up to a unit.
+//
+// The contacts are batched by the islands of the world (see
+// contacts_islands), so the batches share no dynamic bodies and can be
+// solved in parallel. The order of the contacts within a batch is the order
+// of the cache, so the results do not depend on the number of threads. The
+// batches run on the job system (see jobs.h), if any.
+//
+// The boxes do not rotate, so the angular momentum (Lx, Ly) is not changed.
+
+#ifndef _solver_
+#define _solver_
+
+#include "./contacts.h"
+#include "./jobs.h"
+#include "./physics.h"
+
+// Messages for the diagnostics
+#define SOLVER_NOSOLVER "Solver does not exist"
+#define SOLVER_BADFACTOR "Factor must be in range [0, SOLVER_ONE]"
+
+// The fixed-point one of the factors and the velocities
+#define SOLVER_BITS     16
+#define SOLVER_ONE      ( 1 << SOLVER_BITS )
+
+// The defaults
+#define SOLVER_DEFAULT_ITERATIONS   8
+#define SOLVER_DEFAULT_RESTITUTION  0
+#define SOLVER_DEFAULT_FRICTION     ( SOLVER_ONE / 2 )
+#define SOLVER_DEFAULT_BAUMGARTE    ( SOLVER_ONE / 5 )
+#define SOLVER_DEFAULT_SLOP         1
+
+// The relative velocity (units per step) below which the bodies do not
+// bounce
+#define SOLVER_BOUNCE_THRESHOLD     1
+
+// A contact constraint of the latest solve
+typedef struct {
+    contact_t* contact;
+    unsigned int index_0;
+    unsigned int index_1;
+    // The normal and the tangent (ny, -nx)
+    int nx;
+    int ny;
+    // The inverse masses in fixed point
+    long long inv_m0;
+    long long inv_m1;
+    // The normal velocity that the normal impulse aims at
+    long long target;
+    long long impulse_n;
+    long long impulse_t;
+} solver_constraint_t;
+
+// A range of the constraints of one island
+typedef struct {
+    unsigned int first;
+    unsigned int count;
+} solver_batch_t;
+
+typedef struct {
+    // The configuration
+    unsigned int iterations;
+    unsigned int restitution;
+    unsigned int friction;
+    unsigned int baumgarte;
+    unsigned int slop;
+    jobs_t* jobs;
+    // The velocities of the bodies in fixed point
+    long long* vx;
+    long long* vy;
+    unsigned int max_bodies;
+    // The constraints sorted by the island
+    solver_constraint_t* constraints;
+    unsigned int num_constraints;
+    unsigned int max_constraints;
+    solver_batch_t* batches;
+    unsigned int num_batches;
+    // The scratch of the sort
+    solver_constraint_t* sorted;
+    unsigned int* offsets;
+} solver_t;
+
+// Creates a new solver with the default configuration
+//
+// @param jobs The job system that solves the batches, or NULL to solve them
+//             on the calling thread
+// @return The pointer to the solver
+solver_t* solver_new( jobs_t* jobs );
+
+// Releases the solver
+//
+// @param solver The pointer to the solver
+void solver_free( solver_t* solver );
+
+// Sets the configuration of the solver
+//
+// @precondition solver != NULL
+// @precondition restitution <= SOLVER_ONE
+// @precondition friction <= SOLVER_ONE
+// @param solver The pointer to the solver
+// @param iterations The number of the iterations per solve
+// @param restitution The bounciness in range [0, SOLVER_ONE]
+// @param friction The friction coefficient in range [0, SOLVER_ONE]
+void solver_configure( solver_t* solver, unsigned int iterations,
+        unsigned int restitution, unsigned int friction );
+
+// Resolves the touching contacts by changing the velocities of the bodies
+//
+// The contacts between two static or two sleeping bodies are skipped.
+//
+// @precondition solver != NULL
+// @precondition cache != NULL
+// @precondition world != NULL
+// @precondition contacts_islands( cache, world ) has been called after
+//               the latest contacts_update( cache, ... )
+// @param solver The pointer to the solver
+// @param cache The pointer to the contact cache of the world
+// @param world The pointer to the world
+// @return The number of the solved contacts
+unsigned int solver_solve( solver_t* solver, contacts_t* cache, physics_world_t* world );
+
+#endif // _solver_
@@ -0,0 +1,242 @@
+// Tile map
+//
+// [Implementation details]
+//
+// The bit tx % 64 of the word tx / 64 of a row is the tile tx. A range of
+// tiles of a row is scanned by masking the first and the last word; the
+// words between are tested whole.
+//
+// The sweep collects the solid tiles under the swept bounds and tests each
+// of them with physics_sweep_box(), so a thin wall stops a fast body even if
+// the body jumps over it in one step.
+
+#include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "./defs.h"
+#include "./mem.h"
+#include "./physics.h"
+#include "./tilemap.h"
+
+tilemap_t* tilemap_new( unsigned int width, unsigned int height, int x0, int y0,
+        unsigned int tile_bits ) {
+    assert( tile_bits <= TILEMAP_MAX_TILE_BITS && TILEMAP_NOTILEBITS );
+    assert( x0 + ( ( long long ) width << tile_bits ) <= INT_MAX && TILEMAP_TOOBIG );
+    assert( y0 + ( ( long long ) height << tile_bits ) <= INT_MAX && TILEMAP_TOOBIG );
+    tilemap_t* map = ( tilemap_t* ) mem_malloc( sizeof( tilemap_t ) );
+    map->width = width;
+    map->height = height;
+    map->x0 = x0;
+    map->y0 = y0;
+    map->tile_bits = tile_bits;
+    map->words_per_row = ( width + TILEMAP_BITS_PER_WORD - 1 ) / TILEMAP_BITS_PER_WORD;
+    unsigned int num_words = map->words_per_row * height;
+    map->bits = ( uint64_t* ) mem_malloc( ( num_words ? num_words : 1 ) * sizeof( uint64_t ) );
+    memset( map->bits, 0, num_words * sizeof( uint64_t ) );
+    map->max_hits = 16;
+    map->hits = ( tilemap_hit_t* ) mem_malloc( map->max_hits * sizeof( tilemap_hit_t ) );
+    map->num_hits = 0;
+    return map;
+}
+
+void tilemap_free( tilemap_t* map ) {
+    mem_free( map->bits );
+    mem_free( map->hits );
+    mem_free( map );
+}
+
+void tilemap_set( tilemap_t* map, unsigned int tx, unsigned int ty, int solid ) {
+    assert( map && TILEMAP_NOMAP );
+    assert( tx < map->width && ty < map->height && TILEMAP_NOTILE );
+
+    uint64_t* word = &map->bits[ ty * map->words_per_row + tx / TILEMAP_BITS_PER_WORD ];
+    uint64_t bit = ( uint64_t ) 1 << ( tx % TILEMAP_BITS_PER_WORD );
+    if ( solid ) {
+        *word |= bit;
+    } else {
+        *word &= ~bit;
+    }
+}
+
+int tilemap_get( tilemap_t* map, int tx, int ty ) {
+    assert( map && TILEMAP_NOMAP );
+
+    if ( tx < 0 || ty < 0 || tx >= ( int ) map->width || ty >= ( int ) map->height ) {
+        return 0;
+    }
+    uint64_t word = map->bits[ ty * map->words_per_row + tx / TILEMAP_BITS_PER_WORD ];
+    return ( word >> ( tx % TILEMAP_BITS_PER_WORD ) ) & 1;
+}
+
+// Returns the tile of the coordinate, rounding down also below the origin
+static int _tile( long long v, int origin, unsigned int bits ) {
+    long long d = v - origin;
+    return ( int ) ( d >= 0 ? d >> bits : -( ( -d - 1 ) >> bits ) - 1 );
+}
+
+static unsigned int _lowest_bit( uint64_t word ) {
+#ifdef __GNUC__
+    return __builtin_ctzll( word );
+#else
+    unsigned int i = 0;
+    while ( !( word & 1 ) ) {
+        word >>= 1;
+        i++;
+    }
+    return i;
+#endif
+}
+
+// Returns the first solid tile in [ a, b ] of the row, or -1
+static int _next_solid( tilemap_t* map, int ty, int a, int b ) {
+    if ( a > b ) {
+        return -1;
+    }
+    uint64_t* row = &map->bits[ ty * map->words_per_row ];
+    unsigned int w = a / TILEMAP_BITS_PER_WORD;
+    unsigned int last = b / TILEMAP_BITS_PER_WORD;
+    uint64_t word = row[w] & ( ~( uint64_t ) 0 << ( a % TILEMAP_BITS_PER_WORD ) );
+    for ( ;; ) {
+        if ( w == last ) {
+            word &= ~( uint64_t ) 0 >> ( TILEMAP_BITS_PER_WORD - 1 - b % TILEMAP_BITS_PER_WORD );
+        }
+        if ( word ) {
+            return w * TILEMAP_BITS_PER_WORD + _lowest_bit( word );
+        }
+        if ( w == last ) {
+            return -1;
+        }
+        word = row[ ++w ];
+    }
+}
+
+// Clips the box to the tiles of the map. Returns zero if nothing is left
+static int _tiles( tilemap_t* map, long long x0, long long y0, long long x1, long long y1,
+        int* tx0, int* ty0, int* tx1, int* ty1 ) {
+    if ( x1 <= x0 || y1 <= y0 ) {
+        return 0;
+    }
+    *tx0 = _tile( x0, map->x0, map->tile_bits );
+    *ty0 = _tile( y0, map->y0, map->tile_bits );
+    *tx1 = _tile( x1 - 1, map->x0, map->tile_bits );
+    *ty1 = _tile( y1 - 1, map->y0, map->tile_bits );
+    if ( *tx0 < 0 ) {
+        *tx0 = 0;
+    }
+    if ( *ty0 < 0 ) {
+        *ty0 = 0;
+    }
+    if ( *tx1 >= ( int ) map->width ) {
+        *tx1 = map->width - 1;
+    }
+    if ( *ty1 >= ( int ) map->height ) {
+        *ty1 = map->height - 1;
+    }
+    return *tx0 <= *tx1 && *ty0 <= *ty1;
+}
+
+int tilemap_overlaps( tilemap_t* map, int x0, int y0, int x1, int y1, int* tx, int* ty ) {
+    assert( map && TILEMAP_NOMAP );
+
+    int tx0, ty0, tx1, ty1;
+    if ( !_tiles( map, x0, y0, x1, y1, &tx0, &ty0, &tx1, &ty1 ) ) {
+        return 0;
+    }
+    for ( int row = ty0; row <= ty1; row++ ) {
+        int col = _next_solid( map, row, tx0, tx1 );
+        if ( col >= 0 ) {
+            if ( tx ) {
+                *tx = col;
+            }
+            if ( ty ) {
+                *ty = row;
+            }
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int tilemap_sweep( tilemap_t* map, int x, int y, unsigned int w, unsigned int h,
+        int dx, int dy, unsigned int* toi, int* tx, int* ty ) {
+    assert( map && TILEMAP_NOMAP );
+
+    long long x0 = dx < 0 ? ( long long ) x + dx : x;
+    long long y0 = dy < 0 ? ( long long ) y + dy : y;
+    long long x1 = ( long long ) x + w + ( dx > 0 ? dx : 0 );
+    long long y1 = ( long long ) y + h + ( dy > 0 ? dy : 0 );
+    int tx0, ty0, tx1, ty1;
+    if ( !_tiles( map, x0, y0, x1, y1, &tx0, &ty0, &tx1, &ty1 ) ) {
+        return 0;
+    }
+
+    unsigned int size = 1u << map->tile_bits;
+    unsigned int best = PHYSICS_TOI_ONE;
+    for ( int row = ty0; row <= ty1 && best > 0; row++ ) {
+        int col = _next_solid( map, row, tx0, tx1 );
+        while ( col >= 0 ) {
+            unsigned int t;
+            if ( physics_sweep_box( x, y, w, h, dx, dy,
+                    map->x0 + ( col << map->tile_bits ), map->y0 + ( row << map->tile_bits ),
+                    size, size, &t ) && t < best ) {
+                best = t;
+                if ( tx ) {
+                    *tx = col;
+                }
+                if ( ty ) {
+                    *ty = row;
+                }
+            }
+            col = _next_solid( map, row, col + 1, tx1 );
+        }
+    }
+    if ( best == PHYSICS_TOI_ONE ) {
+        return 0;
+    }
+    *toi = best;
+    return 1;
+}
+
+static void _push_hit( tilemap_t* map, int guid, unsigned int toi, int tx, int ty ) {
+    if ( map->num_hits == map->max_hits ) {
+        tilemap_hit_t* grown = ( tilemap_hit_t* ) mem_malloc( 2 * map->max_hits * sizeof( tilemap_hit_t ) );
+        memcpy( grown, map->hits, map->num_hits * sizeof( tilemap_hit_t ) );
+        mem_free( map->hits );
+        map->hits = grown;
+        map->max_hits *= 2;
+    }
+    tilemap_hit_t* hit = &map->hits[ map->num_hits++ ];
+    hit->guid = guid;
+    hit->toi = toi;
+    hit->tx = tx;
+    hit->ty = ty;
+}
+
+unsigned int tilemap_collide( tilemap_t* map, physics_world_t* world ) {
+    assert( map && TILEMAP_NOMAP );
+    assert( world && PHYSICS_NOWORLD );
+
+    map->num_hits = 0;
+    for ( unsigned int i = 0; i < world->count; i++ ) {
+        physics_obj_t* obj = &world->objs[i];
+        physics_body_t* body = obj->body;
+        if ( physics_is_static( body ) || physics_is_sleeping( body ) ) {
+            continue;
+        }
+        unsigned int toi = 0;
+        int tx, ty;
+        if ( obj->flags & PHYSICS_FLAG_FAST ) {
+            if ( tilemap_sweep( map, body->x - body->vx, body->y - body->vy, body->w, body->h,
+                    body->vx, body->vy, &toi, &tx, &ty ) ) {
+                _push_hit( map, obj->guid, toi, tx, ty );
+            }
+        } else if ( tilemap_overlaps( map, body->x, body->y,
+                body->x + ( int ) body->w, body->y + ( int ) body->h, &tx, &ty ) ) {
+            _push_hit( map, obj->guid, 0, tx, ty );
+        }
+    }
+    return map->num_hits;
+}
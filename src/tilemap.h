@@ -0,0 +1,142 @@
+// Tile map
+//
+// The static geometry of a level is a grid of square tiles, each of which
+// is either solid or empty. One bit per tile is stored; the bits of a row
+// are packed into 64-bit words, so a query scans 64 tiles at a time and
+// skips the empty words as a whole. The tiles outside of the map are empty.
+//
+// The tile map is tested against the bodies of the world next to the
+// broadphase (see tilemap_collide). The walls of a level never enter the
+// quad tree, so they do not swamp its buckets.
+
+#ifndef _tilemap_
+#define _tilemap_
+
+#include <stdint.h>
+
+#include "./physics.h"
+
+// Messages for the diagnostics
+#define TILEMAP_NOMAP "Tile map does not exist"
+#define TILEMAP_NOTILE "Tile is outside of the map"
+#define TILEMAP_NOTILEBITS "Tile is too big"
+#define TILEMAP_TOOBIG "Map does not fit in the world"
+
+#define TILEMAP_BITS_PER_WORD 64
+
+// The max size of a tile as a power of two, so that the corners of the
+// tiles are ints
+#define TILEMAP_MAX_TILE_BITS 30
+
+// A hit of a body against the map
+//
+// The tile is the first solid tile that the body met, in the row-major
+// order if several were met at the same time.
+typedef struct {
+    int guid;
+    unsigned int toi;
+    int tx;
+    int ty;
+} tilemap_hit_t;
+
+typedef struct {
+    // The size in tiles
+    unsigned int width;
+    unsigned int height;
+    // The top-left corner in the world and the size of a tile as a power
+    // of two
+    int x0;
+    int y0;
+    unsigned int tile_bits;
+    // The rows of bits
+    uint64_t* bits;
+    unsigned int words_per_row;
+    // The hits of the latest tilemap_collide()
+    tilemap_hit_t* hits;
+    unsigned int num_hits;
+    unsigned int max_hits;
+} tilemap_t;
+
+// Creates a new, empty map
+//
+// @param width The width in tiles
+// @param height The height in tiles
+// @param x0 The x coordinate of the top-left corner in the world
+// @param y0 The y coordinate of the top-left corner in the world
+// @precondition tile_bits <= TILEMAP_MAX_TILE_BITS
+// @precondition x0 + ( width << tile_bits ) <= INT_MAX and
+//               y0 + ( height << tile_bits ) <= INT_MAX, so the whole map is
+//               in the int coordinates of the world
+// @param tile_bits The size of a tile is 2^tile_bits units
+// @return The pointer to the map
+tilemap_t* tilemap_new( unsigned int width, unsigned int height, int x0, int y0,
+        unsigned int tile_bits );
+
+// Releases the map
+//
+// @param map The pointer to the map
+void tilemap_free( tilemap_t* map );
+
+// Sets the solidity of the tile
+//
+// @precondition map != NULL
+// @precondition tx < map->width && ty < map->height
+// @param map The pointer to the map
+// @param tx The column of the tile
+// @param ty The row of the tile
+// @param solid Non-zero for a solid tile
+void tilemap_set( tilemap_t* map, unsigned int tx, unsigned int ty, int solid );
+
+// @precondition map != NULL
+// @param map The pointer to the map
+// @param tx The column of the tile
+// @param ty The row of the tile
+// @return Non-zero if the tile is solid
+int tilemap_get( tilemap_t* map, int tx, int ty );
+
+// Tests whether the box overlaps a solid tile
+//
+// @precondition map != NULL
+// @param map The pointer to the map
+// @param x0 The left edge
+// @param y0 The top edge
+// @param x1 The right edge (exclusive)
+// @param y1 The bottom edge (exclusive)
+// @param tx The pointer to the column of the first solid tile, or NULL
+// @param ty The pointer to the row of the first solid tile, or NULL
+// @return Non-zero if the box overlaps a solid tile
+int tilemap_overlaps( tilemap_t* map, int x0, int y0, int x1, int y1, int* tx, int* ty );
+
+// Tests whether the moving box meets a solid tile
+//
+// Only the solid tiles under the swept bounds of the box are tested.
+//
+// @precondition map != NULL
+// @param map The pointer to the map
+// @param x The x coordinate of the box at the beginning
+// @param y The y coordinate of the box at the beginning
+// @param w The width of the box
+// @param h The height of the box
+// @param dx The movement of the box in x
+// @param dy The movement of the box in y
+// @param toi The pointer to the earliest time of impact in range
+//            [0, PHYSICS_TOI_ONE)
+// @param tx The pointer to the column of the tile, or NULL
+// @param ty The pointer to the row of the tile, or NULL
+// @return Non-zero if the box meets a solid tile
+int tilemap_sweep( tilemap_t* map, int x, int y, unsigned int w, unsigned int h,
+        int dx, int dy, unsigned int* toi, int* tx, int* ty );
+
+// Tests the awake, non-static bodies of the world against the map
+//
+// The fast objects (PHYSICS_FLAG_FAST) are swept over the latest step;
+// the others are tested where they are, with the time of impact zero.
+//
+// @precondition map != NULL
+// @precondition world != NULL
+// @param map The pointer to the map
+// @param world The pointer to the world
+// @return The number of the hits. See map->hits
+unsigned int tilemap_collide( tilemap_t* map, physics_world_t* world );
+
+#endif // _tilemap_
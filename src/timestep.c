@@ -0,0 +1,67 @@
+// Fixed timestep
+//
+// [Implementation details]
+
+#include <assert.h>
+
+#include "./defs.h"
+#include "./timestep.h"
+
+timestep_t* timestep_init( timestep_t* ts, unsigned int rate, unsigned int max_steps ) {
+    assert( ts && TIMESTEP_NOTIMESTEP );
+    assert( rate > 0 && TIMESTEP_ZERORATE );
+
+    ts->rate = rate;
+    ts->max_steps = max_steps;
+    ts->accumulator = 0;
+    ts->steps = 0;
+    ts->caught_up = 0;
+    ts->dropped = 0;
+    return ts;
+}
+
+void timestep_set_rate( timestep_t* ts, unsigned int rate ) {
+    assert( ts && TIMESTEP_NOTIMESTEP );
+    assert( rate > 0 && TIMESTEP_ZERORATE );
+
+    // The accumulator is always less than one step, i.e., less than
+    // TIMESTEP_UNITS_PER_SECOND, so the product cannot overflow.
+    ts->accumulator = ts->accumulator * rate / ts->rate;
+    ts->rate = rate;
+}
+
+unsigned int timestep_advance( timestep_t* ts, int dt ) {
+    assert( ts && TIMESTEP_NOTIMESTEP );
+    assert( dt >= 0 && TIMESTEP_NEGATIVEDT );
+
+    if ( dt <= 0 ) {
+        return 0;
+    }
+
+    ts->accumulator += ( unsigned int ) dt * ts->rate;
+    unsigned int steps = ts->accumulator / TIMESTEP_UNITS_PER_SECOND;
+    ts->accumulator -= steps * TIMESTEP_UNITS_PER_SECOND;
+
+    // Cap the catch-up. The remainder of the step is kept, so the alpha
+    // stays continuous even if steps are dropped.
+    if ( ts->max_steps && steps > ts->max_steps ) {
+        ts->dropped += steps - ts->max_steps;
+        steps = ts->max_steps;
+    }
+    if ( steps > 1 ) {
+        ts->caught_up += steps - 1;
+    }
+    ts->steps += steps;
+
+    return steps;
+}
+
+int timestep_dt( timestep_t* ts ) {
+    assert( ts && TIMESTEP_NOTIMESTEP );
+    return TIMESTEP_UNITS_PER_SECOND / ts->rate;
+}
+
+unsigned int timestep_alpha( timestep_t* ts ) {
+    assert( ts && TIMESTEP_NOTIMESTEP );
+    return ( ts->accumulator << TIMESTEP_ALPHA_BITS ) / TIMESTEP_UNITS_PER_SECOND;
+}
@@ -0,0 +1,91 @@
+// Fixed timestep
+//
+// The frame time is accumulated and consumed in fixed-size steps. The
+// simulation advances the same way regardless of the frame rate and the
+// spikes in the frame time. The part of the frame time that is not consumed
+// is carried over to the next frame and is available as an interpolation
+// factor (alpha) for the rendering.
+//
+// The accumulator is kept in units of dt * rate, so that no precision is lost
+// when the step size is not an integral number of dt units, e.g. 50 Hz with
+// milliseconds.
+
+#ifndef _timestep_
+#define _timestep_
+
+// Messages for the diagnostics
+#define TIMESTEP_NOTIMESTEP "Timestep does not exist"
+#define TIMESTEP_ZERORATE "Step rate must be positive"
+#define TIMESTEP_NEGATIVEDT "Time delta must not be negative"
+
+// The unit of the time delta (dt), i.e., dt is given in milliseconds
+#define TIMESTEP_UNITS_PER_SECOND   1000
+// The step rate of the PAL display
+#define TIMESTEP_DEFAULT_RATE       50
+// The max number of steps per frame before the steps are dropped
+#define TIMESTEP_DEFAULT_MAX_STEPS  4
+// The precision of the interpolation factor in bits
+#define TIMESTEP_ALPHA_BITS         8
+#define TIMESTEP_ALPHA_ONE          ( 1 << TIMESTEP_ALPHA_BITS )
+
+typedef struct {
+    // Configuration
+    unsigned int rate;
+    unsigned int max_steps;
+    // State
+    unsigned int accumulator;
+    // Statistics
+    unsigned int steps;
+    unsigned int caught_up;
+    unsigned int dropped;
+} timestep_t;
+
+// Initializes the timestep
+//
+// @precondition ts != NULL
+// @precondition rate > 0
+// @postcondition The accumulator and the counters are zeroed
+// @param ts The pointer to the timestep
+// @param rate The number of steps per second
+// @param max_steps The max number of steps per frame. If zero, the number
+//                  of steps is not limited
+// @return The timestep for chaining
+timestep_t* timestep_init( timestep_t* ts, unsigned int rate, unsigned int max_steps );
+
+// Changes the step rate
+//
+// The accumulator is rescaled, so the time that has not been consumed yet is
+// preserved. The alpha changes accordingly.
+//
+// @precondition ts != NULL
+// @precondition rate > 0
+// @param ts The pointer to the timestep
+// @param rate The number of steps per second
+void timestep_set_rate( timestep_t* ts, unsigned int rate );
+
+// Accumulates the frame time and returns the number of steps to be taken
+//
+// If the number of steps exceeds the max_steps, the excess steps are dropped
+// to avoid the spiral of death, i.e., a slow frame causing even more steps
+// to the next frame. All steps after the first one in a frame are counted as
+// caught-up steps.
+//
+// @precondition ts != NULL
+// @precondition dt >= 0
+// @param ts The pointer to the timestep
+// @param dt The time delta of the frame (see TIMESTEP_UNITS_PER_SECOND)
+// @return The number of the fixed steps to be taken in this frame
+unsigned int timestep_advance( timestep_t* ts, int dt );
+
+// @param ts The pointer to the timestep
+// @return The size of one step in dt units (rounded down)
+int timestep_dt( timestep_t* ts );
+
+// Returns the interpolation factor between the previous and the current step
+//
+// @precondition ts != NULL
+// @param ts The pointer to the timestep
+// @return The factor in range [0, TIMESTEP_ALPHA_ONE)
+unsigned int timestep_alpha( timestep_t* ts );
+
+#endif // _timestep_
@@ -0,0 +1,150 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <cmocka.h>
+
+#include "../src/mem.h"
+#include "../src/broadphase.h"
+#include "../src/jobs.h"
+#include "../src/physics.h"
+#include "../src/data_structures/quad_tree.h"
+
+#define NUM_OBJS 200
+#define SEED 4321
+
+typedef struct {
+    qtree_t* q;
+    physics_world_t* world;
+    physics_pairs_t* expected;
+    physics_pairs_t* pairs;
+} btest_t;
+
+//  ****************************************
+//  Misc functions
+//  ****************************************
+
+// Fills the world with the random boxes of all sizes, so that there are
+// objects on every level of the tree and outside of it. The objects are
+// put on random layers and some of them sleep.
+static void add_random_boxes( physics_world_t* world, unsigned int count ) {
+    for ( unsigned int i = 0; i < count; i++ ) {
+        physics_body_t body = { 0 };
+        body.x = rand() % 1100 - 50;
+        body.y = rand() % 1100 - 50;
+        body.w = 1 + rand() % ( i % 4 ? 40 : 400 );
+        body.h = 1 + rand() % ( i % 4 ? 40 : 400 );
+        body.idle = rand() % 3 ? 0 : PHYSICS_SLEEP_STEPS;
+        int index = physics_world_add( world, &body );
+        world->objs[ index ].category = 1u << ( rand() % 3 );
+        world->objs[ index ].mask = PHYSICS_MASK_ALL & ~( 1u << ( rand() % 4 ) );
+    }
+}
+
+static void assert_same_pairs( physics_pairs_t* expected, physics_pairs_t* pairs ) {
+    assert_int_equal( expected->count, pairs->count );
+    assert_int_equal( expected->rejected, pairs->rejected );
+    assert_int_equal( expected->sleeping, pairs->sleeping );
+    assert_memory_equal( expected->pairs, pairs->pairs, pairs->count * sizeof( physics_pair_t ) );
+}
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
+static int broadphase_setup(void **state) {
+    btest_t *test_struct = test_malloc( sizeof( btest_t ) );
+    test_struct->q = qtree_new();
+    test_struct->world = physics_world_new( NUM_OBJS );
+    test_struct->expected = physics_pairs_new( 1 );
+    test_struct->pairs = physics_pairs_new( 1 );
+    srand( SEED );
+    *state = test_struct;
+    return 0;
+}
+
+static int broadphase_teardown(void **state) {
+    btest_t *t = ( btest_t* ) *state;
+    physics_pairs_free( t->pairs );
+    physics_pairs_free( t->expected );
+    physics_world_free( t->world );
+    physics_free_bsp( t->q );
+    test_free( *state );
+    return 0;
+}
+
+// ******************
+// broadphase_collect
+// ******************
+
+static void empty_tree(void **state) {
+    btest_t* t = ( btest_t* ) *state;
+    jobs_t* jobs = jobs_new( 4 );
+    broadphase_t* bp = broadphase_new( BROADPHASE_DEFAULT_LEVEL, jobs );
+
+    broadphase_collect( bp, t->q, t->pairs );
+    assert_int_equal( 0, t->pairs->count );
+
+    broadphase_free( bp );
+    jobs_free( jobs );
+}
+
+static void equals_serial_pass(void **state) {
+    btest_t* t = ( btest_t* ) *state;
+    add_random_boxes( t->world, NUM_OBJS );
+    physics_construct_bsp( t->q, t->world );
+    physics_check_collisions( t->q->tree->root, NULL, t->expected );
+    assert_true( t->expected->count > 0 );
+    assert_true( t->expected->rejected > 0 );
+    assert_true( t->expected->sleeping > 0 );
+
+    for ( unsigned int level = 0; level <= t->q->depth + 1; level++ ) {
+        for ( unsigned int threads = 0; threads <= 8; threads++ ) {
+            // No job system at all first
+            jobs_t* jobs = threads ? jobs_new( threads ) : NULL;
+            broadphase_t* bp = broadphase_new( level, jobs );
+            physics_pairs_clear( t->pairs );
+            broadphase_collect( bp, t->q, t->pairs );
+            assert_same_pairs( t->expected, t->pairs );
+            broadphase_free( bp );
+            if ( jobs ) {
+                jobs_free( jobs );
+            }
+        }
+    }
+}
+
+static void buffers_are_reused(void **state) {
+    btest_t* t = ( btest_t* ) *state;
+    jobs_t* jobs = jobs_new( 3 );
+    broadphase_t* bp = broadphase_new( 2, jobs );
+    add_random_boxes( t->world, NUM_OBJS );
+
+    // The tree is rebuilt like in the loop; the pairs follow the bodies.
+    for ( int frame = 0; frame < 4; frame++ ) {
+        for ( unsigned int i = 0; i < t->world->count; i++ ) {
+            t->world->bodies[i].x += rand() % 64 - 32;
+            t->world->bodies[i].y += rand() % 64 - 32;
+        }
+        physics_clear_bsp( t->q );
+        physics_construct_bsp( t->q, t->world );
+        physics_pairs_clear( t->expected );
+        physics_check_collisions( t->q->tree->root, NULL, t->expected );
+        physics_pairs_clear( t->pairs );
+        broadphase_collect( bp, t->q, t->pairs );
+        assert_same_pairs( t->expected, t->pairs );
+    }
+
+    broadphase_free( bp );
+    jobs_free( jobs );
+}
+
+int broadphase_test() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown( empty_tree, broadphase_setup, broadphase_teardown ),
+        cmocka_unit_test_setup_teardown( equals_serial_pass, broadphase_setup, broadphase_teardown ),
+        cmocka_unit_test_setup_teardown( buffers_are_reused, broadphase_setup, broadphase_teardown ),
+    };
+
+    return cmocka_run_group_tests( tests, NULL, NULL );
+}
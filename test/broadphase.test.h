@@ -0,0 +1 @@
+int broadphase_test();
@@ -0,0 +1,340 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <cmocka.h>
+
+#include "../src/mem.h"
+#include "../src/contacts.h"
+#include "../src/physics.h"
+
+#define NUM_OBJS 64
+
+typedef struct {
+    physics_world_t* world;
+    physics_pairs_t* pairs;
+    contacts_t* cache;
+} ctest_t;
+
+//  ****************************************
+//  Misc functions
+//  ****************************************
+
+static void add_box( physics_world_t* world, int x, int y, int w, int h ) {
+    physics_body_t body = { 0 };
+    body.x = x;
+    body.y = y;
+    body.w = w;
+    body.h = h;
+    body.m = 1;
+    physics_world_add( world, &body );
+}
+
+static unsigned int count_events( contacts_t* cache, int type ) {
+    unsigned int num_events;
+    unsigned int count = 0;
+    contact_event_t* events = contacts_events( cache, &num_events );
+    for ( unsigned int i = 0; i < num_events; i++ ) {
+        if ( events[i].type == type ) {
+            count++;
+        }
+    }
+    return count;
+}
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
+static int contacts_setup(void **state) {
+    ctest_t *test_struct = test_malloc( sizeof( ctest_t ) );
+    test_struct->world = physics_world_new( NUM_OBJS );
+    test_struct->pairs = physics_pairs_new( 4 );
+    test_struct->cache = contacts_new( 4 );
+    *state = test_struct;
+    return 0;
+}
+
+static int contacts_teardown(void **state) {
+    ctest_t *t = ( ctest_t* ) *state;
+    contacts_free( t->cache );
+    physics_pairs_free( t->pairs );
+    physics_world_free( t->world );
+    test_free( *state );
+    return 0;
+}
+
+// ***************
+// contacts_update
+// ***************
+
+static void begin_stay_end(void **state) {
+    ctest_t* t = ( ctest_t* ) *state;
+    add_box( t->world, 0, 0, 10, 10 );
+    add_box( t->world, 20, 0, 10, 10 );
+    physics_pairs_push( t->pairs, &t->world->objs[1], &t->world->objs[0] );
+
+    // Apart.
+    contacts_update( t->cache, t->world, t->pairs );
+    assert_int_equal( 0, t->cache->num_events );
+    assert_int_equal( 1, t->cache->tests );
+
+    // Touching.
+    t->world->bodies[1].x = 5;
+    contacts_update( t->cache, t->world, t->pairs );
+    assert_int_equal( 1, count_events( t->cache, CONTACT_BEGIN ) );
+    assert_int_equal( t->world->objs[0].guid, t->cache->events[0].guid_0 );
+    assert_int_equal( t->world->objs[1].guid, t->cache->events[0].guid_1 );
+
+    // Still touching.
+    t->world->bodies[1].x = 6;
+    contacts_update( t->cache, t->world, t->pairs );
+    assert_int_equal( 1, count_events( t->cache, CONTACT_STAY ) );
+
+    // Apart again. The pair that does not touch is not kept.
+    t->world->bodies[1].x = 10;
+    contacts_update( t->cache, t->world, t->pairs );
+    assert_int_equal( 1, count_events( t->cache, CONTACT_END ) );
+    assert_null( contacts_find( t->cache, t->world->objs[1].guid, t->world->objs[0].guid ) );
+}
+
+static void lost_pair_ends_contact(void **state) {
+    ctest_t* t = ( ctest_t* ) *state;
+    add_box( t->world, 0, 0, 10, 10 );
+    add_box( t->world, 5, 5, 10, 10 );
+    physics_pairs_push( t->pairs, &t->world->objs[0], &t->world->objs[1] );
+
+    contacts_update( t->cache, t->world, t->pairs );
+    assert_int_equal( 1, count_events( t->cache, CONTACT_BEGIN ) );
+
+    t->pairs->count = 0;
+    contacts_update( t->cache, t->world, t->pairs );
+    assert_int_equal( 1, count_events( t->cache, CONTACT_END ) );
+    assert_int_equal( 0, t->cache->count );
+    assert_null( contacts_find( t->cache, t->world->objs[0].guid, t->world->objs[1].guid ) );
+}
+
+static void unchanged_pair_skips_narrowphase(void **state) {
+    ctest_t* t = ( ctest_t* ) *state;
+    add_box( t->world, 0, 0, 10, 10 );
+    add_box( t->world, 5, 5, 10, 10 );
+    add_box( t->world, 12, 0, 10, 10 );
+    t->world->objs[1].flags = PHYSICS_FLAG_FAST;
+    physics_pairs_push( t->pairs, &t->world->objs[0], &t->world->objs[1] );
+    physics_pairs_push( t->pairs, &t->world->objs[1], &t->world->objs[2] );
+
+    contacts_update( t->cache, t->world, t->pairs );
+    assert_int_equal( 2, t->cache->ccd_tests );
+    assert_int_equal( 0, t->cache->skipped );
+
+    contacts_update( t->cache, t->world, t->pairs );
+    assert_int_equal( 0, t->cache->ccd_tests );
+    assert_int_equal( 2, t->cache->skipped );
+    assert_int_equal( 2, count_events( t->cache, CONTACT_STAY ) );
+
+    // A change of the velocity is enough for a new test.
+    t->world->bodies[2].vx = 1;
+    contacts_update( t->cache, t->world, t->pairs );
+    assert_int_equal( 1, t->cache->ccd_tests );
+    assert_int_equal( 1, t->cache->skipped );
+}
+
+static void apart_pairs_are_not_stored(void **state) {
+    ctest_t* t = ( ctest_t* ) *state;
+    add_box( t->world, 0, 0, 10, 10 );
+    add_box( t->world, 100, 100, 10, 10 );
+    add_box( t->world, 0, 30, 2, 2 );
+    physics_pairs_push( t->pairs, &t->world->objs[0], &t->world->objs[1] );
+    physics_pairs_push( t->pairs, &t->world->objs[0], &t->world->objs[2] );
+
+    contacts_update( t->cache, t->world, t->pairs );
+    assert_int_equal( 2, t->cache->tests );
+    assert_int_equal( 0, t->cache->count );
+
+    // A fast body is kept if its path during the step meets the other box,
+    // although it is apart at the end of the step.
+    t->world->objs[2].flags = PHYSICS_FLAG_FAST;
+    t->world->bodies[2].vy = 40;
+    contacts_update( t->cache, t->world, t->pairs );
+    assert_int_equal( 1, t->cache->tests );
+    assert_int_equal( 1, t->cache->ccd_tests );
+    assert_int_equal( 1, t->cache->count );
+    assert_int_equal( 1, count_events( t->cache, CONTACT_BEGIN ) );
+}
+
+static void many_pairs_and_clear(void **state) {
+    ctest_t* t = ( ctest_t* ) *state;
+    for ( int i = 0; i < NUM_OBJS; i++ ) {
+        add_box( t->world, i * 5, 0, 10, 10 );
+    }
+    for ( int i = 0; i < NUM_OBJS; i++ ) {
+        for ( int j = i + 1; j < NUM_OBJS; j += 3 ) {
+            physics_pairs_push( t->pairs, &t->world->objs[i], &t->world->objs[j] );
+        }
+    }
+    contacts_update( t->cache, t->world, t->pairs );
+    // Only the neighbours overlap, and only they are stored.
+    assert_int_equal( NUM_OBJS - 1, t->cache->count );
+    assert_int_equal( NUM_OBJS - 1, count_events( t->cache, CONTACT_BEGIN ) );
+
+    // Drop every other pair; the touching rest must still be found.
+    unsigned int kept = 0;
+    unsigned int touching = 0;
+    for ( unsigned int i = 0; i < t->pairs->count; i += 2 ) {
+        t->pairs->pairs[ kept++ ] = t->pairs->pairs[i];
+        touching += physics_check_two_bodies( t->pairs->pairs[i].obj_0, t->pairs->pairs[i].obj_1 ) != 0;
+    }
+    t->pairs->count = kept;
+    contacts_update( t->cache, t->world, t->pairs );
+    assert_int_equal( touching, t->cache->count );
+    for ( unsigned int i = 0; i < kept; i++ ) {
+        contact_t* contact = contacts_find( t->cache,
+                t->pairs->pairs[i].obj_0->guid, t->pairs->pairs[i].obj_1->guid );
+        assert_int_equal( physics_check_two_bodies( t->pairs->pairs[i].obj_0, t->pairs->pairs[i].obj_1 ) != 0,
+                contact != NULL );
+    }
+    assert_int_equal( touching, count_events( t->cache, CONTACT_STAY ) );
+
+    contacts_clear( t->cache );
+    assert_int_equal( 0, t->cache->count );
+    assert_null( contacts_find( t->cache, t->world->objs[0].guid, t->world->objs[1].guid ) );
+    contacts_update( t->cache, t->world, t->pairs );
+    assert_int_equal( kept, t->cache->tests );
+    assert_int_equal( touching, count_events( t->cache, CONTACT_BEGIN ) );
+}
+
+static void fast_pairs_in_toi_order(void **state) {
+    ctest_t* t = ( ctest_t* ) *state;
+    // A bullet that passed three thin walls during the step.
+    add_box( t->world, 100, 0, 2, 2 );
+    add_box( t->world, 80, -10, 2, 20 );
+    add_box( t->world, 20, -10, 2, 20 );
+    add_box( t->world, 50, -10, 2, 20 );
+    add_box( t->world, 0, 100, 2, 20 );
+    t->world->bodies[0].vx = 100;
+    t->world->objs[0].flags = PHYSICS_FLAG_FAST;
+    for ( int i = 1; i < 5; i++ ) {
+        physics_pairs_push( t->pairs, &t->world->objs[i], &t->world->objs[0] );
+    }
+    // A slow pair is tested discretely.
+    physics_pairs_push( t->pairs, &t->world->objs[1], &t->world->objs[2] );
+
+    // The box below the path of the bullet is not tested.
+    contacts_update( t->cache, t->world, t->pairs );
+    assert_int_equal( 3, t->cache->ccd_tests );
+    assert_int_equal( 1, t->cache->tests );
+    assert_int_equal( 3, t->cache->num_events );
+    assert_int_equal( t->world->objs[2].guid, t->cache->events[0].guid_1 );
+    assert_int_equal( t->world->objs[3].guid, t->cache->events[1].guid_1 );
+    assert_int_equal( t->world->objs[1].guid, t->cache->events[2].guid_1 );
+    assert_true( t->cache->events[0].toi < t->cache->events[1].toi );
+    assert_true( t->cache->events[1].toi < t->cache->events[2].toi );
+
+    // Unchanged, the swept tests are skipped, and the events keep the order
+    // of the time of impact.
+    contacts_update( t->cache, t->world, t->pairs );
+    assert_int_equal( 0, t->cache->ccd_tests );
+    assert_int_equal( 3, t->cache->skipped );
+    assert_int_equal( 3, count_events( t->cache, CONTACT_STAY ) );
+    assert_int_equal( t->world->objs[2].guid, t->cache->events[0].guid_1 );
+    assert_int_equal( t->world->objs[3].guid, t->cache->events[1].guid_1 );
+    assert_int_equal( t->world->objs[1].guid, t->cache->events[2].guid_1 );
+}
+
+// ****************
+// contacts_islands
+// ****************
+
+static void touching_bodies_form_islands(void **state) {
+    ctest_t* t = ( ctest_t* ) *state;
+    // Two stacks of boxes and a static floor below them.
+    add_box( t->world, 0, 0, 10, 10 );
+    add_box( t->world, 0, 9, 10, 10 );
+    add_box( t->world, 50, 0, 10, 10 );
+    add_box( t->world, 50, 9, 10, 10 );
+    add_box( t->world, 0, 18, 100, 10 );
+    t->world->bodies[4].m = 0;
+    for ( int i = 0; i < 5; i++ ) {
+        for ( int j = i + 1; j < 5; j++ ) {
+            physics_pairs_push( t->pairs, &t->world->objs[i], &t->world->objs[j] );
+        }
+    }
+    contacts_update( t->cache, t->world, t->pairs );
+
+    // The floor does not join the stacks together.
+    assert_int_equal( 3, contacts_islands( t->cache, t->world ) );
+    assert_int_equal( 0, t->world->islands[1] );
+    assert_int_equal( 2, t->world->islands[3] );
+    assert_int_equal( 4, t->world->islands[4] );
+
+    // The 1st stack is asleep but its lower box is still settling.
+    t->world->bodies[0].idle = PHYSICS_SLEEP_STEPS;
+    t->world->bodies[1].idle = 3;
+    t->world->bodies[2].idle = PHYSICS_SLEEP_STEPS;
+    t->world->bodies[3].idle = PHYSICS_SLEEP_STEPS + 1;
+    t->world->bodies[4].idle = PHYSICS_SLEEP_STEPS;
+    contacts_islands( t->cache, t->world );
+    assert_int_equal( 3, t->world->bodies[0].idle );
+    assert_int_equal( PHYSICS_SLEEP_STEPS, t->world->bodies[3].idle );
+    assert_int_equal( 2, t->world->num_active );
+    assert_int_equal( 3, t->world->num_sleeping );
+}
+
+static void sleeping_contacts_persist(void **state) {
+    ctest_t* t = ( ctest_t* ) *state;
+    add_box( t->world, 0, 0, 10, 10 );
+    add_box( t->world, 5, 5, 10, 10 );
+    physics_pairs_push( t->pairs, &t->world->objs[0], &t->world->objs[1] );
+    contacts_update( t->cache, t->world, t->pairs );
+    assert_int_equal( 1, count_events( t->cache, CONTACT_BEGIN ) );
+
+    // The broadphase drops the pair of the sleeping bodies.
+    t->world->bodies[0].idle = PHYSICS_SLEEP_STEPS;
+    t->world->bodies[1].idle = PHYSICS_SLEEP_STEPS;
+    physics_pairs_clear( t->pairs );
+    contacts_update( t->cache, t->world, t->pairs );
+    assert_int_equal( 0, t->cache->num_events );
+    assert_int_equal( 1, t->cache->count );
+    assert_int_equal( 1, contacts_islands( t->cache, t->world ) );
+
+    // Waking up one wakes up the other.
+    physics_wake( t->world, 1 );
+    contacts_islands( t->cache, t->world );
+    assert_false( physics_is_sleeping( &t->world->bodies[0] ) );
+}
+
+static void removed_bodies_end_contacts(void **state) {
+    ctest_t* t = ( ctest_t* ) *state;
+    add_box( t->world, 0, 0, 10, 10 );
+    add_box( t->world, 5, 5, 10, 10 );
+    add_box( t->world, 100, 100, 10, 10 );
+    physics_pairs_push( t->pairs, &t->world->objs[0], &t->world->objs[1] );
+    contacts_update( t->cache, t->world, t->pairs );
+    assert_int_equal( 1, count_events( t->cache, CONTACT_BEGIN ) );
+
+    // The last body moves to the index of the removed one, and the rest
+    // fall asleep, so the old indexes would point at two sleeping bodies.
+    physics_world_remove( t->world, t->world->objs[0].guid );
+    t->world->bodies[0].idle = PHYSICS_SLEEP_STEPS;
+    t->world->bodies[1].idle = PHYSICS_SLEEP_STEPS;
+    physics_pairs_clear( t->pairs );
+    contacts_update( t->cache, t->world, t->pairs );
+    assert_int_equal( 1, count_events( t->cache, CONTACT_END ) );
+    assert_int_equal( 0, t->cache->count );
+}
+
+int contacts_test() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown( begin_stay_end, contacts_setup, contacts_teardown ),
+        cmocka_unit_test_setup_teardown( lost_pair_ends_contact, contacts_setup, contacts_teardown ),
+        cmocka_unit_test_setup_teardown( unchanged_pair_skips_narrowphase, contacts_setup, contacts_teardown ),
+        cmocka_unit_test_setup_teardown( apart_pairs_are_not_stored, contacts_setup, contacts_teardown ),
+        cmocka_unit_test_setup_teardown( many_pairs_and_clear, contacts_setup, contacts_teardown ),
+        cmocka_unit_test_setup_teardown( fast_pairs_in_toi_order, contacts_setup, contacts_teardown ),
+        cmocka_unit_test_setup_teardown( touching_bodies_form_islands, contacts_setup, contacts_teardown ),
+        cmocka_unit_test_setup_teardown( sleeping_contacts_persist, contacts_setup, contacts_teardown ),
+        cmocka_unit_test_setup_teardown( removed_bodies_end_contacts, contacts_setup, contacts_teardown ),
+    };
+
+    return cmocka_run_group_tests( tests, NULL, NULL );
+}
@@ -0,0 +1 @@
+int contacts_test();
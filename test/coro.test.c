@@ -0,0 +1,243 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include "../src/mem.h"
+#include "../src/coro.h"
+
+#define NUM_COROS 1000
+#define SEED 1357
+
+// An enemy that waits, fires three shots and retreats
+typedef struct {
+    coro_t co;
+    int shots;
+    // The frames of the actions
+    unsigned int fired[3];
+    unsigned int retreated;
+    coro_sched_t* sched;
+} enemy_t;
+
+// A sleeper that wakes up after random sleeps
+typedef struct {
+    coro_t co;
+    unsigned int next_wake;
+    unsigned int wakes;
+    int late;
+    coro_sched_t* sched;
+} sleeper_t;
+
+typedef struct {
+    coro_t co;
+    coro_t* victims[2];
+    coro_sched_t* sched;
+} killer_t;
+
+typedef struct {
+    coro_sched_t* sched;
+    sleeper_t* sleepers;
+} ctest_t;
+
+//  ****************************************
+//  Misc functions
+//  ****************************************
+
+static int enemy( coro_t* co, void* data ) {
+    enemy_t* e = ( enemy_t* ) data;
+    CORO_BEGIN( co );
+    CORO_SLEEP( co, 30 );
+    for ( e->shots = 0; e->shots < 3; e->shots++ ) {
+        e->fired[ e->shots ] = e->sched->frame;
+        CORO_SLEEP( co, 5 );
+    }
+    CORO_YIELD( co );
+    e->retreated = e->sched->frame;
+    CORO_END( co );
+}
+
+static int sleeper( coro_t* co, void* data ) {
+    ( void ) co;
+    sleeper_t* s = ( sleeper_t* ) data;
+    // Woken at another frame than the one asked for
+    s->late |= s->sched->frame != s->next_wake;
+    s->wakes++;
+    // The sleeps go around the wheel too.
+    unsigned int frames = 1 + rand() % ( s->wakes % 8 ? 20 : 3 * CORO_WHEEL_SIZE );
+    s->next_wake = s->sched->frame + frames;
+    return ( int ) frames;
+}
+
+// Stops the victims, which wake in the same frame
+static int killer( coro_t* co, void* data ) {
+    ( void ) co;
+    killer_t* k = ( killer_t* ) data;
+    for ( unsigned int i = 0; i < 2; i++ ) {
+        coro_stop( k->sched, k->victims[i] );
+    }
+    return CORO_DONE;
+}
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
+static int coro_setup(void **state) {
+    ctest_t *test_struct = test_malloc( sizeof( ctest_t ) );
+    test_struct->sched = coro_sched_new();
+    test_struct->sleepers = test_malloc( NUM_COROS * sizeof( sleeper_t ) );
+    memset( test_struct->sleepers, 0, NUM_COROS * sizeof( sleeper_t ) );
+    srand( SEED );
+    *state = test_struct;
+    return 0;
+}
+
+static int coro_teardown(void **state) {
+    ctest_t *t = ( ctest_t* ) *state;
+    coro_sched_free( t->sched );
+    test_free( t->sleepers );
+    test_free( *state );
+    return 0;
+}
+
+// *********
+// coro_tick
+// *********
+
+static void behaviour_runs_in_order(void **state) {
+    ctest_t* t = ( ctest_t* ) *state;
+    enemy_t e;
+    memset( &e, 0, sizeof( enemy_t ) );
+    e.sched = t->sched;
+    coro_start( t->sched, &e.co, enemy, &e );
+    assert_true( coro_running( &e.co ) );
+
+    // Started at the frame 0, it runs first at the frame 1.
+    for ( int frame = 1; frame <= 60; frame++ ) {
+        coro_tick( t->sched );
+    }
+    assert_int_equal( 31, e.fired[0] );
+    assert_int_equal( 36, e.fired[1] );
+    assert_int_equal( 41, e.fired[2] );
+    assert_int_equal( 47, e.retreated );
+    assert_false( coro_running( &e.co ) );
+    assert_int_equal( 0, t->sched->count );
+
+    // A finished coroutine starts from the beginning.
+    coro_start( t->sched, &e.co, enemy, &e );
+    for ( int frame = 1; frame <= 31; frame++ ) {
+        coro_tick( t->sched );
+    }
+    assert_int_equal( 91, e.fired[0] );
+}
+
+static void sleepers_wake_on_time(void **state) {
+    ctest_t* t = ( ctest_t* ) *state;
+    for ( unsigned int i = 0; i < NUM_COROS; i++ ) {
+        t->sleepers[i].sched = t->sched;
+        t->sleepers[i].next_wake = 1;
+        coro_start( t->sched, &t->sleepers[i].co, sleeper, &t->sleepers[i] );
+    }
+    assert_int_equal( NUM_COROS, coro_tick( t->sched ) );
+
+    // Only the due coroutines are resumed, and each of them once.
+    unsigned int max_resumed = 0;
+    unsigned int total = NUM_COROS;
+    for ( int frame = 2; frame <= 4 * CORO_WHEEL_SIZE; frame++ ) {
+        unsigned int due = 0;
+        for ( unsigned int i = 0; i < NUM_COROS; i++ ) {
+            due += t->sleepers[i].next_wake == t->sched->frame + 1;
+        }
+        unsigned int resumed = coro_tick( t->sched );
+        assert_int_equal( due, resumed );
+        total += resumed;
+        max_resumed = resumed > max_resumed ? resumed : max_resumed;
+    }
+    unsigned int wakes = 0;
+    for ( unsigned int i = 0; i < NUM_COROS; i++ ) {
+        assert_false( t->sleepers[i].late );
+        wakes += t->sleepers[i].wakes;
+    }
+    assert_int_equal( total, wakes );
+    assert_true( max_resumed < NUM_COROS / 4 );
+    assert_int_equal( NUM_COROS, t->sched->count );
+}
+
+// *********
+// coro_stop
+// *********
+
+static void stopped_are_not_resumed(void **state) {
+    ctest_t* t = ( ctest_t* ) *state;
+    for ( unsigned int i = 0; i < NUM_COROS; i++ ) {
+        t->sleepers[i].sched = t->sched;
+        t->sleepers[i].next_wake = 1;
+        coro_start( t->sched, &t->sleepers[i].co, sleeper, &t->sleepers[i] );
+    }
+    for ( unsigned int i = 0; i < NUM_COROS; i += 2 ) {
+        coro_stop( t->sched, &t->sleepers[i].co );
+    }
+    coro_stop( t->sched, &t->sleepers[0].co );
+    assert_int_equal( NUM_COROS / 2, t->sched->count );
+    for ( int frame = 1; frame <= 2 * CORO_WHEEL_SIZE; frame++ ) {
+        coro_tick( t->sched );
+    }
+    for ( unsigned int i = 0; i < NUM_COROS; i++ ) {
+        if ( i % 2 ) {
+            assert_true( t->sleepers[i].wakes > 0 );
+        } else {
+            assert_int_equal( 0, t->sleepers[i].wakes );
+        }
+    }
+}
+
+static void stop_within_the_tick(void **state) {
+    ctest_t* t = ( ctest_t* ) *state;
+    enemy_t first;
+    memset( &first, 0, sizeof( enemy_t ) );
+    first.sched = t->sched;
+    enemy_t second;
+    memset( &second, 0, sizeof( enemy_t ) );
+    second.sched = t->sched;
+    sleeper_t* bystander = &t->sleepers[0];
+    bystander->sched = t->sched;
+    bystander->next_wake = 1;
+    killer_t k;
+    memset( &k, 0, sizeof( killer_t ) );
+    k.sched = t->sched;
+    k.victims[0] = &first.co;
+    k.victims[1] = &second.co;
+
+    // The latest started is resumed first, so the killer stops the others
+    // before their turn, one at the head of the slot and one at its end.
+    coro_start( t->sched, &first.co, enemy, &first );
+    coro_start( t->sched, &bystander->co, sleeper, bystander );
+    coro_start( t->sched, &second.co, enemy, &second );
+    coro_start( t->sched, &k.co, killer, &k );
+    assert_int_equal( 2, coro_tick( t->sched ) );
+    assert_false( coro_running( &first.co ) );
+    assert_false( coro_running( &second.co ) );
+    assert_false( coro_running( &k.co ) );
+    assert_int_equal( 1, bystander->wakes );
+    assert_int_equal( 1, t->sched->count );
+
+    for ( int frame = 2; frame <= 40; frame++ ) {
+        coro_tick( t->sched );
+    }
+    assert_int_equal( 0, first.fired[0] );
+    assert_int_equal( 0, second.fired[0] );
+    assert_false( bystander->late );
+}
+
+int coro_test() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown( behaviour_runs_in_order, coro_setup, coro_teardown ),
+        cmocka_unit_test_setup_teardown( sleepers_wake_on_time, coro_setup, coro_teardown ),
+        cmocka_unit_test_setup_teardown( stopped_are_not_resumed, coro_setup, coro_teardown ),
+        cmocka_unit_test_setup_teardown( stop_within_the_tick, coro_setup, coro_teardown ),
+    };
+
+    return cmocka_run_group_tests( tests, NULL, NULL );
+}
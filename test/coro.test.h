@@ -0,0 +1 @@
+int coro_test();
@@ -0,0 +1,133 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include "../../src/data_structures/double_buffer.h"
+
+#define CAPACITY 1000
+#define NUM_FRAMES 200
+#define SEED 8642
+
+typedef struct {
+    int id;
+    int x;
+    int y;
+} record_t;
+
+typedef struct {
+    dblbuf_t* buf;
+    // The expected state of the records
+    record_t* model;
+} dbtest_t;
+
+//  ****************************************
+//  Misc functions
+//  ****************************************
+
+static void write_record( dbtest_t* t, unsigned int index, int x ) {
+    record_t* r = ( record_t* ) dblbuf_write( t->buf, index );
+    r->id = ( int ) index;
+    r->x = x;
+    t->model[ index ] = *r;
+}
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
+static int double_buffer_setup(void **state) {
+    dbtest_t *test_struct = test_malloc( sizeof( dbtest_t ) );
+    test_struct->buf = dblbuf_new( sizeof( record_t ), CAPACITY );
+    test_struct->model = test_calloc( CAPACITY, sizeof( record_t ) );
+    srand( SEED );
+    *state = test_struct;
+    return 0;
+}
+
+static int double_buffer_teardown(void **state) {
+    dbtest_t *t = ( dbtest_t* ) *state;
+    dblbuf_free( t->buf );
+    test_free( t->model );
+    test_free( *state );
+    return 0;
+}
+
+// *****************************
+// dblbuf_write and dblbuf_swap
+// *****************************
+
+static void readers_see_the_completed_frame(void **state) {
+    dbtest_t* t = ( dbtest_t* ) *state;
+    dblbuf_resize( t->buf, 3 );
+    write_record( t, 1, 10 );
+    assert_int_equal( 0, t->buf->front_count );
+    dblbuf_swap( t->buf );
+    assert_int_equal( 3, t->buf->front_count );
+    assert_int_equal( 10, ( ( const record_t* ) dblbuf_read( t->buf, 1 ) )->x );
+
+    // The write of the next frame is not seen before the flip.
+    record_t* r = ( record_t* ) dblbuf_write( t->buf, 1 );
+    assert_int_equal( 10, r->x );
+    r->x = 11;
+    assert_int_equal( 10, ( ( const record_t* ) dblbuf_read( t->buf, 1 ) )->x );
+    dblbuf_swap( t->buf );
+    assert_int_equal( 11, ( ( const record_t* ) dblbuf_read( t->buf, 1 ) )->x );
+    assert_int_equal( 11, ( ( const record_t* ) dblbuf_peek( t->buf, 1 ) )->x );
+    assert_int_equal( 2, t->buf->frame );
+}
+
+static void only_dirty_blocks_are_copied(void **state) {
+    dbtest_t* t = ( dbtest_t* ) *state;
+    dblbuf_resize( t->buf, CAPACITY );
+    dblbuf_swap( t->buf );
+    assert_int_equal( CAPACITY, t->buf->copied );
+
+    dblbuf_swap( t->buf );
+    assert_int_equal( 0, t->buf->copied );
+
+    write_record( t, 5, 1 );
+    write_record( t, 6, 1 );
+    write_record( t, CAPACITY - 1, 1 );
+    dblbuf_swap( t->buf );
+    assert_int_equal( DBLBUF_BLOCK + CAPACITY % DBLBUF_BLOCK, t->buf->copied );
+
+    // A shrunk buffer copies nothing beyond its count.
+    dblbuf_resize( t->buf, 10 );
+    write_record( t, 9, 2 );
+    dblbuf_swap( t->buf );
+    assert_int_equal( 10, t->buf->copied );
+
+    // The records that come back are zeroed.
+    dblbuf_resize( t->buf, 20 );
+    dblbuf_swap( t->buf );
+    assert_int_equal( 0, ( ( const record_t* ) dblbuf_read( t->buf, 15 ) )->x );
+    assert_int_equal( 2, ( ( const record_t* ) dblbuf_read( t->buf, 9 ) )->x );
+}
+
+static void random_frames_match_the_model(void **state) {
+    dbtest_t* t = ( dbtest_t* ) *state;
+    dblbuf_resize( t->buf, CAPACITY );
+    for ( int frame = 0; frame < NUM_FRAMES; frame++ ) {
+        int num_writes = rand() % 50;
+        for ( int i = 0; i < num_writes; i++ ) {
+            write_record( t, ( unsigned int ) rand() % CAPACITY, frame );
+        }
+        dblbuf_swap( t->buf );
+        assert_true( t->buf->copied <= ( unsigned int ) num_writes * DBLBUF_BLOCK );
+        assert_memory_equal( t->model, t->buf->front, CAPACITY * sizeof( record_t ) );
+        assert_memory_equal( t->model, t->buf->back, CAPACITY * sizeof( record_t ) );
+    }
+}
+
+int double_buffer_test() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown( readers_see_the_completed_frame, double_buffer_setup, double_buffer_teardown ),
+        cmocka_unit_test_setup_teardown( only_dirty_blocks_are_copied, double_buffer_setup, double_buffer_teardown ),
+        cmocka_unit_test_setup_teardown( random_frames_match_the_model, double_buffer_setup, double_buffer_teardown ),
+    };
+
+    return cmocka_run_group_tests( tests, NULL, NULL );
+}
@@ -0,0 +1 @@
+int double_buffer_test();
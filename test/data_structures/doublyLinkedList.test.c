@@ -430,6 +430,32 @@ static void list_clear_nodes(void **state) {
     test_free( two );
 }
 
+static void detach_and_link_nodes(void **state) {
+    dbllist_t* list = ( ( struct DblTest * ) *state )->list;
+    int zero = 0;
+    int one = 1;
+
+    struct dblnode_t* node0 = dbllist_push_to_end( list, &zero );
+    struct dblnode_t* node1 = dbllist_push_to_end( list, &one );
+
+    assert_ptr_equal( node0, dbllist_detach( list ) );
+    assert_true( dbllist_is_empty( list ) );
+    assert_null( dbllist_head( list ) );
+    assert_null( dbllist_tail( list ) );
+    assert_ptr_equal( node1, node0->next );
+    assert_null( node1->next );
+
+    // The nodes are linked back in the other order.
+    assert_ptr_equal( node1, dbllist_link_to_end( list, node1, &zero ) );
+    assert_ptr_equal( node0, dbllist_link_to_end( list, node0, &one ) );
+    assert_int_equal( 2, dbllist_size( list ) );
+    assert_ptr_equal( node1, dbllist_head( list ) );
+    assert_ptr_equal( node0, dbllist_tail( list ) );
+    assert_ptr_equal( node1, node0->prev );
+    assert_ptr_equal( &zero, dbllist_pop( list ) );
+    assert_ptr_equal( &one, dbllist_pop( list ) );
+}
+
 static void clr(void **state) {
 }
 
@@ -448,6 +474,7 @@ int dbll_test() {
         cmocka_unit_test_setup_teardown( remove_the_middle, dbll_setup, dbll_teardown ),
         cmocka_unit_test_setup_teardown( list_clear, dbll_setup, dbll_teardown ),
         cmocka_unit_test_setup_teardown( list_clear_nodes, dbll_setup, dbll_teardown ),
+        cmocka_unit_test_setup_teardown( detach_and_link_nodes, dbll_setup, dbll_teardown ),
         cmocka_unit_test_setup_teardown( append_to_two_empty_lists, dbll_setup, dbll_teardown ),
         cmocka_unit_test_setup_teardown( append_to_one_empty_list, dbll_setup, dbll_teardown ),
         cmocka_unit_test_setup_teardown( append_to_nonempty_list, dbll_setup, dbll_teardown ),
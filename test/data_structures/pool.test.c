@@ -0,0 +1,169 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include "../../src/mem.h"
+#include "../../src/data_structures/pool.h"
+
+#define CAPACITY 1000
+#define NUM_OPS 100000
+#define SEED 4321
+
+typedef struct {
+    int value;
+    char name[12];
+} item_t;
+
+typedef struct {
+    pool_t* pool;
+    // The handles of the live items and of the released ones
+    int* live;
+    unsigned int num_live;
+    int* released;
+    unsigned int num_released;
+} pltest_t;
+
+//  ****************************************
+//  Misc functions
+//  ****************************************
+
+static int alloc_item( pool_t* pool, int value ) {
+    int handle = pool_alloc( pool );
+    item_t* item = ( item_t* ) pool_get( pool, handle );
+    if ( item ) {
+        item->value = value;
+    }
+    return handle;
+}
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
+static int pool_setup(void **state) {
+    pltest_t *test_struct = test_malloc( sizeof( pltest_t ) );
+    test_struct->pool = pool_new( sizeof( item_t ), CAPACITY );
+    test_struct->live = test_malloc( CAPACITY * sizeof( int ) );
+    test_struct->num_live = 0;
+    test_struct->released = test_malloc( NUM_OPS * sizeof( int ) );
+    test_struct->num_released = 0;
+    srand( SEED );
+    *state = test_struct;
+    return 0;
+}
+
+static int pool_teardown(void **state) {
+    pltest_t *t = ( pltest_t* ) *state;
+    pool_free( t->pool );
+    test_free( t->live );
+    test_free( t->released );
+    test_free( *state );
+    return 0;
+}
+
+// *****************************
+// pool_alloc and pool_release
+// *****************************
+
+static void stale_handles_are_rejected(void **state) {
+    pltest_t* t = ( pltest_t* ) *state;
+    int a = alloc_item( t->pool, 1 );
+    int b = alloc_item( t->pool, 2 );
+    assert_true( a != POOL_NONE && b != POOL_NONE && a != b );
+    item_t* item_a = ( item_t* ) pool_get( t->pool, a );
+    assert_int_equal( 1, item_a->value );
+    assert_int_equal( 2, ( ( item_t* ) pool_get( t->pool, b ) )->value );
+    assert_int_equal( 2, t->pool->count );
+
+    assert_int_equal( POOL_SUCCESS, pool_release( t->pool, a ) );
+    assert_null( pool_get( t->pool, a ) );
+    assert_int_equal( POOL_STALE, pool_release( t->pool, a ) );
+
+    // The slot is reused without allocating, zeroed and under a new
+    // generation, so the old handle does not reach the new item.
+    int c = pool_alloc( t->pool );
+    assert_int_equal( pool_index( a ), pool_index( c ) );
+    assert_int_not_equal( pool_generation( a ), pool_generation( c ) );
+    assert_ptr_equal( item_a, pool_get( t->pool, c ) );
+    assert_int_equal( 0, item_a->value );
+    assert_null( pool_get( t->pool, a ) );
+
+    // Never valid
+    assert_null( pool_get( t->pool, POOL_NONE ) );
+    assert_null( pool_get( t->pool, -1 ) );
+    assert_null( pool_get( t->pool, ( int ) ( ( 1u << POOL_INDEX_BITS ) | CAPACITY ) ) );
+    // Not allocated yet
+    assert_null( pool_get( t->pool, ( int ) ( ( 1u << POOL_INDEX_BITS ) | 2 ) ) );
+}
+
+static void full_pool(void **state) {
+    pltest_t* t = ( pltest_t* ) *state;
+    for ( int i = 0; i < CAPACITY; i++ ) {
+        t->live[i] = alloc_item( t->pool, i );
+        assert_true( t->live[i] != POOL_NONE );
+    }
+    assert_int_equal( POOL_NONE, pool_alloc( t->pool ) );
+    pool_release( t->pool, t->live[ CAPACITY / 2 ] );
+    int handle = pool_alloc( t->pool );
+    assert_int_equal( CAPACITY / 2, pool_index( handle ) );
+    assert_int_equal( POOL_NONE, pool_alloc( t->pool ) );
+    assert_int_equal( CAPACITY, t->pool->count );
+}
+
+static void generations_wrap_around(void **state) {
+    pltest_t* t = ( pltest_t* ) *state;
+    int prev = pool_alloc( t->pool );
+    for ( unsigned int i = 0; i < 3u << POOL_GENERATION_BITS; i++ ) {
+        pool_release( t->pool, prev );
+        int handle = pool_alloc( t->pool );
+        assert_true( handle > POOL_NONE );
+        assert_int_equal( 0, pool_index( handle ) );
+        assert_null( pool_get( t->pool, prev ) );
+        prev = handle;
+    }
+}
+
+static void random_churn(void **state) {
+    pltest_t* t = ( pltest_t* ) *state;
+    for ( int op = 0; op < NUM_OPS; op++ ) {
+        if ( t->num_live < CAPACITY && ( t->num_live == 0 || rand() % 2 ) ) {
+            int handle = alloc_item( t->pool, op );
+            assert_true( handle != POOL_NONE );
+            t->live[ t->num_live++ ] = handle;
+        } else {
+            unsigned int i = rand() % t->num_live;
+            assert_int_equal( POOL_SUCCESS, pool_release( t->pool, t->live[i] ) );
+            t->released[ t->num_released++ ] = t->live[i];
+            t->live[i] = t->live[ --t->num_live ];
+        }
+    }
+    assert_int_equal( t->num_live, t->pool->count );
+
+    // The live items are distinct; every released handle is stale, as no
+    // slot is reused often enough for its generation to wrap around.
+    for ( unsigned int i = 0; i < t->num_live; i++ ) {
+        assert_non_null( pool_get( t->pool, t->live[i] ) );
+        for ( unsigned int j = 0; j < i; j++ ) {
+            assert_int_not_equal( pool_index( t->live[i] ), pool_index( t->live[j] ) );
+        }
+    }
+    unsigned int stale = 0;
+    for ( unsigned int i = 0; i < t->num_released; i++ ) {
+        stale += pool_get( t->pool, t->released[i] ) == NULL;
+    }
+    assert_int_equal( t->num_released, stale );
+}
+
+int pool_test() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown( stale_handles_are_rejected, pool_setup, pool_teardown ),
+        cmocka_unit_test_setup_teardown( full_pool, pool_setup, pool_teardown ),
+        cmocka_unit_test_setup_teardown( generations_wrap_around, pool_setup, pool_teardown ),
+        cmocka_unit_test_setup_teardown( random_churn, pool_setup, pool_teardown ),
+    };
+
+    return cmocka_run_group_tests( tests, NULL, NULL );
+}
@@ -0,0 +1 @@
+int pool_test();
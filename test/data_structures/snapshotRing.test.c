@@ -0,0 +1,174 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include "../../src/mem.h"
+#include "../../src/data_structures/snapshot_ring.h"
+
+#define STATE_SIZE 256
+
+typedef struct {
+    snapring_t* r;
+    unsigned char state[ STATE_SIZE ];
+    unsigned char out[ STATE_SIZE ];
+} srtest_t;
+
+//  ****************************************
+//  Misc functions
+//  ****************************************
+
+// Makes a state that changes a little from step to step
+static void make_state( unsigned char* state, unsigned int step ) {
+    memset( state, 0, STATE_SIZE );
+    for ( int i = 0; i < STATE_SIZE; i += 16 ) {
+        state[ i ] = ( unsigned char ) ( step + i );
+        state[ i + 1 ] = ( unsigned char ) ( step >> 8 );
+    }
+}
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
+static int snapring_setup(void **state) {
+    srtest_t *test_struct = test_malloc( sizeof( srtest_t ) );
+    *state = test_struct;
+    return 0;
+}
+
+static int snapring_teardown(void **state) {
+    test_free( *state );
+    return 0;
+}
+
+// *********************************
+// snapring_push and snapring_restore
+// *********************************
+
+static void restore_every_step(void **state) {
+    srtest_t* t = ( srtest_t* ) *state;
+    t->r = snapring_new( STATE_SIZE, 64, 64 * STATE_SIZE, 8 );
+
+    for ( unsigned int step = 0; step < 40; step++ ) {
+        make_state( t->state, step );
+        snapring_push( t->r, step, t->state, STATE_SIZE );
+    }
+    assert_int_equal( 0, snapring_oldest( t->r ) );
+    assert_int_equal( 39, snapring_newest( t->r ) );
+    for ( unsigned int step = 0; step < 40; step++ ) {
+        make_state( t->state, step );
+        assert_int_equal( STATE_SIZE, snapring_restore( t->r, step, t->out ) );
+        assert_memory_equal( t->state, t->out, STATE_SIZE );
+    }
+    assert_int_equal( SNAPRING_NOTFOUND, snapring_restore( t->r, 40, t->out ) );
+
+    snapring_free( t->r );
+}
+
+static void deltas_are_compressed(void **state) {
+    srtest_t* t = ( srtest_t* ) *state;
+    t->r = snapring_new( STATE_SIZE, 64, 64 * STATE_SIZE, 16 );
+
+    for ( unsigned int step = 0; step < 16; step++ ) {
+        make_state( t->state, step );
+        snapring_push( t->r, step, t->state, STATE_SIZE );
+    }
+    // 16 states of 256 bytes take less than a half of the raw states.
+    assert_true( snapring_bytes_used( t->r ) < 8 * STATE_SIZE );
+
+    snapring_free( t->r );
+}
+
+static void short_state_is_zero_padded(void **state) {
+    srtest_t* t = ( srtest_t* ) *state;
+    t->r = snapring_new( STATE_SIZE, 4, 4 * STATE_SIZE, 2 );
+
+    memset( t->state, 0xaa, STATE_SIZE );
+    snapring_push( t->r, 1, t->state, 10 );
+    memset( t->out, 0x55, STATE_SIZE );
+    assert_int_equal( 10, snapring_restore( t->r, 1, t->out ) );
+    assert_int_equal( 0xaa, t->out[9] );
+    assert_int_equal( 0, t->out[10] );
+    assert_int_equal( 0, t->out[ STATE_SIZE - 1 ] );
+
+    snapring_free( t->r );
+}
+
+static void frame_limit_evicts_groups(void **state) {
+    srtest_t* t = ( srtest_t* ) *state;
+    t->r = snapring_new( STATE_SIZE, 10, 64 * STATE_SIZE, 4 );
+
+    for ( unsigned int step = 0; step < 30; step++ ) {
+        make_state( t->state, step );
+        snapring_push( t->r, step, t->state, STATE_SIZE );
+        assert_true( t->r->count <= 10 );
+    }
+    // The oldest frame is always a keyframe.
+    assert_int_equal( 0, snapring_oldest( t->r ) % 4 );
+    assert_int_equal( 29, snapring_newest( t->r ) );
+    make_state( t->state, snapring_oldest( t->r ) );
+    snapring_restore( t->r, snapring_oldest( t->r ), t->out );
+    assert_memory_equal( t->state, t->out, STATE_SIZE );
+
+    snapring_free( t->r );
+}
+
+static void byte_limit_evicts_groups(void **state) {
+    srtest_t* t = ( srtest_t* ) *state;
+    // Room for three raw states only.
+    t->r = snapring_new( STATE_SIZE, 100, 3 * STATE_SIZE + 8, 100 );
+
+    for ( unsigned int step = 0; step < 50; step++ ) {
+        // Random-like states do not compress.
+        for ( int i = 0; i < STATE_SIZE; i++ ) {
+            t->state[i] = ( unsigned char ) ( ( step * 131 + i * 71 ) ^ ( i >> 2 ) );
+        }
+        snapring_push( t->r, step, t->state, STATE_SIZE );
+        assert_true( snapring_bytes_used( t->r ) <= 3 * STATE_SIZE + 8 );
+        assert_int_equal( STATE_SIZE, snapring_restore( t->r, step, t->out ) );
+        assert_memory_equal( t->state, t->out, STATE_SIZE );
+    }
+    assert_true( t->r->evicted > 0 );
+
+    snapring_free( t->r );
+}
+
+static void push_rewrites_history(void **state) {
+    srtest_t* t = ( srtest_t* ) *state;
+    t->r = snapring_new( STATE_SIZE, 64, 64 * STATE_SIZE, 4 );
+
+    for ( unsigned int step = 0; step < 20; step++ ) {
+        make_state( t->state, step );
+        snapring_push( t->r, step, t->state, STATE_SIZE );
+    }
+    // A new timeline from the step 10 onwards.
+    for ( unsigned int step = 10; step < 15; step++ ) {
+        make_state( t->state, step + 1000 );
+        snapring_push( t->r, step, t->state, STATE_SIZE );
+    }
+    assert_int_equal( 14, snapring_newest( t->r ) );
+    make_state( t->state, 9 );
+    snapring_restore( t->r, 9, t->out );
+    assert_memory_equal( t->state, t->out, STATE_SIZE );
+    make_state( t->state, 1013 );
+    snapring_restore( t->r, 13, t->out );
+    assert_memory_equal( t->state, t->out, STATE_SIZE );
+
+    snapring_free( t->r );
+}
+
+int snapring_test() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown( restore_every_step, snapring_setup, snapring_teardown ),
+        cmocka_unit_test_setup_teardown( deltas_are_compressed, snapring_setup, snapring_teardown ),
+        cmocka_unit_test_setup_teardown( short_state_is_zero_padded, snapring_setup, snapring_teardown ),
+        cmocka_unit_test_setup_teardown( frame_limit_evicts_groups, snapring_setup, snapring_teardown ),
+        cmocka_unit_test_setup_teardown( byte_limit_evicts_groups, snapring_setup, snapring_teardown ),
+        cmocka_unit_test_setup_teardown( push_rewrites_history, snapring_setup, snapring_teardown ),
+    };
+
+    return cmocka_run_group_tests( tests, NULL, NULL );
+}
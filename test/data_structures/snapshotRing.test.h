@@ -0,0 +1 @@
+int snapring_test();
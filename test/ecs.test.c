@@ -0,0 +1,215 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <cmocka.h>
+
+#include "../src/ecs.h"
+#include "../src/mem.h"
+
+#define NUM_ENTITIES 1000
+#define SEED 37
+
+typedef struct {
+    int x;
+    int y;
+} pos_t;
+
+typedef struct {
+    int vx;
+    int vy;
+} vel_t;
+
+typedef struct {
+    ecs_t* ecs;
+    ecs_commands_t* commands;
+    int pos;
+    int vel;
+    int tag;
+} etest_t;
+
+//  ****************************************
+//  Misc functions
+//  ****************************************
+
+static void move( ecs_archetype_t* a, void* user ) {
+    unsigned int* archetypes = ( unsigned int* ) user;
+    pos_t* p = ecs_column( a, 0, pos_t );
+    vel_t* v = ecs_column( a, 1, vel_t );
+    for ( unsigned int i = 0; i < a->count; i++ ) {
+        p[i].x += v[i].vx;
+        p[i].y += v[i].vy;
+    }
+    ( *archetypes )++;
+}
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
+static int ecs_setup(void **state) {
+    etest_t *test_struct = test_malloc( sizeof( etest_t ) );
+    test_struct->ecs = ecs_new( NUM_ENTITIES );
+    test_struct->commands = ecs_commands_new( test_struct->ecs );
+    test_struct->pos = ecs_component( test_struct->ecs, sizeof( pos_t ) );
+    test_struct->vel = ecs_component( test_struct->ecs, sizeof( vel_t ) );
+    test_struct->tag = ecs_component( test_struct->ecs, 0 );
+    srand( SEED );
+    *state = test_struct;
+    return 0;
+}
+
+static int ecs_teardown(void **state) {
+    etest_t *t = ( etest_t* ) *state;
+    ecs_commands_free( t->commands );
+    ecs_free( t->ecs );
+    test_free( *state );
+    return 0;
+}
+
+// *******
+// ecs_add
+// *******
+
+static void add_and_remove(void **state) {
+    etest_t* t = ( etest_t* ) *state;
+    assert_int_equal( 0, t->pos );
+    assert_int_equal( 1, t->vel );
+
+    int e = ecs_create( t->ecs );
+    assert_true( ecs_alive( t->ecs, e ) );
+    assert_null( ecs_get( t->ecs, e, t->pos ) );
+
+    pos_t* p = ( pos_t* ) ecs_add( t->ecs, e, t->pos );
+    assert_int_equal( 0, p->x );
+    p->x = 5;
+    p->y = 6;
+    vel_t* v = ( vel_t* ) ecs_add( t->ecs, e, t->vel );
+    v->vx = 7;
+
+    // The position moved with the entity to the new archetype.
+    p = ( pos_t* ) ecs_get( t->ecs, e, t->pos );
+    assert_int_equal( 5, p->x );
+    assert_int_equal( 6, p->y );
+    assert_int_equal( 3, t->ecs->num_archetypes );
+
+    // Adding again keeps the component.
+    assert_ptr_equal( p, ecs_add( t->ecs, e, t->pos ) );
+    assert_int_equal( 5, p->x );
+
+    ecs_remove( t->ecs, e, t->pos );
+    assert_null( ecs_get( t->ecs, e, t->pos ) );
+    v = ( vel_t* ) ecs_get( t->ecs, e, t->vel );
+    assert_int_equal( 7, v->vx );
+    assert_int_equal( 4, t->ecs->num_archetypes );
+}
+
+// ***********
+// ecs_destroy
+// ***********
+
+static void destroy_moves_last_row(void **state) {
+    etest_t* t = ( etest_t* ) *state;
+    int e[3];
+    for ( int i = 0; i < 3; i++ ) {
+        e[i] = ecs_create( t->ecs );
+        ( ( pos_t* ) ecs_add( t->ecs, e[i], t->pos ) )->x = 10 * i;
+    }
+    ecs_destroy( t->ecs, e[0] );
+    assert_false( ecs_alive( t->ecs, e[0] ) );
+    assert_int_equal( 20, ( ( pos_t* ) ecs_get( t->ecs, e[2], t->pos ) )->x );
+    assert_int_equal( 10, ( ( pos_t* ) ecs_get( t->ecs, e[1], t->pos ) )->x );
+
+    // The entity is reused.
+    assert_int_equal( e[0], ecs_create( t->ecs ) );
+
+    // The capacity is the limit.
+    for ( int i = 3; i < NUM_ENTITIES; i++ ) {
+        assert_int_not_equal( ECS_FULL, ecs_create( t->ecs ) );
+    }
+    assert_int_equal( ECS_FULL, ecs_create( t->ecs ) );
+}
+
+// *******
+// ecs_run
+// *******
+
+static void run_matching_archetypes(void **state) {
+    etest_t* t = ( etest_t* ) *state;
+    int expected_x[ NUM_ENTITIES ];
+    int e[ NUM_ENTITIES ];
+    unsigned int moving = 0;
+    for ( int i = 0; i < NUM_ENTITIES; i++ ) {
+        e[i] = ecs_create( t->ecs );
+        pos_t* p = ( pos_t* ) ecs_add( t->ecs, e[i], t->pos );
+        p->x = rand() % 100;
+        expected_x[i] = p->x;
+        if ( rand() % 2 ) {
+            vel_t* v = ( vel_t* ) ecs_add( t->ecs, e[i], t->vel );
+            v->vx = rand() % 10;
+            expected_x[i] += v->vx;
+            moving++;
+        }
+        if ( rand() % 3 == 0 ) {
+            ecs_add( t->ecs, e[i], t->tag );
+        }
+    }
+
+    unsigned int archetypes = 0;
+    assert_int_equal( moving, ecs_run( t->ecs, ecs_bit( t->pos ) | ecs_bit( t->vel ), move, &archetypes ) );
+    // With and without the tag
+    assert_int_equal( 2, archetypes );
+    for ( int i = 0; i < NUM_ENTITIES; i++ ) {
+        assert_int_equal( expected_x[i], ( ( pos_t* ) ecs_get( t->ecs, e[i], t->pos ) )->x );
+    }
+}
+
+// ******************
+// ecs_commands_flush
+// ******************
+
+static void commands_are_deferred(void **state) {
+    etest_t* t = ( etest_t* ) *state;
+    int a = ecs_create( t->ecs );
+    ecs_add( t->ecs, a, t->pos );
+
+    pos_t value = { 3, 4 };
+    int b = ecs_commands_create( t->commands );
+    ecs_commands_add( t->commands, b, t->pos, &value );
+    ecs_commands_add( t->commands, b, t->vel, NULL );
+    ecs_commands_remove( t->commands, a, t->pos );
+    assert_false( ecs_alive( t->ecs, b ) );
+    assert_non_null( ecs_get( t->ecs, a, t->pos ) );
+
+    assert_int_equal( 4, ecs_commands_flush( t->commands ) );
+    assert_true( ecs_alive( t->ecs, b ) );
+    pos_t* p = ( pos_t* ) ecs_get( t->ecs, b, t->pos );
+    assert_int_equal( 3, p->x );
+    assert_int_equal( 4, p->y );
+    assert_int_equal( 0, ( ( vel_t* ) ecs_get( t->ecs, b, t->vel ) )->vx );
+    assert_null( ecs_get( t->ecs, a, t->pos ) );
+
+    // The commands of a destroyed entity are skipped.
+    ecs_commands_destroy( t->commands, a );
+    ecs_commands_add( t->commands, a, t->vel, NULL );
+    assert_int_equal( 1, ecs_commands_flush( t->commands ) );
+    assert_false( ecs_alive( t->ecs, a ) );
+
+    // The buffer grows.
+    for ( int i = 0; i < 100; i++ ) {
+        ecs_commands_add( t->commands, ecs_commands_create( t->commands ), t->pos, &value );
+    }
+    assert_int_equal( 200, ecs_commands_flush( t->commands ) );
+    assert_int_equal( 0, t->commands->size );
+}
+
+int ecs_test() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown( add_and_remove, ecs_setup, ecs_teardown ),
+        cmocka_unit_test_setup_teardown( destroy_moves_last_row, ecs_setup, ecs_teardown ),
+        cmocka_unit_test_setup_teardown( run_matching_archetypes, ecs_setup, ecs_teardown ),
+        cmocka_unit_test_setup_teardown( commands_are_deferred, ecs_setup, ecs_teardown ),
+    };
+
+    return cmocka_run_group_tests( tests, NULL, NULL );
+}
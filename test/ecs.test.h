@@ -0,0 +1 @@
+int ecs_test();
@@ -0,0 +1,249 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <cmocka.h>
+
+#include "../src/mem.h"
+#include "../src/events.h"
+#include "../src/physics.h"
+#include "../src/data_structures/quad_tree.h"
+
+#define NUM_OBJS 300
+#define SEED 2468
+
+typedef struct {
+    int id;
+    int power;
+} boom_t;
+
+typedef struct {
+    events_t* bus;
+    qtree_t* q;
+    physics_world_t* world;
+} etest_t;
+
+//  ****************************************
+//  Misc functions
+//  ****************************************
+
+typedef struct {
+    unsigned int batches;
+    unsigned int events;
+    int last_id;
+    int ordered;
+    // The recipients of the latest batch
+    int recipients[ NUM_OBJS ];
+    unsigned int num_recipients;
+    // The bus that the handler emits to, if any
+    events_t* bus;
+    int channel;
+} log_t;
+
+static void handler( const events_batch_t* batch, void* user ) {
+    log_t* log = ( log_t* ) user;
+    log->batches++;
+    log->num_recipients = 0;
+    for ( unsigned int i = 0; i < batch->count; i++ ) {
+        const boom_t* boom = events_at( batch, i, boom_t );
+        log->ordered &= boom->id == log->last_id + 1;
+        log->last_id = boom->id;
+        const int* guids = events_recipients( batch, i );
+        for ( unsigned int j = 0; j < batch->spans[i].count; j++ ) {
+            log->recipients[ log->num_recipients++ ] = guids[j];
+        }
+    }
+    log->events += batch->count;
+    if ( log->bus ) {
+        boom_t echo = { 1000, 0 };
+        events_emit( log->bus, log->channel, &echo );
+        log->bus = NULL;
+    }
+}
+
+static void add_random_boxes( physics_world_t* world, unsigned int count ) {
+    for ( unsigned int i = 0; i < count; i++ ) {
+        physics_body_t body = { 0 };
+        body.x = rand() % 1100 - 50;
+        body.y = rand() % 1100 - 50;
+        body.w = 1 + rand() % ( i % 4 ? 40 : 400 );
+        body.h = 1 + rand() % ( i % 4 ? 40 : 400 );
+        int index = physics_world_add( world, &body );
+        world->objs[ index ].category = 1u << ( rand() % 3 );
+    }
+}
+
+static int compare_ints( const void* a, const void* b ) {
+    return *( const int* ) a - *( const int* ) b;
+}
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
+static int events_setup(void **state) {
+    etest_t *test_struct = test_malloc( sizeof( etest_t ) );
+    test_struct->bus = events_new();
+    test_struct->q = qtree_new();
+    test_struct->world = physics_world_new( NUM_OBJS );
+    srand( SEED );
+    *state = test_struct;
+    return 0;
+}
+
+static int events_teardown(void **state) {
+    etest_t *t = ( etest_t* ) *state;
+    events_free( t->bus );
+    physics_free_bsp( t->q );
+    physics_world_free( t->world );
+    test_free( *state );
+    return 0;
+}
+
+// ***************
+// events_dispatch
+// ***************
+
+static void batches_by_phase(void **state) {
+    etest_t* t = ( etest_t* ) *state;
+    int early = events_channel( t->bus, sizeof( boom_t ), 0 );
+    int late = events_channel( t->bus, sizeof( boom_t ), 1 );
+    log_t log_0 = { 0, 0, 0, 1, { 0 }, 0, NULL, 0 };
+    log_t log_1 = { 0, 0, 0, 1, { 0 }, 0, NULL, 0 };
+    log_t log_2 = { 0, 0, 0, 1, { 0 }, 0, NULL, 0 };
+    assert_int_equal( 0, events_subscribe( t->bus, early, handler, &log_0 ) );
+    assert_int_equal( 1, events_subscribe( t->bus, early, handler, &log_1 ) );
+    assert_int_equal( 0, events_subscribe( t->bus, late, handler, &log_2 ) );
+
+    // Enough events to grow the buffers
+    for ( int i = 1; i <= 100; i++ ) {
+        boom_t boom = { i, 2 * i };
+        events_emit( t->bus, early, &boom );
+    }
+    boom_t* zeroed = ( boom_t* ) events_emit( t->bus, late, NULL );
+    assert_int_equal( 0, zeroed->id );
+    zeroed->id = 1;
+
+    // Each subscriber gets the channel as one batch, in the order of the emits.
+    assert_int_equal( 100, events_dispatch( t->bus, 0 ) );
+    assert_int_equal( 1, log_0.batches );
+    assert_int_equal( 100, log_0.events );
+    assert_true( log_0.ordered );
+    assert_int_equal( 1, log_1.batches );
+    assert_int_equal( 100, log_1.events );
+    assert_int_equal( 0, log_2.batches );
+    assert_int_equal( 0, events_dispatch( t->bus, 0 ) );
+    assert_int_equal( 1, log_0.batches );
+
+    assert_int_equal( 1, events_dispatch( t->bus, 1 ) );
+    assert_int_equal( 1, log_2.events );
+    assert_true( log_2.ordered );
+}
+
+static void emits_of_handlers_wait(void **state) {
+    etest_t* t = ( etest_t* ) *state;
+    int channel = events_channel( t->bus, sizeof( boom_t ), 0 );
+    log_t log = { 0, 0, 0, 1, { 0 }, 0, t->bus, channel };
+    events_subscribe( t->bus, channel, handler, &log );
+
+    boom_t boom = { 1, 0 };
+    events_emit( t->bus, channel, &boom );
+    assert_int_equal( 1, events_dispatch( t->bus, 0 ) );
+    assert_int_equal( 1, log.events );
+
+    // The echo of the handler comes with the next dispatch.
+    assert_int_equal( 1, events_dispatch( t->bus, 0 ) );
+    assert_int_equal( 2, log.events );
+    assert_int_equal( 1000, log.last_id );
+    assert_int_equal( 0, events_dispatch( t->bus, 0 ) );
+}
+
+// ****************
+// events_broadcast
+// ****************
+
+static void broadcast_equals_brute_force(void **state) {
+    etest_t* t = ( etest_t* ) *state;
+    int channel = events_channel( t->bus, sizeof( boom_t ), 0 );
+    log_t log = { 0, 0, 0, 1, { 0 }, 0, NULL, 0 };
+    events_subscribe( t->bus, channel, handler, &log );
+    add_random_boxes( t->world, NUM_OBJS );
+    physics_construct_bsp( t->q, t->world );
+
+    unsigned int hits = 0;
+    for ( int round = 0; round < 200; round++ ) {
+        int x0 = rand() % 1200 - 100;
+        int y0 = rand() % 1200 - 100;
+        int x1 = x0 + 1 + rand() % ( round % 8 ? 100 : 600 );
+        int y1 = y0 + 1 + rand() % ( round % 8 ? 100 : 600 );
+        unsigned int mask = round % 2 ? PHYSICS_MASK_ALL : 0x2;
+
+        int expected[ NUM_OBJS ];
+        unsigned int num_expected = 0;
+        for ( unsigned int i = 0; i < t->world->count; i++ ) {
+            physics_obj_t* obj = &t->world->objs[i];
+            int ox0, oy0, ox1, oy1;
+            physics_bounds( obj, &ox0, &oy0, &ox1, &oy1 );
+            if ( ( obj->category & mask ) && ox0 < x1 && x0 < ox1 && oy0 < y1 && y0 < oy1 ) {
+                expected[ num_expected++ ] = obj->guid;
+            }
+        }
+
+        boom_t boom = { round, 0 };
+        unsigned int count = events_broadcast( t->bus, channel, t->q, x0, y0, x1, y1, mask, &boom );
+        assert_int_equal( num_expected, count );
+        log.num_recipients = 0;
+        events_dispatch( t->bus, 0 );
+        assert_int_equal( num_expected, log.num_recipients );
+        qsort( expected, num_expected, sizeof( int ), compare_ints );
+        qsort( log.recipients, log.num_recipients, sizeof( int ), compare_ints );
+        assert_memory_equal( expected, log.recipients, num_expected * sizeof( int ) );
+        hits += count > 0;
+    }
+    // Both the empty and the non-empty broadcasts were tried.
+    assert_true( hits > 10 && hits < 200 );
+    assert_int_equal( hits, log.events );
+}
+
+// ************
+// events_stats
+// ************
+
+static void counts_per_frame(void **state) {
+    etest_t* t = ( etest_t* ) *state;
+    int channel = events_channel( t->bus, sizeof( boom_t ), 0 );
+    add_random_boxes( t->world, NUM_OBJS );
+    physics_construct_bsp( t->q, t->world );
+
+    events_emit( t->bus, channel, NULL );
+    events_emit( t->bus, channel, NULL );
+    unsigned int count = events_broadcast( t->bus, channel, t->q, 0, 0, 1024, 1024, PHYSICS_MASK_ALL, NULL );
+    assert_true( count > 0 );
+    const events_stats_t* stats = events_stats( t->bus, channel );
+    assert_int_equal( 3, stats->frame_events );
+    assert_int_equal( count, stats->frame_recipients );
+
+    events_dispatch( t->bus, 0 );
+    events_frame( t->bus );
+    assert_int_equal( 0, stats->frame_events );
+    assert_int_equal( 3, stats->last_events );
+    assert_int_equal( count, stats->last_recipients );
+    assert_int_equal( 1, stats->deliveries );
+
+    events_emit( t->bus, channel, NULL );
+    events_frame( t->bus );
+    assert_int_equal( 1, stats->last_events );
+    assert_int_equal( 0, stats->last_recipients );
+    assert_int_equal( 4, stats->total_events );
+}
+
+int events_test() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown( batches_by_phase, events_setup, events_teardown ),
+        cmocka_unit_test_setup_teardown( emits_of_handlers_wait, events_setup, events_teardown ),
+        cmocka_unit_test_setup_teardown( broadcast_equals_brute_force, events_setup, events_teardown ),
+        cmocka_unit_test_setup_teardown( counts_per_frame, events_setup, events_teardown ),
+    };
+
+    return cmocka_run_group_tests( tests, NULL, NULL );
+}
@@ -0,0 +1 @@
+int events_test();
@@ -0,0 +1,251 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include "../src/mem.h"
+#include "../src/fsm.h"
+
+#define NUM_AGENTS 10000
+#define SEED 8642
+
+// The states of the enemy
+#define ALIVE   0
+#define PATROL  1
+#define HUNT    2
+#define CHASE   3
+#define ATTACK  4
+#define DEAD    5
+
+// The events of the enemy
+#define SEE     0
+#define LOSE    1
+#define NEAR    2
+#define FAR     3
+#define DIE     4
+#define RESET   5
+#define NUM_EVENTS 6
+
+// An agent logs its actions
+typedef struct {
+    char log[64];
+    unsigned int length;
+} agent_t;
+
+typedef struct {
+    fsm_machine_t* machine;
+} ftest_t;
+
+//  ****************************************
+//  Misc functions
+//  ****************************************
+
+static void _log( void* agent, char c ) {
+    agent_t* a = ( agent_t* ) agent;
+    if ( a->length + 1 < sizeof( a->log ) ) {
+        a->log[ a->length++ ] = c;
+        a->log[ a->length ] = '\0';
+    }
+}
+
+// Upper case for the entries, lower case for the exits
+static void enter_alive( void* agent ) { _log( agent, 'A' ); }
+static void exit_alive( void* agent ) { _log( agent, 'a' ); }
+static void enter_patrol( void* agent ) { _log( agent, 'P' ); }
+static void exit_patrol( void* agent ) { _log( agent, 'p' ); }
+static void enter_hunt( void* agent ) { _log( agent, 'H' ); }
+static void exit_hunt( void* agent ) { _log( agent, 'h' ); }
+static void enter_chase( void* agent ) { _log( agent, 'C' ); }
+static void exit_chase( void* agent ) { _log( agent, 'c' ); }
+static void enter_attack( void* agent ) { _log( agent, 'T' ); }
+static void exit_attack( void* agent ) { _log( agent, 't' ); }
+static void enter_dead( void* agent ) { _log( agent, 'D' ); }
+static void scream( void* agent ) { _log( agent, '!' ); }
+
+// ALIVE ( PATROL, HUNT ( CHASE, ATTACK ) ), DEAD
+static const fsm_state_t _states[] = {
+    { FSM_NONE, PATROL,   enter_alive,  exit_alive },
+    { ALIVE,    FSM_NONE, enter_patrol, exit_patrol },
+    { ALIVE,    CHASE,    enter_hunt,   exit_hunt },
+    { HUNT,     FSM_NONE, enter_chase,  exit_chase },
+    { HUNT,     FSM_NONE, enter_attack, exit_attack },
+    { FSM_NONE, FSM_NONE, enter_dead,   NULL },
+};
+
+static const fsm_transition_t _transitions[] = {
+    { PATROL, SEE,   HUNT,   NULL },
+    { HUNT,   LOSE,  PATROL, NULL },
+    { CHASE,  NEAR,  ATTACK, NULL },
+    { ATTACK, FAR,   CHASE,  NULL },
+    { ALIVE,  DIE,   DEAD,   scream },
+    // The attack is not interrupted; the first one of a state wins.
+    { ATTACK, LOSE,  ATTACK, NULL },
+    { ATTACK, LOSE,  PATROL, NULL },
+    { ALIVE,  RESET, ALIVE,  NULL },
+    { DEAD,   RESET, ALIVE,  NULL },
+};
+
+static const fsm_def_t _def = {
+    _states, sizeof( _states ) / sizeof( _states[0] ),
+    _transitions, sizeof( _transitions ) / sizeof( _transitions[0] ),
+    NUM_EVENTS, ALIVE
+};
+
+static void assert_log( agent_t* agent, const char* expected ) {
+    assert_string_equal( expected, agent->log );
+    agent->length = 0;
+    agent->log[0] = '\0';
+}
+
+// The leaf that the event leads to, found by searching the definition
+static unsigned int reference_next( unsigned int leaf, unsigned int event ) {
+    for ( unsigned int s = leaf; s != FSM_NONE; s = _states[s].parent ) {
+        for ( unsigned int i = 0; i < _def.num_transitions; i++ ) {
+            if ( _transitions[i].state == s && _transitions[i].event == event ) {
+                unsigned int target = _transitions[i].target;
+                while ( _states[ target ].initial != FSM_NONE ) {
+                    target = _states[ target ].initial;
+                }
+                return target;
+            }
+        }
+    }
+    return leaf;
+}
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
+static int fsm_setup(void **state) {
+    ftest_t *test_struct = test_malloc( sizeof( ftest_t ) );
+    test_struct->machine = fsm_new( &_def );
+    srand( SEED );
+    *state = test_struct;
+    return 0;
+}
+
+static int fsm_teardown(void **state) {
+    ftest_t *t = ( ftest_t* ) *state;
+    fsm_free( t->machine );
+    test_free( *state );
+    return 0;
+}
+
+// ************
+// fsm_dispatch
+// ************
+
+static void hierarchical_transitions(void **state) {
+    ftest_t* t = ( ftest_t* ) *state;
+    assert_non_null( t->machine );
+    agent_t agent = { { 0 }, 0 };
+    fsm_t fsm;
+
+    // The composite states are entered through their initial children.
+    fsm_start( t->machine, &fsm, &agent );
+    assert_int_equal( PATROL, fsm.state );
+    assert_log( &agent, "AP" );
+    assert_int_equal( FSM_HANDLED, fsm_dispatch( t->machine, &fsm, SEE, &agent ) );
+    assert_int_equal( CHASE, fsm.state );
+    assert_log( &agent, "pHC" );
+    assert_true( fsm_in( t->machine, &fsm, HUNT ) );
+    assert_true( fsm_in( t->machine, &fsm, ALIVE ) );
+    assert_false( fsm_in( t->machine, &fsm, PATROL ) );
+
+    // Within the parent, only the siblings are exited and entered.
+    fsm_dispatch( t->machine, &fsm, NEAR, &agent );
+    assert_log( &agent, "cT" );
+    assert_int_equal( FSM_IGNORED, fsm_dispatch( t->machine, &fsm, SEE, &agent ) );
+    assert_log( &agent, "" );
+
+    // The own transition wins over that of the parent.
+    fsm_dispatch( t->machine, &fsm, LOSE, &agent );
+    assert_int_equal( ATTACK, fsm.state );
+    assert_log( &agent, "tT" );
+
+    // The inherited one; the action is run between the exits and the entries.
+    fsm_dispatch( t->machine, &fsm, DIE, &agent );
+    assert_int_equal( DEAD, fsm.state );
+    assert_log( &agent, "tha!D" );
+    assert_int_equal( FSM_IGNORED, fsm_dispatch( t->machine, &fsm, DIE, &agent ) );
+
+    // To the ancestor, which is exited and re-entered.
+    fsm_dispatch( t->machine, &fsm, RESET, &agent );
+    assert_log( &agent, "AP" );
+    fsm_dispatch( t->machine, &fsm, SEE, &agent );
+    assert_log( &agent, "pHC" );
+    fsm_dispatch( t->machine, &fsm, RESET, &agent );
+    assert_int_equal( PATROL, fsm.state );
+    assert_log( &agent, "chaAP" );
+}
+
+static void agents_share_the_machine(void **state) {
+    ftest_t* t = ( ftest_t* ) *state;
+    assert_int_equal( 1, sizeof( fsm_t ) );
+    fsm_t* agents = ( fsm_t* ) test_malloc( NUM_AGENTS * sizeof( fsm_t ) );
+    agent_t log = { { 0 }, 0 };
+    for ( unsigned int i = 0; i < NUM_AGENTS; i++ ) {
+        fsm_start( t->machine, &agents[i], &log );
+        log.length = 0;
+    }
+
+    // The lookups agree with a search of the definition.
+    for ( int round = 0; round < 20; round++ ) {
+        for ( unsigned int i = 0; i < NUM_AGENTS; i++ ) {
+            unsigned int event = rand() % NUM_EVENTS;
+            unsigned int expected = reference_next( agents[i].state, event );
+            fsm_dispatch( t->machine, &agents[i], event, &log );
+            log.length = 0;
+            assert_int_equal( expected, agents[i].state );
+            // Always in a leaf
+            assert_true( agents[i].state != ALIVE && agents[i].state != HUNT );
+        }
+    }
+    test_free( agents );
+}
+
+// *******
+// fsm_new
+// *******
+
+static void invalid_definitions(void **state) {
+    ( void ) state;
+    fsm_state_t states[3] = {
+        { FSM_NONE, 1, NULL, NULL },
+        { 0, FSM_NONE, NULL, NULL },
+        { FSM_NONE, FSM_NONE, NULL, NULL },
+    };
+    fsm_transition_t transitions[1] = { { 1, 0, 2, NULL } };
+    fsm_def_t def = { states, 3, transitions, 1, 1, 0 };
+    fsm_machine_t* machine = fsm_new( &def );
+    assert_non_null( machine );
+    fsm_free( machine );
+
+    // The initial child is not a child.
+    states[0].initial = 2;
+    assert_null( fsm_new( &def ) );
+    states[0].initial = 1;
+    // A cycle of the parents
+    states[0].parent = 1;
+    assert_null( fsm_new( &def ) );
+    states[0].parent = FSM_NONE;
+    // The event is out of range.
+    transitions[0].event = 1;
+    assert_null( fsm_new( &def ) );
+    transitions[0].event = 0;
+    transitions[0].target = 3;
+    assert_null( fsm_new( &def ) );
+}
+
+int fsm_test() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown( hierarchical_transitions, fsm_setup, fsm_teardown ),
+        cmocka_unit_test_setup_teardown( agents_share_the_machine, fsm_setup, fsm_teardown ),
+        cmocka_unit_test_setup_teardown( invalid_definitions, fsm_setup, fsm_teardown ),
+    };
+
+    return cmocka_run_group_tests( tests, NULL, NULL );
+}
@@ -0,0 +1 @@
+int fsm_test();
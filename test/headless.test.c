@@ -0,0 +1,162 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include "../src/headless.h"
+
+#define NUM_OBJECTS 100
+#define NUM_STEPS 50
+#define SEED 2468
+#define DT ( TIMESTEP_UNITS_PER_SECOND / TIMESTEP_DEFAULT_RATE )
+
+typedef struct {
+    headless_config_t config;
+    headless_report_t report;
+} htest_t;
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
+static int headless_setup(void **state) {
+    htest_t *test_struct = test_malloc( sizeof( htest_t ) );
+    test_struct->config.num_objects = NUM_OBJECTS;
+    test_struct->config.num_steps = NUM_STEPS;
+    test_struct->config.seed = SEED;
+    test_struct->config.level = NULL;
+    test_struct->config.record = NULL;
+    test_struct->config.replay = NULL;
+    *state = test_struct;
+    return 0;
+}
+
+static int headless_teardown(void **state) {
+    htest_t* t = ( htest_t* ) *state;
+    if ( t->config.record ) {
+        replay_free( t->config.record );
+    }
+    if ( t->config.replay ) {
+        replay_free( t->config.replay );
+    }
+    test_free( *state );
+    return 0;
+}
+
+// ************
+// headless_run
+// ************
+
+static void report_is_consistent(void **state) {
+    htest_t* t = ( htest_t* ) *state;
+    assert_int_equal( HEADLESS_SUCCESS, headless_run( &t->config, &t->report ) );
+    headless_report_t* r = &t->report;
+    assert_int_equal( NUM_OBJECTS, r->num_objects );
+    assert_int_equal( NUM_STEPS, r->num_steps );
+    assert_true( r->mean_ms > 0 );
+    assert_true( r->p50_ms <= r->p99_ms );
+    assert_true( r->p99_ms <= r->max_ms );
+    assert_true( r->mean_ms <= r->max_ms );
+    // The allocations are counted only with MEM_STATS.
+    assert_true( r->allocs_per_frame * NUM_STEPS == ( double ) r->allocs );
+}
+
+static void runs_are_reproducible(void **state) {
+    htest_t* t = ( htest_t* ) *state;
+    headless_run( &t->config, &t->report );
+    unsigned int checksum = t->report.checksum;
+    headless_run( &t->config, &t->report );
+    assert_int_equal( checksum, t->report.checksum );
+
+    t->config.seed++;
+    headless_run( &t->config, &t->report );
+    assert_int_not_equal( checksum, t->report.checksum );
+}
+
+static void invalid_scenarios(void **state) {
+    htest_t* t = ( htest_t* ) *state;
+    t->config.num_objects = HEADLESS_MAX_OBJECTS + 1;
+    assert_int_equal( HEADLESS_TOOMANY, headless_run( &t->config, &t->report ) );
+
+    t->config.num_objects = NUM_OBJECTS;
+    t->config.level = "\"version\":\"1.0.1\"";
+    assert_int_equal( HEADLESS_BADLEVEL, headless_run( &t->config, &t->report ) );
+
+    // A level with walls around the region
+    t->config.level = "\"tilemap\":{ \"x\":-64 \"y\":-64 \"tile\":64\n"
+        "\"rows\":[ \"###\" \"#.#\" \"###\" ] }";
+    t->config.num_steps = 5;
+    assert_int_equal( HEADLESS_SUCCESS, headless_run( &t->config, &t->report ) );
+}
+
+static void replays_match_the_recording(void **state) {
+    htest_t* t = ( htest_t* ) *state;
+    t->config.record = replay_new( SEED, DT, NUM_OBJECTS, REPLAY_NOLEVEL );
+    assert_int_equal( HEADLESS_SUCCESS, headless_run( &t->config, &t->report ) );
+    unsigned int checksum = t->report.checksum;
+    assert_int_equal( NUM_STEPS + 1, t->config.record->num_frames );
+    assert_int_equal( -1, t->report.diverged );
+    assert_true( t->report.realtime > 0 );
+
+    // The seed, the objects and the frames are those of the recording.
+    t->config.replay = t->config.record;
+    t->config.record = NULL;
+    t->config.seed = SEED + 1;
+    t->config.num_objects = NUM_OBJECTS - 1;
+    t->config.num_steps = 0;
+    assert_int_equal( HEADLESS_SUCCESS, headless_run( &t->config, &t->report ) );
+    assert_int_equal( -1, t->report.diverged );
+    assert_int_equal( NUM_STEPS, t->report.num_steps );
+    assert_int_equal( SEED, t->report.seed );
+    assert_int_equal( NUM_OBJECTS, t->report.num_objects );
+    assert_int_equal( checksum, t->report.checksum );
+
+    // A replay can be run again.
+    assert_int_equal( HEADLESS_SUCCESS, headless_run( &t->config, &t->report ) );
+    assert_int_equal( checksum, t->report.checksum );
+}
+
+static void divergence_is_caught(void **state) {
+    htest_t* t = ( htest_t* ) *state;
+    t->config.record = replay_new( SEED, DT, NUM_OBJECTS, REPLAY_NOLEVEL );
+    headless_run( &t->config, &t->report );
+    t->config.replay = t->config.record;
+    t->config.record = NULL;
+
+    // Another level is rejected.
+    t->config.level = "\"tilemap\":{ \"tile\":64 \"rows\":[ \"#\" ] }";
+    assert_int_equal( HEADLESS_OTHERLEVEL, headless_run( &t->config, &t->report ) );
+    t->config.level = NULL;
+
+    // The checksum of the frame 10 is flipped.
+    replay_t* replay = t->config.replay;
+    game_input_t input;
+    replay_rewind( replay );
+    for ( int i = 0; i < 10; i++ ) {
+        assert_int_equal( REPLAY_SUCCESS, replay_next( replay, &input, NULL ) );
+    }
+    assert_int_equal( REPLAY_SUCCESS, replay_next( replay, &input, NULL ) );
+    replay->data[ replay->pos - 1 ] ^= 0x80;
+    assert_int_equal( HEADLESS_DIVERGED, headless_run( &t->config, &t->report ) );
+    assert_int_equal( 10, t->report.diverged );
+    assert_int_equal( 9, t->report.num_steps );
+
+    // A frame cut short
+    replay->data[ replay->pos - 1 ] ^= 0x80;
+    replay->size -= 2;
+    assert_int_equal( HEADLESS_BADREPLAY, headless_run( &t->config, &t->report ) );
+}
+
+int headless_test() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown( report_is_consistent, headless_setup, headless_teardown ),
+        cmocka_unit_test_setup_teardown( runs_are_reproducible, headless_setup, headless_teardown ),
+        cmocka_unit_test_setup_teardown( invalid_scenarios, headless_setup, headless_teardown ),
+        cmocka_unit_test_setup_teardown( replays_match_the_recording, headless_setup, headless_teardown ),
+        cmocka_unit_test_setup_teardown( divergence_is_caught, headless_setup, headless_teardown ),
+    };
+
+    return cmocka_run_group_tests( tests, NULL, NULL );
+}
@@ -0,0 +1 @@
+int headless_test();
@@ -0,0 +1,228 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <cmocka.h>
+
+#include <stdatomic.h>
+
+#include "../src/jobs.h"
+#include "../src/mem.h"
+
+#define NUM_THREADS 4
+#define NUM_JOBS 10000
+#define NUM_ROUNDS 20
+#define RANGE 100003
+
+typedef struct {
+    jobs_t* jobs;
+    jobs_job_t* job_array;
+} jtest_t;
+
+//  ****************************************
+//  Misc functions
+//  ****************************************
+
+static atomic_int _sum;
+static atomic_int _order;
+static atomic_int _errors;
+
+static void add_one( void* data ) {
+    ( void ) data;
+    atomic_fetch_add( &_sum, 1 );
+}
+
+// Records the order of the runs; the data is the expected position. The
+// fan-in must be done before
+static void in_order( void* data ) {
+    int expected = *( int* ) data;
+    if ( atomic_load( &_sum ) != NUM_JOBS || atomic_fetch_add( &_order, 1 ) != expected ) {
+        atomic_fetch_add( &_errors, 1 );
+    }
+}
+
+// Fails unless all NUM_JOBS jobs and the chain have run before it
+static void after_all( void* data ) {
+    ( void ) data;
+    if ( atomic_load( &_sum ) != NUM_JOBS || atomic_load( &_order ) != 3 ) {
+        atomic_fetch_add( &_errors, 1 );
+    }
+}
+
+// Increments each index of the part
+static void mark( void* data, unsigned int begin, unsigned int end ) {
+    atomic_int* marks = ( atomic_int* ) data;
+    if ( begin >= end ) {
+        atomic_fetch_add( &_errors, 1 );
+    }
+    for ( unsigned int i = begin; i < end; i++ ) {
+        atomic_fetch_add_explicit( &marks[i], 1, memory_order_relaxed );
+    }
+}
+
+static jobs_t* _nested_jobs = NULL;
+
+// Runs a parallel loop of its own for each index of the part
+static void nested( void* data, unsigned int begin, unsigned int end ) {
+    atomic_int* marks = ( atomic_int* ) data;
+    for ( unsigned int i = begin; i < end; i++ ) {
+        jobs_parallel_for( _nested_jobs, 100, 7, mark, &marks[ i * 100 ] );
+    }
+}
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
+static int jobs_setup(void **state) {
+    jtest_t *test_struct = test_malloc( sizeof( jtest_t ) );
+    test_struct->jobs = jobs_new( NUM_THREADS );
+    test_struct->job_array = test_malloc( NUM_JOBS * sizeof( jobs_job_t ) );
+    atomic_store( &_sum, 0 );
+    atomic_store( &_order, 0 );
+    atomic_store( &_errors, 0 );
+    *state = test_struct;
+    return 0;
+}
+
+static int jobs_teardown(void **state) {
+    jtest_t *t = ( jtest_t* ) *state;
+    jobs_free( t->jobs );
+    test_free( t->job_array );
+    test_free( *state );
+    return 0;
+}
+
+// ***********
+// jobs_submit
+// ***********
+
+static void runs_all_jobs(void **state) {
+    jtest_t* t = ( jtest_t* ) *state;
+    assert_int_equal( NUM_THREADS, t->jobs->num_threads );
+    assert_int_equal( 0, jobs_thread_index( t->jobs ) );
+
+    jobs_counter_t counter;
+    jobs_counter_init( &counter );
+    // More jobs than a deque holds; the rest run at once.
+    for ( int round = 0; round < NUM_ROUNDS; round++ ) {
+        for ( int i = 0; i < NUM_JOBS; i++ ) {
+            jobs_job_t job = { add_one, NULL, &counter, NULL, NULL };
+            t->job_array[i] = job;
+            jobs_submit( t->jobs, &t->job_array[i] );
+        }
+        jobs_wait( t->jobs, &counter );
+        assert_int_equal( ( round + 1 ) * NUM_JOBS, atomic_load( &_sum ) );
+        assert_int_equal( 0, atomic_load( &counter.value ) );
+    }
+    assert_int_equal( 0, atomic_load( &t->jobs->pending ) );
+}
+
+static void dependencies(void **state) {
+    jtest_t* t = ( jtest_t* ) *state;
+    for ( int round = 0; round < NUM_ROUNDS; round++ ) {
+        atomic_store( &_sum, 0 );
+        atomic_store( &_order, 0 );
+
+        // A fan-in of NUM_JOBS jobs, then a chain of three jobs, each of
+        // which waits for the counter of the previous one, then the last
+        // job that checks that the fan-in is done.
+        jobs_counter_t fan_in, done, links[3];
+        jobs_counter_init( &fan_in );
+        jobs_counter_init( &done );
+        for ( int i = 0; i < NUM_JOBS; i++ ) {
+            jobs_job_t job = { add_one, NULL, &fan_in, NULL, NULL };
+            t->job_array[i] = job;
+            jobs_submit( t->jobs, &t->job_array[i] );
+        }
+        jobs_job_t chain[3];
+        int positions[3] = { 0, 1, 2 };
+        for ( int i = 0; i < 3; i++ ) {
+            jobs_counter_init( &links[i] );
+            jobs_job_t job = { in_order, &positions[i], &links[i], i ? &links[ i - 1 ] : &fan_in, NULL };
+            chain[i] = job;
+            jobs_submit( t->jobs, &chain[i] );
+        }
+        jobs_job_t last = { after_all, NULL, &done, &links[2], NULL };
+        jobs_submit( t->jobs, &last );
+
+        jobs_wait( t->jobs, &done );
+        assert_int_equal( NUM_JOBS, atomic_load( &_sum ) );
+        assert_int_equal( 3, atomic_load( &_order ) );
+        assert_int_equal( 0, atomic_load( &fan_in.value ) );
+    }
+    assert_int_equal( 0, atomic_load( &_errors ) );
+}
+
+// *****************
+// jobs_parallel_for
+// *****************
+
+static void parallel_for_covers_range(void **state) {
+    jtest_t* t = ( jtest_t* ) *state;
+    atomic_int* marks = test_malloc( RANGE * sizeof( atomic_int ) );
+    unsigned int counts[] = { 0, 1, 2, 63, 64, 65, 1000, RANGE };
+    unsigned int chunks[] = { 0, 1, 16, 1000 };
+    for ( unsigned int c = 0; c < sizeof( counts ) / sizeof( counts[0] ); c++ ) {
+        for ( unsigned int k = 0; k < sizeof( chunks ) / sizeof( chunks[0] ); k++ ) {
+            for ( unsigned int i = 0; i < RANGE; i++ ) {
+                atomic_init( &marks[i], 0 );
+            }
+            jobs_parallel_for( t->jobs, counts[c], chunks[k], mark, marks );
+            for ( unsigned int i = 0; i < RANGE; i++ ) {
+                assert_int_equal( i < counts[c], atomic_load( &marks[i] ) );
+            }
+        }
+    }
+    assert_int_equal( 0, atomic_load( &_errors ) );
+    test_free( marks );
+}
+
+static void parallel_for_nested(void **state) {
+    jtest_t* t = ( jtest_t* ) *state;
+    atomic_int* marks = test_malloc( 100 * 100 * sizeof( atomic_int ) );
+    _nested_jobs = t->jobs;
+    for ( int round = 0; round < NUM_ROUNDS; round++ ) {
+        for ( unsigned int i = 0; i < 100 * 100; i++ ) {
+            atomic_init( &marks[i], 0 );
+        }
+        jobs_parallel_for( t->jobs, 100, 1, nested, marks );
+        for ( unsigned int i = 0; i < 100 * 100; i++ ) {
+            assert_int_equal( 1, atomic_load( &marks[i] ) );
+        }
+    }
+    test_free( marks );
+}
+
+static void single_thread(void **state) {
+    ( void ) state;
+    jobs_t* jobs = jobs_new( 1 );
+    jobs_counter_t counter;
+    jobs_counter_init( &counter );
+    jobs_job_t job = { add_one, NULL, &counter, NULL, NULL };
+    jobs_submit( jobs, &job );
+    jobs_wait( jobs, &counter );
+    assert_int_equal( 1, atomic_load( &_sum ) );
+
+    atomic_int marks[10];
+    for ( int i = 0; i < 10; i++ ) {
+        atomic_init( &marks[i], 0 );
+    }
+    jobs_parallel_for( jobs, 10, 1, mark, marks );
+    for ( int i = 0; i < 10; i++ ) {
+        assert_int_equal( 1, atomic_load( &marks[i] ) );
+    }
+    jobs_free( jobs );
+}
+
+int jobs_test() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown( runs_all_jobs, jobs_setup, jobs_teardown ),
+        cmocka_unit_test_setup_teardown( dependencies, jobs_setup, jobs_teardown ),
+        cmocka_unit_test_setup_teardown( parallel_for_covers_range, jobs_setup, jobs_teardown ),
+        cmocka_unit_test_setup_teardown( parallel_for_nested, jobs_setup, jobs_teardown ),
+        cmocka_unit_test_setup_teardown( single_thread, jobs_setup, jobs_teardown ),
+    };
+
+    return cmocka_run_group_tests( tests, NULL, NULL );
+}
@@ -0,0 +1 @@
+int jobs_test();
@@ -7,17 +7,69 @@
 
 #include <cmocka.h>
 
+#include "../../src/mem.h"
+#include "../../src/fsm.h"
+#include "../../src/tilemap.h"
+#include "../../src/loaders/lvl_loader.h"
+
+// The events of the enemy of the fsm tests
+#define SEE     0
+#define DIE     4
+
 typedef struct {
     char *path;
     float x;
     float y;
     int active;
 } t_data;
- 
+
 t_data t_rec;
 
 FILE *fp;
 
+// The full name of the text asset
+static char _t_rec_name[256];
+
+// An agent logs its actions
+typedef struct {
+    char log[64];
+    unsigned int length;
+} agent_t;
+
+//  ****************************************
+//  Misc functions
+//  ****************************************
+
+static void _log( void* agent, char c ) {
+    agent_t* a = ( agent_t* ) agent;
+    if ( a->length + 1 < sizeof( a->log ) ) {
+        a->log[ a->length++ ] = c;
+        a->log[ a->length ] = '\0';
+    }
+}
+
+// Upper case for the entries, lower case for the exits
+static void enter_alive( void* agent ) { _log( agent, 'A' ); }
+static void exit_alive( void* agent ) { _log( agent, 'a' ); }
+static void enter_patrol( void* agent ) { _log( agent, 'P' ); }
+static void exit_patrol( void* agent ) { _log( agent, 'p' ); }
+static void enter_hunt( void* agent ) { _log( agent, 'H' ); }
+static void exit_hunt( void* agent ) { _log( agent, 'h' ); }
+static void enter_chase( void* agent ) { _log( agent, 'C' ); }
+static void exit_chase( void* agent ) { _log( agent, 'c' ); }
+static void enter_dead( void* agent ) { _log( agent, 'D' ); }
+static void scream( void* agent ) { _log( agent, '!' ); }
+
+static void assert_log( agent_t* agent, const char* expected ) {
+    assert_string_equal( expected, agent->log );
+    agent->length = 0;
+    agent->log[0] = '\0';
+}
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
 static int lvl_loader_setup(void **state) {
     return 0;
 }
@@ -30,7 +82,7 @@ static void read_from_text(void **state) {
     t_rec.path = "hello";
     printf("\nmitä on: %s", t_rec.path);
     t_rec.path = calloc(100, sizeof(char));
-    fp = fopen("./test/assets/t_rec.txt", "r");
+    fp = fopen(_t_rec_name, "r");
     if (fp != NULL) {
         printf("löytyy!");
         fscanf(fp, "%s %f %f %d", t_rec.path, &t_rec.x, &t_rec.y, &t_rec.active);
@@ -44,21 +96,109 @@ static void read_from_text(void **state) {
         fclose(fp);
     }
     fprintf(stderr, "Value of errno: %d\n", errno);
+    free(t_rec.path);
     return;
 }
 
-static void clr(void **state) {
+// ************
+// lvl_load_fsm
+// ************
+
+static void load_fsm_from_level(void **state) {
+    ( void ) state;
+    // The enemy without the attack. The name of the section in a string and
+    // in a nested object does not count.
+    const char* level =
+        "\"version\":\"1.0.1\" \"note\":\"\\\"fsm\\\":{ \\\"initial\\\":7 }\"\n"
+        "\"objects\":[ { \"type\":\"guard\" \"fsm\":{ \"initial\":1 } } ]\n"
+        "\"fsm\":{ \"initial\":0, \"events\":6\n"
+        "    \"states\":[ [ -1 1 0 1 ] [ 0 -1 2 3 ] [ 0 3 4 5 ] [ 2 -1 6 7 ] [ -1 -1 -1 -1 ] [ -1 -1 8 -1 ] ]\n"
+        "    \"transitions\":[ [ 1 0 2 -1 ], [ 2 1 1 -1 ], [ 0 4 5 9 ] ] }\n";
+    const fsm_action_t actions[] = {
+        enter_alive, exit_alive, enter_patrol, exit_patrol, enter_hunt,
+        exit_hunt, enter_chase, exit_chase, enter_dead, scream,
+    };
+    fsm_machine_t* machine = lvl_load_fsm( level, actions, 10 );
+    assert_non_null( machine );
+
+    agent_t agent = { { 0 }, 0 };
+    fsm_t fsm;
+    fsm_start( machine, &fsm, &agent );
+    assert_log( &agent, "AP" );
+    fsm_dispatch( machine, &fsm, SEE, &agent );
+    assert_log( &agent, "pHC" );
+    fsm_dispatch( machine, &fsm, DIE, &agent );
+    assert_log( &agent, "cha!D" );
+    fsm_free( machine );
+
+    // An action out of range, a state out of range and a broken section
+    assert_null( lvl_load_fsm( level, actions, 9 ) );
+    assert_null( lvl_load_fsm( "\"fsm\":{ \"initial\":0 \"events\":1 \"states\":[ [ -1 -1 -1 -1 ] ]"
+        " \"transitions\":[ [ 0 0 1 -1 ] ] }", actions, 10 ) );
+    assert_null( lvl_load_fsm( "\"fsm\":{ \"initial\":0 \"states\":[ [ -1 -1 ] ] }", actions, 10 ) );
+    assert_null( lvl_load_fsm( "\"fsm\":{ \"initial\":0 \"events\":1 \"states\":[ [ -1 -1 -1 -1 ]",
+        actions, 10 ) );
+    assert_null( lvl_load_fsm( "\"version\":\"1.0.1\"", actions, 10 ) );
+}
+
+// ****************
+// lvl_load_tilemap
+// ****************
+
+static void load_tilemap_from_level(void **state) {
+    ( void ) state;
+    // The name of the section in a string and in a nested object does not
+    // count, and the unknown members are skipped.
+    const char* level =
+        "\"version\":\"1.0.1\" \"title\":\"\\\"tilemap\\\":{ }\"\n"
+        "\"objects\":[ { \"tilemap\":{ \"tile\":4 \"rows\":[ \"#\" ] } } ]\n"
+        "\"tilemap\":{\n"
+        "\t\"name\":\"walls\" \"spawn\":{ \"x\":1 }\n"
+        "\t\"x\":-16 \"y\":32, \"tile\":8\n"
+        "\t\"rows\":[ \"#####\" \"#...#\"\n"
+        "\t\t\"#..##\" ]\n"
+        "}\n";
+    tilemap_t* map = lvl_load_tilemap( level );
+    assert_non_null( map );
+    assert_int_equal( 5, map->width );
+    assert_int_equal( 3, map->height );
+    assert_int_equal( -16, map->x0 );
+    assert_int_equal( 32, map->y0 );
+    assert_int_equal( 3, map->tile_bits );
+    assert_true( tilemap_get( map, 0, 0 ) );
+    assert_true( tilemap_get( map, 4, 1 ) );
+    assert_false( tilemap_get( map, 1, 1 ) );
+    assert_false( tilemap_get( map, 2, 2 ) );
+    assert_true( tilemap_get( map, 3, 2 ) );
+    tilemap_free( map );
+
+    // The biggest tile
+    map = lvl_load_tilemap( "\"tilemap\":{ \"x\":-1073741824 \"tile\":1073741824 \"rows\":[ \"##\" ] }" );
+    assert_non_null( map );
+    assert_int_equal( TILEMAP_MAX_TILE_BITS, map->tile_bits );
+    tilemap_free( map );
+
+    // No section, a tile that is not a power of two, unequal rows
+    assert_null( lvl_load_tilemap( "\"version\":\"1.0.1\"" ) );
+    assert_null( lvl_load_tilemap( "\"tilemap\":{ \"tile\":12 \"rows\":[ \"#\" ] }" ) );
+    // A tile or a map too big for the world
+    assert_null( lvl_load_tilemap( "\"tilemap\":{ \"tile\":1099511627776 \"rows\":[ \"#\" ] }" ) );
+    assert_null( lvl_load_tilemap( "\"tilemap\":{ \"tile\":2147483648 \"rows\":[ \"#\" ] }" ) );
+    assert_null( lvl_load_tilemap( "\"tilemap\":{ \"tile\":1073741824 \"rows\":[ \"##\" ] }" ) );
+    assert_null( lvl_load_tilemap( "\"tilemap\":{ \"y\":2147483647 \"tile\":1 \"rows\":[ \"#\" ] }" ) );
+    assert_null( lvl_load_tilemap( "\"tilemap\":{ \"tile\":8 \"rows\":[ \"#\" \"##\" ] }" ) );
+    assert_null( lvl_load_tilemap( "\"tilemap\":{ \"tile\":8 \"rows\":[ \"#\" " ) );
 }
 
 int lvl_loader_test(char *assets) {
-    // Full file name
-    char full_name[256];
-    strcpy(full_name, assets);
-    strcat(full_name, "t_rec.txt");
-    printf("%s", full_name);
+    // Full file name. Without -d the assets are looked up from the root of
+    // the repository.
+    snprintf(_t_rec_name, sizeof(_t_rec_name), "%st_rec.txt", assets ? assets : "./test/assets/");
 
     const struct CMUnitTest tests[] = {
         cmocka_unit_test_setup_teardown( read_from_text, lvl_loader_setup, lvl_loader_teardown ),
+        cmocka_unit_test_setup_teardown( load_fsm_from_level, lvl_loader_setup, lvl_loader_teardown ),
+        cmocka_unit_test_setup_teardown( load_tilemap_from_level, lvl_loader_setup, lvl_loader_teardown ),
     };
 
     return cmocka_run_group_tests( tests, NULL, NULL );
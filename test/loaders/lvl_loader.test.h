@@ -1 +1 @@
-void lvl_loader_test(char *assets);
\ No newline at end of file
+int lvl_loader_test(char *assets);
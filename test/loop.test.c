@@ -0,0 +1,326 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include "../src/game.h"
+
+// One step at 50 Hz
+#define STEP_MS 20
+#define NUM_OBJS 8
+
+typedef struct {
+    game_obj_t objs[ NUM_OBJS ];
+} ltest_t;
+
+//  ****************************************
+//  Misc functions
+//  ****************************************
+
+static unsigned int _updates = 0;
+static unsigned int _batches = 0;
+static unsigned int _batched = 0;
+static game_obj_t* _first = NULL;
+static int _seen_x = 0;
+
+static int update( int dt ) {
+    ( void ) dt;
+    _updates++;
+    return 0;
+}
+
+static void batch( game_obj_t** objs, unsigned int count, int dt ) {
+    ( void ) dt;
+    _batches++;
+    _batched += count;
+    _first = objs[0];
+}
+
+// Reads the published state in the middle of a frame
+static void read_state( game_obj_t** objs, unsigned int count, int dt ) {
+    ( void ) objs;
+    ( void ) count;
+    ( void ) dt;
+    unsigned int num_states;
+    _seen_x = loop_body_states( &num_states )[0].x;
+}
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
+static int loop_setup(void **state) {
+    ltest_t *test_struct = test_malloc( sizeof( ltest_t ) );
+    for ( int i = 0; i < NUM_OBJS; i++ ) {
+        game_obj_t* obj = &test_struct->objs[i];
+        obj->type = i % 2;
+        obj->update = update;
+    }
+    _updates = 0;
+    _batches = 0;
+    _batched = 0;
+    _first = NULL;
+    init();
+    *state = test_struct;
+    return 0;
+}
+
+static int loop_teardown(void **state) {
+    quit();
+    test_free( *state );
+    return 0;
+}
+
+// ********
+// loop_add
+// ********
+
+static void add_and_remove_are_deferred(void **state) {
+    ltest_t* t = ( ltest_t* ) *state;
+    loop_add( &t->objs[0] );
+    loop_add( &t->objs[2] );
+    assert_int_equal( 0, loop_type_stats( 0 )->count );
+
+    // The objects join after the frame.
+    loop( STEP_MS );
+    assert_int_equal( 0, _updates );
+    assert_int_equal( 2, loop_type_stats( 0 )->count );
+    loop( STEP_MS );
+    assert_int_equal( 2, _updates );
+
+    // The removed object is still updated in the frame of the removal.
+    loop_remove( &t->objs[0] );
+    loop( STEP_MS );
+    assert_int_equal( 4, _updates );
+    assert_int_equal( 1, loop_type_stats( 0 )->count );
+    loop( STEP_MS );
+    assert_int_equal( 5, _updates );
+
+    // Added and removed within a frame, it is never updated.
+    loop_add( &t->objs[4] );
+    loop_remove( &t->objs[4] );
+    loop( STEP_MS );
+    loop( STEP_MS );
+    assert_int_equal( 7, _updates );
+
+    // Removed twice, or removed after a change of the type, the object
+    // leaves the bucket that it joined.
+    loop_remove( &t->objs[2] );
+    loop_remove( &t->objs[2] );
+    loop_add( &t->objs[6] );
+    loop( STEP_MS );
+    assert_int_equal( 1, loop_type_stats( 0 )->count );
+    t->objs[6].type = 1;
+    loop_remove( &t->objs[6] );
+    loop( STEP_MS );
+    assert_int_equal( 0, loop_type_stats( 0 )->count );
+    assert_int_equal( 0, loop_type_stats( 1 )->count );
+}
+
+// **********
+// loop_spawn
+// **********
+
+static void spawned_objects_are_pooled(void **state) {
+    ( void ) state;
+    int handle = loop_spawn();
+    assert_true( handle != GAME_FULL );
+    game_obj_t* obj = loop_obj( handle );
+    assert_non_null( obj );
+    obj->type = 1;
+    obj->update = update;
+    loop( STEP_MS );
+    assert_int_equal( 1, loop_type_stats( 1 )->count );
+    unsigned int count;
+    assert_int_equal( handle, loop_obj_states( &count )[0].handle );
+
+    // The handle resolves until the end of the frame of the despawn.
+    assert_int_equal( GAME_SUCCESS, loop_despawn( handle ) );
+    assert_ptr_equal( obj, loop_obj( handle ) );
+    loop( STEP_MS );
+    assert_int_equal( 1, _updates );
+    assert_int_equal( 0, loop_type_stats( 1 )->count );
+    assert_null( loop_obj( handle ) );
+    assert_int_equal( GAME_STALE, loop_despawn( handle ) );
+
+    // The slot is recycled under a new handle.
+    int again = loop_spawn();
+    assert_int_not_equal( handle, again );
+    assert_ptr_equal( obj, loop_obj( again ) );
+    assert_null( obj->update );
+    assert_null( loop_obj( handle ) );
+
+    obj->type = 1;
+    loop( STEP_MS );
+    assert_int_equal( again, loop_obj_states( &count )[0].handle );
+
+    // An object that takes the place of another with the same fields is
+    // published.
+    assert_int_equal( GAME_SUCCESS, loop_despawn( again ) );
+    int other = loop_spawn();
+    loop_obj( other )->type = 1;
+    loop( STEP_MS );
+    assert_int_equal( other, loop_obj_states( &count )[0].handle );
+
+    // Despawned after a change of the type, the object leaves its bucket
+    // before its slot is released.
+    loop_obj( other )->type = 0;
+    assert_int_equal( GAME_SUCCESS, loop_despawn( other ) );
+    loop( STEP_MS );
+    assert_int_equal( 0, loop_type_stats( 1 )->count );
+    assert_null( loop_obj( other ) );
+
+    // The pool is fixed.
+    for ( int i = 0; i < GAME_MAX_OBJECTS; i++ ) {
+        assert_true( loop_spawn() != GAME_FULL );
+    }
+    assert_int_equal( GAME_FULL, loop_spawn() );
+}
+
+// **************
+// loop_set_batch
+// **************
+
+static void batch_per_type(void **state) {
+    ltest_t* t = ( ltest_t* ) *state;
+    for ( int i = 0; i < NUM_OBJS; i++ ) {
+        loop_add( &t->objs[i] );
+    }
+    loop_set_batch( 1, batch );
+    loop( STEP_MS );
+
+    // Two steps: the type 0 is updated object by object, the type 1 in
+    // one call per step.
+    loop( 2 * STEP_MS );
+    assert_int_equal( NUM_OBJS, _updates );
+    assert_int_equal( 2, _batches );
+    assert_int_equal( NUM_OBJS, _batched );
+    assert_ptr_equal( &t->objs[1], _first );
+
+    const game_type_stats_t* stats = loop_type_stats( 1 );
+    assert_int_equal( NUM_OBJS / 2, stats->count );
+    assert_int_equal( 2, stats->batches );
+    assert_true( stats->total_ns >= stats->frame_ns );
+    assert_int_equal( 2, loop_type_stats( 0 )->batches );
+    // The empty types are skipped.
+    assert_int_equal( 0, loop_type_stats( 2 )->batches );
+}
+
+// ****************
+// loop_body_states
+// ****************
+
+static void states_are_double_buffered(void **state) {
+    ltest_t* t = ( ltest_t* ) *state;
+    physics_body_t body;
+    memset( &body, 0, sizeof( physics_body_t ) );
+    body.w = 4;
+    body.h = 4;
+    body.vx = 3;
+    body.m = 1;
+    int moving = physics_world_add( loop_world(), &body );
+    body.x = 100;
+    body.vx = 0;
+    body.idle = PHYSICS_SLEEP_STEPS;
+    physics_world_add( loop_world(), &body );
+    t->objs[2].x = 7;
+    loop_add( &t->objs[2] );
+    loop_set_batch( 0, read_state );
+
+    unsigned int count;
+    loop_body_states( &count );
+    assert_int_equal( 0, count );
+    loop( STEP_MS );
+    const game_body_state_t* bodies = loop_body_states( &count );
+    assert_int_equal( 2, count );
+    assert_int_equal( loop_world()->objs[ moving ].guid, bodies[ moving ].guid );
+    assert_int_equal( 3, bodies[ moving ].x );
+    assert_int_equal( 100, bodies[ 1 - moving ].x );
+    const game_obj_state_t* objs = loop_obj_states( &count );
+    assert_int_equal( 1, count );
+    assert_int_equal( 7, objs[0].x );
+
+    // The frame reads the state of the previous frame while it moves the
+    // body; the state is published at its end. Only the moving body is
+    // copied forward after that.
+    loop( STEP_MS );
+    assert_int_equal( 3, _seen_x );
+    bodies = loop_body_states( &count );
+    assert_int_equal( 6, bodies[ moving ].x );
+    assert_int_equal( 6, loop_world()->bodies[ moving ].x );
+    t->objs[2].x = 8;
+    loop( STEP_MS );
+    assert_int_equal( 9, loop_body_states( &count )[ moving ].x );
+    assert_int_equal( 8, loop_obj_states( &count )[0].x );
+
+    // A sleeping body that is moved by the game is published.
+    loop_world()->bodies[ 1 - moving ].x = 50;
+    loop( STEP_MS );
+    assert_true( physics_is_sleeping( &loop_world()->bodies[ 1 - moving ] ) );
+    assert_int_equal( 50, loop_body_states( &count )[ 1 - moving ].x );
+}
+
+// ****
+// loop
+// ****
+
+static void resting_stack_falls_asleep(void **state) {
+    ( void ) state;
+    physics_body_t body;
+    memset( &body, 0, sizeof( physics_body_t ) );
+    // The static ground and a stack of three boxes on it under gravity
+    body.x = 0;
+    body.y = 100;
+    body.w = 64;
+    body.h = 8;
+    physics_world_add( loop_world(), &body );
+    body.w = 8;
+    body.h = 8;
+    body.ay = 1;
+    body.m = 1;
+    for ( int i = 1; i <= 3; i++ ) {
+        body.y = 100 - 8 * i;
+        physics_world_add( loop_world(), &body );
+    }
+
+    // The solver cancels what gravity adds, so the stack comes to rest and
+    // falls asleep.
+    physics_world_t* world = loop_world();
+    for ( int frame = 0; frame < 4 * PHYSICS_SLEEP_STEPS; frame++ ) {
+        loop( STEP_MS );
+    }
+    assert_int_equal( 4, world->num_sleeping );
+    int y[4];
+    for ( unsigned int i = 0; i < world->count; i++ ) {
+        assert_true( physics_is_sleeping( &world->bodies[i] ) );
+        y[i] = world->bodies[i].y;
+    }
+    loop( STEP_MS );
+    for ( unsigned int i = 0; i < world->count; i++ ) {
+        assert_int_equal( y[i], world->bodies[i].y );
+    }
+
+    // Without the ground, the stack wakes up and falls.
+    physics_world_remove( world, world->objs[0].guid );
+    loop( STEP_MS );
+    assert_int_equal( 0, world->num_sleeping );
+    loop( STEP_MS );
+    for ( unsigned int i = 0; i < world->count; i++ ) {
+        assert_false( physics_is_sleeping( &world->bodies[i] ) );
+        assert_true( world->bodies[i].vy > 0 );
+    }
+}
+
+int loop_test() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown( add_and_remove_are_deferred, loop_setup, loop_teardown ),
+        cmocka_unit_test_setup_teardown( batch_per_type, loop_setup, loop_teardown ),
+        cmocka_unit_test_setup_teardown( spawned_objects_are_pooled, loop_setup, loop_teardown ),
+        cmocka_unit_test_setup_teardown( states_are_double_buffered, loop_setup, loop_teardown ),
+        cmocka_unit_test_setup_teardown( resting_stack_falls_asleep, loop_setup, loop_teardown ),
+    };
+
+    return cmocka_run_group_tests( tests, NULL, NULL );
+}
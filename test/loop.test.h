@@ -0,0 +1 @@
+int loop_test();
@@ -7,11 +7,32 @@
 #include <unistd.h>
 #include <cmocka.h>
 
+#include "./data_structures/doubleBuffer.test.h"
 #include "./data_structures/doublyLinkedList.test.h"
+#include "./data_structures/pool.test.h"
 #include "./data_structures/quadTree.test.h"
+#include "./data_structures/snapshotRing.test.h"
 #include "./data_structures/tree.test.h"
 #include "./loaders/lvl_loader.test.h"
+#include "./broadphase.test.h"
+#include "./contacts.test.h"
+#include "./coro.test.h"
+#include "./ecs.test.h"
+#include "./events.test.h"
+#include "./fsm.test.h"
+#include "./headless.test.h"
+#include "./jobs.test.h"
+#include "./loop.test.h"
+#include "./narrowphase.test.h"
+#include "./parsers/sjson.test.h"
 #include "./physics.test.h"
+#include "./profiler.test.h"
+#include "./projectiles.test.h"
+#include "./replay.test.h"
+#include "./scheduler.test.h"
+#include "./solver.test.h"
+#include "./tilemap.test.h"
+#include "./timestep.test.h"
 
 int main(int argc, char* argv[]) {
     opterr = 0;
@@ -45,6 +66,27 @@ int main(int argc, char* argv[]) {
 	dbll_test();
     tree_test();
     qtree_test();
+    snapring_test();
     physics_test();
-	//lvl_loader_test(dirvalue);
+    timestep_test();
+    contacts_test();
+    narrowphase_test();
+    broadphase_test();
+    solver_test();
+    projectiles_test();
+    tilemap_test();
+    ecs_test();
+    loop_test();
+    scheduler_test();
+    jobs_test();
+    events_test();
+    coro_test();
+    fsm_test();
+    pool_test();
+    headless_test();
+    profiler_test();
+    replay_test();
+    double_buffer_test();
+    sjson_test();
+    lvl_loader_test(dirvalue);
 }
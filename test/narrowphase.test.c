@@ -0,0 +1,211 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <cmocka.h>
+
+#include "../src/mem.h"
+#include "../src/narrowphase.h"
+#include "../src/physics.h"
+
+#define NUM_OBJS 101
+#define SEED 1234
+
+typedef struct {
+    physics_world_t* world;
+    physics_pairs_t* pairs;
+    narrowphase_boxes_t* boxes;
+    unsigned int* hits;
+    int isa;
+} ntest_t;
+
+// The instruction sets that are tested against physics_check_two_bodies()
+static const int isas[] = { NARROWPHASE_SCALAR, NARROWPHASE_SSE2, NARROWPHASE_AVX2 };
+#define NUM_ISAS ( sizeof( isas ) / sizeof( isas[0] ) )
+
+//  ****************************************
+//  Misc functions
+//  ****************************************
+
+// Fills the world with the random boxes, so that roughly half of the pairs
+// overlap. Some of the boxes touch, some have negative coordinates.
+static void add_random_boxes( physics_world_t* world, unsigned int count ) {
+    for ( unsigned int i = 0; i < count; i++ ) {
+        physics_body_t body = { 0 };
+        body.x = rand() % 64 - 32;
+        body.y = rand() % 64 - 32;
+        body.w = rand() % 40;
+        body.h = rand() % 40;
+        physics_world_add( world, &body );
+    }
+}
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
+static int narrowphase_setup(void **state) {
+    ntest_t *test_struct = test_malloc( sizeof( ntest_t ) );
+    test_struct->world = physics_world_new( NUM_OBJS );
+    test_struct->pairs = physics_pairs_new( NUM_OBJS * NUM_OBJS );
+    test_struct->boxes = narrowphase_boxes_new( NUM_OBJS );
+    test_struct->hits = test_malloc( NUM_OBJS * NUM_OBJS * sizeof( unsigned int ) );
+    test_struct->isa = narrowphase_isa();
+    srand( SEED );
+    *state = test_struct;
+    return 0;
+}
+
+static int narrowphase_teardown(void **state) {
+    ntest_t *t = ( ntest_t* ) *state;
+    narrowphase_select( t->isa );
+    test_free( t->hits );
+    narrowphase_boxes_free( t->boxes );
+    physics_pairs_free( t->pairs );
+    physics_world_free( t->world );
+    test_free( *state );
+    return 0;
+}
+
+// ******************
+// narrowphase_gather
+// ******************
+
+static void gather_boxes(void **state) {
+    ntest_t* t = ( ntest_t* ) *state;
+    physics_body_t body = { 0 };
+    body.x = -3;
+    body.y = 4;
+    body.w = 10;
+    body.h = 2;
+    physics_world_add( t->world, &body );
+
+    narrowphase_gather( t->boxes, t->world );
+    assert_int_equal( 1, t->boxes->count );
+    assert_int_equal( -3, t->boxes->x0[0] );
+    assert_int_equal( 4, t->boxes->y0[0] );
+    assert_int_equal( 7, t->boxes->x1[0] );
+    assert_int_equal( 6, t->boxes->y1[0] );
+}
+
+// *****************
+// narrowphase_pairs
+// *****************
+
+static void pairs_match_scalar(void **state) {
+    ntest_t* t = ( ntest_t* ) *state;
+    add_random_boxes( t->world, NUM_OBJS );
+    // Every ordered pair, so the count is not a multiple of the width.
+    for ( unsigned int i = 0; i < NUM_OBJS; i++ ) {
+        for ( unsigned int j = 0; j < NUM_OBJS; j++ ) {
+            physics_pairs_push( t->pairs, &t->world->objs[i], &t->world->objs[j] );
+        }
+    }
+    narrowphase_gather( t->boxes, t->world );
+
+    for ( unsigned int v = 0; v < NUM_ISAS; v++ ) {
+        if ( !narrowphase_select( isas[v] ) ) {
+            continue;
+        }
+        unsigned int count = narrowphase_pairs( t->boxes, t->pairs, t->hits );
+        unsigned int n = 0;
+        for ( unsigned int i = 0; i < t->pairs->count; i++ ) {
+            physics_pair_t* pair = &t->pairs->pairs[i];
+            if ( physics_check_two_bodies( pair->obj_0, pair->obj_1 ) ) {
+                assert_true( n < count );
+                assert_int_equal( i, t->hits[ n++ ] );
+            }
+        }
+        assert_int_equal( n, count );
+        // The test data has both outcomes.
+        assert_in_range( count, 1, t->pairs->count - 1 );
+    }
+}
+
+static void pairs_touching_do_not_overlap(void **state) {
+    ntest_t* t = ( ntest_t* ) *state;
+    physics_body_t body = { 0 };
+    body.w = 10;
+    body.h = 10;
+    physics_world_add( t->world, &body );
+    body.x = 10;
+    physics_world_add( t->world, &body );
+    body.x = 9;
+    physics_world_add( t->world, &body );
+    for ( unsigned int i = 0; i < 8; i++ ) {
+        physics_pairs_push( t->pairs, &t->world->objs[0], &t->world->objs[ 1 + i % 2 ] );
+    }
+    narrowphase_gather( t->boxes, t->world );
+
+    for ( unsigned int v = 0; v < NUM_ISAS; v++ ) {
+        if ( !narrowphase_select( isas[v] ) ) {
+            continue;
+        }
+        assert_int_equal( 4, narrowphase_pairs( t->boxes, t->pairs, t->hits ) );
+        assert_int_equal( 1, t->hits[0] );
+        assert_int_equal( 7, t->hits[3] );
+    }
+}
+
+// ***********************
+// narrowphase_one_vs_many
+// ***********************
+
+static void one_vs_many_matches_scalar(void **state) {
+    ntest_t* t = ( ntest_t* ) *state;
+    unsigned int others[ NUM_OBJS ];
+    add_random_boxes( t->world, NUM_OBJS );
+    narrowphase_gather( t->boxes, t->world );
+    // The others in the reverse order
+    for ( unsigned int i = 0; i < NUM_OBJS; i++ ) {
+        others[i] = NUM_OBJS - 1 - i;
+    }
+
+    for ( unsigned int v = 0; v < NUM_ISAS; v++ ) {
+        if ( !narrowphase_select( isas[v] ) ) {
+            continue;
+        }
+        for ( unsigned int index = 0; index < NUM_OBJS; index++ ) {
+            for ( unsigned int count = 0; count < NUM_OBJS; count += 13 ) {
+                unsigned int hits = narrowphase_one_vs_many( t->boxes, index, others, count, t->hits );
+                unsigned int n = 0;
+                for ( unsigned int i = 0; i < count; i++ ) {
+                    if ( physics_check_two_bodies( &t->world->objs[ index ], &t->world->objs[ others[i] ] ) ) {
+                        assert_true( n < hits );
+                        assert_int_equal( others[i], t->hits[ n++ ] );
+                    }
+                }
+                assert_int_equal( n, hits );
+            }
+        }
+    }
+}
+
+// ******************
+// narrowphase_select
+// ******************
+
+static void select_keeps_the_supported(void **state) {
+    ntest_t* t = ( ntest_t* ) *state;
+    // The default is the widest supported one, and scalar is always there.
+    for ( int isa = t->isa + 1; isa <= NARROWPHASE_AVX2; isa++ ) {
+        assert_false( narrowphase_select( isa ) );
+    }
+    assert_int_equal( t->isa, narrowphase_isa() );
+    assert_true( narrowphase_select( NARROWPHASE_SCALAR ) );
+    assert_int_equal( NARROWPHASE_SCALAR, narrowphase_isa() );
+    assert_false( narrowphase_select( -1 ) );
+    assert_int_equal( NARROWPHASE_SCALAR, narrowphase_isa() );
+}
+
+int narrowphase_test() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown( gather_boxes, narrowphase_setup, narrowphase_teardown ),
+        cmocka_unit_test_setup_teardown( pairs_match_scalar, narrowphase_setup, narrowphase_teardown ),
+        cmocka_unit_test_setup_teardown( pairs_touching_do_not_overlap, narrowphase_setup, narrowphase_teardown ),
+        cmocka_unit_test_setup_teardown( one_vs_many_matches_scalar, narrowphase_setup, narrowphase_teardown ),
+        cmocka_unit_test_setup_teardown( select_keeps_the_supported, narrowphase_setup, narrowphase_teardown ),
+    };
+
+    return cmocka_run_group_tests( tests, NULL, NULL );
+}
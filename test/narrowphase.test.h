@@ -0,0 +1 @@
+int narrowphase_test();
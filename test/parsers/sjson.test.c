@@ -0,0 +1,334 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <cmocka.h>
+
+#include "../../src/parsers/sjson.h"
+
+#define ASSET "./test/assets/json_test.txt"
+#define MAX_TOKENS 256
+#define MAX_TEXT 64
+
+typedef struct {
+    sjson_token_t tokens[ MAX_TOKENS ];
+    char texts[ MAX_TOKENS ][ MAX_TEXT ];
+    unsigned int count;
+    // The handler stops at this token, or never if zero
+    unsigned int stop_at;
+} sjtest_t;
+
+//  ****************************************
+//  Misc functions
+//  ****************************************
+
+static int collect( void* user, const sjson_token_t* token, const char* text ) {
+    sjtest_t* t = ( sjtest_t* ) user;
+    assert_true( t->count < MAX_TOKENS );
+    t->tokens[ t->count ] = *token;
+    size_t length = token->length < MAX_TEXT - 1 ? token->length : MAX_TEXT - 1;
+    memcpy( t->texts[ t->count ], text, length );
+    t->texts[ t->count ][ length ] = '\0';
+    t->count++;
+    return t->stop_at && t->count == t->stop_at;
+}
+
+static char* read_asset( size_t* size ) {
+    FILE* file = fopen( ASSET, "rb" );
+    assert_non_null( file );
+    fseek( file, 0, SEEK_END );
+    long length = ftell( file );
+    fseek( file, 0, SEEK_SET );
+    char* buf = test_malloc( length );
+    *size = fread( buf, 1, length, file );
+    fclose( file );
+    return buf;
+}
+
+// Fills the buffer with the random bytes that the index classifies
+static void random_text( char* buf, size_t size ) {
+    static const char alphabet[] = "\"\"\"\\\\\\{}[]: ,\n\tax1-_+.=\x80";
+    for ( size_t i = 0; i < size; i++ ) {
+        buf[i] = alphabet[ rand() % ( sizeof( alphabet ) - 1 ) ];
+    }
+}
+
+static void assert_same_index( const char* data, size_t size ) {
+    size_t words = ( size + 63 ) / 64 + 1;
+    unsigned long long* index = test_malloc( words * sizeof( unsigned long long ) );
+    unsigned long long* scalar = test_malloc( words * sizeof( unsigned long long ) );
+    memset( index, 0xff, words * sizeof( unsigned long long ) );
+    memset( scalar, 0xff, words * sizeof( unsigned long long ) );
+    sjson_index( data, size, index );
+    sjson_index_scalar( data, size, scalar );
+    // The word after the index is not touched
+    assert_memory_equal( index, scalar, words * sizeof( unsigned long long ) );
+    test_free( scalar );
+    test_free( index );
+}
+
+// Feeds the input in chunks of the size, carrying the unconsumed bytes over
+static int feed_in_chunks( sjtest_t* t, const char* data, size_t size, size_t chunk ) {
+    sjson_parser_t parser;
+    sjson_init( &parser, collect, t );
+    char* buf = test_malloc( size + 1 );
+    size_t pending = 0;
+    size_t read = 0;
+    while ( !parser.error ) {
+        size_t n = size - read < chunk ? size - read : chunk;
+        memcpy( buf + pending, data + read, n );
+        read += n;
+        pending += n;
+        int last = read == size;
+        size_t consumed = sjson_feed( &parser, buf, pending, last );
+        memmove( buf, buf + consumed, pending - consumed );
+        pending -= consumed;
+        if ( last ) {
+            break;
+        }
+    }
+    test_free( buf );
+    return parser.error;
+}
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
+static int sjson_setup(void **state) {
+    sjtest_t *test_struct = test_malloc( sizeof( sjtest_t ) );
+    memset( test_struct, 0, sizeof( sjtest_t ) );
+    *state = test_struct;
+    return 0;
+}
+
+static int sjson_teardown(void **state) {
+    test_free( *state );
+    return 0;
+}
+
+// ***********
+// sjson_parse
+// ***********
+
+static void asset_is_tokenized(void **state) {
+    sjtest_t* t = ( sjtest_t* ) *state;
+    size_t size;
+    char* data = read_asset( &size );
+    assert_int_equal( SJSON_SUCCESS, sjson_parse( data, size, collect, t ) );
+
+    static const int types[] = {
+        SJSON_KEY, SJSON_STRING,
+        SJSON_KEY, SJSON_BEGIN_ARRAY, SJSON_BEGIN_OBJECT,
+        SJSON_KEY, SJSON_STRING, SJSON_KEY, SJSON_STRING, SJSON_KEY, SJSON_NUMBER,
+        SJSON_KEY, SJSON_NUMBER, SJSON_KEY, SJSON_NUMBER, SJSON_KEY, SJSON_NUMBER,
+        SJSON_END_OBJECT, SJSON_END_ARRAY,
+        SJSON_KEY, SJSON_BEGIN_ARRAY, SJSON_KEY, SJSON_NUMBER, SJSON_END_ARRAY,
+    };
+    static const char* texts[] = {
+        "version", "1.0.1",
+        "objects", "[", "{",
+        "type", "attacker", "path", "a.b.c", "x", "1.0",
+        "y", "2.0", "v", "1", "d", "2",
+        "}", "]",
+        "settings", "[", "world_x", "12.0", "]",
+    };
+    unsigned int count = sizeof( types ) / sizeof( types[0] );
+    assert_int_equal( count, t->count );
+    for ( unsigned int i = 0; i < count; i++ ) {
+        assert_int_equal( types[i], t->tokens[i].type );
+        assert_string_equal( texts[i], t->texts[i] );
+        // The slices point into the input.
+        assert_int_equal( strlen( texts[i] ), t->tokens[i].length );
+        assert_memory_equal( texts[i], data + t->tokens[i].offset, t->tokens[i].length );
+    }
+    test_free( data );
+}
+
+static void strings_keep_their_escapes(void **state) {
+    sjtest_t* t = ( sjtest_t* ) *state;
+    const char* text = "\"a\\\"b\" : \"\\\\\" , true null -1e3";
+    assert_int_equal( SJSON_SUCCESS, sjson_parse( text, strlen( text ), collect, t ) );
+    assert_int_equal( 5, t->count );
+    assert_int_equal( SJSON_KEY, t->tokens[0].type );
+    assert_string_equal( "a\\\"b", t->texts[0] );
+    assert_int_equal( SJSON_STRING, t->tokens[1].type );
+    assert_string_equal( "\\\\", t->texts[1] );
+    assert_int_equal( SJSON_LITERAL, t->tokens[2].type );
+    assert_int_equal( SJSON_LITERAL, t->tokens[3].type );
+    assert_int_equal( SJSON_NUMBER, t->tokens[4].type );
+    assert_string_equal( "-1e3", t->texts[4] );
+}
+
+static void errors_are_reported(void **state) {
+    sjtest_t* t = ( sjtest_t* ) *state;
+    static const struct {
+        const char* text;
+        int error;
+        size_t offset;
+    } cases[] = {
+        { "[ 1 }", SJSON_MISMATCH, 4 },
+        { "]", SJSON_MISMATCH, 0 },
+        { "{ \"a\":1", SJSON_UNTERMINATED, 7 },
+        { "\"abc", SJSON_UNTERMINATED, 0 },
+        { "1 : 2", SJSON_BADCHAR, 2 },
+        { "\"a\" = 1", SJSON_BADCHAR, 4 },
+    };
+    for ( unsigned int i = 0; i < sizeof( cases ) / sizeof( cases[0] ); i++ ) {
+        sjson_parser_t parser;
+        sjson_init( &parser, collect, t );
+        t->count = 0;
+        sjson_feed( &parser, cases[i].text, strlen( cases[i].text ), 1 );
+        assert_int_equal( cases[i].error, parser.error );
+        assert_int_equal( cases[i].offset, parser.error_offset );
+    }
+
+    char deep[ SJSON_MAX_DEPTH + 2 ];
+    memset( deep, '[', sizeof( deep ) );
+    t->count = 0;
+    assert_int_equal( SJSON_TOODEEP, sjson_parse( deep, sizeof( deep ), collect, t ) );
+    assert_int_equal( SJSON_MAX_DEPTH, t->count );
+
+    // The handler stops the parsing
+    t->count = 0;
+    t->stop_at = 2;
+    assert_int_equal( SJSON_STOPPED, sjson_parse( "1 2 3", 5, collect, t ) );
+    assert_int_equal( 2, t->count );
+}
+
+// ***********
+// sjson_index
+// ***********
+
+static void index_marks_the_structure(void **state) {
+    ( void ) state;
+    // The escaped quote, the brackets in the string and the rest of the
+    // words are not indexed; the backslash outside the strings is
+    const char* text = "{\"a\\\"[\" : [ true,-1 ] } \\\"";
+    static const size_t marks[] = { 0, 1, 6, 8, 10, 12, 17, 20, 22, 24 };
+    unsigned long long index = 0;
+    sjson_index( text, strlen( text ), &index );
+    unsigned long long expected = 0;
+    for ( unsigned int i = 0; i < sizeof( marks ) / sizeof( marks[0] ); i++ ) {
+        expected |= 1ULL << marks[i];
+    }
+    assert_int_equal( expected, index );
+}
+
+static void index_matches_the_scalar_one(void **state) {
+    ( void ) state;
+    size_t size;
+    char* data = read_asset( &size );
+    assert_same_index( data, size );
+    test_free( data );
+
+    // The runs of backslashes and the strings span the blocks, and the
+    // data starts at every alignment
+    char* buf = test_malloc( 1024 + 64 );
+    srand( 5 );
+    for ( unsigned int round = 0; round < 2000; round++ ) {
+        size_t length = ( size_t ) rand() % 1024;
+        size_t align = round % 64;
+        random_text( buf + align, length );
+        assert_same_index( buf + align, length );
+    }
+    test_free( buf );
+}
+
+// **********
+// sjson_feed
+// **********
+
+static void chunks_give_the_same_tokens(void **state) {
+    sjtest_t* t = ( sjtest_t* ) *state;
+    size_t size;
+    char* data = read_asset( &size );
+    sjtest_t* whole = test_malloc( sizeof( sjtest_t ) );
+    memset( whole, 0, sizeof( sjtest_t ) );
+    assert_int_equal( SJSON_SUCCESS, sjson_parse( data, size, collect, whole ) );
+
+    for ( size_t chunk = 1; chunk <= size; chunk++ ) {
+        t->count = 0;
+        assert_int_equal( SJSON_SUCCESS, feed_in_chunks( t, data, size, chunk ) );
+        assert_int_equal( whole->count, t->count );
+        for ( unsigned int i = 0; i < whole->count; i++ ) {
+            assert_int_equal( whole->tokens[i].type, t->tokens[i].type );
+            assert_int_equal( whole->tokens[i].offset, t->tokens[i].offset );
+            assert_int_equal( whole->tokens[i].length, t->tokens[i].length );
+        }
+        assert_memory_equal( whole->texts, t->texts, sizeof( whole->texts ) );
+    }
+    test_free( whole );
+    test_free( data );
+}
+
+static void long_tokens_span_the_slices(void **state) {
+    sjtest_t* t = ( sjtest_t* ) *state;
+    size_t string = 3 * SJSON_SLICE + 5;
+    size_t word = SJSON_SLICE + 7;
+    size_t size = 0;
+    char* data = test_malloc( 2 * string + word + SJSON_SLICE + 64 );
+    size += ( size_t ) sprintf( data, "\"k\" : \"" );
+    for ( size_t i = 0; i < string; i++ ) {
+        // Escaped quotes and backslashes at every alignment
+        if ( i % 7 == 6 || i % 13 == 0 ) {
+            data[ size++ ] = '\\';
+            data[ size++ ] = i % 7 == 6 ? '"' : '\\';
+        } else {
+            data[ size++ ] = 'x';
+        }
+    }
+    size += ( size_t ) sprintf( data + size, "\" " );
+    memset( data + size, 'w', word );
+    size += word;
+    size += ( size_t ) sprintf( data + size, " [ 1 ] \"z\"" );
+    // The colon of the key is a slice away
+    memset( data + size, ' ', SJSON_SLICE );
+    size += SJSON_SLICE;
+    size += ( size_t ) sprintf( data + size, ":2" );
+
+    static const int types[] = {
+        SJSON_KEY, SJSON_STRING, SJSON_LITERAL, SJSON_BEGIN_ARRAY, SJSON_NUMBER,
+        SJSON_END_ARRAY, SJSON_KEY, SJSON_NUMBER,
+    };
+    unsigned int count = sizeof( types ) / sizeof( types[0] );
+    assert_int_equal( SJSON_SUCCESS, sjson_parse( data, size, collect, t ) );
+    assert_int_equal( count, t->count );
+    for ( unsigned int i = 0; i < count; i++ ) {
+        assert_int_equal( types[i], t->tokens[i].type );
+    }
+    assert_int_equal( 7, t->tokens[1].offset );
+    assert_int_equal( word, t->tokens[2].length );
+    assert_string_equal( "z", t->texts[6] );
+
+    static const size_t chunks[] = { 1000, SJSON_SLICE - 1, SJSON_SLICE + 1, 3 * SJSON_SLICE };
+    for ( unsigned int c = 0; c < sizeof( chunks ) / sizeof( chunks[0] ); c++ ) {
+        sjtest_t* chunked = test_malloc( sizeof( sjtest_t ) );
+        memset( chunked, 0, sizeof( sjtest_t ) );
+        assert_int_equal( SJSON_SUCCESS, feed_in_chunks( chunked, data, size, chunks[c] ) );
+        assert_int_equal( count, chunked->count );
+        for ( unsigned int i = 0; i < count; i++ ) {
+            assert_int_equal( t->tokens[i].type, chunked->tokens[i].type );
+            assert_int_equal( t->tokens[i].offset, chunked->tokens[i].offset );
+            assert_int_equal( t->tokens[i].length, chunked->tokens[i].length );
+        }
+        test_free( chunked );
+    }
+    test_free( data );
+}
+
+int sjson_test() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown( asset_is_tokenized, sjson_setup, sjson_teardown ),
+        cmocka_unit_test_setup_teardown( strings_keep_their_escapes, sjson_setup, sjson_teardown ),
+        cmocka_unit_test_setup_teardown( errors_are_reported, sjson_setup, sjson_teardown ),
+        cmocka_unit_test_setup_teardown( index_marks_the_structure, sjson_setup, sjson_teardown ),
+        cmocka_unit_test_setup_teardown( index_matches_the_scalar_one, sjson_setup, sjson_teardown ),
+        cmocka_unit_test_setup_teardown( chunks_give_the_same_tokens, sjson_setup, sjson_teardown ),
+        cmocka_unit_test_setup_teardown( long_tokens_span_the_slices, sjson_setup, sjson_teardown ),
+    };
+
+    return cmocka_run_group_tests( tests, NULL, NULL );
+}
@@ -0,0 +1 @@
+int sjson_test();
@@ -6,6 +6,7 @@
 
 #include "../src/mem.h"
 #include "../src/physics.h"
+#include "../src/timestep.h"
 
 typedef struct {
     physics_obj_t* p;
@@ -44,9 +45,476 @@ static void physics_ok(void **state) {
     assert_int_equal( 0, 0 );
 }
 
+// ************
+// physics_step
+// ************
+
+static void step_integrates_bodies(void **state) {
+    physics_world_t* world = physics_world_new( 2 );
+    physics_body_t body = { 0 };
+    body.x = 10;
+    body.vx = 2;
+    body.ay = 1;
+
+    assert_int_equal( 0, physics_world_add( world, &body ) );
+    assert_int_equal( 1, physics_world_add( world, &body ) );
+    assert_int_equal( PHYSICS_FULL, physics_world_add( world, &body ) );
+
+    physics_step( world );
+    assert_int_equal( 12, world->bodies[0].x );
+    assert_int_equal( 1, world->bodies[0].y );
+    physics_step( world );
+    assert_int_equal( 14, world->bodies[1].x );
+    assert_int_equal( 3, world->bodies[1].y );
+    assert_int_equal( 12, world->prev[1].x );
+    assert_int_equal( 2, world->step );
+
+    physics_world_free( world );
+}
+
+// ********************
+// physics_world_remove
+// ********************
+
+static void removed_guids_go_stale(void **state) {
+    physics_world_t* world = physics_world_new( 3 );
+    physics_body_t body = { 0 };
+    for ( int i = 0; i < 3; i++ ) {
+        body.x = i;
+        physics_world_add( world, &body );
+    }
+    int first = world->objs[0].guid;
+    int last = world->objs[2].guid;
+    assert_ptr_equal( &world->objs[2], physics_world_find( world, last ) );
+
+    // The last body takes the index of the removed one and keeps its guid.
+    assert_int_equal( PHYSICS_SUCCESS, physics_world_remove( world, first ) );
+    assert_int_equal( 2, world->count );
+    assert_null( physics_world_find( world, first ) );
+    assert_int_equal( PHYSICS_STALE, physics_world_remove( world, first ) );
+    physics_obj_t* obj = physics_world_find( world, last );
+    assert_ptr_equal( &world->objs[0], obj );
+    assert_int_equal( 0, obj->index );
+    assert_ptr_equal( &world->bodies[0], obj->body );
+    assert_int_equal( 2, obj->body->x );
+
+    // The slot is reused under a new guid; the old one stays stale.
+    body.x = 3;
+    assert_int_equal( 2, physics_world_add( world, &body ) );
+    assert_int_not_equal( first, world->objs[2].guid );
+    assert_null( physics_world_find( world, first ) );
+    assert_int_equal( 3, physics_world_find( world, world->objs[2].guid )->body->x );
+    assert_null( physics_world_find( world, POOL_NONE ) );
+
+    physics_world_free( world );
+}
+
+static void interpolate_between_steps(void **state) {
+    physics_world_t* world = physics_world_new( 1 );
+    physics_body_t body = { 0 };
+    body.vx = 8;
+    body.vy = -8;
+    physics_world_add( world, &body );
+    physics_step( world );
+
+    int x;
+    int y;
+    physics_interpolate( world, 0, 0, &x, &y );
+    assert_int_equal( 0, x );
+    assert_int_equal( 0, y );
+    physics_interpolate( world, 0, TIMESTEP_ALPHA_ONE / 4, &x, &y );
+    assert_int_equal( 2, x );
+    assert_int_equal( -2, y );
+    physics_interpolate( world, 0, TIMESTEP_ALPHA_ONE, &x, &y );
+    assert_int_equal( 8, x );
+    assert_int_equal( -8, y );
+
+    physics_world_free( world );
+}
+
+// *********************************************
+// physics_prev_step and physics_next_step
+// *********************************************
+
+static void step_back_and_forth(void **state) {
+    physics_world_t* world = physics_world_new( 4 );
+    physics_body_t body = { 0 };
+    body.vx = 3;
+    physics_world_add( world, &body );
+    body.vy = -1;
+    physics_world_add( world, &body );
+
+    physics_debug_attach( world, 64, 4096, 8 );
+    for ( int i = 0; i < 20; i++ ) {
+        physics_step( world );
+    }
+    assert_int_equal( 20, physics_current_step() );
+    assert_int_equal( 60, world->bodies[0].x );
+
+    physics_prev_step( 5 );
+    assert_int_equal( 15, physics_current_step() );
+    assert_int_equal( 45, world->bodies[0].x );
+    assert_int_equal( -15, world->bodies[1].y );
+    physics_next_step( 2 );
+    assert_int_equal( 17, world->step );
+    assert_int_equal( 51, world->bodies[1].x );
+
+    // Stepping back past the history stops at the oldest step.
+    physics_prev_step( 100 );
+    assert_int_equal( 0, physics_current_step() );
+    assert_int_equal( 0, world->bodies[0].x );
+    assert_int_equal( 2, world->count );
+
+    // Simulating beyond the history extends it.
+    physics_next_step( 25 );
+    assert_int_equal( 25, physics_current_step() );
+    assert_int_equal( 75, world->bodies[0].x );
+
+    physics_debug_detach();
+    physics_world_free( world );
+}
+
+static void removal_restarts_history(void **state) {
+    physics_world_t* world = physics_world_new( 4 );
+    physics_body_t body = { 0 };
+    body.vx = 1;
+    int first = physics_world_add( world, &body );
+    body.vx = 2;
+    physics_world_add( world, &body );
+    int guid_0 = world->objs[ first ].guid;
+
+    physics_debug_attach( world, 64, 4096, 8 );
+    for ( int i = 0; i < 10; i++ ) {
+        physics_step( world );
+    }
+    physics_world_remove( world, guid_0 );
+    int guid_1 = world->objs[0].guid;
+    physics_step( world );
+
+    // The steps before the removal are gone, so the removed body does not
+    // come back and the guids still find their bodies.
+    physics_prev_step( 5 );
+    assert_int_equal( 10, physics_current_step() );
+    assert_int_equal( 1, world->count );
+    assert_null( physics_world_find( world, guid_0 ) );
+    assert_ptr_equal( &world->bodies[0], physics_world_find( world, guid_1 )->body );
+    assert_int_equal( 20, world->bodies[0].x );
+
+    physics_debug_detach();
+    physics_world_free( world );
+}
+
+// *************
+// Sleeping
+// *************
+
+static void still_body_falls_asleep(void **state) {
+    physics_world_t* world = physics_world_new( 2 );
+    physics_body_t body = { 0 };
+    physics_world_add( world, &body );
+    body.vx = 1;
+    physics_world_add( world, &body );
+
+    for ( int i = 0; i < PHYSICS_SLEEP_STEPS; i++ ) {
+        physics_step( world );
+    }
+    assert_true( physics_is_sleeping( &world->bodies[0] ) );
+    assert_false( physics_is_sleeping( &world->bodies[1] ) );
+    physics_step( world );
+    assert_int_equal( 1, world->num_active );
+    assert_int_equal( 1, world->num_sleeping );
+
+    // A push wakes the body up; it is integrated in the same step.
+    world->bodies[0].vy = 2;
+    physics_step( world );
+    assert_int_equal( 2, world->bodies[0].y );
+    assert_int_equal( 0, world->bodies[0].idle );
+    assert_int_equal( 2, world->num_active );
+
+    // So does an explicit wake up.
+    world->bodies[0].vy = 0;
+    for ( int i = 0; i < PHYSICS_SLEEP_STEPS; i++ ) {
+        physics_step( world );
+    }
+    assert_true( physics_is_sleeping( &world->bodies[0] ) );
+    physics_wake( world, 0 );
+    assert_false( physics_is_sleeping( &world->bodies[0] ) );
+
+    physics_world_free( world );
+}
+
+// ************************
+// physics_check_collisions
+// ************************
+
+static void add_box( physics_world_t* world, int x, int y, int w, int h ) {
+    physics_body_t body = { 0 };
+    body.x = x;
+    body.y = y;
+    body.w = w;
+    body.h = h;
+    physics_world_add( world, &body );
+}
+
+static void check_two_bodies(void **state) {
+    physics_world_t* world = physics_world_new( 3 );
+    add_box( world, 0, 0, 10, 10 );
+    add_box( world, 9, 9, 10, 10 );
+    add_box( world, 10, 0, 10, 10 );
+
+    assert_true( physics_check_two_bodies( &world->objs[0], &world->objs[1] ) );
+    // Touching edges do not overlap.
+    assert_false( physics_check_two_bodies( &world->objs[0], &world->objs[2] ) );
+    assert_true( physics_check_two_bodies( &world->objs[2], &world->objs[1] ) );
+
+    physics_world_free( world );
+}
+
+static void insert_into_smallest_quadrant(void **state) {
+    qtree_t* q = qtree_new();
+    physics_world_t* world = physics_world_new( 3 );
+    // A small box deep in the 1st quadrant, a box over the center and a box
+    // outside of the region.
+    add_box( world, 1, 1, 4, 4 );
+    add_box( world, 500, 500, 50, 50 );
+    add_box( world, -10, 0, 4, 4 );
+
+    tnode_t* node = physics_insert( q, &world->objs[0] );
+    assert_ptr_equal( qtree_get_node( q, q->depth, 0 ), node );
+    assert_ptr_equal( q->tree->root, physics_insert( q, &world->objs[1] ) );
+    assert_ptr_equal( q->tree->root, physics_insert( q, &world->objs[2] ) );
+
+    physics_free_bsp( q );
+    physics_world_free( world );
+}
+
+static void collect_candidate_pairs(void **state) {
+    qtree_t* q = qtree_new();
+    physics_world_t* world = physics_world_new( 8 );
+    physics_pairs_t* pairs = physics_pairs_new( 1 );
+    // Two boxes in the 1st leaf, one in the last leaf and one at the root.
+    add_box( world, 1, 1, 4, 4 );
+    add_box( world, 2, 2, 4, 4 );
+    add_box( world, 1000, 1000, 4, 4 );
+    add_box( world, 500, 500, 50, 50 );
+
+    physics_construct_bsp( q, world );
+    physics_check_collisions( q->tree->root, NULL, pairs );
+    // The root box pairs with everybody; the leaf boxes pair with each other.
+    assert_int_equal( 4, pairs->count );
+
+    // The tree can be rebuilt without losing the pairs. The nodes of the
+    // lists go to the spares of the root and back.
+    physics_clear_bsp( q );
+    physics_bucket_t* root = ( physics_bucket_t* ) q->tree->root->data;
+    unsigned int spare = 0;
+    for ( dblnode_t* node = root->spare; node; node = node->next ) {
+        spare++;
+    }
+    assert_int_equal( 4, spare );
+    physics_construct_bsp( q, world );
+    assert_null( root->spare );
+    pairs->count = 0;
+    physics_check_collisions( q->tree->root, NULL, pairs );
+    assert_int_equal( 4, pairs->count );
+
+    physics_pairs_free( pairs );
+    physics_free_bsp( q );
+    physics_world_free( world );
+}
+
+static void sleeping_pairs_are_skipped(void **state) {
+    qtree_t* q = qtree_new();
+    physics_world_t* world = physics_world_new( 8 );
+    physics_pairs_t* pairs = physics_pairs_new( 1 );
+    add_box( world, 1, 1, 4, 4 );
+    add_box( world, 2, 2, 4, 4 );
+    add_box( world, 3, 3, 4, 4 );
+    world->bodies[0].idle = PHYSICS_SLEEP_STEPS;
+    world->bodies[1].idle = PHYSICS_SLEEP_STEPS;
+
+    physics_construct_bsp( q, world );
+    physics_check_collisions( q->tree->root, NULL, pairs );
+    // Only the pairs with the awake body.
+    assert_int_equal( 2, pairs->count );
+    assert_int_equal( 1, pairs->sleeping );
+
+    physics_pairs_free( pairs );
+    physics_free_bsp( q );
+    physics_world_free( world );
+}
+
+static void layers_reject_pairs(void **state) {
+    qtree_t* q = qtree_new();
+    physics_world_t* world = physics_world_new( 8 );
+    physics_pairs_t* pairs = physics_pairs_new( 1 );
+    // Layers: 0 = ships, 1 = enemy ships, 2 = enemy bullets, 3 = pickups.
+    // All boxes are in the same leaf.
+    for ( int i = 0; i < 6; i++ ) {
+        add_box( world, 1 + i, 1 + i, 4, 4 );
+    }
+    world->objs[0].category = 0x1;
+    world->objs[0].mask = 0x2 | 0x4 | 0x8;
+    world->objs[1].category = 0x2;
+    world->objs[1].mask = 0x1;
+    world->objs[2].category = 0x2;
+    world->objs[2].mask = 0x1;
+    world->objs[3].category = 0x4;
+    world->objs[3].mask = 0x1;
+    world->objs[4].category = 0x4;
+    world->objs[4].mask = 0x1;
+    world->objs[5].category = 0x8;
+    world->objs[5].mask = 0x1;
+
+    physics_construct_bsp( q, world );
+    physics_check_collisions( q->tree->root, NULL, pairs );
+    // Only the ship pairs with the others.
+    assert_int_equal( 5, pairs->count );
+    for ( unsigned int i = 0; i < pairs->count; i++ ) {
+        assert_true( pairs->pairs[i].obj_0 == &world->objs[0]
+            || pairs->pairs[i].obj_1 == &world->objs[0] );
+    }
+    // 15 pairs in total.
+    assert_int_equal( 10, pairs->rejected );
+
+    physics_pairs_free( pairs );
+    physics_free_bsp( q );
+    physics_world_free( world );
+}
+
+static void layers_reject_ancestor_pairs(void **state) {
+    qtree_t* q = qtree_new();
+    physics_world_t* world = physics_world_new( 8 );
+    physics_pairs_t* pairs = physics_pairs_new( 1 );
+    // A wall over the center and pickups in the leaves.
+    add_box( world, 500, 500, 50, 50 );
+    add_box( world, 1, 1, 4, 4 );
+    add_box( world, 1000, 1000, 4, 4 );
+    add_box( world, 1000, 1, 4, 4 );
+    world->objs[0].category = 0x1;
+    world->objs[0].mask = 0x1;
+    for ( int i = 1; i < 4; i++ ) {
+        world->objs[i].category = 0x8;
+        world->objs[i].mask = PHYSICS_MASK_ALL;
+    }
+
+    physics_construct_bsp( q, world );
+    physics_check_collisions( q->tree->root, NULL, pairs );
+    assert_int_equal( 0, pairs->count );
+    assert_int_equal( 3, pairs->rejected );
+
+    physics_pairs_clear( pairs );
+    world->objs[0].mask = PHYSICS_MASK_ALL;
+    physics_check_collisions( q->tree->root, NULL, pairs );
+    assert_int_equal( 3, pairs->count );
+    assert_int_equal( 0, pairs->rejected );
+
+    physics_pairs_free( pairs );
+    physics_free_bsp( q );
+    physics_world_free( world );
+}
+
+// ************************
+// physics_sweep_two_bodies
+// ************************
+
+static void sweep_through_thin_wall(void **state) {
+    physics_world_t* world = physics_world_new( 2 );
+    unsigned int toi = 0;
+    // A bullet that moved from x = 0 to x = 40 and a wall at x = 20.
+    add_box( world, 40, 0, 2, 2 );
+    add_box( world, 20, -10, 2, 20 );
+    world->bodies[0].vx = 40;
+    world->objs[0].flags = PHYSICS_FLAG_FAST;
+
+    assert_false( physics_check_two_bodies( &world->objs[0], &world->objs[1] ) );
+    assert_true( physics_sweep_two_bodies( &world->objs[0], &world->objs[1], &toi ) );
+    // The front edge (x + 2) reaches the wall after 18 units out of 40.
+    assert_int_equal( 18 * PHYSICS_TOI_ONE / 40, toi );
+    // The test is symmetric.
+    assert_true( physics_sweep_two_bodies( &world->objs[1], &world->objs[0], &toi ) );
+    assert_int_equal( 18 * PHYSICS_TOI_ONE / 40, toi );
+
+    // Passing above the wall.
+    world->bodies[0].y = -20;
+    assert_false( physics_sweep_two_bodies( &world->objs[0], &world->objs[1], &toi ) );
+
+    physics_world_free( world );
+}
+
+static void sweep_moving_bodies(void **state) {
+    physics_world_t* world = physics_world_new( 2 );
+    unsigned int toi = 0;
+    // Head-on; the gap of 10 units closes at the speed of 20 units per step.
+    add_box( world, 10, 0, 5, 5 );
+    add_box( world, 5, 0, 5, 5 );
+    world->bodies[0].vx = 10;
+    world->bodies[1].vx = -10;
+    assert_true( physics_sweep_two_bodies( &world->objs[0], &world->objs[1], &toi ) );
+    assert_int_equal( PHYSICS_TOI_ONE / 2, toi );
+
+    // Overlapping already at the beginning of the step.
+    world->bodies[0].x = 0;
+    world->bodies[0].vx = 0;
+    world->bodies[1].x = 2;
+    world->bodies[1].vx = 0;
+    assert_true( physics_sweep_two_bodies( &world->objs[0], &world->objs[1], &toi ) );
+    assert_int_equal( 0, toi );
+
+    // Meeting exactly at the end of the step is not an overlap.
+    world->bodies[0].x = 0;
+    world->bodies[0].vx = 5;
+    world->bodies[1].x = 5;
+    assert_false( physics_sweep_two_bodies( &world->objs[0], &world->objs[1], &toi ) );
+
+    physics_world_free( world );
+}
+
+static void fast_body_uses_swept_bounds(void **state) {
+    qtree_t* q = qtree_new();
+    physics_world_t* world = physics_world_new( 1 );
+    int x0, y0, x1, y1;
+    add_box( world, 150, 10, 4, 4 );
+    world->bodies[0].vx = 80;
+    world->bodies[0].vy = -5;
+
+    physics_bounds( &world->objs[0], &x0, &y0, &x1, &y1 );
+    assert_int_equal( 150, x0 );
+    assert_int_equal( 154, x1 );
+
+    world->objs[0].flags = PHYSICS_FLAG_FAST;
+    physics_bounds( &world->objs[0], &x0, &y0, &x1, &y1 );
+    assert_int_equal( 70, x0 );
+    assert_int_equal( 10, y0 );
+    assert_int_equal( 154, x1 );
+    assert_int_equal( 19, y1 );
+
+    // The sweep crosses the border of the leaves (128 units) in the x axis.
+    tnode_t* node = physics_insert( q, &world->objs[0] );
+    assert_ptr_equal( qtree_get_node( q, 2, 0 ), node );
+
+    physics_free_bsp( q );
+    physics_world_free( world );
+}
+
 int physics_test() {
     const struct CMUnitTest tests[] = {
         cmocka_unit_test_setup_teardown( physics_ok, physics_setup, physics_teardown ),
+        cmocka_unit_test_setup_teardown( step_integrates_bodies, physics_setup, physics_teardown ),
+        cmocka_unit_test_setup_teardown( removed_guids_go_stale, physics_setup, physics_teardown ),
+        cmocka_unit_test_setup_teardown( interpolate_between_steps, physics_setup, physics_teardown ),
+        cmocka_unit_test_setup_teardown( step_back_and_forth, physics_setup, physics_teardown ),
+        cmocka_unit_test_setup_teardown( removal_restarts_history, physics_setup, physics_teardown ),
+        cmocka_unit_test_setup_teardown( check_two_bodies, physics_setup, physics_teardown ),
+        cmocka_unit_test_setup_teardown( insert_into_smallest_quadrant, physics_setup, physics_teardown ),
+        cmocka_unit_test_setup_teardown( collect_candidate_pairs, physics_setup, physics_teardown ),
+        cmocka_unit_test_setup_teardown( still_body_falls_asleep, physics_setup, physics_teardown ),
+        cmocka_unit_test_setup_teardown( sleeping_pairs_are_skipped, physics_setup, physics_teardown ),
+        cmocka_unit_test_setup_teardown( layers_reject_pairs, physics_setup, physics_teardown ),
+        cmocka_unit_test_setup_teardown( layers_reject_ancestor_pairs, physics_setup, physics_teardown ),
+        cmocka_unit_test_setup_teardown( sweep_through_thin_wall, physics_setup, physics_teardown ),
+        cmocka_unit_test_setup_teardown( sweep_moving_bodies, physics_setup, physics_teardown ),
+        cmocka_unit_test_setup_teardown( fast_body_uses_swept_bounds, physics_setup, physics_teardown ),
     };
 
     return cmocka_run_group_tests( tests, NULL, NULL );
@@ -0,0 +1,225 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <cmocka.h>
+
+#include "../src/profiler.h"
+
+#define NUM_THREADS 4
+#define NUM_ZONES 100
+
+typedef struct {
+    FILE* out;
+} proftest_t;
+
+//  ****************************************
+//  Misc functions
+//  ****************************************
+
+// Returns the index of the zone with the name and the parent, or -1
+static int find_zone( const prof_zone_t* zones, unsigned int count, const char* name, int parent ) {
+    for ( unsigned int i = 0; i < count; i++ ) {
+        if ( zones[i].parent == parent && !strcmp( zones[i].name, name ) ) {
+            return ( int ) i;
+        }
+    }
+    return -1;
+}
+
+// Counts the occurrences of the text in the stream
+static unsigned int count_text( FILE* out, const char* text ) {
+    char line[ 256 ];
+    unsigned int count = 0;
+    rewind( out );
+    while ( fgets( line, sizeof( line ), out ) ) {
+        for ( char* c = strstr( line, text ); c; c = strstr( c + 1, text ) ) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static void* record( void* data ) {
+    ( void ) data;
+    for ( int i = 0; i < NUM_ZONES; i++ ) {
+        prof_begin( "worker" );
+        prof_begin( "task" );
+        prof_end();
+        prof_end();
+    }
+    return NULL;
+}
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
+static int profiler_setup(void **state) {
+    proftest_t *test_struct = test_malloc( sizeof( proftest_t ) );
+    test_struct->out = tmpfile();
+    prof_reset();
+    *state = test_struct;
+    return 0;
+}
+
+static int profiler_teardown(void **state) {
+    proftest_t *t = ( proftest_t* ) *state;
+    fclose( t->out );
+    prof_free();
+    test_free( *state );
+    return 0;
+}
+
+// *****************************
+// prof_frame
+// *****************************
+
+static void nested_zones_aggregate(void **state) {
+    ( void ) state;
+    prof_begin( "frame" );
+    for ( int i = 0; i < 3; i++ ) {
+        prof_begin( "physics" );
+        prof_begin( "broadphase" );
+        prof_end();
+        prof_end();
+    }
+    prof_begin( "broadphase" );
+    prof_end();
+    prof_end();
+
+    const prof_zone_t* zones;
+    unsigned int count = prof_frame( &zones );
+    assert_int_equal( 4, count );
+    int frame = find_zone( zones, count, "frame", -1 );
+    int physics = find_zone( zones, count, "physics", frame );
+    int nested = find_zone( zones, count, "broadphase", physics );
+    int direct = find_zone( zones, count, "broadphase", frame );
+    assert_true( frame >= 0 && physics >= 0 && nested >= 0 && direct >= 0 );
+    assert_int_equal( 1, zones[ frame ].count );
+    assert_int_equal( 3, zones[ physics ].count );
+    assert_int_equal( 3, zones[ nested ].count );
+    assert_int_equal( 1, zones[ direct ].count );
+    assert_int_equal( 2, zones[ nested ].depth );
+    assert_true( zones[ frame ].ns >= zones[ physics ].ns );
+    assert_true( zones[ physics ].ns >= zones[ nested ].ns );
+
+    // The events are aggregated once
+    assert_int_equal( 0, prof_frame( &zones ) );
+}
+
+static void open_zones_span_frames(void **state) {
+    ( void ) state;
+    const prof_zone_t* zones;
+    prof_begin( "level" );
+    prof_begin( "load" );
+    assert_int_equal( 2, prof_frame( &zones ) );
+    assert_int_equal( 0, zones[0].count );
+
+    prof_end();
+    prof_begin( "update" );
+    prof_end();
+    prof_end();
+    unsigned int count = prof_frame( &zones );
+    int level = find_zone( zones, count, "level", -1 );
+    assert_true( level >= 0 );
+    assert_int_equal( 1, zones[ level ].count );
+    assert_true( find_zone( zones, count, "load", level ) >= 0 );
+    assert_true( find_zone( zones, count, "update", level ) >= 0 );
+}
+
+static void buffers_are_reused(void **state) {
+    ( void ) state;
+    const prof_zone_t* zones;
+    for ( int frame = 0; frame < 4; frame++ ) {
+        for ( int i = 0; i < PROF_MAX_EVENTS / 4; i++ ) {
+            prof_begin( "zone" );
+            prof_end();
+        }
+        assert_int_equal( 1, prof_frame( &zones ) );
+        assert_int_equal( PROF_MAX_EVENTS / 4, zones[0].count );
+    }
+    assert_int_equal( 0, prof_dropped() );
+}
+
+static void full_buffers_drop_zones(void **state) {
+    proftest_t* t = ( proftest_t* ) *state;
+    prof_capture( 1 );
+    prof_begin( "outer" );
+    for ( int i = 0; i < PROF_MAX_EVENTS; i++ ) {
+        prof_begin( "inner" );
+        prof_begin( "innermost" );
+        prof_end();
+        prof_end();
+    }
+    prof_end();
+    assert_true( prof_dropped() > 0 );
+
+    // Every recorded zone is ended, the outer one included
+    const prof_zone_t* zones;
+    unsigned int count = prof_frame( &zones );
+    int outer = find_zone( zones, count, "outer", -1 );
+    assert_true( outer >= 0 );
+    assert_int_equal( 1, zones[ outer ].count );
+
+    unsigned int written = prof_export( t->out );
+    assert_true( written <= PROF_MAX_EVENTS );
+    assert_int_equal( count_text( t->out, "\"ph\":\"B\"" ), count_text( t->out, "\"ph\":\"E\"" ) );
+}
+
+// *****************************
+// prof_export
+// *****************************
+
+static void threads_record_separately(void **state) {
+    proftest_t* t = ( proftest_t* ) *state;
+    prof_capture( 1 );
+    prof_begin( "main" );
+    pthread_t threads[ NUM_THREADS ];
+    for ( int i = 0; i < NUM_THREADS; i++ ) {
+        pthread_create( &threads[i], NULL, record, NULL );
+    }
+    for ( int i = 0; i < NUM_THREADS; i++ ) {
+        pthread_join( threads[i], NULL );
+    }
+    prof_end();
+
+    // The zones of the threads are roots of their own
+    const prof_zone_t* zones;
+    unsigned int count = prof_frame( &zones );
+    int worker = find_zone( zones, count, "worker", -1 );
+    assert_true( worker >= 0 );
+    assert_int_equal( NUM_THREADS * NUM_ZONES, zones[ worker ].count );
+    assert_int_equal( NUM_THREADS * NUM_ZONES, zones[ find_zone( zones, count, "task", worker ) ].count );
+    assert_int_equal( 1, zones[ find_zone( zones, count, "main", -1 ) ].count );
+
+    unsigned int written = prof_export( t->out );
+    assert_int_equal( 2 + NUM_THREADS * NUM_ZONES * 4, written );
+    assert_int_equal( NUM_THREADS + 1, count_text( t->out, "\"thread_name\"" ) );
+    assert_int_equal( 1 + NUM_THREADS * NUM_ZONES * 2, count_text( t->out, "\"ph\":\"B\"" ) );
+    assert_int_equal( 1 + NUM_THREADS * NUM_ZONES * 2, count_text( t->out, "\"ph\":\"E\"" ) );
+    assert_int_equal( 1, count_text( t->out, "\"traceEvents\":[" ) );
+
+    // The calling thread registered first
+    assert_int_equal( 2, count_text( t->out, "\"tid\":0}" ) );
+    for ( int i = 1; i <= NUM_THREADS; i++ ) {
+        char tid[ 16 ];
+        snprintf( tid, sizeof( tid ), "\"tid\":%d}", i );
+        assert_int_equal( NUM_ZONES * 4, count_text( t->out, tid ) );
+    }
+}
+
+int profiler_test() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown( nested_zones_aggregate, profiler_setup, profiler_teardown ),
+        cmocka_unit_test_setup_teardown( open_zones_span_frames, profiler_setup, profiler_teardown ),
+        cmocka_unit_test_setup_teardown( buffers_are_reused, profiler_setup, profiler_teardown ),
+        cmocka_unit_test_setup_teardown( full_buffers_drop_zones, profiler_setup, profiler_teardown ),
+        cmocka_unit_test_setup_teardown( threads_record_separately, profiler_setup, profiler_teardown ),
+    };
+
+    return cmocka_run_group_tests( tests, NULL, NULL );
+}
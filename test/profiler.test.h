@@ -0,0 +1 @@
+int profiler_test();
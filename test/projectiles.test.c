@@ -0,0 +1,234 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <cmocka.h>
+
+#include "../src/mem.h"
+#include "../src/physics.h"
+#include "../src/projectiles.h"
+#include "../src/data_structures/quad_tree.h"
+
+#define NUM_OBJS 16
+#define NUM_PROJECTILES 20000
+#define SEED 77
+
+typedef struct {
+    qtree_t* q;
+    physics_world_t* world;
+    projectile_pool_t* pool;
+} ptest_t;
+
+//  ****************************************
+//  Misc functions
+//  ****************************************
+
+static int add_box( physics_world_t* world, int x, int y, int w, int h ) {
+    physics_body_t body = { 0 };
+    body.x = x;
+    body.y = y;
+    body.w = w;
+    body.h = h;
+    return physics_world_add( world, &body );
+}
+
+static int find_tag( projectile_pool_t* pool, int tag ) {
+    for ( unsigned int i = 0; i < pool->count; i++ ) {
+        if ( pool->tag[i] == tag ) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
+static int projectiles_setup(void **state) {
+    ptest_t *test_struct = test_malloc( sizeof( ptest_t ) );
+    test_struct->q = qtree_new();
+    test_struct->world = physics_world_new( NUM_OBJS );
+    test_struct->pool = projectiles_new( NUM_PROJECTILES, 4, 2, 0x2, PHYSICS_MASK_ALL );
+    srand( SEED );
+    *state = test_struct;
+    return 0;
+}
+
+static int projectiles_teardown(void **state) {
+    ptest_t *t = ( ptest_t* ) *state;
+    projectiles_free( t->pool );
+    physics_world_free( t->world );
+    physics_free_bsp( t->q );
+    test_free( *state );
+    return 0;
+}
+
+// *****************
+// projectiles_spawn
+// *****************
+
+static void spawn_and_remove(void **state) {
+    ( void ) state;
+    projectile_pool_t* pool = projectiles_new( 3, 1, 1, 0x1, PHYSICS_MASK_ALL );
+    assert_int_equal( 0, projectiles_spawn( pool, 0, 0, 0, 0, 10, 100 ) );
+    assert_int_equal( 1, projectiles_spawn( pool, 1, 0, 0, 0, 10, 101 ) );
+    assert_int_equal( 2, projectiles_spawn( pool, 2, 0, 0, 0, 10, 102 ) );
+    assert_int_equal( PROJECTILES_FULL, projectiles_spawn( pool, 3, 0, 0, 0, 10, 103 ) );
+
+    // The last one takes the place of the removed one.
+    projectiles_remove( pool, 0 );
+    assert_int_equal( 2, pool->count );
+    assert_int_equal( 102, pool->tag[0] );
+    assert_int_equal( 2, pool->x[0] );
+    assert_int_equal( 2, projectiles_spawn( pool, 3, 0, 0, 0, 10, 103 ) );
+
+    projectiles_free( pool );
+}
+
+// ****************
+// projectiles_step
+// ****************
+
+static void step_moves_and_expires(void **state) {
+    ptest_t* t = ( ptest_t* ) *state;
+    // A count that does not fill the vectors
+    for ( int i = 0; i < 13; i++ ) {
+        projectiles_spawn( t->pool, i, -i, i - 6, 2 * i, 1 + i % 3, i );
+    }
+
+    assert_int_equal( 5, projectiles_step( t->pool ) );
+    assert_int_equal( 8, t->pool->count );
+    for ( unsigned int i = 0; i < t->pool->count; i++ ) {
+        int tag = t->pool->tag[i];
+        assert_int_equal( tag + tag - 6, t->pool->x[i] );
+        assert_int_equal( -tag + 2 * tag, t->pool->y[i] );
+        assert_int_equal( tag % 3, t->pool->life[i] );
+    }
+    assert_int_equal( 4, projectiles_step( t->pool ) );
+    assert_int_equal( 4, projectiles_step( t->pool ) );
+    assert_int_equal( 0, t->pool->count );
+}
+
+// *******************
+// projectiles_collide
+// *******************
+
+static void hits_objects_of_all_levels(void **state) {
+    ptest_t* t = ( ptest_t* ) *state;
+    add_box( t->world, 10, 10, 10, 10 );
+    // Over the center of the region, stored at the root
+    add_box( t->world, 500, 500, 40, 40 );
+    // Outside of the region
+    add_box( t->world, -40, 100, 30, 30 );
+    physics_construct_bsp( t->q, t->world );
+
+    projectiles_spawn( t->pool, 6, 10, 0, 0, 10, 1 );    // Touches, no hit
+    projectiles_spawn( t->pool, 19, 19, 0, 0, 10, 2 );   // Hits 0
+    projectiles_spawn( t->pool, 497, 538, 0, 0, 10, 3 ); // Hits 1 over cells
+    projectiles_spawn( t->pool, 530, 540, 0, 0, 10, 4 ); // Touches, no hit
+    projectiles_spawn( t->pool, -5, 0, 0, 0, 10, 5 );    // Outside
+
+    // The root is walked first.
+    assert_int_equal( 2, projectiles_collide( t->pool, t->q ) );
+    assert_int_equal( 3, t->pool->hits[0].tag );
+    assert_int_equal( t->world->objs[1].guid, t->pool->hits[0].guid );
+    assert_int_equal( 2, t->pool->hits[1].tag );
+    assert_int_equal( t->world->objs[0].guid, t->pool->hits[1].guid );
+    // The hits and the outside one are removed.
+    assert_int_equal( 2, t->pool->count );
+    assert_true( find_tag( t->pool, 1 ) >= 0 );
+    assert_true( find_tag( t->pool, 4 ) >= 0 );
+}
+
+static void layers_and_pierce(void **state) {
+    ptest_t* t = ( ptest_t* ) *state;
+    add_box( t->world, 100, 100, 20, 20 );
+    add_box( t->world, 110, 100, 20, 20 );
+    add_box( t->world, 100, 110, 20, 20 );
+    // The 2nd box ignores the layer of the projectiles.
+    t->world->objs[1].mask = 0x1;
+    // The projectiles ignore the layer of the 3rd box.
+    t->world->objs[2].category = 0x4;
+    t->pool->mask = ~0x4u;
+    physics_construct_bsp( t->q, t->world );
+
+    t->pool->flags = PROJECTILES_FLAG_PIERCE;
+    projectiles_spawn( t->pool, 112, 112, 0, 0, 10, 1 );
+    assert_int_equal( 1, projectiles_collide( t->pool, t->q ) );
+    assert_int_equal( t->world->objs[0].guid, t->pool->hits[0].guid );
+    assert_int_equal( 1, t->pool->count );
+
+    // Without the layer filters, the piercing one hits all three.
+    t->world->objs[1].mask = PHYSICS_MASK_ALL;
+    t->pool->mask = PHYSICS_MASK_ALL;
+    assert_int_equal( 3, projectiles_collide( t->pool, t->q ) );
+
+    // Without the pierce, only the first one.
+    t->pool->flags = 0;
+    assert_int_equal( 1, projectiles_collide( t->pool, t->q ) );
+    assert_int_equal( 0, t->pool->count );
+}
+
+static void fast_projectiles_do_not_tunnel(void **state) {
+    ptest_t* t = ( ptest_t* ) *state;
+    // A thin wall and a bullet that crosses it within a step
+    add_box( t->world, 500, 400, 4, 200 );
+    physics_construct_bsp( t->q, t->world );
+    projectiles_spawn( t->pool, 400, 500, 200, 0, 10, 1 );
+    // Another one that stops short of the wall
+    projectiles_spawn( t->pool, 300, 500, 190, 0, 10, 2 );
+    // And one that passes above it
+    projectiles_spawn( t->pool, 400, 390, 200, 0, 10, 3 );
+
+    projectiles_step( t->pool );
+    assert_int_equal( 600, t->pool->x[ find_tag( t->pool, 1 ) ] );
+    assert_int_equal( 1, projectiles_collide( t->pool, t->q ) );
+    assert_int_equal( 1, t->pool->hits[0].tag );
+    assert_int_equal( t->world->objs[0].guid, t->pool->hits[0].guid );
+    assert_int_equal( 2, t->pool->count );
+}
+
+static void matches_brute_force(void **state) {
+    ptest_t* t = ( ptest_t* ) *state;
+    for ( int i = 0; i < NUM_OBJS; i++ ) {
+        add_box( t->world, rand() % 1024, rand() % 1024, 1 + rand() % 200, 1 + rand() % 200 );
+    }
+    physics_construct_bsp( t->q, t->world );
+    t->pool->flags = PROJECTILES_FLAG_PIERCE;
+    for ( int i = 0; i < NUM_PROJECTILES; i++ ) {
+        projectiles_spawn( t->pool, rand() % 1024, rand() % 1024, rand() % 9 - 4, rand() % 9 - 4, 100, i );
+    }
+    projectiles_step( t->pool );
+
+    // The ones that have left the region are not tested. The paths of the
+    // step are swept.
+    unsigned int expected = 0;
+    for ( unsigned int i = 0; i < t->pool->count; i++ ) {
+        if ( t->pool->x[i] < 0 || t->pool->x[i] >= 1024 || t->pool->y[i] < 0 || t->pool->y[i] >= 1024 ) {
+            continue;
+        }
+        for ( unsigned int j = 0; j < t->world->count; j++ ) {
+            physics_body_t* b = &t->world->bodies[j];
+            unsigned int toi;
+            expected += physics_sweep_box( t->pool->x[i] - t->pool->vx[i], t->pool->y[i] - t->pool->vy[i],
+                4, 2, t->pool->vx[i], t->pool->vy[i], b->x, b->y, b->w, b->h, &toi ) != 0;
+        }
+    }
+    unsigned int count = t->pool->count;
+    assert_int_equal( expected, projectiles_collide( t->pool, t->q ) );
+    assert_in_range( t->pool->count, count - 100, count );
+}
+
+int projectiles_test() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown( spawn_and_remove, projectiles_setup, projectiles_teardown ),
+        cmocka_unit_test_setup_teardown( step_moves_and_expires, projectiles_setup, projectiles_teardown ),
+        cmocka_unit_test_setup_teardown( hits_objects_of_all_levels, projectiles_setup, projectiles_teardown ),
+        cmocka_unit_test_setup_teardown( layers_and_pierce, projectiles_setup, projectiles_teardown ),
+        cmocka_unit_test_setup_teardown( fast_projectiles_do_not_tunnel, projectiles_setup, projectiles_teardown ),
+        cmocka_unit_test_setup_teardown( matches_brute_force, projectiles_setup, projectiles_teardown ),
+    };
+
+    return cmocka_run_group_tests( tests, NULL, NULL );
+}
@@ -0,0 +1 @@
+int projectiles_test();
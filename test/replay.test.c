@@ -0,0 +1,169 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <cmocka.h>
+
+#include "../src/mem.h"
+#include "../src/replay.h"
+
+#define NUM_FRAMES 10000
+#define SEED 1357
+#define DT 20
+#define NUM_OBJECTS 250
+#define LEVEL 0xdeadbeef
+
+typedef struct {
+    replay_t* replay;
+    game_input_t* inputs;
+} rptest_t;
+
+//  ****************************************
+//  Misc functions
+//  ****************************************
+
+// Some inputs stay, some change a little and some jump to the extremes
+static void random_input( game_input_t* input, int frame ) {
+    switch ( rand() % 4 ) {
+        case 0:
+            break;
+        case 1:
+            input->buttons ^= 1u << ( rand() % 32 );
+            break;
+        case 2:
+            input->x += rand() % 33 - 16;
+            input->y -= rand() % 33 - 16;
+            break;
+        default:
+            input->x = frame % 2 ? INT_MIN : INT_MAX;
+            input->y = rand() - RAND_MAX / 2;
+            input->buttons = ( unsigned int ) rand();
+            break;
+    }
+}
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
+static int replay_setup(void **state) {
+    rptest_t *test_struct = test_malloc( sizeof( rptest_t ) );
+    test_struct->replay = replay_new( SEED, DT, NUM_OBJECTS, LEVEL );
+    test_struct->inputs = test_malloc( NUM_FRAMES * sizeof( game_input_t ) );
+    srand( SEED );
+    *state = test_struct;
+    return 0;
+}
+
+static int replay_teardown(void **state) {
+    rptest_t *t = ( rptest_t* ) *state;
+    replay_free( t->replay );
+    test_free( t->inputs );
+    test_free( *state );
+    return 0;
+}
+
+// *****************************
+// replay_record and replay_next
+// *****************************
+
+static void frames_round_trip(void **state) {
+    rptest_t* t = ( rptest_t* ) *state;
+    game_input_t input = { 0, 0, 0 };
+    for ( int i = 0; i < NUM_FRAMES; i++ ) {
+        random_input( &input, i );
+        t->inputs[i] = input;
+        replay_record( t->replay, &input, ( unsigned int ) i * 2654435761u );
+    }
+    assert_int_equal( NUM_FRAMES, t->replay->num_frames );
+
+    // Through a copy of the stream, as a file would be read
+    replay_t* copy = replay_open( t->replay->data, t->replay->size );
+    assert_non_null( copy );
+    assert_int_equal( SEED, copy->seed );
+    assert_int_equal( DT, copy->dt );
+    assert_int_equal( NUM_OBJECTS, copy->num_objects );
+    assert_int_equal( LEVEL, copy->level );
+    for ( int pass = 0; pass < 2; pass++ ) {
+        for ( int i = 0; i < NUM_FRAMES; i++ ) {
+            unsigned int checksum;
+            assert_int_equal( REPLAY_SUCCESS, replay_next( copy, &input, &checksum ) );
+            assert_int_equal( t->inputs[i].buttons, input.buttons );
+            assert_int_equal( t->inputs[i].x, input.x );
+            assert_int_equal( t->inputs[i].y, input.y );
+            assert_int_equal( ( unsigned int ) i * 2654435761u, checksum );
+        }
+        assert_int_equal( REPLAY_END, replay_next( copy, &input, NULL ) );
+        assert_int_equal( NUM_FRAMES, copy->frame );
+        replay_rewind( copy );
+    }
+    replay_free( copy );
+}
+
+static void unchanged_input_is_compact(void **state) {
+    rptest_t* t = ( rptest_t* ) *state;
+    game_input_t input = { 0, 0, 0 };
+    for ( int i = 0; i < NUM_FRAMES; i++ ) {
+        replay_record( t->replay, &input, 0 );
+    }
+    assert_int_equal( REPLAY_HEADER_SIZE + 5 * NUM_FRAMES, t->replay->size );
+
+    // A small move costs a byte per axis
+    input.x = -3;
+    input.y = 60;
+    size_t size = t->replay->size;
+    replay_record( t->replay, &input, 0 );
+    assert_int_equal( size + 7, t->replay->size );
+}
+
+static void corrupt_streams_are_rejected(void **state) {
+    rptest_t* t = ( rptest_t* ) *state;
+    game_input_t input = { 0x81, 1000000, -1000000 };
+    replay_record( t->replay, &input, 7 );
+
+    // The header
+    assert_null( replay_open( t->replay->data, REPLAY_HEADER_SIZE - 1 ) );
+    unsigned char header[ REPLAY_HEADER_SIZE ];
+    memcpy( header, t->replay->data, REPLAY_HEADER_SIZE );
+    header[3] = '1';
+    assert_null( replay_open( header, REPLAY_HEADER_SIZE ) );
+    memcpy( header, t->replay->data, REPLAY_HEADER_SIZE );
+    memset( header + 8, 0, 4 );
+    assert_null( replay_open( header, REPLAY_HEADER_SIZE ) );
+
+    // Every cut of the frame
+    for ( size_t size = REPLAY_HEADER_SIZE + 1; size < t->replay->size; size++ ) {
+        replay_t* cut = replay_open( t->replay->data, size );
+        assert_int_equal( REPLAY_CORRUPT, replay_next( cut, &input, NULL ) );
+        replay_free( cut );
+    }
+
+    // Unknown flags
+    t->replay->data[ REPLAY_HEADER_SIZE ] |= 0x80;
+    assert_int_equal( REPLAY_CORRUPT, replay_next( t->replay, &input, NULL ) );
+}
+
+// ***********
+// replay_hash
+// ***********
+
+static void levels_are_hashed(void **state) {
+    ( void ) state;
+    assert_int_equal( REPLAY_NOLEVEL, replay_hash( NULL ) );
+    assert_int_not_equal( REPLAY_NOLEVEL, replay_hash( "" ) );
+    assert_int_equal( replay_hash( "\"tilemap\":{}" ), replay_hash( "\"tilemap\":{}" ) );
+    assert_int_not_equal( replay_hash( "\"tilemap\":{}" ), replay_hash( "\"tilemap\":{ }" ) );
+}
+
+int replay_test() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown( frames_round_trip, replay_setup, replay_teardown ),
+        cmocka_unit_test_setup_teardown( unchanged_input_is_compact, replay_setup, replay_teardown ),
+        cmocka_unit_test_setup_teardown( corrupt_streams_are_rejected, replay_setup, replay_teardown ),
+        cmocka_unit_test_setup_teardown( levels_are_hashed, replay_setup, replay_teardown ),
+    };
+
+    return cmocka_run_group_tests( tests, NULL, NULL );
+}
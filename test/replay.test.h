@@ -0,0 +1 @@
+int replay_test();
@@ -0,0 +1,195 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <cmocka.h>
+
+#include "../src/mem.h"
+#include "../src/scheduler.h"
+
+#define MAX_LOG 64
+
+typedef struct {
+    scheduler_t* s;
+} stest_t;
+
+//  ****************************************
+//  Misc functions
+//  ****************************************
+
+// A fake clock that the tasks advance by their cost
+static unsigned long long _now = 0;
+static int _log[ MAX_LOG ];
+static unsigned int _num_log = 0;
+static scheduler_t* _scheduler = NULL;
+static int _respawn_kind = -1;
+
+static unsigned long long fake_clock() {
+    return _now;
+}
+
+// The data of a task is its cost; the cost is logged
+static void work( void* data ) {
+    int cost = *( int* ) data;
+    _now += cost;
+    if ( _num_log < MAX_LOG ) {
+        _log[ _num_log++ ] = cost;
+    }
+}
+
+static void respawn( void* data ) {
+    work( data );
+    scheduler_submit( _scheduler, _respawn_kind, data );
+}
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
+static int scheduler_setup(void **state) {
+    stest_t *test_struct = test_malloc( sizeof( stest_t ) );
+    test_struct->s = scheduler_new( fake_clock );
+    _now = 0;
+    _num_log = 0;
+    _scheduler = test_struct->s;
+    *state = test_struct;
+    return 0;
+}
+
+static int scheduler_teardown(void **state) {
+    stest_t *t = ( stest_t* ) *state;
+    scheduler_free( t->s );
+    test_free( *state );
+    return 0;
+}
+
+// *************
+// scheduler_run
+// *************
+
+static void defers_over_budget(void **state) {
+    stest_t* t = ( stest_t* ) *state;
+    int cost = 3000;
+    int low = scheduler_kind( t->s, work, SCHEDULER_LOW );
+    for ( int i = 0; i < 3; i++ ) {
+        scheduler_submit( t->s, low, &cost );
+    }
+
+    // The first task has no estimate yet; after it, the others do not fit.
+    assert_int_equal( 1, scheduler_run( t->s, 4000 ) );
+    assert_int_equal( 2, t->s->deferred );
+    assert_int_equal( 3000, t->s->used_ns );
+    assert_int_equal( 1, scheduler_run( t->s, 4000 ) );
+    assert_int_equal( 1, scheduler_run( t->s, 4000 ) );
+    assert_int_equal( 0, scheduler_pending( t->s ) );
+
+    const scheduler_stats_t* stats = scheduler_stats( t->s, low );
+    assert_int_equal( 3, stats->runs );
+    assert_int_equal( 3, stats->deferrals );
+    assert_int_equal( 0 + 1 + 2, stats->total_latency );
+    assert_int_equal( 2, stats->max_latency );
+    assert_int_equal( 3000, stats->estimate_ns );
+}
+
+static void runs_by_priority(void **state) {
+    stest_t* t = ( stest_t* ) *state;
+    int cheap = 1000, dear = 3000, huge = 5000;
+    int low = scheduler_kind( t->s, work, SCHEDULER_LOW );
+    int high = scheduler_kind( t->s, work, SCHEDULER_HIGH );
+    int background = scheduler_kind( t->s, work, SCHEDULER_LOW );
+    int critical = scheduler_kind( t->s, work, SCHEDULER_CRITICAL );
+    // Learn the costs
+    scheduler_submit( t->s, low, &dear );
+    scheduler_submit( t->s, high, &cheap );
+    scheduler_submit( t->s, background, &cheap );
+    scheduler_run( t->s, 100000 );
+    _num_log = 0;
+
+    // The high one runs first although it was submitted last, and the low
+    // one no longer fits.
+    scheduler_submit( t->s, low, &dear );
+    scheduler_submit( t->s, high, &cheap );
+    assert_int_equal( 1, scheduler_run( t->s, 3500 ) );
+    assert_int_equal( 1, _num_log );
+    assert_int_equal( cheap, _log[0] );
+
+    // A cheaper task behind the deferred one still runs.
+    scheduler_submit( t->s, background, &cheap );
+    _num_log = 0;
+    assert_int_equal( 1, scheduler_run( t->s, 1500 ) );
+    assert_int_equal( cheap, _log[0] );
+    assert_int_equal( 2, scheduler_stats( t->s, low )->deferrals );
+
+    // The critical ones run regardless of the budget.
+    scheduler_submit( t->s, critical, &huge );
+    _num_log = 0;
+    assert_int_equal( 1, scheduler_run( t->s, 0 ) );
+    assert_int_equal( huge, _log[0] );
+    assert_int_equal( 1, scheduler_pending( t->s ) );
+}
+
+static void starved_task_runs(void **state) {
+    stest_t* t = ( stest_t* ) *state;
+    int load = 4000, small = 1000;
+    t->s->max_age = 3;
+    int low = scheduler_kind( t->s, work, SCHEDULER_LOW );
+    int high = scheduler_kind( t->s, work, SCHEDULER_HIGH );
+    scheduler_submit( t->s, low, &small );
+    scheduler_submit( t->s, high, &load );
+    scheduler_run( t->s, 100000 );
+
+    // The high load fills the budget of each frame.
+    scheduler_submit( t->s, low, &small );
+    for ( int frame = 0; frame < 3; frame++ ) {
+        scheduler_submit( t->s, high, &load );
+        assert_int_equal( 1, scheduler_run( t->s, 4000 ) );
+    }
+    scheduler_submit( t->s, high, &load );
+    assert_int_equal( 2, scheduler_run( t->s, 4000 ) );
+
+    const scheduler_stats_t* stats = scheduler_stats( t->s, low );
+    assert_int_equal( 3, stats->deferrals );
+    assert_int_equal( 1, stats->starved );
+    assert_int_equal( 3, stats->max_latency );
+}
+
+static void moving_average_cost(void **state) {
+    stest_t* t = ( stest_t* ) *state;
+    int costs[] = { 800, 1600, 100 };
+    int kind = scheduler_kind( t->s, work, SCHEDULER_NORMAL );
+    unsigned long long expected[] = { 800, 900, 800 };
+    for ( int i = 0; i < 3; i++ ) {
+        scheduler_submit( t->s, kind, &costs[i] );
+        scheduler_run( t->s, 100000 );
+        assert_int_equal( expected[i], scheduler_stats( t->s, kind )->estimate_ns );
+        assert_int_equal( costs[i], scheduler_stats( t->s, kind )->last_ns );
+    }
+}
+
+static void submitted_during_frame(void **state) {
+    stest_t* t = ( stest_t* ) *state;
+    int cost = 10;
+    _respawn_kind = scheduler_kind( t->s, respawn, SCHEDULER_NORMAL );
+    scheduler_submit( t->s, _respawn_kind, &cost );
+
+    // Each frame runs the task of the previous frame only.
+    for ( int frame = 0; frame < 20; frame++ ) {
+        assert_int_equal( 1, scheduler_run( t->s, 100000 ) );
+        assert_int_equal( 1, scheduler_pending( t->s ) );
+    }
+    // The tasks of a frame are late by one frame.
+    assert_int_equal( 1, scheduler_stats( t->s, _respawn_kind )->max_latency );
+    assert_int_equal( 19, scheduler_stats( t->s, _respawn_kind )->total_latency );
+}
+
+int scheduler_test() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown( defers_over_budget, scheduler_setup, scheduler_teardown ),
+        cmocka_unit_test_setup_teardown( runs_by_priority, scheduler_setup, scheduler_teardown ),
+        cmocka_unit_test_setup_teardown( starved_task_runs, scheduler_setup, scheduler_teardown ),
+        cmocka_unit_test_setup_teardown( moving_average_cost, scheduler_setup, scheduler_teardown ),
+        cmocka_unit_test_setup_teardown( submitted_during_frame, scheduler_setup, scheduler_teardown ),
+    };
+
+    return cmocka_run_group_tests( tests, NULL, NULL );
+}
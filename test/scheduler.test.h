@@ -0,0 +1 @@
+int scheduler_test();
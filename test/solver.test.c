@@ -0,0 +1,292 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <cmocka.h>
+
+#include "../src/mem.h"
+#include "../src/contacts.h"
+#include "../src/jobs.h"
+#include "../src/physics.h"
+#include "../src/solver.h"
+
+#define NUM_OBJS 64
+#define SEED 99
+
+typedef struct {
+    physics_world_t* world;
+    physics_pairs_t* pairs;
+    contacts_t* cache;
+    solver_t* solver;
+} stest_t;
+
+//  ****************************************
+//  Misc functions
+//  ****************************************
+
+static int add_box( physics_world_t* world, int x, int y, int w, int h,
+        int vx, int vy, unsigned int m ) {
+    physics_body_t body = { 0 };
+    body.x = x;
+    body.y = y;
+    body.w = w;
+    body.h = h;
+    body.vx = vx;
+    body.vy = vy;
+    body.m = m;
+    return physics_world_add( world, &body );
+}
+
+// Feeds all pairs of the world to the cache and groups the islands
+static void collide( stest_t* t ) {
+    physics_pairs_clear( t->pairs );
+    for ( unsigned int i = 0; i < t->world->count; i++ ) {
+        for ( unsigned int j = i + 1; j < t->world->count; j++ ) {
+            physics_pairs_push( t->pairs, &t->world->objs[i], &t->world->objs[j] );
+        }
+    }
+    contacts_update( t->cache, t->world, t->pairs );
+    contacts_islands( t->cache, t->world );
+}
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
+static int solver_setup(void **state) {
+    stest_t *test_struct = test_malloc( sizeof( stest_t ) );
+    test_struct->world = physics_world_new( NUM_OBJS );
+    test_struct->pairs = physics_pairs_new( 4 );
+    test_struct->cache = contacts_new( 4 );
+    test_struct->solver = solver_new( NULL );
+    // No push out of the penetration unless a test asks for it
+    test_struct->solver->baumgarte = 0;
+    srand( SEED );
+    *state = test_struct;
+    return 0;
+}
+
+static int solver_teardown(void **state) {
+    stest_t *t = ( stest_t* ) *state;
+    solver_free( t->solver );
+    contacts_free( t->cache );
+    physics_pairs_free( t->pairs );
+    physics_world_free( t->world );
+    test_free( *state );
+    return 0;
+}
+
+// ************
+// solver_solve
+// ************
+
+static void elastic_collision_swaps_velocities(void **state) {
+    stest_t* t = ( stest_t* ) *state;
+    solver_configure( t->solver, 8, SOLVER_ONE, 0 );
+    add_box( t->world, 0, 0, 10, 10, 5, 0, 2 );
+    add_box( t->world, 8, 0, 10, 10, -5, 0, 2 );
+    collide( t );
+
+    assert_int_equal( 1, solver_solve( t->solver, t->cache, t->world ) );
+    assert_int_equal( -5, t->world->bodies[0].vx );
+    assert_int_equal( 5, t->world->bodies[1].vx );
+    contact_t* contact = contacts_find( t->cache, t->world->objs[0].guid, t->world->objs[1].guid );
+    assert_int_equal( 1, contact->nx );
+    assert_true( contact->impulse_n > 0 );
+}
+
+static void inelastic_collision_stops_bodies(void **state) {
+    stest_t* t = ( stest_t* ) *state;
+    solver_configure( t->solver, 8, 0, 0 );
+    add_box( t->world, 0, 0, 10, 10, 0, 6, 1 );
+    add_box( t->world, 0, 8, 10, 10, 0, 0, 2 );
+    collide( t );
+
+    solver_solve( t->solver, t->cache, t->world );
+    // The momentum is conserved: 1 * 6 = 3 * 2
+    assert_int_equal( 2, t->world->bodies[0].vy );
+    assert_int_equal( 2, t->world->bodies[1].vy );
+}
+
+static void heavy_bodies_are_not_static(void **state) {
+    stest_t* t = ( stest_t* ) *state;
+    solver_configure( t->solver, 8, 0, 0 );
+    add_box( t->world, 0, 0, 10, 10, 0, 6, 1u << 30 );
+    add_box( t->world, 0, 8, 10, 10, 0, 0, 1u << 30 );
+    collide( t );
+
+    // The inverse masses do not truncate to zero.
+    assert_int_equal( 1, solver_solve( t->solver, t->cache, t->world ) );
+    assert_int_equal( 3, t->world->bodies[0].vy );
+    assert_int_equal( 3, t->world->bodies[1].vy );
+}
+
+static void static_body_does_not_move(void **state) {
+    stest_t* t = ( stest_t* ) *state;
+    solver_configure( t->solver, 4, SOLVER_ONE / 2, 0 );
+    add_box( t->world, 0, 0, 10, 10, 8, 0, 1 );
+    add_box( t->world, 9, -50, 10, 100, 0, 0, 0 );
+    collide( t );
+
+    solver_solve( t->solver, t->cache, t->world );
+    assert_int_equal( -4, t->world->bodies[0].vx );
+    assert_int_equal( 0, t->world->bodies[1].vx );
+}
+
+static void friction_slows_sliding(void **state) {
+    stest_t* t = ( stest_t* ) *state;
+    add_box( t->world, 0, 0, 10, 10, 10, 4, 1 );
+    add_box( t->world, -100, 9, 1000, 10, 0, 0, 0 );
+    collide( t );
+
+    // The normal impulse 4 allows the friction impulse 2.
+    solver_configure( t->solver, 4, 0, SOLVER_ONE / 2 );
+    solver_solve( t->solver, t->cache, t->world );
+    assert_int_equal( 0, t->world->bodies[0].vy );
+    assert_int_equal( 8, t->world->bodies[0].vx );
+
+    // Without the friction, the box keeps sliding.
+    t->world->bodies[0].vy = 4;
+    contacts_clear( t->cache );
+    collide( t );
+    solver_configure( t->solver, 4, 0, 0 );
+    solver_solve( t->solver, t->cache, t->world );
+    assert_int_equal( 8, t->world->bodies[0].vx );
+}
+
+static void penetration_is_pushed_out(void **state) {
+    stest_t* t = ( stest_t* ) *state;
+    t->solver->baumgarte = SOLVER_DEFAULT_BAUMGARTE;
+    add_box( t->world, 0, 0, 10, 10, 0, 0, 1 );
+    add_box( t->world, -100, 4, 1000, 10, 0, 0, 0 );
+    collide( t );
+
+    solver_solve( t->solver, t->cache, t->world );
+    // ( 6 - 1 ) / 5 units per step upwards
+    assert_int_equal( -1, t->world->bodies[0].vy );
+}
+
+static void shallow_penetration_adds_up(void **state) {
+    stest_t* t = ( stest_t* ) *state;
+    t->solver->baumgarte = SOLVER_DEFAULT_BAUMGARTE;
+    add_box( t->world, 0, 0, 10, 10, 0, 0, 1 );
+    add_box( t->world, -100, 8, 1000, 10, 0, 0, 0 );
+
+    // ( 2 - 1 ) / 5 units per step rounds to no velocity, but the body is
+    // moved a unit by the 3rd step.
+    for ( int i = 0; i < 3; i++ ) {
+        collide( t );
+        solver_solve( t->solver, t->cache, t->world );
+        assert_int_equal( 0, t->world->bodies[0].vy );
+        assert_int_equal( i < 2 ? 0 : -1, t->world->bodies[0].y );
+    }
+}
+
+static void warm_start_reuses_impulses(void **state) {
+    stest_t* t = ( stest_t* ) *state;
+    add_box( t->world, 0, 0, 10, 10, 0, 3, 1 );
+    add_box( t->world, -100, 9, 1000, 10, 0, 0, 0 );
+    collide( t );
+    solver_solve( t->solver, t->cache, t->world );
+    assert_int_equal( 0, t->world->bodies[0].vy );
+
+    // The box keeps pressing the floor; the cached impulse alone stops it.
+    t->world->bodies[0].vy = 3;
+    collide( t );
+    solver_configure( t->solver, 0, 0, 0 );
+    solver_solve( t->solver, t->cache, t->world );
+    assert_int_equal( 0, t->world->bodies[0].vy );
+
+    // A contact that stops touching is dropped with its impulses.
+    t->world->bodies[0].y = -20;
+    collide( t );
+    assert_int_equal( 0, solver_solve( t->solver, t->cache, t->world ) );
+    assert_null( contacts_find( t->cache, t->world->objs[0].guid, t->world->objs[1].guid ) );
+}
+
+static void sleeping_contacts_are_skipped(void **state) {
+    stest_t* t = ( stest_t* ) *state;
+    add_box( t->world, 0, 0, 10, 10, 0, 0, 1 );
+    add_box( t->world, 0, 9, 10, 10, 0, 0, 1 );
+    t->world->bodies[0].idle = PHYSICS_SLEEP_STEPS;
+    t->world->bodies[1].idle = PHYSICS_SLEEP_STEPS;
+    collide( t );
+
+    assert_int_equal( 0, solver_solve( t->solver, t->cache, t->world ) );
+}
+
+static void batches_follow_islands(void **state) {
+    stest_t* t = ( stest_t* ) *state;
+    // Two stacks on a static floor
+    add_box( t->world, 0, 0, 10, 10, 0, 2, 1 );
+    add_box( t->world, 50, 0, 10, 10, 0, 2, 1 );
+    add_box( t->world, 0, 9, 10, 10, 0, 1, 1 );
+    add_box( t->world, 50, 9, 10, 10, 0, 1, 1 );
+    add_box( t->world, -100, 18, 1000, 10, 0, 0, 0 );
+    collide( t );
+
+    assert_int_equal( 4, solver_solve( t->solver, t->cache, t->world ) );
+    assert_int_equal( 2, t->solver->num_batches );
+    assert_int_equal( 2, t->solver->batches[0].count );
+    assert_int_equal( 2, t->solver->batches[1].count );
+}
+
+static void threads_give_same_result(void **state) {
+    stest_t* t = ( stest_t* ) *state;
+    for ( int i = 0; i < NUM_OBJS; i++ ) {
+        add_box( t->world, rand() % 200, rand() % 200, 5 + rand() % 20, 5 + rand() % 20,
+            rand() % 11 - 5, rand() % 11 - 5, i % 8 ? 1 + rand() % 4 : 0 );
+    }
+    physics_world_t* expected = physics_world_new( NUM_OBJS );
+    for ( int i = 0; i < NUM_OBJS; i++ ) {
+        physics_world_add( expected, &t->world->bodies[i] );
+    }
+    collide( t );
+    solver_configure( t->solver, 8, SOLVER_ONE / 3, SOLVER_ONE / 2 );
+    assert_true( solver_solve( t->solver, t->cache, t->world ) > 0 );
+
+    for ( unsigned int threads = 2; threads <= 8; threads *= 2 ) {
+        physics_world_t* world = t->world;
+        contacts_t* cache = t->cache;
+        t->world = physics_world_new( NUM_OBJS );
+        t->cache = contacts_new( 4 );
+        for ( int i = 0; i < NUM_OBJS; i++ ) {
+            physics_world_add( t->world, &expected->bodies[i] );
+        }
+        jobs_t* jobs = jobs_new( threads );
+        solver_t* solver = solver_new( jobs );
+        solver_configure( solver, 8, SOLVER_ONE / 3, SOLVER_ONE / 2 );
+        solver->baumgarte = 0;
+        collide( t );
+        solver_solve( solver, t->cache, t->world );
+        for ( int i = 0; i < NUM_OBJS; i++ ) {
+            assert_int_equal( world->bodies[i].vx, t->world->bodies[i].vx );
+            assert_int_equal( world->bodies[i].vy, t->world->bodies[i].vy );
+        }
+        solver_free( solver );
+        jobs_free( jobs );
+        contacts_free( t->cache );
+        physics_world_free( t->world );
+        t->world = world;
+        t->cache = cache;
+    }
+    physics_world_free( expected );
+}
+
+int solver_test() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown( elastic_collision_swaps_velocities, solver_setup, solver_teardown ),
+        cmocka_unit_test_setup_teardown( inelastic_collision_stops_bodies, solver_setup, solver_teardown ),
+        cmocka_unit_test_setup_teardown( heavy_bodies_are_not_static, solver_setup, solver_teardown ),
+        cmocka_unit_test_setup_teardown( static_body_does_not_move, solver_setup, solver_teardown ),
+        cmocka_unit_test_setup_teardown( friction_slows_sliding, solver_setup, solver_teardown ),
+        cmocka_unit_test_setup_teardown( penetration_is_pushed_out, solver_setup, solver_teardown ),
+        cmocka_unit_test_setup_teardown( shallow_penetration_adds_up, solver_setup, solver_teardown ),
+        cmocka_unit_test_setup_teardown( warm_start_reuses_impulses, solver_setup, solver_teardown ),
+        cmocka_unit_test_setup_teardown( sleeping_contacts_are_skipped, solver_setup, solver_teardown ),
+        cmocka_unit_test_setup_teardown( batches_follow_islands, solver_setup, solver_teardown ),
+        cmocka_unit_test_setup_teardown( threads_give_same_result, solver_setup, solver_teardown ),
+    };
+
+    return cmocka_run_group_tests( tests, NULL, NULL );
+}
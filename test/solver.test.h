@@ -0,0 +1 @@
+int solver_test();
@@ -0,0 +1,224 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <cmocka.h>
+
+#include "../src/mem.h"
+#include "../src/physics.h"
+#include "../src/tilemap.h"
+
+#define NUM_OBJS 32
+#define WIDTH 200
+#define HEIGHT 8
+#define SEED 36
+
+typedef struct {
+    physics_world_t* world;
+    tilemap_t* map;
+} tmtest_t;
+
+//  ****************************************
+//  Misc functions
+//  ****************************************
+
+static int add_box( physics_world_t* world, int x, int y, int w, int h, int vx, int vy ) {
+    physics_body_t body = { 0 };
+    body.x = x;
+    body.y = y;
+    body.w = w;
+    body.h = h;
+    body.vx = vx;
+    body.vy = vy;
+    body.m = 1;
+    return physics_world_add( world, &body );
+}
+
+// Tests the box tile by tile
+static int brute_force( tilemap_t* map, int x0, int y0, int x1, int y1 ) {
+    int size = 1 << map->tile_bits;
+    for ( int ty = 0; ty < ( int ) map->height; ty++ ) {
+        for ( int tx = 0; tx < ( int ) map->width; tx++ ) {
+            int left = map->x0 + tx * size;
+            int top = map->y0 + ty * size;
+            if ( tilemap_get( map, tx, ty ) && x0 < left + size && left < x1
+                    && y0 < top + size && top < y1 ) {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
+static int tilemap_setup(void **state) {
+    tmtest_t *test_struct = test_malloc( sizeof( tmtest_t ) );
+    test_struct->world = physics_world_new( NUM_OBJS );
+    // Tiles of 16 units, the top-left corner at ( -32, 0 )
+    test_struct->map = tilemap_new( WIDTH, HEIGHT, -32, 0, 4 );
+    srand( SEED );
+    *state = test_struct;
+    return 0;
+}
+
+static int tilemap_teardown(void **state) {
+    tmtest_t *t = ( tmtest_t* ) *state;
+    tilemap_free( t->map );
+    physics_world_free( t->world );
+    test_free( *state );
+    return 0;
+}
+
+// ***********
+// tilemap_set
+// ***********
+
+static void set_and_get(void **state) {
+    tmtest_t* t = ( tmtest_t* ) *state;
+    assert_int_equal( 4, t->map->words_per_row );
+
+    tilemap_set( t->map, 63, 1, 1 );
+    tilemap_set( t->map, 64, 1, 1 );
+    tilemap_set( t->map, 199, 7, 1 );
+    assert_true( tilemap_get( t->map, 63, 1 ) );
+    assert_true( tilemap_get( t->map, 64, 1 ) );
+    assert_true( tilemap_get( t->map, 199, 7 ) );
+    assert_false( tilemap_get( t->map, 65, 1 ) );
+    assert_false( tilemap_get( t->map, 63, 0 ) );
+
+    tilemap_set( t->map, 63, 1, 0 );
+    assert_false( tilemap_get( t->map, 63, 1 ) );
+    assert_true( tilemap_get( t->map, 64, 1 ) );
+
+    // The tiles outside of the map are empty.
+    assert_false( tilemap_get( t->map, -1, 1 ) );
+    assert_false( tilemap_get( t->map, 200, 7 ) );
+    assert_false( tilemap_get( t->map, 0, 8 ) );
+}
+
+// ****************
+// tilemap_overlaps
+// ****************
+
+static void overlaps_across_words(void **state) {
+    tmtest_t* t = ( tmtest_t* ) *state;
+    int tx, ty;
+
+    // The box covers the tiles 60..70 of the row 2, i.e., two words.
+    int x0 = -32 + 60 * 16 + 1, x1 = -32 + 71 * 16 - 1;
+    assert_false( tilemap_overlaps( t->map, x0, 33, x1, 40, &tx, &ty ) );
+    tilemap_set( t->map, 65, 2, 1 );
+    assert_true( tilemap_overlaps( t->map, x0, 33, x1, 40, &tx, &ty ) );
+    assert_int_equal( 65, tx );
+    assert_int_equal( 2, ty );
+    tilemap_set( t->map, 63, 2, 1 );
+    assert_true( tilemap_overlaps( t->map, x0, 33, x1, 40, &tx, &ty ) );
+    assert_int_equal( 63, tx );
+
+    // Touching a solid tile is not overlapping it.
+    assert_false( tilemap_overlaps( t->map, -32 + 64 * 16, 32, -32 + 65 * 16, 48, NULL, NULL ) );
+    assert_true( tilemap_overlaps( t->map, -32 + 64 * 16 - 1, 32, -32 + 65 * 16, 48, NULL, NULL ) );
+    // The boxes outside of the map and the empty boxes hit nothing.
+    assert_false( tilemap_overlaps( t->map, -100, -100, -32, 200, NULL, NULL ) );
+    assert_false( tilemap_overlaps( t->map, x0, 33, x0, 40, NULL, NULL ) );
+}
+
+static void overlaps_matches_brute_force(void **state) {
+    tmtest_t* t = ( tmtest_t* ) *state;
+    for ( unsigned int ty = 0; ty < HEIGHT; ty++ ) {
+        for ( unsigned int tx = 0; tx < WIDTH; tx++ ) {
+            tilemap_set( t->map, tx, ty, rand() % 40 == 0 );
+        }
+    }
+    for ( int i = 0; i < 2000; i++ ) {
+        int x0 = rand() % ( WIDTH * 16 + 64 ) - 64;
+        int y0 = rand() % ( HEIGHT * 16 + 32 ) - 16;
+        int x1 = x0 + 1 + rand() % 1200;
+        int y1 = y0 + 1 + rand() % 40;
+        assert_int_equal( brute_force( t->map, x0, y0, x1, y1 ),
+            tilemap_overlaps( t->map, x0, y0, x1, y1, NULL, NULL ) );
+    }
+}
+
+// *************
+// tilemap_sweep
+// *************
+
+static void sweep_stops_at_thin_wall(void **state) {
+    tmtest_t* t = ( tmtest_t* ) *state;
+    unsigned int toi = 0;
+    int tx, ty;
+
+    // A wall of one tile at x = 32..48
+    for ( unsigned int ty = 0; ty < HEIGHT; ty++ ) {
+        tilemap_set( t->map, 4, ty, 1 );
+    }
+    // The box jumps over the wall in one step: neither end overlaps it.
+    assert_false( tilemap_overlaps( t->map, 8, 20, 16, 28, NULL, NULL ) );
+    assert_false( tilemap_overlaps( t->map, 72, 20, 80, 28, NULL, NULL ) );
+    assert_true( tilemap_sweep( t->map, 8, 20, 8, 8, 64, 0, &toi, &tx, &ty ) );
+    // The right edge meets the wall after 16 units out of 64.
+    assert_int_equal( PHYSICS_TOI_ONE / 4, toi );
+    assert_int_equal( 4, tx );
+    assert_int_equal( 1, ty );
+
+    // Backwards, the box meets the wall after 24 units out of 64.
+    assert_true( tilemap_sweep( t->map, 72, 20, 8, 8, -64, 0, &toi, NULL, NULL ) );
+    assert_int_equal( PHYSICS_TOI_ONE * 3 / 8, toi );
+
+    // The step ends just at the wall.
+    assert_false( tilemap_sweep( t->map, 8, 20, 8, 8, 16, 0, &toi, NULL, NULL ) );
+    // A box that starts in the wall hits it at once.
+    assert_true( tilemap_sweep( t->map, 40, 20, 8, 8, 64, 0, &toi, NULL, NULL ) );
+    assert_int_equal( 0, toi );
+}
+
+// ***************
+// tilemap_collide
+// ***************
+
+static void collide_world(void **state) {
+    tmtest_t* t = ( tmtest_t* ) *state;
+    for ( unsigned int ty = 0; ty < HEIGHT; ty++ ) {
+        tilemap_set( t->map, 4, ty, 1 );
+    }
+    // A slow body that rests in the wall, a fast one that has tunneled
+    // through it and a slow one that is far away
+    int slow = add_box( t->world, 36, 0, 8, 8, 0, 0 );
+    int fast = add_box( t->world, 72, 20, 8, 8, 64, 0 );
+    add_box( t->world, 200, 20, 8, 8, 64, 0 );
+    t->world->objs[ fast ].flags |= PHYSICS_FLAG_FAST;
+    // A static body in the wall is not tested.
+    int wall = add_box( t->world, 32, 64, 16, 16, 0, 0 );
+    t->world->bodies[ wall ].m = 0;
+
+    assert_int_equal( 2, tilemap_collide( t->map, t->world ) );
+    assert_int_equal( t->world->objs[ slow ].guid, t->map->hits[0].guid );
+    assert_int_equal( 0, t->map->hits[0].toi );
+    assert_int_equal( 4, t->map->hits[0].tx );
+    assert_int_equal( 0, t->map->hits[0].ty );
+    assert_int_equal( t->world->objs[ fast ].guid, t->map->hits[1].guid );
+    assert_int_equal( PHYSICS_TOI_ONE / 4, t->map->hits[1].toi );
+    assert_int_equal( 1, t->map->hits[1].ty );
+
+    // The hit buffer grows.
+    for ( int i = 0; i < NUM_OBJS - 4; i++ ) {
+        add_box( t->world, 36, 16 * ( i % HEIGHT ), 4, 4, 0, 0 );
+    }
+    assert_int_equal( NUM_OBJS - 2, tilemap_collide( t->map, t->world ) );
+}
+
+int tilemap_test() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown( set_and_get, tilemap_setup, tilemap_teardown ),
+        cmocka_unit_test_setup_teardown( overlaps_across_words, tilemap_setup, tilemap_teardown ),
+        cmocka_unit_test_setup_teardown( overlaps_matches_brute_force, tilemap_setup, tilemap_teardown ),
+        cmocka_unit_test_setup_teardown( sweep_stops_at_thin_wall, tilemap_setup, tilemap_teardown ),
+        cmocka_unit_test_setup_teardown( collide_world, tilemap_setup, tilemap_teardown ),
+    };
+
+    return cmocka_run_group_tests( tests, NULL, NULL );
+}
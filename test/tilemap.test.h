@@ -0,0 +1 @@
+int tilemap_test();
@@ -0,0 +1,109 @@
+#include <setjmp.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <cmocka.h>
+
+#include "../src/timestep.h"
+
+typedef struct {
+    timestep_t ts;
+} tstest_t;
+
+//  ****************************************
+//   Test Fixtures
+//  ****************************************
+
+static int timestep_setup(void **state) {
+    tstest_t *test_struct = test_malloc( sizeof( tstest_t ) );
+    *state = test_struct;
+    return 0;
+}
+
+static int timestep_teardown(void **state) {
+    test_free( *state );
+    return 0;
+}
+
+// ****************
+// timestep_advance
+// ****************
+
+static void advance_one_step_per_frame(void **state) {
+    timestep_t* ts = &( ( tstest_t* ) *state )->ts;
+    timestep_init( ts, 50, 4 );
+
+    // 50 Hz is 20 ms per step.
+    assert_int_equal( 20, timestep_dt( ts ) );
+    assert_int_equal( 0, timestep_advance( ts, 10 ) );
+    assert_int_equal( TIMESTEP_ALPHA_ONE / 2, timestep_alpha( ts ) );
+    assert_int_equal( 1, timestep_advance( ts, 10 ) );
+    assert_int_equal( 0, timestep_alpha( ts ) );
+    assert_int_equal( 1, timestep_advance( ts, 20 ) );
+    assert_int_equal( 2, ts->steps );
+    assert_int_equal( 0, ts->caught_up );
+    assert_int_equal( 0, ts->dropped );
+}
+
+static void advance_without_rounding_error(void **state) {
+    timestep_t* ts = &( ( tstest_t* ) *state )->ts;
+    timestep_init( ts, 60, 0 );
+
+    // 60 Hz is not an integral number of milliseconds. After one second of
+    // 1 ms frames there must be exactly 60 steps.
+    unsigned int steps = 0;
+    for ( int i = 0; i < 1000; i++ ) {
+        steps += timestep_advance( ts, 1 );
+    }
+    assert_int_equal( 60, steps );
+    assert_int_equal( 0, timestep_alpha( ts ) );
+}
+
+static void advance_catches_up(void **state) {
+    timestep_t* ts = &( ( tstest_t* ) *state )->ts;
+    timestep_init( ts, 50, 4 );
+
+    assert_int_equal( 3, timestep_advance( ts, 65 ) );
+    assert_int_equal( 2, ts->caught_up );
+    assert_int_equal( 0, ts->dropped );
+    assert_int_equal( TIMESTEP_ALPHA_ONE / 4, timestep_alpha( ts ) );
+}
+
+static void advance_drops_steps_over_the_cap(void **state) {
+    timestep_t* ts = &( ( tstest_t* ) *state )->ts;
+    timestep_init( ts, 50, 4 );
+
+    // A spike of 10 steps and a half.
+    assert_int_equal( 4, timestep_advance( ts, 210 ) );
+    assert_int_equal( 3, ts->caught_up );
+    assert_int_equal( 6, ts->dropped );
+    // The fraction is kept.
+    assert_int_equal( TIMESTEP_ALPHA_ONE / 2, timestep_alpha( ts ) );
+    // The next frame is not affected by the spike.
+    assert_int_equal( 1, timestep_advance( ts, 20 ) );
+}
+
+static void set_rate_keeps_the_time(void **state) {
+    timestep_t* ts = &( ( tstest_t* ) *state )->ts;
+    timestep_init( ts, 50, 4 );
+
+    assert_int_equal( 0, timestep_advance( ts, 5 ) );
+    assert_int_equal( TIMESTEP_ALPHA_ONE / 4, timestep_alpha( ts ) );
+    // 5 ms is a half of a step at 100 Hz.
+    timestep_set_rate( ts, 100 );
+    assert_int_equal( TIMESTEP_ALPHA_ONE / 2, timestep_alpha( ts ) );
+    assert_int_equal( 10, timestep_dt( ts ) );
+    assert_int_equal( 1, timestep_advance( ts, 8 ) );
+}
+
+int timestep_test() {
+    const struct CMUnitTest tests[] = {
+        cmocka_unit_test_setup_teardown( advance_one_step_per_frame, timestep_setup, timestep_teardown ),
+        cmocka_unit_test_setup_teardown( advance_without_rounding_error, timestep_setup, timestep_teardown ),
+        cmocka_unit_test_setup_teardown( advance_catches_up, timestep_setup, timestep_teardown ),
+        cmocka_unit_test_setup_teardown( advance_drops_steps_over_the_cap, timestep_setup, timestep_teardown ),
+        cmocka_unit_test_setup_teardown( set_rate_keeps_the_time, timestep_setup, timestep_teardown ),
+    };
+
+    return cmocka_run_group_tests( tests, NULL, NULL );
+}
@@ -0,0 +1 @@
+int timestep_test();